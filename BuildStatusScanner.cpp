@@ -0,0 +1,262 @@
+#include "BuildStatusScanner.h"
+
+// Every string the scanner compares against, padded to a fixed row so a
+// token can be checked against its terminator without reading past the row
+enum Name
+{
+  NAME_BUILDING,
+  NAME_RESULT,
+  NAME_TRUE,
+  NAME_SUCCESS,   // Result names follow in BuildStatusScanner::Result order
+  NAME_UNSTABLE,
+  NAME_FAILURE,
+  NAME_NOT_BUILT,
+  NAME_ABORTED,
+  NAME_COUNT
+};
+
+static const char NAMES[NAME_COUNT][10] PROGMEM = {
+  "building",
+  "result",
+  "true",
+  "SUCCESS",
+  "UNSTABLE",
+  "FAILURE",
+  "NOT_BUILT",
+  "ABORTED"
+};
+
+BuildStatusScanner::BuildStatusScanner()
+{
+  reset();
+}
+
+void BuildStatusScanner::reset()
+{
+  scanned = 0;
+  state = HEADERS;
+  headerMatch = 0;
+  depth = 0;
+  member = MEMBER_NONE;
+  found = 0;
+  buildResult = RESULT_OTHER;
+  isBuilding = false;
+  inString = false;
+  escaped = false;
+  expectKey = false;
+  capturing = false;
+  tokenQuoted = false;
+  tokenLength = 0;
+}
+
+bool BuildStatusScanner::feed(const uint8_t* data, uint16_t len)
+{
+  for(uint16_t i = 0; i < len && DONE != state; i++)
+  {
+    scanned++;
+    Scan(data[i]);
+  }
+  return DONE == state;
+}
+
+void BuildStatusScanner::Scan(char c)
+{
+  if(HEADERS == state)
+  {
+    // Headers end with an empty line: "\r\n\r\n"
+    if(c == ((headerMatch & 1) ? '\n' : '\r'))
+    {
+      if(4 == ++headerMatch)
+      {
+        state = BODY;
+      }
+    }
+    else
+    {
+      headerMatch = ('\r' == c) ? 1 : 0;
+    }
+    return;
+  }
+  if(BODY == state)
+  {
+    if('{' == c)
+    {
+      state = JSON;
+      depth = 1;
+      expectKey = true;
+    }
+    return;
+  }
+
+  if(inString)
+  {
+    if(escaped)
+    {
+      escaped = false;
+    }
+    else if('\\' == c)
+    {
+      // None of the names of interest contain escapes
+      escaped = true;
+      tokenLength = TOKEN_SIZE + 1;
+    }
+    else if('"' == c)
+    {
+      inString = false;
+      if(capturing)
+      {
+        if(expectKey)
+        {
+          EndKey();
+        }
+        else
+        {
+          EndValue();
+        }
+      }
+    }
+    else if(capturing)
+    {
+      Capture(c);
+    }
+    return;
+  }
+
+  switch(c)
+  {
+    case '"':
+      inString = true;
+      if(1 == depth && (expectKey || MEMBER_NONE != member))
+      {
+        StartToken(true);
+      }
+      break;
+    case '{':
+    case '[':
+      depth++;
+      break;
+    case '}':
+    case ']':
+      if(capturing)
+      {
+        EndValue();
+      }
+      if(0 == --depth)
+      {
+        state = DONE;
+      }
+      break;
+    case ',':
+      if(capturing)
+      {
+        EndValue();
+      }
+      if(1 == depth)
+      {
+        expectKey = true;
+        member = MEMBER_NONE;
+      }
+      break;
+    case ':':
+      if(1 == depth)
+      {
+        expectKey = false;
+      }
+      break;
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+      if(capturing)
+      {
+        EndValue();
+      }
+      break;
+    default:
+      // Bare literal: true, false, null or a number
+      if(!capturing && 1 == depth && !expectKey && MEMBER_NONE != member)
+      {
+        StartToken(false);
+      }
+      if(capturing)
+      {
+        Capture(c);
+      }
+      break;
+  }
+}
+
+void BuildStatusScanner::StartToken(bool quoted)
+{
+  capturing = true;
+  tokenQuoted = quoted;
+  tokenLength = 0;
+}
+
+void BuildStatusScanner::Capture(char c)
+{
+  if(tokenLength < TOKEN_SIZE)
+  {
+    token[tokenLength++] = c;
+  }
+  else
+  {
+    // Too long to be anything of interest
+    tokenLength = TOKEN_SIZE + 1;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Checks the captured token against one of NAMES.
+////////////////////////////////////////////////////////////////////////////////
+static bool TokenIs(const char* token, uint8_t tokenLength, uint8_t name)
+{
+  return tokenLength < sizeof(NAMES[0]) &&
+         0 == memcmp_P(token, NAMES[name], tokenLength) &&
+         0 == pgm_read_byte(&NAMES[name][tokenLength]);
+}
+
+void BuildStatusScanner::EndKey()
+{
+  capturing = false;
+  if(TokenIs(token, tokenLength, NAME_BUILDING))
+  {
+    member = MEMBER_BUILDING;
+  }
+  else if(TokenIs(token, tokenLength, NAME_RESULT))
+  {
+    member = MEMBER_RESULT;
+  }
+  else
+  {
+    member = MEMBER_NONE;
+  }
+}
+
+void BuildStatusScanner::EndValue()
+{
+  capturing = false;
+  if(MEMBER_BUILDING == member)
+  {
+    found |= FOUND_BUILDING;
+    isBuilding = !tokenQuoted && TokenIs(token, tokenLength, NAME_TRUE);
+  }
+  else if(MEMBER_RESULT == member)
+  {
+    found |= FOUND_RESULT;
+    buildResult = RESULT_OTHER;
+    for(uint8_t r = RESULT_SUCCESS; tokenQuoted && r <= RESULT_ABORTED; r++)
+    {
+      if(TokenIs(token, tokenLength, NAME_SUCCESS + r - RESULT_SUCCESS))
+      {
+        buildResult = r;
+        break;
+      }
+    }
+  }
+  member = MEMBER_NONE;
+  if((FOUND_BUILDING | FOUND_RESULT) == found)
+  {
+    state = DONE;
+  }
+}
@@ -0,0 +1,129 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file BuildStatusScanner.h
+///
+/// @brief Incremental scanner for the Jenkins build JSON (`.../api/json`).
+///
+/// The response is fed in as it arrives, one TCP segment at a time, and is
+/// looked at exactly once, byte by byte.  Only the top level `building` and
+/// `result` members are extracted; everything else, including nested objects
+/// with keys of the same name, is skipped without being stored.  Tokens may
+/// be split anywhere across segments.
+///
+/// Scanning stops as soon as both members have been seen, so the rest of a
+/// response that can run to many kilobytes need not be read at all.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef BUILDSTATUSSCANNER_H
+#define BUILDSTATUSSCANNER_H
+
+#include <Arduino.h>
+
+class BuildStatusScanner
+{
+  public:
+    enum Result
+    {
+      RESULT_OTHER = 0,  ///< null (still building) or a result not listed here
+      RESULT_SUCCESS,
+      RESULT_UNSTABLE,
+      RESULT_FAILURE,
+      RESULT_NOT_BUILT,
+      RESULT_ABORTED
+    };
+
+    BuildStatusScanner();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Forgets everything scanned so far.  Call before each request.
+    ////////////////////////////////////////////////////////////////////////////
+    void reset();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Scans the next part of the response, starting with the HTTP
+    ///        status line.
+    /// @param data Bytes received, not necessarily NUL terminated.
+    /// @param len Number of bytes in data.
+    /// @return True once scanning is complete: both members were found or
+    ///         the top level object ended.  Later calls do nothing.
+    ////////////////////////////////////////////////////////////////////////////
+    bool feed(const uint8_t* data, uint16_t len);
+
+    bool isDone() const
+    {
+      return DONE == state;
+    }
+
+    bool haveBuilding() const
+    {
+      return found & FOUND_BUILDING;
+    }
+
+    bool haveResult() const
+    {
+      return found & FOUND_RESULT;
+    }
+
+    bool building() const
+    {
+      return isBuilding;
+    }
+
+    Result result() const
+    {
+      return (Result)buildResult;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Number of bytes examined since reset(); bytes passed to feed()
+    ///        after scanning completed are not counted.
+    ////////////////////////////////////////////////////////////////////////////
+    uint16_t bytesScanned() const
+    {
+      return scanned;
+    }
+
+  private:
+    enum State
+    {
+      HEADERS,   ///< Waiting for the blank line that ends the HTTP headers
+      BODY,      ///< Waiting for the opening brace
+      JSON,      ///< Inside the top level object
+      DONE
+    };
+
+    enum Member
+    {
+      MEMBER_NONE,
+      MEMBER_BUILDING,
+      MEMBER_RESULT
+    };
+
+    static const uint8_t FOUND_BUILDING = 0x01;
+    static const uint8_t FOUND_RESULT = 0x02;
+
+    /// Longest value of interest is "NOT_BUILT"
+    static const uint8_t TOKEN_SIZE = 9;
+
+    void Scan(char c);
+    void StartToken(bool quoted);
+    void Capture(char c);
+    void EndKey();
+    void EndValue();
+
+    uint16_t scanned;
+    uint8_t state;
+    uint8_t headerMatch;   ///< Characters of "\r\n\r\n" matched so far
+    uint8_t depth;         ///< Object and array nesting, 1 for the top level
+    uint8_t member;        ///< Top level member whose value comes next
+    uint8_t found;         ///< FOUND_* flags
+    uint8_t buildResult;
+    bool isBuilding;
+    bool inString;
+    bool escaped;
+    bool expectKey;        ///< Next top level string is a key
+    bool capturing;        ///< Characters go to token
+    bool tokenQuoted;
+    uint8_t tokenLength;   ///< TOKEN_SIZE + 1 once the token is too long
+    char token[TOKEN_SIZE];
+};
+
+#endif // BUILDSTATUSSCANNER_H
@@ -0,0 +1,331 @@
+#include "ConfigStore.h"
+
+#include <EEPROM.h>
+
+// Layout used before this store: pointers to the domain, port and first
+// endpoint, with a version and job count only from version 3
+#define LEGACY_VERSION 3
+#define LEGACY_VERSION_ADDRESS 0
+#define LEGACY_JOB_COUNT_ADDRESS 1
+#define LEGACY_DOMAIN_ADDRESS 2
+#define LEGACY_PORT_ADDRESS 4
+#define LEGACY_ENDPOINT_ADDRESS 6
+#define LEGACY_DATA_START 8
+
+static uint16_t ReadWord(uint16_t address)
+{
+  return EEPROM.read(address) | ((uint16_t)EEPROM.read(address + 1) << 8);
+}
+
+// Skips one "\n" or "\r\n" line break
+static const char* NextLine(const char* p)
+{
+  if('\r' == *p)
+  {
+    p++;
+  }
+  if('\n' == *p)
+  {
+    p++;
+  }
+  return p;
+}
+
+ConfigStore::ConfigStore() :
+  port(0),
+  stringsLength(1),
+  jobCount(0),
+  slot(CONFIG_SLOTS - 1),
+  sequence(0)
+{
+  strings[0] = '\0';
+}
+
+bool ConfigStore::begin()
+{
+  // Newest valid slot, by serial number arithmetic on the sequence numbers
+  uint8_t best = CONFIG_SLOTS;
+  uint8_t bestSequence = 0;
+  for(uint8_t i = 0; i < CONFIG_SLOTS; i++)
+  {
+    uint8_t s;
+    if(LoadSlot(i, s) &&
+       (CONFIG_SLOTS == best || (int8_t)(s - bestSequence) > 0))
+    {
+      best = i;
+      bestSequence = s;
+    }
+  }
+
+  if(CONFIG_SLOTS != best)
+  {
+    LoadSlot(best, bestSequence);
+    slot = best;
+    sequence = bestSequence;
+    return true;
+  }
+
+  // Nothing saved yet in this format; the first save goes to slot 0
+  slot = CONFIG_SLOTS - 1;
+  sequence = 0;
+  if(LoadLegacy())
+  {
+    WriteSlot(0, 1);
+    slot = 0;
+    sequence = 1;
+    return true;
+  }
+  port = 0;
+  jobCount = 0;
+  stringsLength = 1;
+  strings[0] = '\0';
+  return false;
+}
+
+bool ConfigStore::save(const char* urlString)
+{
+  // Domain: at least four characters (a.co) and a line break
+  uint16_t domainLength = strcspn(urlString, "\r\n");
+  if('\0' == urlString[domainLength] || domainLength < 4)
+  {
+    return false;
+  }
+
+  // Port: decimal digits and a line break
+  const char* portString = NextLine(urlString + domainLength);
+  uint16_t portLength = strcspn(portString, "\r\n");
+  if('\0' == portString[portLength] || 0 == portLength)
+  {
+    return false;
+  }
+  uint16_t newPort = 0;
+  for(uint16_t i = 0; i < portLength; i++)
+  {
+    uint8_t digit = portString[i] - '0';
+    if(digit > 9)
+    {
+      return false;
+    }
+    newPort = newPort * 10 + digit;
+  }
+
+  // Endpoints: one per non-empty line, at least one
+  const char* endpoints = NextLine(portString + portLength);
+  uint16_t length = domainLength + 1;
+  uint8_t newJobCount = 0;
+  for(const char* p = endpoints + strspn(endpoints, "\r\n");
+      '\0' != *p && newJobCount < JOB_MAX;
+      p += strspn(p, "\r\n"))
+  {
+    uint16_t endpointLength = strcspn(p, "\r\n");
+    length += endpointLength + 1;
+    newJobCount++;
+    p += endpointLength;
+  }
+  if(0 == newJobCount || length > CONFIG_STRINGS_MAX)
+  {
+    return false;
+  }
+
+  // Valid: take it, noting whether anything differs
+  bool changed = (newPort != port || newJobCount != jobCount || length != stringsLength);
+  port = newPort;
+  jobCount = newJobCount;
+  stringsLength = length;
+  uint16_t pos = 0;
+  changed |= Store(pos, urlString, domainLength);
+  for(const char* p = endpoints + strspn(endpoints, "\r\n");
+      pos < length;
+      p += strspn(p, "\r\n"))
+  {
+    uint16_t endpointLength = strcspn(p, "\r\n");
+    changed |= Store(pos, p, endpointLength);
+    p += endpointLength;
+  }
+
+  if(changed)
+  {
+    slot = (slot + 1) % CONFIG_SLOTS;
+    sequence++;
+    WriteSlot(slot, sequence);
+  }
+  return true;
+}
+
+const char* ConfigStore::getEndpoint(uint8_t job) const
+{
+  if(job >= jobCount)
+  {
+    return strings + stringsLength - 1; // Null stop character of the last
+  }
+  const char* p = strings;
+  for(uint8_t i = 0; i <= job; i++)
+  {
+    p += strlen(p) + 1;
+  }
+  return p;
+}
+
+bool ConfigStore::LoadSlot(uint8_t slot, uint8_t& sequence)
+{
+  uint16_t address = SlotAddress(slot);
+  sequence = EEPROM.read(address);
+  if(CONFIG_VERSION != EEPROM.read(address + 1))
+  {
+    return false;
+  }
+  uint16_t length = ReadWord(address + 2);
+  if(length < 3 + 2 || length > CONFIG_RECORD_MAX)
+  {
+    return false;
+  }
+
+  address += CONFIG_HEADER_SIZE;
+  uint16_t crc = 0xFFFF;
+  uint8_t b[3];
+  for(uint8_t i = 0; i < 3; i++)
+  {
+    b[i] = EEPROM.read(address + i);
+    crc = Crc(crc, b[i]);
+  }
+  uint8_t nulls = 0;
+  for(uint16_t i = 3; i < length; i++)
+  {
+    char c = EEPROM.read(address + i);
+    crc = Crc(crc, c);
+    strings[i - 3] = c;
+    nulls += ('\0' == c);
+  }
+  port = b[0] | ((uint16_t)b[1] << 8);
+  jobCount = b[2];
+  stringsLength = length - 3;
+
+  if(crc != ReadWord(SlotAddress(slot) + 4) ||
+     0 == jobCount || jobCount > JOB_MAX ||
+     nulls != jobCount + 1 ||
+     '\0' != strings[stringsLength - 1])
+  {
+    jobCount = 0;
+    stringsLength = 1;
+    strings[0] = '\0';
+    return false;
+  }
+  return true;
+}
+
+bool ConfigStore::LoadLegacy()
+{
+  uint16_t domain = ReadWord(LEGACY_DOMAIN_ADDRESS);
+  uint16_t portAddress = ReadWord(LEGACY_PORT_ADDRESS);
+  uint16_t endpoint = ReadWord(LEGACY_ENDPOINT_ADDRESS);
+  uint16_t end = EEPROM.length();
+  if(domain < LEGACY_DATA_START || domain >= end ||
+     portAddress >= end - 1 || endpoint >= end)
+  {
+    return false;
+  }
+
+  // Version 2 and earlier stored a single endpoint and no count
+  uint8_t count = 1;
+  if(LEGACY_VERSION == EEPROM.read(LEGACY_VERSION_ADDRESS))
+  {
+    count = EEPROM.read(LEGACY_JOB_COUNT_ADDRESS);
+    if(0 == count || count > JOB_MAX)
+    {
+      count = 1;
+    }
+  }
+
+  // Domain, then the endpoints back to back, each null terminated
+  uint16_t pos = 0;
+  uint16_t address = domain;
+  for(uint8_t s = 0; s <= count; s++)
+  {
+    if(1 == s)
+    {
+      address = endpoint;
+    }
+    char c;
+    do
+    {
+      if(pos >= CONFIG_STRINGS_MAX || address >= end)
+      {
+        return false;
+      }
+      c = EEPROM.read(address++);
+      strings[pos++] = c;
+    } while('\0' != c);
+  }
+  port = ReadWord(portAddress);
+  jobCount = count;
+  stringsLength = pos;
+  return true;
+}
+
+void ConfigStore::WriteSlot(uint8_t slot, uint8_t sequence)
+{
+  // The record, then the header, and the sequence number last, so the slot
+  // only becomes the newest once it is complete
+  uint16_t address = SlotAddress(slot);
+  uint16_t length = RecordLength();
+  uint16_t crc = 0xFFFF;
+  for(uint16_t i = 0; i < length; i++)
+  {
+    uint8_t b = RecordByte(i);
+    crc = Crc(crc, b);
+    EEPROM.update(address + CONFIG_HEADER_SIZE + i, b);
+  }
+  EEPROM.update(address + 2, length & 0xFF);
+  EEPROM.update(address + 3, length >> 8);
+  EEPROM.update(address + 4, crc & 0xFF);
+  EEPROM.update(address + 5, crc >> 8);
+  EEPROM.update(address + 1, CONFIG_VERSION);
+  EEPROM.update(address, sequence);
+}
+
+bool ConfigStore::Store(uint16_t& pos, const char* s, uint16_t len)
+{
+  bool changed = false;
+  for(uint16_t i = 0; i <= len; i++)
+  {
+    char c = (i < len) ? s[i] : '\0';
+    changed = changed || strings[pos] != c;
+    strings[pos++] = c;
+  }
+  return changed;
+}
+
+uint16_t ConfigStore::RecordLength() const
+{
+  return 3 + stringsLength;
+}
+
+uint8_t ConfigStore::RecordByte(uint16_t i) const
+{
+  switch(i)
+  {
+    case 0:
+      return port & 0xFF;
+    case 1:
+      return port >> 8;
+    case 2:
+      return jobCount;
+    default:
+      return strings[i - 3];
+  }
+}
+
+uint16_t ConfigStore::SlotAddress(uint8_t slot)
+{
+  return CONFIG_ADDRESS + (uint16_t)slot * CONFIG_SLOT_SIZE;
+}
+
+uint16_t ConfigStore::Crc(uint16_t crc, uint8_t data)
+{
+  crc ^= (uint16_t)data << 8;
+  for(uint8_t i = 0; i < 8; i++)
+  {
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
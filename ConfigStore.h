@@ -0,0 +1,122 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file ConfigStore.h
+///
+/// @brief The Jenkins server and jobs a standalone tree polls, kept in RAM
+///        and backed by EEPROM.
+///
+/// The configuration is read from EEPROM once, by begin(), and served from
+/// RAM after that, so polling does not touch EEPROM.  It is stored as one
+/// record:
+///
+///   Port (2 bytes, little endian)
+///   Job count (1 byte, 1 to JOB_MAX)
+///   Domain, then the endpoint of each job, each null terminated
+///
+/// EEPROM holds CONFIG_SLOTS copies of the record, each behind a header:
+///
+///   0    Sequence number, one more than the slot saved before
+///   1    CONFIG_VERSION
+///   2-3  Record length (little endian)
+///   4-5  CRC-16/CCITT of the record (little endian)
+///
+/// The newest slot whose version and CRC check out is loaded.  A save goes
+/// to the slot after the current one, so wear is spread over the slots, and
+/// the current slot stays intact until the new one is complete: the
+/// sequence number is written last.  Only bytes that differ from what the
+/// slot held are written, and a save that changes nothing writes nothing.
+///
+/// A tree without a valid slot imports the configuration from the layout
+/// used before this store (PERSISTENT_MEMORY_VERSION 3 and earlier), if
+/// there is one.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef CONFIGSTORE_H
+#define CONFIGSTORE_H
+
+#include <Arduino.h>
+#include "JobScheduler.h"
+
+#define CONFIG_VERSION 4          ///< Follows PERSISTENT_MEMORY_VERSION 3
+#define CONFIG_ADDRESS 0          ///< EEPROM address of the first slot
+#define CONFIG_SLOTS 2
+#define CONFIG_STRINGS_MAX 320    ///< Domain and endpoints, null characters included
+#define CONFIG_HEADER_SIZE 6
+#define CONFIG_RECORD_MAX (3 + CONFIG_STRINGS_MAX)
+#define CONFIG_SLOT_SIZE (CONFIG_HEADER_SIZE + CONFIG_RECORD_MAX)
+#define CONFIG_END (CONFIG_ADDRESS + CONFIG_SLOTS * CONFIG_SLOT_SIZE)
+
+class ConfigStore
+{
+  public:
+    ConfigStore();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Loads the configuration from EEPROM.  Call once at startup.
+    /// @return True if a configuration was found.
+    ////////////////////////////////////////////////////////////////////////////
+    bool begin();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Validates and stores a configuration sent by the config page.
+    /// @param urlString Domain, port and one endpoint per job, each on its
+    ///                  own line ("\n" or "\r\n").  Jobs past JOB_MAX are
+    ///                  dropped.
+    /// @return False, leaving the configuration as it was, if the string is
+    ///         malformed or too long.
+    ////////////////////////////////////////////////////////////////////////////
+    bool save(const char* urlString);
+
+    bool haveURL() const
+    {
+      return jobCount > 0;
+    }
+
+    uint16_t getPort() const
+    {
+      return port;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Number of jobs; 0 if no configuration has been saved.
+    ////////////////////////////////////////////////////////////////////////////
+    uint8_t getJobCount() const
+    {
+      return jobCount;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Server domain; empty if no configuration has been saved.
+    ////////////////////////////////////////////////////////////////////////////
+    const char* getDomain() const
+    {
+      return strings;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief API endpoint of a job; empty if there is no such job.
+    ////////////////////////////////////////////////////////////////////////////
+    const char* getEndpoint(uint8_t job) const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief One byte of CRC-16/CCITT, starting from 0xFFFF.  Also checks
+    ///        NetworkCache's record.
+    ////////////////////////////////////////////////////////////////////////////
+    static uint16_t Crc(uint16_t crc, uint8_t data);
+
+  private:
+    bool LoadSlot(uint8_t slot, uint8_t& sequence);
+    bool LoadLegacy();
+    void WriteSlot(uint8_t slot, uint8_t sequence);
+    bool Store(uint16_t& pos, const char* s, uint16_t len);
+    uint16_t RecordLength() const;
+    uint8_t RecordByte(uint16_t i) const;
+    static uint16_t SlotAddress(uint8_t slot);
+
+    uint16_t port;
+    uint16_t stringsLength;              ///< Bytes used in strings
+    uint8_t jobCount;
+    uint8_t slot;                        ///< Slot last loaded or saved
+    uint8_t sequence;                    ///< Its sequence number
+    char strings[CONFIG_STRINGS_MAX];    ///< Domain, then endpoints
+};
+
+#endif // CONFIGSTORE_H
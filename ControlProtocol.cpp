@@ -0,0 +1,85 @@
+#include "ControlProtocol.h"
+
+ControlProtocol::ControlProtocol() :
+  lastSequence(0),
+  group(0),
+  haveSequence(false)
+{
+}
+
+ControlProtocol::Status ControlProtocol::apply(NeoPixelRing& tree,
+                                               const uint8_t* data,
+                                               uint16_t len)
+{
+  if(!isControlDatagram(data, len))
+  {
+    return MALFORMED;
+  }
+  uint8_t flags = data[1];
+  uint16_t sequence = ((uint16_t)data[2] << 8) | data[3];
+  uint8_t numCommands = data[5];
+  uint8_t headerSize = (flags & CONTROL_FLAG_GROUP) ? CONTROL_HEADER_SIZE + 1
+                                                    : CONTROL_HEADER_SIZE;
+  if(0 == numCommands ||
+     len != headerSize + (uint16_t)numCommands * CONTROL_COMMAND_SIZE)
+  {
+    return MALFORMED;
+  }
+
+  // Checked before the sequence number so another group's datagrams do not
+  // move this tree's count along
+  if((flags & CONTROL_FLAG_GROUP) &&
+     CONTROL_GROUP_ALL != data[CONTROL_HEADER_SIZE] &&
+     group != data[CONTROL_HEADER_SIZE])
+  {
+    return NOT_ADDRESSED;
+  }
+
+  // Serial number arithmetic: newer if ahead by less than half the space
+  if(haveSequence &&
+     !(flags & CONTROL_FLAG_RESYNC) &&
+     (int16_t)(sequence - lastSequence) <= 0)
+  {
+    return STALE;
+  }
+  lastSequence = sequence;
+  haveSequence = true;
+
+  if(flags & CONTROL_FLAG_BRIGHTNESS)
+  {
+    tree.setBrightness(data[4]);
+  }
+
+  const uint8_t* command = data + headerSize;
+  for(uint8_t c = 0; c < numCommands; c++, command += CONTROL_COMMAND_SIZE)
+  {
+    NeoPixelRing::Pattern pattern = (NeoPixelRing::Pattern)command[1];
+    uint32_t color = ((uint32_t)command[2] << 16) |
+                     ((uint32_t)command[3] << 8) |
+                     command[4];
+    uint16_t period = ((uint16_t)command[5] << 8) | command[6];
+    uint8_t param = command[7];
+
+    if(CONTROL_ALL_RINGS == command[0])
+    {
+      for(uint8_t i = 0; i < tree.getNumRings(); i++)
+      {
+        tree.setPattern(i, pattern, color, period, param);
+      }
+    }
+    else
+    {
+      // Out of range rings are ignored by setPattern()
+      tree.setPattern(command[0], pattern, color, period, param);
+    }
+  }
+  return APPLIED;
+}
+
+void ControlProtocol::fillAck(uint8_t* dest, const uint8_t* data, Status status)
+{
+  dest[0] = CONTROL_ACK_MAGIC;
+  dest[1] = status;
+  dest[2] = data[2];
+  dest[3] = data[3];
+}
@@ -0,0 +1,141 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file ControlProtocol.h
+///
+/// @brief Decoder for batched ring control datagrams.
+///
+/// One datagram carries any number of per-ring commands.  All multi-byte
+/// fields are big endian.
+///
+///   Header (6 bytes)
+///     0    CONTROL_MAGIC
+///     1    Flags (CONTROL_FLAG_*)
+///     2-3  Sequence number
+///     4    Brightness, applied if CONTROL_FLAG_BRIGHTNESS is set
+///     5    Number of commands (at least 1)
+///     6    Group, present only if CONTROL_FLAG_GROUP is set
+///
+///   Command (8 bytes each)
+///     0    Ring index, or CONTROL_ALL_RINGS
+///     1    Pattern (NeoPixelRing::Pattern)
+///     2-4  Red, green, blue
+///     5-6  Period in milliseconds
+///     7    Param
+///
+/// Brightness is in the header rather than in each command because
+/// NeoPixelRing has one brightness for the whole tree: it is applied by the
+/// transfer pass along with gamma, which runs over whole strips while
+/// sparkles are drawn.  A command per ring has no brightness of its own to
+/// set.
+///
+/// Sequence numbers use serial number arithmetic: a datagram is applied only
+/// if its sequence number is ahead of the last applied one by less than
+/// half the sequence space, so duplicates and reordered datagrams are
+/// dropped.  A sender that restarts its count sets CONTROL_FLAG_RESYNC on
+/// its first datagram.
+///
+/// A group datagram is meant to be broadcast: every tree hears it, and only
+/// trees whose group matches (or all of them, for CONTROL_GROUP_ALL) apply
+/// it.  The others return NOT_ADDRESSED and do not ack, so one datagram
+/// reconfigures a whole group.  Sequence numbers count per sender as usual.
+///
+/// The shortest valid datagram is 14 bytes, so it cannot be confused with
+/// the original 5 or 6 byte message.
+///
+/// When CONTROL_FLAG_ACK is set the device answers with a 4 byte ack:
+///     0    CONTROL_ACK_MAGIC
+///     1    ControlProtocol::Status
+///     2-3  Sequence number being acknowledged
+////////////////////////////////////////////////////////////////////////////////
+#ifndef CONTROLPROTOCOL_H
+#define CONTROLPROTOCOL_H
+
+#include <Arduino.h>
+#include "NeoPixelRing.h"
+
+#define CONTROL_MAGIC 0x4C     // 'L'
+#define CONTROL_ACK_MAGIC 0x41 // 'A'
+
+#define CONTROL_FLAG_ACK        0x01 ///< Reply with an ack
+#define CONTROL_FLAG_BRIGHTNESS 0x02 ///< Header brightness byte is valid
+#define CONTROL_FLAG_RESYNC     0x04 ///< Accept this sequence number unconditionally
+#define CONTROL_FLAG_GROUP      0x08 ///< Header ends with a group byte
+
+#define CONTROL_ALL_RINGS 0xFF
+#define CONTROL_GROUP_ALL 0xFF ///< Group byte addressing every tree
+
+#define CONTROL_HEADER_SIZE 6
+#define CONTROL_COMMAND_SIZE 8
+#define CONTROL_ACK_SIZE 4
+
+class ControlProtocol
+{
+  public:
+    enum Status
+    {
+      APPLIED = 0,   ///< Commands were applied
+      STALE = 1,     ///< Duplicate or out of order; nothing was applied
+      MALFORMED = 2, ///< Not a valid datagram; nothing was applied
+      NOT_ADDRESSED = 3 ///< For another group; nothing was applied, no ack
+    };
+
+    ControlProtocol();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Checks whether a datagram uses this protocol rather than the
+    ///        original fixed-length message.
+    ////////////////////////////////////////////////////////////////////////////
+    static bool isControlDatagram(const uint8_t* data, uint16_t len)
+    {
+      return len >= CONTROL_HEADER_SIZE + CONTROL_COMMAND_SIZE &&
+             CONTROL_MAGIC == data[0];
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Validates a datagram and applies its commands in order.  The
+    ///        commands are read where they lie, so data may point straight
+    ///        into the receive buffer.  Nothing is applied unless the whole
+    ///        datagram is valid and new.
+    /// @param tree Rings to update.
+    /// @param data Datagram payload.
+    /// @param len Number of bytes in data.
+    /// @return Outcome, also the status to report in an ack.
+    ////////////////////////////////////////////////////////////////////////////
+    Status apply(NeoPixelRing& tree, const uint8_t* data, uint16_t len);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Checks whether the sender of a datagram asked for an ack.
+    ////////////////////////////////////////////////////////////////////////////
+    static bool ackRequested(const uint8_t* data, uint16_t len)
+    {
+      return len >= CONTROL_HEADER_SIZE && (data[1] & CONTROL_FLAG_ACK);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Writes the ack for a datagram.
+    /// @param dest Destination for CONTROL_ACK_SIZE bytes.
+    /// @param data Datagram being acknowledged.
+    /// @param status Result of apply() for the datagram.
+    ////////////////////////////////////////////////////////////////////////////
+    static void fillAck(uint8_t* dest, const uint8_t* data, Status status);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Sets the group this tree answers to in group datagrams.
+    ///        Datagrams without CONTROL_FLAG_GROUP are applied regardless.
+    ////////////////////////////////////////////////////////////////////////////
+    void setGroup(uint8_t g)
+    {
+      group = g;
+    }
+
+    uint8_t getGroup() const
+    {
+      return group;
+    }
+
+  private:
+    uint16_t lastSequence;
+    uint8_t group;
+    bool haveSequence;  ///< lastSequence is valid
+};
+
+#endif // CONTROLPROTOCOL_H
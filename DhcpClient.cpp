@@ -0,0 +1,308 @@
+#include "DhcpClient.h"
+
+#define DHCP_OPTIONS_P 240       // Options follow the fixed fields and cookie
+#define DHCP_BOOTREQUEST 1
+#define DHCP_BOOTREPLY 2
+#define DHCP_BROADCAST_FLAG 0x80 // High byte of the flags field
+
+// Message types, option 53
+#define DHCP_DISCOVER 1
+#define DHCP_OFFER 2
+#define DHCP_REQUEST 3
+#define DHCP_ACK 5
+#define DHCP_NAK 6
+
+// Options
+#define DHCP_OPT_PAD 0
+#define DHCP_OPT_MASK 1
+#define DHCP_OPT_ROUTER 3
+#define DHCP_OPT_DNS 6
+#define DHCP_OPT_REQUESTED_IP 50
+#define DHCP_OPT_LEASE_TIME 51
+#define DHCP_OPT_MESSAGE_TYPE 53
+#define DHCP_OPT_SERVER_ID 54
+#define DHCP_OPT_PARAMETERS 55
+#define DHCP_OPT_END 255
+
+static const uint8_t magicCookie[4] = { 99, 130, 83, 99 };
+
+static uint32_t GetLong(const uint8_t* p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void SetLong(uint8_t* p, uint32_t val)
+{
+  p[0] = val >> 24;
+  p[1] = (val >> 16) & 0xFF;
+  p[2] = (val >> 8) & 0xFF;
+  p[3] = val & 0xFF;
+}
+
+static uint8_t* PutOption(uint8_t* p, uint8_t option, const uint8_t* data,
+                          uint8_t len)
+{
+  p[0] = option;
+  p[1] = len;
+  memcpy(p + 2, data, len);
+  return p + 2 + len;
+}
+
+DhcpClient::DhcpClient() :
+  mac(NULL),
+  sentAt(0),
+  leasedAt(0),
+  xid(0),
+  tries(0),
+  step(DISCOVERING),
+  leased(false),
+  state(IDLE)
+{
+  memset(&lease, 0, sizeof(lease));
+  memset(offered, 0, sizeof(offered));
+  memset(offerServer, 0, sizeof(offerServer));
+}
+
+void DhcpClient::begin(const uint8_t* mac, unsigned long now)
+{
+  this->mac = mac;
+  leased = false;
+  Start(DISCOVERING, now);
+}
+
+void DhcpClient::reboot(const uint8_t* mac, const DhcpLease& lease,
+                        unsigned long now)
+{
+  this->mac = mac;
+  this->lease = lease;
+  leased = true;
+  leasedAt = now;
+  Start(REBOOTING, now);
+}
+
+DhcpClient::State DhcpClient::poll(unsigned long now)
+{
+  if(BOUND == state && now - leasedAt >= LeaseMs() / 2)
+  {
+    Start(RENEWING, now);
+  }
+  else if(WAITING == state && now - sentAt >= Timeout())
+  {
+    if(tries < DHCP_MAX_TRIES)
+    {
+      state = SEND;
+    }
+    else
+    {
+      // An offer may be gone by now; a lease is asked for again until it
+      // runs out
+      Start((REQUESTING == step) ? DISCOVERING : (Step)step, now);
+    }
+  }
+  if(leased && BOUND != state && now - leasedAt >= LeaseMs())
+  {
+    leased = false;
+    Start(DISCOVERING, now);
+  }
+  return state;
+}
+
+uint16_t DhcpClient::fillMessage(uint8_t* buf, uint16_t size,
+                                 unsigned long now)
+{
+  if(size < DHCP_MESSAGE_LEN)
+  {
+    return 0;
+  }
+  memset(buf, 0, DHCP_MESSAGE_LEN);
+  buf[0] = DHCP_BOOTREQUEST;
+  buf[1] = 1;  // Ethernet
+  buf[2] = 6;  // Hardware address length
+  SetLong(buf + 4, xid);
+  if(RENEWING == step)
+  {
+    // The address is in use, so the answer can come straight to it
+    memcpy(buf + 12, lease.ip, 4);
+  }
+  else
+  {
+    buf[10] = DHCP_BROADCAST_FLAG;
+  }
+  memcpy(buf + 28, mac, 6);
+  memcpy(buf + DHCP_OPTIONS_P - 4, magicCookie, 4);
+
+  uint8_t* p = buf + DHCP_OPTIONS_P;
+  uint8_t type = (DISCOVERING == step) ? DHCP_DISCOVER : DHCP_REQUEST;
+  p = PutOption(p, DHCP_OPT_MESSAGE_TYPE, &type, 1);
+  if(REQUESTING == step)
+  {
+    p = PutOption(p, DHCP_OPT_REQUESTED_IP, offered, 4);
+    p = PutOption(p, DHCP_OPT_SERVER_ID, offerServer, 4);
+  }
+  else if(REBOOTING == step)
+  {
+    p = PutOption(p, DHCP_OPT_REQUESTED_IP, lease.ip, 4);
+  }
+  static const uint8_t parameters[] = {
+    DHCP_OPT_MASK, DHCP_OPT_ROUTER, DHCP_OPT_DNS
+  };
+  p = PutOption(p, DHCP_OPT_PARAMETERS, parameters, sizeof(parameters));
+  *p = DHCP_OPT_END;
+
+  tries++;
+  sentAt = now;
+  state = WAITING;
+  return DHCP_MESSAGE_LEN;
+}
+
+bool DhcpClient::receive(const uint8_t* data, uint16_t len, unsigned long now)
+{
+  if(WAITING != state ||
+     len < DHCP_OPTIONS_P + 3 ||
+     DHCP_BOOTREPLY != data[0] ||
+     GetLong(data + 4) != xid ||
+     0 != memcmp(data + 28, mac, 6) ||
+     0 != memcmp(data + DHCP_OPTIONS_P - 4, magicCookie, 4))
+  {
+    // Not an answer to the message in flight
+    return false;
+  }
+
+  uint8_t type = 0;
+  bool haveLeaseTime = false;
+  DhcpLease answer = lease;
+  if(RENEWING != step)
+  {
+    // A new lease carries only what this server says
+    memset(&answer, 0, sizeof(answer));
+  }
+  memcpy(answer.ip, data + 16, 4);
+  for(uint16_t pos = DHCP_OPTIONS_P; pos < len; )
+  {
+    uint8_t option = data[pos];
+    if(DHCP_OPT_END == option)
+    {
+      break;
+    }
+    if(DHCP_OPT_PAD == option)
+    {
+      pos++;
+      continue;
+    }
+    if(pos + 2 > len || pos + 2 + data[pos + 1] > len)
+    {
+      return false;
+    }
+    const uint8_t* value = data + pos + 2;
+    uint8_t optionLen = data[pos + 1];
+    // Routers and DNS servers are lists; the first of each is used
+    if(DHCP_OPT_MESSAGE_TYPE == option && optionLen >= 1)
+    {
+      type = value[0];
+    }
+    else if(optionLen >= 4)
+    {
+      switch(option)
+      {
+        case DHCP_OPT_MASK:
+          memcpy(answer.mask, value, 4);
+          break;
+        case DHCP_OPT_ROUTER:
+          memcpy(answer.gateway, value, 4);
+          break;
+        case DHCP_OPT_DNS:
+          memcpy(answer.dns, value, 4);
+          break;
+        case DHCP_OPT_SERVER_ID:
+          memcpy(answer.server, value, 4);
+          break;
+        case DHCP_OPT_LEASE_TIME:
+          answer.seconds = GetLong(value);
+          haveLeaseTime = true;
+          break;
+      }
+    }
+    pos += 2 + optionLen;
+  }
+
+  if(DISCOVERING == step && DHCP_OFFER == type)
+  {
+    // The request keeps the transaction ID of the offer
+    memcpy(offered, answer.ip, 4);
+    memcpy(offerServer, answer.server, 4);
+    step = REQUESTING;
+    tries = 0;
+    state = SEND;
+    return true;
+  }
+  if(DISCOVERING != step && DHCP_ACK == type && haveLeaseTime)
+  {
+    lease = answer;
+    leased = true;
+    leasedAt = now;
+    state = BOUND;
+    return true;
+  }
+  if(DISCOVERING != step && DHCP_NAK == type)
+  {
+    leased = false;
+    Start(DISCOVERING, now);
+    return true;
+  }
+  return false;
+}
+
+unsigned long DhcpClient::msUntilPoll(unsigned long now) const
+{
+  unsigned long next;
+  switch(state)
+  {
+    case SEND:
+      return 0;
+    case WAITING:
+      next = Timeout();
+      break;
+    case BOUND:
+      return (now - leasedAt < LeaseMs() / 2) ?
+             LeaseMs() / 2 - (now - leasedAt) : 0;
+    default:
+      return (unsigned long)-1;
+  }
+  unsigned long waited = now - sentAt;
+  next = (waited < next) ? next - waited : 0;
+  if(leased)
+  {
+    unsigned long held = now - leasedAt;
+    unsigned long left = (held < LeaseMs()) ? LeaseMs() - held : 0;
+    next = (left < next) ? left : next;
+  }
+  return next;
+}
+
+void DhcpClient::Start(Step first, unsigned long now)
+{
+  // A new transaction ID for every exchange so late answers to an old one
+  // are ignored.  Retries keep it, so a slow answer to the first try still
+  // counts.
+  if(0 == xid)
+  {
+    xid = ((uint32_t)mac[2] << 24) | ((uint32_t)mac[3] << 16) |
+          ((uint32_t)mac[4] << 8) | mac[5];
+  }
+  xid = xid * 1103515245UL + 12345 + now;
+  step = first;
+  tries = 0;
+  state = SEND;
+}
+
+unsigned long DhcpClient::Timeout() const
+{
+  return (tries < DHCP_MAX_TRIES) ? DHCP_TIMEOUT_MS : DHCP_RETRY_MS;
+}
+
+unsigned long DhcpClient::LeaseMs() const
+{
+  return ((lease.seconds < DHCP_LEASE_MAX_S) ? lease.seconds :
+                                               DHCP_LEASE_MAX_S) * 1000UL;
+}
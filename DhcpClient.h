@@ -0,0 +1,167 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file DhcpClient.h
+///
+/// @brief Gets and keeps a DHCP lease without blocking loop().
+///
+/// EtherCard's dhcpSetup() runs the whole exchange before it returns, so a
+/// tree on a slow network shows its boot pattern until the server answers,
+/// and it cannot reuse a lease from before a reset.  DhcpClient is the same
+/// exchange as a state machine, in the manner of DnsResolver: the sketch
+/// broadcasts the message it builds from DHCP_CLIENT_PORT to
+/// DHCP_SERVER_PORT, hands any datagram on DHCP_CLIENT_PORT to receive(),
+/// and checks poll() now and then.
+///
+///   IDLE     nothing asked yet
+///   SEND     a message should go out now (first try or a retry)
+///   WAITING  a message is out; DHCP_TIMEOUT_MS later it is sent again, up
+///            to DHCP_MAX_TRIES times, and after DHCP_RETRY_MS more the
+///            exchange starts over
+///   BOUND    getLease() holds an address; half way through the lease it
+///            is renewed (SEND again)
+///
+/// begin() starts from nothing: DISCOVER, then REQUEST the first offer.
+/// reboot() asks to keep a lease cached from before a reset (INIT-REBOOT,
+/// RFC 2131 section 3.2): the server acknowledges it, or refuses it and the
+/// client starts over with DISCOVER.  While a reboot or renewal waits for
+/// an answer, hasLease() stays true and the lease stays usable, until the
+/// lease runs out.
+///
+/// The tree has no clock across a reset, so a cached lease is taken to run
+/// for its full length from reboot(); a server that has since given the
+/// address away refuses the reboot within a round trip.
+///
+/// This class only builds and checks the datagrams; the sketch moves them.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef DHCPCLIENT_H
+#define DHCPCLIENT_H
+
+#include <Arduino.h>
+
+#define DHCP_SERVER_PORT 67
+#define DHCP_CLIENT_PORT 68
+#define DHCP_TIMEOUT_MS 2000UL
+#define DHCP_MAX_TRIES 4
+#define DHCP_RETRY_MS 10000UL         ///< Pause after DHCP_MAX_TRIES unanswered
+#define DHCP_LEASE_MAX_S 604800UL     ///< Longer leases are timed as a week
+#define DHCP_MESSAGE_LEN 300          ///< BOOTP minimum, options padded out
+
+struct DhcpLease
+{
+  uint8_t ip[4];
+  uint8_t gateway[4];
+  uint8_t dns[4];
+  uint8_t mask[4];
+  uint8_t server[4];   ///< DHCP server that granted the lease
+  uint32_t seconds;    ///< Lease length
+};
+
+class DhcpClient
+{
+  public:
+    enum State
+    {
+      IDLE,
+      SEND,
+      WAITING,
+      BOUND
+    };
+
+    DhcpClient();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Starts a new exchange from nothing.  The DISCOVER is due
+    ///        immediately.
+    /// @param mac Hardware address of the tree, 6 bytes, kept by pointer.
+    /// @param now Current time in milliseconds.
+    ////////////////////////////////////////////////////////////////////////////
+    void begin(const uint8_t* mac, unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Asks to keep a lease held before a reset.  hasLease() is true
+    ///        at once; the REQUEST is due immediately.
+    /// @param mac Hardware address of the tree, 6 bytes, kept by pointer.
+    /// @param lease Lease to reuse.
+    /// @param now Current time in milliseconds.
+    ////////////////////////////////////////////////////////////////////////////
+    void reboot(const uint8_t* mac, const DhcpLease& lease, unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Moves on when a message has gone unanswered, a renewal is due
+    ///        or the lease has run out.
+    /// @param now Current time in milliseconds.
+    /// @return State after the check.
+    ////////////////////////////////////////////////////////////////////////////
+    State poll(unsigned long now);
+
+    State getState() const
+    {
+      return state;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Builds the message that is due and moves to WAITING.
+    /// @param buf Destination for the DHCP message (the UDP payload).
+    /// @param size Room in buf.
+    /// @param now Current time in milliseconds.
+    /// @return Message length, or 0 if it does not fit.
+    ////////////////////////////////////////////////////////////////////////////
+    uint16_t fillMessage(uint8_t* buf, uint16_t size, unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Checks a datagram received on DHCP_CLIENT_PORT.  Anything that
+    ///        is not an answer to the message in flight is ignored.
+    /// @param data DHCP message.
+    /// @param len Length of the message.
+    /// @param now Current time in milliseconds.
+    /// @return True if it moved the exchange on: an offer to be requested,
+    ///         an acknowledgement (now BOUND), or a refusal (starting over).
+    ////////////////////////////////////////////////////////////////////////////
+    bool receive(const uint8_t* data, uint16_t len, unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Whether getLease() holds an address that may be used: BOUND,
+    ///        or renewing or rebooting a lease that has not run out.
+    ////////////////////////////////////////////////////////////////////////////
+    bool hasLease() const
+    {
+      return leased;
+    }
+
+    const DhcpLease& getLease() const
+    {
+      return lease;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Milliseconds until poll() can next change the state; 0 when a
+    ///        message is due, (unsigned long)-1 when nothing is in progress.
+    ////////////////////////////////////////////////////////////////////////////
+    unsigned long msUntilPoll(unsigned long now) const;
+
+  private:
+    enum Step
+    {
+      DISCOVERING,
+      REQUESTING,   ///< Requesting an offer
+      REBOOTING,    ///< Requesting a cached lease
+      RENEWING
+    };
+
+    void Start(Step first, unsigned long now);
+    unsigned long Timeout() const;
+    unsigned long LeaseMs() const;
+
+    const uint8_t* mac;
+    DhcpLease lease;
+    unsigned long sentAt;     ///< Time the message in flight was sent
+    unsigned long leasedAt;   ///< Start of the lease in use
+    uint32_t xid;             ///< Transaction ID of the exchange in progress
+    uint8_t offered[4];       ///< Address offered, while REQUESTING
+    uint8_t offerServer[4];   ///< Server that offered it
+    uint8_t tries;            ///< Messages sent for this step
+    uint8_t step;             ///< Step
+    bool leased;
+    State state;
+};
+
+#endif // DHCPCLIENT_H
@@ -0,0 +1,197 @@
+#include "DnsResolver.h"
+
+#define DNS_HEADER_LEN 12
+#define DNS_TYPE_A 1
+#define DNS_CLASS_IN 1
+#define DNS_RCODE_NXDOMAIN 3
+
+static uint16_t GetWord(const uint8_t* p)
+{
+  return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static void SetWord(uint8_t* p, uint16_t val)
+{
+  p[0] = val >> 8;
+  p[1] = val & 0xFF;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Steps over a name in a DNS message, either labels ending in a zero
+///        byte or labels ending in a compression pointer.
+/// @return Offset just past the name, or 0 if it runs off the message.
+////////////////////////////////////////////////////////////////////////////////
+static uint16_t SkipName(const uint8_t* data, uint16_t len, uint16_t pos)
+{
+  while(pos < len)
+  {
+    uint8_t label = data[pos];
+    if(0 == label)
+    {
+      return pos + 1;
+    }
+    if((label & 0xC0) == 0xC0)
+    {
+      return (pos + 2 <= len) ? pos + 2 : 0;
+    }
+    pos += 1 + label;
+  }
+  return 0;
+}
+
+DnsResolver::DnsResolver() :
+  sentAt(0),
+  id(0),
+  tries(0),
+  state(IDLE)
+{
+  memset(address, 0, sizeof(address));
+}
+
+void DnsResolver::begin(unsigned long now)
+{
+  // A new ID for every lookup so late answers to an old one are ignored.
+  // Retries keep it, so a slow answer to the first try still counts.
+  id = (uint16_t)(id + 1 + (now & 0xFF));
+  tries = 0;
+  state = SEND;
+}
+
+DnsResolver::State DnsResolver::poll(unsigned long now)
+{
+  if(WAITING == state && now - sentAt >= DNS_TIMEOUT_MS)
+  {
+    state = (tries < DNS_MAX_TRIES) ? SEND : FAILED;
+  }
+  return state;
+}
+
+uint16_t DnsResolver::fillQuery(uint8_t* buf, uint16_t size, const char* host,
+                                unsigned long now)
+{
+  uint16_t nameLen = strlen(host);
+  // Labels plus the leading length byte and the root label
+  uint16_t len = DNS_HEADER_LEN + nameLen + 2 + 4;
+  if(0 == nameLen || len > size)
+  {
+    state = FAILED;
+    return 0;
+  }
+
+  SetWord(buf, id);
+  SetWord(buf + 2, 0x0100);  // Standard query, recursion desired
+  SetWord(buf + 4, 1);       // One question
+  memset(buf + 6, 0, 6);
+
+  // www.example.com becomes 3www7example3com0
+  uint8_t* labelStart = buf + DNS_HEADER_LEN;
+  uint8_t* out = labelStart + 1;
+  for(const char* c = host; ; c++)
+  {
+    if('.' == *c || '\0' == *c)
+    {
+      uint16_t labelLen = out - labelStart - 1;
+      if(0 == labelLen || labelLen > 63)
+      {
+        state = FAILED;
+        return 0;
+      }
+      *labelStart = labelLen;
+      labelStart = out;
+      out++;
+      if('\0' == *c)
+      {
+        break;
+      }
+    }
+    else
+    {
+      *out = *c;
+      out++;
+    }
+  }
+  *labelStart = 0;
+  SetWord(labelStart + 1, DNS_TYPE_A);
+  SetWord(labelStart + 3, DNS_CLASS_IN);
+
+  tries++;
+  sentAt = now;
+  state = WAITING;
+  return len;
+}
+
+bool DnsResolver::receive(const uint8_t* data, uint16_t len)
+{
+  if(WAITING != state ||
+     len < DNS_HEADER_LEN ||
+     GetWord(data) != id ||
+     !(data[2] & 0x80))
+  {
+    // Not an answer to the query in flight
+    return false;
+  }
+  uint8_t rcode = data[3] & 0x0F;
+  if(DNS_RCODE_NXDOMAIN == rcode)
+  {
+    state = FAILED;
+    return true;
+  }
+  if(0 != rcode)
+  {
+    // The server had trouble; the retry may do better
+    return false;
+  }
+
+  uint16_t pos = DNS_HEADER_LEN;
+  uint16_t questions = GetWord(data + 4);
+  for(uint16_t i = 0; i < questions; i++)
+  {
+    pos = SkipName(data, len, pos);
+    if(0 == pos || pos + 4 > len)
+    {
+      return false;
+    }
+    pos += 4;
+  }
+
+  // The first A record wins; CNAMEs before it are stepped over
+  uint16_t answers = GetWord(data + 6);
+  for(uint16_t i = 0; i < answers; i++)
+  {
+    pos = SkipName(data, len, pos);
+    if(0 == pos || pos + 10 > len)
+    {
+      return false;
+    }
+    uint16_t type = GetWord(data + pos);
+    uint16_t rrClass = GetWord(data + pos + 2);
+    uint16_t rdLength = GetWord(data + pos + 8);
+    pos += 10;
+    if(pos + rdLength > len)
+    {
+      return false;
+    }
+    if(DNS_TYPE_A == type && DNS_CLASS_IN == rrClass && 4 == rdLength)
+    {
+      memcpy(address, data + pos, 4);
+      state = RESOLVED;
+      return true;
+    }
+    pos += rdLength;
+  }
+  return false;
+}
+
+unsigned long DnsResolver::msUntilPoll(unsigned long now) const
+{
+  if(SEND == state)
+  {
+    return 0;
+  }
+  if(WAITING != state)
+  {
+    return (unsigned long)-1;
+  }
+  unsigned long waited = now - sentAt;
+  return waited < DNS_TIMEOUT_MS ? DNS_TIMEOUT_MS - waited : 0;
+}
@@ -0,0 +1,107 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file DnsResolver.h
+///
+/// @brief Resolves the Jenkins server's name without blocking loop().
+///
+/// EtherCard's dnsLookup() sends a query and then spins in packetLoop()
+/// until an answer comes or its timeout runs out, freezing the tree for as
+/// long as the DNS server takes.  DnsResolver is the same lookup as a state
+/// machine: the sketch sends the query it builds, hands any UDP answer on
+/// DNS_CLIENT_PORT to receive(), and checks poll() now and then.
+///
+///   IDLE      nothing asked yet
+///   SEND      a query should go out now (first try or a retry)
+///   WAITING   a query is out; DNS_TIMEOUT_MS later it is sent again, up
+///             to DNS_MAX_TRIES times in all
+///   RESOLVED  getAddress() holds the server's IPv4 address
+///   FAILED    no answer after DNS_MAX_TRIES, or the server said the name
+///             does not exist
+///
+/// This class only builds and checks the datagrams; the sketch moves them.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef DNSRESOLVER_H
+#define DNSRESOLVER_H
+
+#include <Arduino.h>
+
+#define DNS_SERVER_PORT 53
+#define DNS_CLIENT_PORT 3053   ///< Local port queries are sent from
+#define DNS_TIMEOUT_MS 1500UL
+#define DNS_MAX_TRIES 3
+
+class DnsResolver
+{
+  public:
+    enum State
+    {
+      IDLE,
+      SEND,
+      WAITING,
+      RESOLVED,
+      FAILED
+    };
+
+    DnsResolver();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Starts a new lookup.  The first query is due immediately.
+    /// @param now Current time in milliseconds.
+    ////////////////////////////////////////////////////////////////////////////
+    void begin(unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Moves on from WAITING when the query has gone unanswered.
+    /// @param now Current time in milliseconds.
+    /// @return State after the check.
+    ////////////////////////////////////////////////////////////////////////////
+    State poll(unsigned long now);
+
+    State getState() const
+    {
+      return state;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Builds the query that is due and moves to WAITING.
+    /// @param buf Destination for the DNS message (the UDP payload).
+    /// @param size Room in buf.
+    /// @param host Null terminated name to look up.
+    /// @param now Current time in milliseconds.
+    /// @return Message length, or 0 if the name is invalid or does not fit,
+    ///         which fails the lookup.
+    ////////////////////////////////////////////////////////////////////////////
+    uint16_t fillQuery(uint8_t* buf, uint16_t size, const char* host,
+                       unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Checks a datagram received on DNS_CLIENT_PORT.  Anything that
+    ///        is not the answer to the query in flight is ignored.
+    /// @param data DNS message.
+    /// @param len Length of the message.
+    /// @return True if the lookup finished, resolved or failed.
+    ////////////////////////////////////////////////////////////////////////////
+    bool receive(const uint8_t* data, uint16_t len);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Resolved address, valid in RESOLVED.
+    ////////////////////////////////////////////////////////////////////////////
+    const uint8_t* getAddress() const
+    {
+      return address;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Milliseconds until poll() can next change the state; 0 when a
+    ///        query is due, (unsigned long)-1 when nothing is in progress.
+    ////////////////////////////////////////////////////////////////////////////
+    unsigned long msUntilPoll(unsigned long now) const;
+
+  private:
+    unsigned long sentAt;  ///< Time the query in flight was sent
+    uint16_t id;           ///< ID of the lookup in progress
+    uint8_t tries;         ///< Queries sent for this lookup
+    uint8_t address[4];
+    State state;
+};
+
+#endif // DNSRESOLVER_H
@@ -0,0 +1,99 @@
+#include "FleetClock.h"
+
+FleetClock::FleetClock() :
+  localRef(0),
+  fleetRef(0),
+  localStart(0),
+  fleetStart(0),
+  skew(0),
+  group(0),
+  synced(false)
+{
+}
+
+FleetClock::Status FleetClock::receive(const uint8_t* data, uint16_t len,
+                                       unsigned long now)
+{
+  if(SYNC_BEACON_SIZE != len || SYNC_MAGIC != data[0])
+  {
+    return MALFORMED;
+  }
+  if(CONTROL_GROUP_ALL != data[1] && group != data[1])
+  {
+    return IGNORED;
+  }
+  unsigned long fleetTime = ((unsigned long)data[2] << 24) |
+                            ((unsigned long)data[3] << 16) |
+                            ((unsigned long)data[4] << 8) |
+                            data[5];
+  return beacon(fleetTime, now);
+}
+
+FleetClock::Status FleetClock::beacon(unsigned long fleetTime, unsigned long now)
+{
+  long error = (long)(fleetTime - toFleet(now));
+  if(!synced || error > SYNC_STEP_MS || error < -SYNC_STEP_MS)
+  {
+    localRef = localStart = now;
+    fleetRef = fleetStart = fleetTime;
+    skew = 0;
+    synced = true;
+    return STEPPED;
+  }
+  if((long)(fleetTime - fleetRef) <= 0)
+  {
+    // Duplicate or reordered
+    return IGNORED;
+  }
+
+  unsigned long baseline = now - localStart;
+  if(baseline >= SYNC_MIN_BASELINE_MS)
+  {
+    // One division per beacon
+    long gained = (long)(fleetTime - fleetStart) - (long)baseline;
+    // Multiplied rather than shifted: gained is negative when millis() runs
+    // fast, and shifting a negative value left is undefined
+    skew = (long)((int64_t)gained * ((int64_t)1 << SYNC_SKEW_SHIFT) /
+                  (long)baseline);
+    if(skew > SYNC_MAX_SKEW)
+    {
+      skew = SYNC_MAX_SKEW;
+    }
+    else if(skew < -SYNC_MAX_SKEW)
+    {
+      skew = -SYNC_MAX_SKEW;
+    }
+  }
+  if(baseline >= SYNC_MAX_BASELINE_MS)
+  {
+    // The skew carries on until the new baseline is long enough
+    localStart = now;
+    fleetStart = fleetTime;
+  }
+  localRef = now;
+  fleetRef = fleetTime;
+  return ADJUSTED;
+}
+
+unsigned long FleetClock::toFleet(unsigned long now) const
+{
+  if(!synced)
+  {
+    return now;
+  }
+  unsigned long local = now - localRef;
+  // Relies on >> of a negative skew being an arithmetic shift, as it is in
+  // GCC and avr-gcc; a 64-bit division here would cost every frame
+  long correction = (long)(((int64_t)local * skew) >> SYNC_SKEW_SHIFT);
+  return fleetRef + local + correction;
+}
+
+void FleetClock::fillBeacon(uint8_t* dest, uint8_t group, unsigned long fleetTime)
+{
+  dest[0] = SYNC_MAGIC;
+  dest[1] = group;
+  dest[2] = fleetTime >> 24;
+  dest[3] = fleetTime >> 16;
+  dest[4] = fleetTime >> 8;
+  dest[5] = fleetTime & 0xFF;
+}
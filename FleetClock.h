@@ -0,0 +1,117 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file FleetClock.h
+///
+/// @brief Shared time base for a fleet of trees, kept in step by beacons.
+///
+/// Every pattern is phased from the time passed to NeoPixelRing::update(),
+/// so trees fed their own millis() drift apart and pulse out of step.  A
+/// controller broadcasts a beacon now and then carrying its own clock; each
+/// tree's FleetClock keeps an offset from millis() to that clock and learns
+/// how fast its own crystal runs against it, so between beacons fleet time
+/// does not wander.  The sketch then draws at toFleet(millis()).
+///
+///   Beacon (SYNC_BEACON_SIZE bytes, big endian)
+///     0    SYNC_MAGIC
+///     1    Group, or CONTROL_GROUP_ALL (see ControlProtocol.h)
+///     2-5  Fleet time in milliseconds
+///
+/// The first beacon sets the offset and starts a baseline.  Each later one
+/// resets the offset and, once the baseline spans SYNC_MIN_BASELINE_MS,
+/// sets the skew to how much more fleet time than local time has passed
+/// along it.  Timestamps are whole milliseconds and arrive with a few ms of
+/// jitter, so a long baseline is what makes the skew accurate; it restarts
+/// after SYNC_MAX_BASELINE_MS to follow a crystal warming up.  A beacon
+/// further off than SYNC_STEP_MS (controller restarted, long outage)
+/// starts over.
+///
+/// Fleet time steps by the remaining error at each beacon, usually a
+/// millisecond or two; NeoPixelRing copes with small steps back.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef FLEETCLOCK_H
+#define FLEETCLOCK_H
+
+#include <Arduino.h>
+#include "ControlProtocol.h"
+
+#define SYNC_MAGIC 0x54 // 'T'
+#define SYNC_BEACON_SIZE 6
+
+#define SYNC_STEP_MS 1000L            ///< Errors beyond this restart the sync
+#define SYNC_MIN_BASELINE_MS 20000UL  ///< Shortest baseline the skew is taken from
+#define SYNC_MAX_BASELINE_MS 600000UL ///< Baseline restarts after this long
+#define SYNC_SKEW_SHIFT 24            ///< Skew is in units of 2^-24 (~0.06 ppm)
+#define SYNC_MAX_SKEW (1L << 18)      ///< About 1.6%, well past any resonator
+
+class FleetClock
+{
+  public:
+    enum Status
+    {
+      ADJUSTED = 0,  ///< Offset and skew were corrected
+      STEPPED = 1,   ///< First beacon, or too far off: offset set outright
+      IGNORED = 2,   ///< Another group's beacon, or older than the last
+      MALFORMED = 3  ///< Not a beacon
+    };
+
+    FleetClock();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Checks and applies a beacon datagram.
+    /// @param data Datagram payload.
+    /// @param len Number of bytes in data.
+    /// @param now millis() when the datagram arrived.
+    ////////////////////////////////////////////////////////////////////////////
+    Status receive(const uint8_t* data, uint16_t len, unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Applies a beacon's time.  receive() without the framing.
+    /// @param fleetTime Time the beacon carried.
+    /// @param now millis() when it arrived.
+    ////////////////////////////////////////////////////////////////////////////
+    Status beacon(unsigned long fleetTime, unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Converts local time to fleet time.  Until the first beacon the
+    ///        two are the same.
+    /// @param now Local time from millis().
+    ////////////////////////////////////////////////////////////////////////////
+    unsigned long toFleet(unsigned long now) const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Writes a beacon, for a tree leading the fleet.
+    /// @param dest Destination for SYNC_BEACON_SIZE bytes.
+    /// @param group Group the beacon is for.
+    /// @param fleetTime Time to send.
+    ////////////////////////////////////////////////////////////////////////////
+    static void fillBeacon(uint8_t* dest, uint8_t group, unsigned long fleetTime);
+
+    bool isSynced() const
+    {
+      return synced;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Learned skew: how much faster the fleet runs than millis(),
+    ///        in units of 2^-SYNC_SKEW_SHIFT.
+    ////////////////////////////////////////////////////////////////////////////
+    long getSkew() const
+    {
+      return skew;
+    }
+
+    void setGroup(uint8_t g)
+    {
+      group = g;
+    }
+
+  private:
+    unsigned long localRef;   ///< millis() at the last beacon
+    unsigned long fleetRef;   ///< Fleet time at localRef
+    unsigned long localStart; ///< millis() at the start of the baseline
+    unsigned long fleetStart; ///< Fleet time at localStart
+    long skew;                ///< See getSkew()
+    uint8_t group;            ///< Beacons for other groups are ignored
+    bool synced;              ///< At least one beacon has been applied
+};
+
+#endif // FLEETCLOCK_H
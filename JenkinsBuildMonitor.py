@@ -3,6 +3,7 @@ from jenkinsapi.jenkins import Jenkins
 import time
 import datetime
 import socket
+import struct
 
 PATTERN_DONE      = 3 # Spin
 PATTERN_RUN       = 1 # Pulse
@@ -23,8 +24,31 @@ URL     = "http://localhost:8080"
 JOBNAME = "TEST"
 REFRESHINTERVAL = 10 # seconds
 
-TREEIP = "192.168.1.253"
+TREEIP = "192.168.1.253" # "255.255.255.255" with GROUP set reaches a whole group
 TREEPORT = 8733
+GROUP = None             # Group of trees to address (0-254, 255 for all), or None
+
+# Fleet time beacons keep the trees' patterns in step (see FleetClock.h)
+SYNCIP = "255.255.255.255"
+SYNCPORT = 8736
+SYNC_MAGIC = 0x54
+
+# Batched control datagrams (see ControlProtocol.h)
+CONTROL_MAGIC           = 0x4C
+CONTROL_ACK_MAGIC       = 0x41
+CONTROL_FLAG_ACK        = 0x01
+CONTROL_FLAG_BRIGHTNESS = 0x02
+CONTROL_FLAG_RESYNC     = 0x04
+CONTROL_FLAG_GROUP      = 0x08
+CONTROL_GROUP_ALL       = 0xFF
+CONTROL_STATUS          = {0: "applied", 1: "stale", 2: "malformed"}
+
+STATUSRINGS = range(5) # Every ring but the top one shows build status
+PERIOD      = 2000     # milliseconds
+WANTACK     = True
+ACKTIMEOUT  = 0.5      # seconds
+
+sequence = 0
 
 def get_server_instance():
     server = None
@@ -36,11 +60,59 @@ def get_server_instance():
     return server
 
 def sendControl(red=0x00, green=0x00, blue=0x00, patttern=0x03, param=0x00):
+    global sequence
     try:
-        message = chr(red) + chr(green) + chr(blue) + chr(patttern) + chr(param)
+        # First datagram after starting tells the tree to accept our count
+        flags = CONTROL_FLAG_RESYNC if sequence == 0 else 0
+        if WANTACK:
+            flags |= CONTROL_FLAG_ACK
+        if GROUP is not None:
+            flags |= CONTROL_FLAG_GROUP
+        sequence = (sequence + 1) & 0xFFFF
+        message = struct.pack(">BBHBB", CONTROL_MAGIC, flags, sequence, 0,
+                              len(STATUSRINGS))
+        if GROUP is not None:
+            message += struct.pack(">B", GROUP)
+        for ring in STATUSRINGS:
+            message += struct.pack(">BBBBBHB", ring, patttern, red, green, blue,
+                                   PERIOD, param)
         treeSock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
-        treeSock.setblocking(0)
+        treeSock.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+        if WANTACK:
+            treeSock.settimeout(ACKTIMEOUT)
+        else:
+            treeSock.setblocking(0)
         treeSock.sendto(message, (TREEIP,TREEPORT))
+        if WANTACK:
+            # A group datagram is acked by every tree in the group
+            acks = 0
+            try:
+                while True:
+                    ack, sender = treeSock.recvfrom(4)
+                    magic, status, ackSequence = struct.unpack(">BBH", ack)
+                    if magic != CONTROL_ACK_MAGIC or ackSequence != sequence:
+                        print "Unexpected ack"
+                    else:
+                        print "Tree", sender[0] + ":", CONTROL_STATUS.get(status, status)
+                        acks += 1
+                    if GROUP is None:
+                        break
+            except socket.timeout:
+                if acks == 0:
+                    print "No ack from tree"
+        treeSock.close()
+    except Exception as e:
+        print e
+
+def sendBeacon():
+    try:
+        fleetTime = int(time.time() * 1000) & 0xFFFFFFFF
+        group = CONTROL_GROUP_ALL if GROUP is None else GROUP
+        beacon = struct.pack(">BBI", SYNC_MAGIC, group, fleetTime)
+        syncSock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        syncSock.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+        syncSock.sendto(beacon, (SYNCIP, SYNCPORT))
+        syncSock.close()
     except Exception as e:
         print e
 
@@ -79,6 +151,7 @@ while(True):
         else:
             print "Error retrieving job"
     print "Red:",curRed,"Green:",curGreen,"Blue:",curBlue,"Pattern:",curPattern,"Param:",curParam
+    sendBeacon()
     sendControl(curRed, curGreen, curBlue, curPattern, curParam)
 
     time.sleep(REFRESHINTERVAL);
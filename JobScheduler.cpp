@@ -0,0 +1,110 @@
+#include "JobScheduler.h"
+
+JobScheduler::JobScheduler() :
+  sentAt(0),
+  numJobs(0),
+  current(JOB_NONE),
+  last(0)
+{
+}
+
+void JobScheduler::begin(uint8_t numJobs, unsigned long now)
+{
+  this->numJobs = numJobs > JOB_MAX ? JOB_MAX : numJobs;
+  for(uint8_t i = 0; i < this->numJobs; i++)
+  {
+    jobs[i].due = now;
+    jobs[i].backoff = 0;
+    jobs[i].failing = false;
+  }
+  current = JOB_NONE;
+  // Start the rotation at job 0
+  last = this->numJobs - 1;
+}
+
+uint8_t JobScheduler::nextJob(unsigned long now) const
+{
+  if(JOB_NONE != current)
+  {
+    return JOB_NONE;
+  }
+  uint8_t job = last;
+  for(uint8_t i = 0; i < numJobs; i++)
+  {
+    job = (job + 1 < numJobs) ? job + 1 : 0;
+    // Signed difference so the comparison survives millis() wrapping
+    if((long)(now - jobs[job].due) >= 0)
+    {
+      return job;
+    }
+  }
+  return JOB_NONE;
+}
+
+void JobScheduler::started(uint8_t job, unsigned long now)
+{
+  if(job >= numJobs)
+  {
+    return;
+  }
+  current = job;
+  last = job;
+  sentAt = now;
+}
+
+void JobScheduler::completed(bool building, bool changed, unsigned long now)
+{
+  if(JOB_NONE == current)
+  {
+    return;
+  }
+  Job& job = jobs[current];
+  if(building)
+  {
+    job.backoff = 0;
+    job.due = now + JOB_POLL_BUILDING_MS;
+  }
+  else
+  {
+    // Coming back from a retry backoff counts as a change
+    if(changed || job.failing)
+    {
+      job.backoff = 0;
+    }
+    else if(job.backoff < JOB_POLL_IDLE_MAX_SHIFT)
+    {
+      job.backoff++;
+    }
+    job.due = now + (JOB_POLL_IDLE_MS << job.backoff);
+  }
+  job.failing = false;
+  current = JOB_NONE;
+}
+
+uint8_t JobScheduler::checkTimeout(unsigned long now)
+{
+  if(JOB_NONE == current || now - sentAt < JOB_REQUEST_TIMEOUT_MS)
+  {
+    return JOB_NONE;
+  }
+  uint8_t failed = current;
+  Job& job = jobs[failed];
+  if(!job.failing)
+  {
+    job.failing = true;
+    job.backoff = 0;
+  }
+  else if(job.backoff < JOB_POLL_RETRY_MAX_SHIFT)
+  {
+    job.backoff++;
+  }
+  job.due = now + (JOB_POLL_RETRY_MS << job.backoff);
+  current = JOB_NONE;
+  return failed;
+}
+
+unsigned long JobScheduler::msUntilDue(uint8_t job, unsigned long now) const
+{
+  long remaining = (long)(jobs[job].due - now);
+  return remaining > 0 ? remaining : 0;
+}
@@ -0,0 +1,111 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file JobScheduler.h
+///
+/// @brief Decides when to poll each of several Jenkins jobs.
+///
+/// Only one request is in flight at a time, since EtherCard has a single
+/// client connection and one shared buffer.  Jobs that are due are taken
+/// round-robin, starting after the job polled last, so no job can starve
+/// the others.
+///
+/// How soon a job is polled again depends on what the last poll found:
+///
+///   building     every JOB_POLL_BUILDING_MS, so the result shows up soon
+///                after the build ends
+///   idle         JOB_POLL_IDLE_MS after a change, then doubling on every
+///                unchanged poll up to JOB_POLL_IDLE_MS << JOB_POLL_IDLE_MAX_SHIFT
+///   unreachable  no complete response within JOB_REQUEST_TIMEOUT_MS;
+///                JOB_POLL_RETRY_MS, doubling up to
+///                JOB_POLL_RETRY_MS << JOB_POLL_RETRY_MAX_SHIFT
+////////////////////////////////////////////////////////////////////////////////
+#ifndef JOBSCHEDULER_H
+#define JOBSCHEDULER_H
+
+#include <Arduino.h>
+
+#define JOB_MAX 8      ///< Most jobs that can be polled
+#define JOB_NONE 0xFF  ///< No job
+
+#define JOB_POLL_BUILDING_MS 5000UL
+#define JOB_POLL_IDLE_MS 5000UL
+#define JOB_POLL_IDLE_MAX_SHIFT 3   // 40 s
+#define JOB_POLL_RETRY_MS 5000UL
+#define JOB_POLL_RETRY_MAX_SHIFT 5  // 160 s
+#define JOB_REQUEST_TIMEOUT_MS 5000UL
+
+class JobScheduler
+{
+  public:
+    JobScheduler();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Starts over with a new set of jobs, all due immediately.
+    /// @param numJobs Number of jobs, at most JOB_MAX.
+    /// @param now Current time in milliseconds.
+    ////////////////////////////////////////////////////////////////////////////
+    void begin(uint8_t numJobs, unsigned long now);
+
+    uint8_t getNumJobs() const
+    {
+      return numJobs;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Picks the job to poll next.
+    /// @param now Current time in milliseconds.
+    /// @return Index of a due job, or JOB_NONE if no job is due or a request
+    ///         is already in flight.
+    ////////////////////////////////////////////////////////////////////////////
+    uint8_t nextJob(unsigned long now) const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Records that a request for a job has been sent.
+    ////////////////////////////////////////////////////////////////////////////
+    void started(uint8_t job, unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Records a complete response for the job in flight and schedules
+    ///        its next poll.  Ignored if no request is in flight.
+    /// @param building The job is building.
+    /// @param changed The job's status differs from the previous poll.
+    /// @param now Current time in milliseconds.
+    ////////////////////////////////////////////////////////////////////////////
+    void completed(bool building, bool changed, unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Gives up on a request that has gone unanswered for
+    ///        JOB_REQUEST_TIMEOUT_MS and backs its job off.
+    /// @param now Current time in milliseconds.
+    /// @return The job that timed out, or JOB_NONE.
+    ////////////////////////////////////////////////////////////////////////////
+    uint8_t checkTimeout(unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Job whose request is in flight, or JOB_NONE.
+    ////////////////////////////////////////////////////////////////////////////
+    uint8_t inFlight() const
+    {
+      return current;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Time until a job's next poll is due, in milliseconds; 0 if due.
+    ////////////////////////////////////////////////////////////////////////////
+    unsigned long msUntilDue(uint8_t job, unsigned long now) const;
+
+  private:
+    struct Job
+    {
+      unsigned long due;  ///< millis() at which the next poll is due
+      uint8_t backoff;    ///< Doublings applied to the idle or retry interval
+      bool failing;       ///< Last request went unanswered
+    };
+
+    Job jobs[JOB_MAX];
+    unsigned long sentAt;  ///< millis() when the request in flight was sent
+    uint8_t numJobs;
+    uint8_t current;       ///< Job in flight, or JOB_NONE
+    uint8_t last;          ///< Job polled most recently
+};
+
+#endif // JOBSCHEDULER_H
@@ -3,8 +3,15 @@
 
 #include <Adafruit_NeoPixel.h>
 #include "NeoPixelRing.h"
+#include "ControlProtocol.h"
+#include "FleetClock.h"
+#include "PixelStream.h"
+#include "LoopScheduler.h"
+#include "PerfCounters.h"
+#include "StatusPatterns.h"
 #ifdef __AVR__
   #include <avr/power.h>
+  #include <avr/sleep.h>
 #endif
 
 #define PIN 9
@@ -12,12 +19,21 @@
 
 #define DEBUG 0
 
+#include <EEPROM.h>
+
 #if STANDALONE
-  #include <EEPROM.h>
   #include "config_html.h"
+  #include "BuildStatusScanner.h"
+  #include "JobScheduler.h"
+  #include "ResponseSender.h"
+  #include "ConfigStore.h"
+  #include "DnsResolver.h"
+  #include "NetworkCache.h"
 
   #define DNS_RETRY_INTERVAL_MS 5000
-  #define SERVER_POLL_INTERVAL_MS 10000
+  #define DNS_LINK_CHECK_MS 100 // Wait for the link and gateway before querying
+  #define DHCP_LINK_CHECK_MS 100
+  #define DHCP_CHECK_MS 60000UL // Longest the DHCP task sleeps between lease checks
 
   #define STATIC 0  // set to 1 to disable DHCP (adjust myip/gwip values below)
   #define BUFFERSIZE 900
@@ -29,20 +45,46 @@
   #define BUFFERSIZE 500
 #endif
 
-uint8_t buildStatus;
+// Program for rings using NeoPixelRing::PROGRAM: a length byte followed by
+// the bytecode, at the end of EEPROM clear of the Jenkins configuration slots
+// that start at CONFIG_ADDRESS (see ConfigStore.h) and the network cache after
+// them (see NetworkCache.h)
+#define PERSISTENT_MEMORY_PROGRAM_ADDRESS (E2END - PROGRAM_MAX_LENGTH)
+
+#if STANDALONE && NETCACHE_END > PERSISTENT_MEMORY_PROGRAM_ADDRESS
+  #error "Jenkins configuration slots and network cache overlap the stored program"
+#endif
 
-#define PERSISTENT_MEMORY_VERSION 2
-#define PERSISTENT_MEMORY_DOMAIN_ADDRESS 2
-#define PERSISTENT_MEMORY_PORT_ADDRESS 4
-#define PERSISTENT_MEMORY_ENDPOINT_ADDRESS 6
-#define PERSISTENT_MEMORY_DATA_START 8
+#if STANDALONE == 0
+  #define PROGRAM_UDP_PORT 8734 // Port to receive raw pattern programs on
+  #define STREAM_UDP_PORT 8735  // Port to receive raw pixel frames on
+#endif
 
-#define BUILDSTATUS_SUCCESS    0x01
-#define BUILDSTATUS_UNSTABLE   0x02
-#define BUILDSTATUS_FAILURE    0x04
-#define BUILDSTATUS_OTHER      0x08
-#define BUILDSTATUS_UNKNOWN    0x10
-#define BUILDSTATUS_BUILDING   0x80
+// Deadlines and budgets of the loop() tasks in microseconds; see
+// LoopScheduler.h.  A frame of the stock 93 pixels takes about 3.8 ms.
+#define RENDER_DEADLINE_US 2000UL
+#define RENDER_BUDGET_US 4000UL
+#define NETWORK_INTERVAL_US 1000UL // The ENC28J60 buffers packets in between
+#define NETWORK_DEADLINE_US 5000UL
+#define NETWORK_BUDGET_US 2000UL
+#if STANDALONE
+  #define CONFIG_INTERVAL_US 1000UL
+  #define CONFIG_DEADLINE_US 20000UL
+  #define CONFIG_BUDGET_US 4000UL  // A burst of page segments
+  #define DNS_DEADLINE_US 50000UL
+  #define DNS_BUDGET_US 1000UL
+  #define DHCP_DEADLINE_US 50000UL
+  #define DHCP_BUDGET_US 1000UL
+  #define POLL_INTERVAL_US 10000UL
+  #define POLL_DEADLINE_US 50000UL
+  #define POLL_BUDGET_US 2000UL
+#endif
+#if DEBUG
+  #define STATS_INTERVAL_MS 10000UL // Task statistics are printed this often
+#endif
+#if PERF_COUNTERS
+  #define PERF_SERIAL_INTERVAL_MS 0 // Print the counters this often; 0 for never
+#endif
 
 // IP Address configuration
 #if STATIC
@@ -56,10 +98,17 @@ static byte myMAC[] = {0x6,0x5,0x4,0x3,0x2,0x1};
 // Send/receive buffer
 byte Ethernet::buffer[BUFFERSIZE];
 
-// Colors
-#define COLOR_RED    0x00FF0000
-#define COLOR_GREEN  0x0000FF00
-#define COLOR_YELLOW 0x00FFBF00
+// Status changes fade from the old pattern to the new one over this long
+#define STATUS_FADE_MS 800
+
+// Trees phase their patterns from a shared fleet time kept by beacons on
+// SYNC_UDP_PORT (see FleetClock.h).  Beacons come from the Jenkins monitor
+// or from the one tree built with FLEET_LEADER set.  Group control datagrams
+// and beacons reach only trees in their group.
+#define FLEET_GROUP 0   // Group this tree belongs to, 0-254
+#define FLEET_LEADER 0  // Set to 1 on one tree to send beacons
+#define SYNC_UDP_PORT 8736
+#define SYNC_BEACON_INTERVAL_MS 5000UL
 
 // Parameter 1 = number of pixels in strip
 // Parameter 2 = Arduino pin number (most are valid)
@@ -69,90 +118,170 @@ byte Ethernet::buffer[BUFFERSIZE];
 //   NEO_GRB     Pixels are wired for GRB bitstream (most NeoPixel products)
 //   NEO_RGB     Pixels are wired for RGB bitstream (v1 FLORA pixels, not v2)
 //   NEO_RGBW    Pixels are wired for RGBW bitstream (NeoPixel RGBW products)
-const uint8_t ringsArray[6] = { 32, 24, 16, 12, 8, 1 };
-NeoPixelRing tree = NeoPixelRing(PIN, NEO_GRB + NEO_KHZ800, 6, ringsArray);
+// The ring layout is a template argument so all ring state is allocated
+// statically and shows up in the sketch's reported global variable usage.
+StaticNeoPixelRing<32, 24, 16, 12, 8, 1> tree(PIN, NEO_GRB + NEO_KHZ800);
+
+// Everything loop() does is one of these tasks
+LoopScheduler tasks;
+uint8_t renderTask;
+
+#if PERF_COUNTERS
+// Read with GET /stats or printed to serial; see PerfCounters.h
+PerfCounters perf;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Bytes of SRAM between the top of the heap and the stack.
+////////////////////////////////////////////////////////////////////////////////
+int FreeRam()
+{
+#ifdef __AVR__
+  extern int __heap_start, *__brkval;
+  int top;
+  return (int)&top - (NULL == __brkval ? (int)&__heap_start : (int)__brkval);
+#else
+  return 0;
+#endif
+}
+#endif
 
 // IMPORTANT: To reduce NeoPixel burnout risk, add 1000 uF capacitor across
 // pixel power leads, add 300 - 500 Ohm resistor on first pixel's data input
 // and minimize distance between Arduino and first pixel.  Avoid connecting
 // on a live circuit...if you must, connect GND first.
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Stores a pattern program so it survives a reset.
+/// @param code Bytecode already accepted by NeoPixelRing::setProgram()
+/// @param length Number of bytes in code
+////////////////////////////////////////////////////////////////////////////////
+void SaveProgram(const uint8_t* code, uint8_t length)
+{
+  // Only changed bytes are written, so resending the stored program costs
+  // neither a 3.3 ms write per byte in the receive callback nor wear
+  EEPROM.update(PERSISTENT_MEMORY_PROGRAM_ADDRESS, length);
+  for(uint8_t i = 0; i < length; i++)
+  {
+    EEPROM.update(PERSISTENT_MEMORY_PROGRAM_ADDRESS + 1 + i, code[i]);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Loads the stored pattern program into the tree.  Erased or corrupt
+///        EEPROM is rejected by setProgram() and leaves the tree without a
+///        program.
+////////////////////////////////////////////////////////////////////////////////
+void LoadProgram()
+{
+  uint8_t code[PROGRAM_MAX_LENGTH];
+  uint8_t length = EEPROM.read(PERSISTENT_MEMORY_PROGRAM_ADDRESS);
+  if(length > PROGRAM_MAX_LENGTH)
+  {
+    return;
+  }
+  for(uint8_t i = 0; i < length; i++)
+  {
+    code[i] = EEPROM.read(PERSISTENT_MEMORY_PROGRAM_ADDRESS + 1 + i);
+  }
+  tree.setProgram(code, length);
+}
+
+FleetClock fleet;
+
+// Callback for fleet time beacons
+void udpSyncReceived(uint16_t dest_port, uint8_t src_ip[IP_LEN], uint16_t src_port, const char *data, uint16_t len){
+  if(FleetClock::MALFORMED == fleet.receive((const uint8_t*)data, len, millis()))
+  {
+#if PERF_COUNTERS
+    perf.dropped();
+#endif
+    return;
+  }
+  RedrawIfChanged();
+}
+
 #if STANDALONE == 0
-//callback that prints received packets to the serial port
-void udpDataReceived(uint16_t dest_port, uint8_t src_ip[IP_LEN], uint16_t src_port, const char *data, uint16_t len){
-  IPAddress src(src_ip[0],src_ip[1],src_ip[2],src_ip[3]);
+// Callback for pattern program uploads.  The datagram is the raw bytecode.
+void udpProgramReceived(uint16_t dest_port, uint8_t src_ip[IP_LEN], uint16_t src_port, const char *data, uint16_t len){
+  if(len <= PROGRAM_MAX_LENGTH &&
+     tree.setProgram((const uint8_t*)data, len))
+  {
+    SaveProgram((const uint8_t*)data, len);
+  }
+#if PERF_COUNTERS
+  else
+  {
+    perf.dropped();
+  }
+#endif
+}
+
+ControlProtocol control;
+PixelStream stream;
 
-  // Serial.print("dest_port: ");
-  // Serial.println(dest_port);
-  // Serial.print("src_port: ");
-  // Serial.println(src_port);
+// Callback for streamed pixel frames.  Colors go straight from
+// Ethernet::buffer into the strip buffers; see PixelStream.h.
+void udpStreamReceived(uint16_t dest_port, uint8_t src_ip[IP_LEN], uint16_t src_port, const char *data, uint16_t len){
+  PixelStream::Status status = stream.receive(tree, (const uint8_t*)data, len, millis());
+#if PERF_COUNTERS
+  if(PixelStream::IGNORED == status)
+  {
+    perf.dropped();
+  }
+#endif
+}
 
-  // Serial.print("src_ip: ");
-  // ether.printIp(src_ip);
+// Callback for ring control datagrams.  Batched control datagrams are decoded
+// in place in Ethernet::buffer; anything else is the original single message.
+void udpDataReceived(uint16_t dest_port, uint8_t src_ip[IP_LEN], uint16_t src_port, const char *data, uint16_t len){
+  const uint8_t* payload = (const uint8_t*)data;
 
-  uint8_t red;
-  uint8_t green;
-  uint8_t blue;
-  NeoPixelRing::Pattern pattern;
-  uint8_t param;
+  if(ControlProtocol::isControlDatagram(payload, len))
+  {
+    ControlProtocol::Status status = control.apply(tree, payload, len);
+    if(ControlProtocol::NOT_ADDRESSED == status)
+    {
+      return; // Another group's broadcast
+    }
+#if PERF_COUNTERS
+    if(ControlProtocol::APPLIED != status)
+    {
+      perf.dropped();
+    }
+#endif
+    if(ControlProtocol::ackRequested(payload, len))
+    {
+      uint8_t ack[CONTROL_ACK_SIZE];
+      ControlProtocol::fillAck(ack, payload, status);
+      ether.makeUdpReply((const char*)ack, sizeof(ack), dest_port);
+    }
+    return;
+  }
 
   // 0x0 : red value
   // 0x1 : green value
   // 0x2 : blue value
   // 0x3 : pattern
   // 0x4 : param
-  if(len != 6)
-  {
-    // Serial.write("\nData not equal to 6 bytes. Received:");
-    // Serial.println(data);
-    // Serial.write("\nLength:");
-    // Serial.print(len);
-  }
-  for(uint8_t i = 0; i < len; i++)
+  if(len < 5)
   {
-    switch (i)
-    {
-        case 0:
-          red = data[i];
-          // Serial.write("\nRed:");
-          // Serial.print(red);
-          break;
-        case 1:
-          green = data[i];
-          // Serial.write("\nGreen:");
-          // Serial.print(green);
-          break;
-        case 2:
-          blue = data[i];
-          // Serial.write("\nBlue:");
-          // Serial.print(blue);
-          break;
-        case 3:
-          pattern = data[i];
-          // Serial.write("\nPattern:");
-          // Serial.print(pattern);
-          break;
-        case 4:
-          param = data[i];
-          // Serial.write("\nParam:");
-          // Serial.print(param);
-          break;
-        default:
-          break;
-    }
+#if PERF_COUNTERS
+    perf.dropped();
+#endif
+    return;
   }
 
-  uint32_t color = ((uint32_t)red)   << 16 |
-                   ((uint32_t)green) << 8  |
-                   ((uint32_t)blue)  << 0;
+  uint32_t color = ((uint32_t)payload[0]) << 16 |
+                   ((uint32_t)payload[1]) << 8  |
+                   ((uint32_t)payload[2]) << 0;
 
-  for(uint8_t i = 0; i < (sizeof(ringsArray) - 1); i++)
+  for(uint8_t i = 0; i < (tree.getNumRings() - 1); i++)
   {
     tree.setPattern(i,
-                    pattern,
+                    (NeoPixelRing::Pattern)payload[3],
                     color,
                     2000,
-                    param);
+                    payload[4]);
   }
 }
 #else
@@ -175,151 +304,241 @@ const char http_Unauthorized[] PROGMEM =
 "Content-Type: text/html\r\n\r\n"
 "<h1>401 Unauthorized</h1>";
 
-////////////////////////////////////////////////////////////////////////////////
-///////////////////////////// API Query Components /////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
+#if PERF_COUNTERS
+const char http_JSON[] PROGMEM =
+"HTTP/1.0 200 OK\r\n"
+"Content-Type: application/json\r\n"
+"Pragma: no-cache\r\n\r\n";
+#endif
 
-const char http_Get_Prefix[] PROGMEM =
-"GET ";
+// For a browser whose cached copy of the config page is still current
+const char http_NotModified[] PROGMEM =
+"HTTP/1.0 304 Not Modified\r\n"
+"Cache-Control: no-cache\r\n"
+"ETag: " CONFIG_HTML_ETAG "\r\n\r\n";
 
-const char http_Get_Middle[] PROGMEM =
-" HTTP/1.0\r\nHost: ";
+////////////////////////////////////////////////////////////////////////////////
+////////////////////////////// Config Page Sending /////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 
-const char http_Get_Suffix[] PROGMEM =
-"\r\nAccept: text/html\r\n\r\n";
+// Ethernet, IP and TCP headers of a segment without TCP options
+#define TCP_HEADERS_SIZE (ETH_HEADER_LEN + IP_HEADER_LEN + TCP_HEADER_LEN_PLAIN)
 
+// The config page goes out a burst per loop() so the tree keeps animating
+ResponseSender pageSender;
+uint8_t configTask;
 
-////////////////////////////////////////////////////////////////////////////////
-///////////////////////////////// EEPROM Access ////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
+// Headers of the first reply to the page request.  Every page segment is
+// built from them, since the request itself is long gone from the buffer.
+uint8_t pageReply[TCP_HEADERS_SIZE];
 
-uint16_t GetEEPROMWord(uint16_t address)
+static uint32_t GetLong(const uint8_t* p)
 {
-  uint16_t retval = (EEPROM.read(address) & 0xFF);
-  retval |= ((EEPROM.read(address + 1) & 0xFF) << 8);
-  return retval;
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
 }
 
-void SetEEPROMWord(uint16_t address, uint16_t val)
+static void SetLong(uint8_t* p, uint32_t val)
 {
-  EEPROM.write(address, val & 0xFF);
-  EEPROM.write(address + 1, (val >> 8) & 0xFF);
+  p[0] = val >> 24;
+  p[1] = val >> 16;
+  p[2] = val >> 8;
+  p[3] = val;
 }
 
-bool HaveURL()
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Internet checksum, as used by IP and TCP.
+/// @param data Bytes to sum.
+/// @param len Number of bytes.
+/// @param sum Partial sum to start from, e.g. for the TCP pseudo header.
+////////////////////////////////////////////////////////////////////////////////
+static uint16_t Checksum(const uint8_t* data, uint16_t len, uint32_t sum)
 {
-  return GetEEPROMWord(PERSISTENT_MEMORY_DOMAIN_ADDRESS) >= PERSISTENT_MEMORY_DATA_START;
+  for(; len > 1; data += 2, len -= 2)
+  {
+    sum += ((uint16_t)data[0] << 8) | data[1];
+  }
+  if(len)
+  {
+    sum += (uint16_t)data[0] << 8;
+  }
+  while(sum >> 16)
+  {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  }
+  return ~sum;
 }
 
-bool SaveURL(char* urlString)
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Starts sending the config page in answer to the request that was
+///        just acknowledged with httpServerReplyAck().
+////////////////////////////////////////////////////////////////////////////////
+static void BeginPage()
 {
-  #if DEBUG
-  Serial.println(F("Saving URL..."));
-  #endif
-
-  // Indices within urlString where newline delimiters are
-  uint16_t divs[2];
+  memcpy(pageReply, Ethernet::buffer, TCP_HEADERS_SIZE);
+  pageSender.begin(CONFIG_HTML_LENGTH,
+                   BUFFERSIZE - TCP_HEADERS_SIZE,
+                   GetLong(pageReply + TCP_SEQ_H_P),
+                   millis());
+  tasks.wake(configTask);
+}
 
-  // Ensure delimiter at end of domain exists and domain string is longer than
-  // four characters.  a.co style should be shortest domain.
-  divs[0] = strcspn(urlString, "\n");
-  if('\n' != urlString[divs[0]]
-     || divs[0] < 4)
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Checks whether a page request's If-None-Match header names the
+///        current page's ETag, so the browser's cached copy can be used.
+/// @param request Null terminated request headers.
+////////////////////////////////////////////////////////////////////////////////
+static bool HaveCurrentPage(const char* request)
+{
+  const char* match = strstr_P(request, PSTR("\r\nIf-None-Match:"));
+  if(NULL == match)
   {
-    #if DEBUG
-    Serial.println(F("Could not find first newline"));
-    #endif
     return false;
   }
+  const char* etag = strstr_P(match, PSTR(CONFIG_HTML_ETAG));
+  const char* lineEnd = strstr_P(match + 2, PSTR("\r\n"));
+  return NULL != etag && (NULL == lineEnd || etag < lineEnd);
+}
 
-  // Ensure delimiter at end of port exists
-  divs[1] = strcspn(urlString + divs[0] + 1, "\n");
-  divs[1] += (divs[0] + 1);
-  if('\n' != urlString[divs[1]])
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Passes an acknowledgement from the page's client to pageSender.
+///        Must run before packetLoop(), which answers a FIN in place.
+/// @param len Length of the packet in the buffer.
+////////////////////////////////////////////////////////////////////////////////
+static void CheckPageAck(uint16_t len)
+{
+  uint8_t* buf = Ethernet::buffer;
+  if(!pageSender.isActive() ||
+     len < TCP_HEADERS_SIZE ||
+     buf[ETH_TYPE_H_P] != ETHTYPE_IP_H_V ||
+     buf[ETH_TYPE_L_P] != ETHTYPE_IP_L_V ||
+     buf[IP_PROTO_P] != IP_PROTO_TCP_V ||
+     0 != memcmp(buf + IP_SRC_P, pageReply + IP_DST_P, 4) ||
+     0 != memcmp(buf + TCP_SRC_PORT_H_P, pageReply + TCP_DST_PORT_H_P, 2) ||
+     0 != memcmp(buf + TCP_DST_PORT_H_P, pageReply + TCP_SRC_PORT_H_P, 2))
   {
-    #if DEBUG
-    Serial.println(F("Could not find second newline"));
-    Serial.print(F("First newline at "));
-    Serial.println(divs[0],DEC);
-    Serial.print(F("Second newline at "));
-    Serial.println(divs[1],DEC);
-    #endif
-    return false;
+    return;
   }
-
-  // Ensure port string is at least one digit
-  if(divs[1] - divs[0] < 2)
+  if(buf[TCP_FLAGS_P] & TCP_FLAGS_RST_V)
   {
-    #if DEBUG
-    Serial.println(F("Port not present"));
-    #endif
-    return false;
+    pageSender.stop();
   }
-
-  // Ensure an API endpoint string exists
-  if('\0' == urlString[divs[1] + 1])
+  else if(buf[TCP_FLAGS_P] & TCP_FLAGS_ACK_V)
   {
-    #if DEBUG
-    Serial.println(F("API endpoint not present"));
-    #endif
-    return false;
+    pageSender.acknowledged(GetLong(buf + TCP_SEQACK_H_P), millis());
   }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Sends one segment of the config page.  The segment is built here
+///        rather than with httpServerReply_with_flags(), whose sequence
+///        number only moves forward and so cannot resend.
+/// @param offset Offset of the first byte in config_html.
+/// @param size Number of bytes.
+/// @param flags TCP flags.
+////////////////////////////////////////////////////////////////////////////////
+static void SendPageSegment(uint16_t offset, uint16_t size, uint8_t flags)
+{
+  uint8_t* buf = Ethernet::buffer;
+  memcpy(buf, pageReply, TCP_HEADERS_SIZE);
+  memcpy_P(buf + TCP_HEADERS_SIZE, config_html + offset, size);
+
+  uint16_t ipLength = IP_HEADER_LEN + TCP_HEADER_LEN_PLAIN + size;
+  buf[IP_TOTLEN_H_P] = ipLength >> 8;
+  buf[IP_TOTLEN_L_P] = ipLength & 0xFF;
+  buf[IP_CHECKSUM_P] = 0;
+  buf[IP_CHECKSUM_P + 1] = 0;
+  uint16_t sum = Checksum(buf + IP_P, IP_HEADER_LEN, 0);
+  buf[IP_CHECKSUM_P] = sum >> 8;
+  buf[IP_CHECKSUM_P + 1] = sum & 0xFF;
+
+  SetLong(buf + TCP_SEQ_H_P, GetLong(pageReply + TCP_SEQ_H_P) + offset);
+  buf[TCP_FLAGS_P] = flags;
+  buf[TCP_CHECKSUM_H_P] = 0;
+  buf[TCP_CHECKSUM_L_P] = 0;
+  // The pseudo header's addresses sit right before the TCP header
+  uint16_t tcpLength = TCP_HEADER_LEN_PLAIN + size;
+  sum = Checksum(buf + IP_SRC_P, 8 + tcpLength, IP_PROTO_TCP_V + tcpLength);
+  buf[TCP_CHECKSUM_H_P] = sum >> 8;
+  buf[TCP_CHECKSUM_L_P] = sum & 0xFF;
+
+  ether.packetSend(TCP_HEADERS_SIZE + size);
+}
 
-  // Extract and validate port
-  uint16_t port = 0;
-  uint8_t charVal = 0;
-  for(uint16_t i = divs[0] + 1; i < divs[1]; i++)
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Sends the next burst of the config page if one is due.
+////////////////////////////////////////////////////////////////////////////////
+static void SendPage()
+{
+  if(!pageSender.sendDue(millis()))
   {
-    // Validate character in range '0'-'9'
-    charVal = urlString[i] - 48;
-    if(charVal > 9)
-    {
-      #if DEBUG
-      Serial.print(F("Invalid character "));
-      Serial.println(charVal, DEC);
-      #endif
-      return false;
-    }
-    // Port is decimal ascii
-    port *= 10;
-    port += charVal;
-    ether.hisport = port;
+    return;
   }
-
-  // Write pointer to domain string
-  uint16_t eepromAddress = PERSISTENT_MEMORY_DATA_START;
-  SetEEPROMWord(PERSISTENT_MEMORY_DOMAIN_ADDRESS, PERSISTENT_MEMORY_DATA_START);
-
-  // Write domain string
-  for(uint16_t i = 0; i < divs[0]; i++)
+  uint8_t segments = pageSender.burstSegments();
+  for(uint8_t i = 0; i < segments; i++)
   {
-    EEPROM.write(eepromAddress, urlString[i]);
-    eepromAddress++;
+    uint16_t offset;
+    uint16_t size;
+    pageSender.segment(i, offset, size);
+    SendPageSegment(offset, size,
+                    TCP_FLAGS_ACK_V | (i + 1 == segments ? TCP_FLAGS_PUSH_V : 0));
   }
-  // Write null stop character
-  EEPROM.write(eepromAddress, '\0');
-  eepromAddress++;
+  if(pageSender.burstEnds())
+  {
+    // Also when the data was acknowledged and only the FIN is resent
+    SendPageSegment(pageSender.finOffset(), 0,
+                    TCP_FLAGS_ACK_V | TCP_FLAGS_FIN_V);
+  }
+  pageSender.sent(millis());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///////////////////////////// API Query Components /////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+const char http_Get_Prefix[] PROGMEM =
+"GET ";
+
+const char http_Get_Middle[] PROGMEM =
+" HTTP/1.0\r\nHost: ";
+
+const char http_Get_Suffix[] PROGMEM =
+"\r\nAccept: text/html\r\n\r\n";
+
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////// Configuration /////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
 
-  // Write pointer to port
-  SetEEPROMWord(PERSISTENT_MEMORY_PORT_ADDRESS, eepromAddress);
+// Loaded from EEPROM once in setup(); polling reads it from RAM
+ConfigStore config;
 
-  // Write port
-  SetEEPROMWord(eepromAddress, port);
-  eepromAddress += 2;
+bool HaveURL()
+{
+  return config.haveURL();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Number of job endpoints stored after the port.
+////////////////////////////////////////////////////////////////////////////////
+uint8_t LoadJobCount()
+{
+  return config.getJobCount();
+}
 
-  // Write pointer to API endpoint URL
-  SetEEPROMWord(PERSISTENT_MEMORY_ENDPOINT_ADDRESS, eepromAddress);
+bool SaveURL(char* urlString)
+{
+  #if DEBUG
+  Serial.println(F("Saving URL..."));
+  #endif
 
-  // Write API endpoint URL
-  uint16_t i = divs[1] + 1;
-  do
+  if(!config.save(urlString))
   {
-    EEPROM.write(eepromAddress, urlString[i]);
-    eepromAddress++;
-    i++;
-  } while(urlString[i] != '\0');
-  // Write null stop character
-  EEPROM.write(eepromAddress, '\0');
+    #if DEBUG
+    Serial.println(F("Invalid or too long URL"));
+    #endif
+    return false;
+  }
 
   // Indicate successful write
   return true;
@@ -347,36 +566,27 @@ uint16_t LoadURL(char* urlString)
   urlString[totalLength] = ':';
   totalLength++;
   totalLength += LoadPort(urlString + totalLength);
-  totalLength += LoadEndpoint(urlString + totalLength);
+  // Further jobs follow on their own lines
+  uint8_t jobCount = LoadJobCount();
+  for(uint8_t job = 0; job < jobCount; job++)
+  {
+    if(job > 0)
+    {
+      urlString[totalLength] = '\n';
+      totalLength++;
+    }
+    totalLength += LoadEndpoint(job, urlString + totalLength);
+  }
 
   return totalLength;
 }
 
 uint16_t LoadDomain(char* destString)
 {
-  uint16_t domainSize = 0;
-  uint8_t eepromByte = '\0';
-  // Get start address for domain string
-  uint16_t eepromAddress = GetEEPROMWord(PERSISTENT_MEMORY_DOMAIN_ADDRESS);
-
-  // If start address is invalid, return empty string
-  if(!HaveURL())
-  {
-    destString[0] = '\0';
-    return domainSize;
-  }
-
-  // Load null-terminated string from EEPROM
-  do
-  {
-    eepromByte = EEPROM.read(eepromAddress);
-    destString[domainSize] = eepromByte;
-    eepromAddress++;
-    domainSize++;
-  } while(eepromByte != '\0');
+  strcpy(destString, config.getDomain());
 
   // Return size not including null stop character
-  return domainSize - 1;
+  return strlen(destString);
 }
 
 uint16_t LoadPort()
@@ -387,7 +597,7 @@ uint16_t LoadPort()
     return -1;
   }
 
-  uint16_t port = GetEEPROMWord(GetEEPROMWord(PERSISTENT_MEMORY_PORT_ADDRESS));
+  uint16_t port = config.getPort();
   SetPort(port);
   return port;
 }
@@ -400,49 +610,97 @@ uint16_t LoadPort(char* destString)
     return -1;
   }
 
-  uint16_t port = GetEEPROMWord(GetEEPROMWord(PERSISTENT_MEMORY_PORT_ADDRESS));
-  return sprintf(destString, "%d", port);
+  return sprintf(destString, "%u", config.getPort());
 }
 
-uint16_t LoadEndpoint(char* destString)
+uint16_t LoadEndpoint(uint8_t job, char* destString)
 {
-  uint16_t endpointSize = 0;
-  uint8_t eepromByte = '\0';
-  // Get start address for endpoint string
-  uint16_t eepromAddress = GetEEPROMWord(PERSISTENT_MEMORY_ENDPOINT_ADDRESS);
-
-  // If start address is invalid, return empty string
-  if(!HaveURL())
-  {
-    destString[0] = '\0';
-    return endpointSize;
-  }
-
-  // Load null-terminated string from EEPROM
-  do
-  {
-    eepromByte = EEPROM.read(eepromAddress);
-    destString[endpointSize] = eepromByte;
-    eepromAddress++;
-    endpointSize++;
-  } while(eepromByte != '\0');
+  strcpy(destString, config.getEndpoint(job));
 
   // Return size not including null stop character
-  return endpointSize - 1;
+  return strlen(destString);
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Decodes a pattern program sent as hex text (two digits per byte,
+///        no separators) in place.
+/// @param hex Null or whitespace terminated hex string.  Overwritten with the
+///            decoded bytecode.
+/// @param length Set to the number of decoded bytes.
+/// @return True if the text was valid hex and fits in a program.
+////////////////////////////////////////////////////////////////////////////////
+bool DecodeProgram(char* hex, uint8_t& length)
+{
+  length = 0;
+  for(uint16_t i = 0; hex[i] > ' '; i += 2)
+  {
+    uint8_t value = 0;
+    for(uint8_t j = 0; j < 2; j++)
+    {
+      char c = hex[i + j];
+      value <<= 4;
+      if(c >= '0' && c <= '9')
+      {
+        value |= c - '0';
+      }
+      else if(c >= 'a' && c <= 'f')
+      {
+        value |= c - 'a' + 10;
+      }
+      else if(c >= 'A' && c <= 'F')
+      {
+        value |= c - 'A' + 10;
+      }
+      else
+      {
+        return false;
+      }
+    }
+    if(length >= PROGRAM_MAX_LENGTH)
+    {
+      return false;
+    }
+    // Never overtakes the read position, which is two characters per byte
+    hex[length] = value;
+    length++;
+  }
+  return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////// API Query Helpers //////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
+// Scan state for the response to the current poll, kept across segments
+BuildStatusScanner statusScanner;
+
+// Poll timing and BUILDSTATUS_* flags for each job
+JobScheduler scheduler;
+uint8_t jobStatus[JOB_MAX];
+uint8_t statusBeforePoll; // Status of the job in flight when it was sent
+uint8_t pollSession;      // EtherCard session of the request in flight
+#if PERF_COUNTERS
+unsigned long pollSentAt; // When the request in flight was sent
+#endif
+
 static uint16_t FillServerQuery(uint8_t sessionID)
 {
+  if(JOB_NONE == scheduler.inFlight() || sessionID != pollSession)
+  {
+    // A request that timed out connecting late; the scanner may be part way
+    // through the response to the one in flight
+    return 0;
+  }
+
+  // A new request: forget the previous response
+  statusScanner.reset();
+
   // Create API query in payload
   uint8_t* startPos = EtherCard::tcpOffset();
   uint16_t len = sizeof(http_Get_Prefix) - 1;
   memcpy_P(startPos, http_Get_Prefix, len);
-  len += LoadEndpoint(startPos+len);
+  len += LoadEndpoint(scheduler.inFlight(), startPos + len);
   memcpy_P(startPos + len, http_Get_Middle, sizeof(http_Get_Middle));
   len += sizeof(http_Get_Middle) - 1;
   len += LoadDomain(startPos + len);
@@ -459,240 +717,837 @@ static uint8_t ReceiveServerResponse( uint8_t sessionID,
   // Reset port to enable http server
   SetPort(HTTP_SERVER_PORT);
 
-  char* responseStart = (char*)(Ethernet::buffer + offset);
-  Ethernet::buffer[offset+length] = '\0';
   #if DEBUG
   Serial.println(F("Request callback:"));
   #endif
 
-  // Serial.println(F("Content:"));
-  // Serial.println(responseStart);
+  uint8_t job = scheduler.inFlight();
+  if(JOB_NONE == job || sessionID != pollSession)
+  {
+    // Late segments after the request completed or timed out, possibly of
+    // an earlier request answering while a newer one is in flight
+    return 1;
+  }
+
+  // Called once per TCP segment; the scanner picks up where the last
+  // segment left off
+  bool complete = statusScanner.feed(Ethernet::buffer + offset, length);
+  ApplyBuildStatus(statusScanner, jobStatus[job]);
 
-  // Find beginning of JSON
-  size_t jsonStartIdx = strcspn(responseStart, "{");
-  responseStart += jsonStartIdx;
-  if(*responseStart != '{')
+  if(complete)
   {
-    #if DEBUG
-    Serial.println(F("JSON not found!"));
-    #endif
-    return 0;
+    jobStatus[job] &= ~BUILDSTATUS_UNKNOWN;
+#if PERF_COUNTERS
+    perf.pollCompleted(millis() - pollSentAt);
+#endif
+    scheduler.completed(jobStatus[job] & BUILDSTATUS_BUILDING,
+                        jobStatus[job] != statusBeforePoll,
+                        millis());
+    UpdateRings();
   }
 
-  char* key = NULL;
-  uint8_t keyLen = 0;
-  char* value = NULL;
-  uint8_t valueLen = 0;
+  // Non-zero closes the connection, skipping the rest of the response
+  return complete ? 1 : 0;
+}
 
-  while(getKVPair(responseStart, key, keyLen, value, valueLen))
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Folds whatever the scanner has found so far into a job's status.
+///        Safe to call repeatedly for the same response.
+/// @param scanner Scanner fed with the job's response
+/// @param buildStatus BUILDSTATUS_* flags of the job
+////////////////////////////////////////////////////////////////////////////////
+void ApplyBuildStatus(const BuildStatusScanner& scanner, uint8_t& buildStatus)
+{
+  if(scanner.haveBuilding())
   {
-    if(keyLen > 0 && valueLen > 0 && 0 == strncmp(key,"building",keyLen))
+    if(scanner.building())
     {
-      if(0 == strncmp(value,"true",valueLen))
-      {
-        // Set building flag
-        buildStatus |= BUILDSTATUS_BUILDING;
-        #if DEBUG
-        Serial.println(F("Building!"));
-        #endif
-      }
-      else
-      {
-        // Clear building flag
-        uint8_t statusMask = ~BUILDSTATUS_BUILDING;
-        buildStatus &= statusMask;
-        #if DEBUG
-        Serial.println(F("Not Building!"));
-        #endif
-      }
+      buildStatus |= BUILDSTATUS_BUILDING;
     }
-    else if(keyLen > 0 && valueLen > 0 && 0 == strncmp(key,"result",keyLen))
+    else
     {
-      if(0 == strncmp(value,"\"SUCCESS\"",valueLen))
-      {
-        // Clear all status flags except success and building
-        uint8_t statusMask = BUILDSTATUS_BUILDING | BUILDSTATUS_SUCCESS;
-        buildStatus &= statusMask;
-        // Set success flag
-        buildStatus |= BUILDSTATUS_SUCCESS;
-        #if DEBUG
-        Serial.println(F("Build: SUCCESS"));
-        Serial.print(buildStatus);
-        #endif
-      }
-      else if(0 == strncmp(value,"\"FAILURE\"",valueLen))
-      {
-        // Clear all status flags except failure and building
-        uint8_t statusMask = BUILDSTATUS_BUILDING | BUILDSTATUS_FAILURE;
-        buildStatus &= statusMask;
-        // Set failure flag
-        buildStatus |= BUILDSTATUS_FAILURE;
-        #if DEBUG
-        Serial.println(F("Build: FAILURE"));
-        Serial.print(buildStatus);
-        #endif
-      }
-      else if(0 == strncmp(value,"\"NOT_BUILT\"",valueLen))
-      {
-        // Clear all status flags except other and building
-        uint8_t statusMask = BUILDSTATUS_BUILDING | BUILDSTATUS_OTHER;
-        buildStatus &= statusMask;
-        // Set other flag
-        buildStatus |= BUILDSTATUS_OTHER;
-        #if DEBUG
-        Serial.println(F("Build: NOT_BUILT"));
-        Serial.print(buildStatus);
-        #endif
-      }
-      else if(0 == strncmp(value,"\"ABORTED\"",valueLen))
-      {
-        // Clear all status flags except other and building
-        uint8_t statusMask = BUILDSTATUS_BUILDING | BUILDSTATUS_OTHER;
-        buildStatus &= statusMask;
-        // Set other flag
-        buildStatus |= BUILDSTATUS_OTHER;
-        #if DEBUG
-        Serial.println(F("Build: ABORTED"));
-        Serial.print(buildStatus);
-        #endif
-      }
-      else if(0 == strncmp(value,"\"UNSTABLE\"",valueLen))
-      {
-        // Clear all status flags except failure and building
-        uint8_t statusMask = BUILDSTATUS_BUILDING | BUILDSTATUS_UNSTABLE;
-        buildStatus &= statusMask;
-        // Set unstable flag
-        buildStatus |= BUILDSTATUS_UNSTABLE;
-        #if DEBUG
-        Serial.println(F("Build: UNSTABLE"));
-        Serial.print(buildStatus);
-        #endif
-      }
-      else
-      {
-        // Do nothing and maintain previous status
-        #if DEBUG
-        Serial.println(F("Build: OTHER"));
-        Serial.print(buildStatus);
-        #endif
-      }
+      uint8_t statusMask = ~BUILDSTATUS_BUILDING;
+      buildStatus &= statusMask;
     }
-    responseStart = value + valueLen + 1;
   }
-  return 0; // Not used for anything
-}
 
-bool getKVPair(char* responseStart, char*& key, uint8_t& keyLen, char*& value, uint8_t& valueLen)
-{
-  // Every key should start with a double quote and end with a double quote
-  size_t findOffset = strcspn(responseStart, "\"");
-  if(responseStart[findOffset] != '\"')
+  if(scanner.haveResult())
   {
-    // No key found
-    return false;
+    uint8_t resultFlag = 0;
+    switch(scanner.result())
+    {
+      case BuildStatusScanner::RESULT_SUCCESS:
+        resultFlag = BUILDSTATUS_SUCCESS;
+        break;
+      case BuildStatusScanner::RESULT_FAILURE:
+        resultFlag = BUILDSTATUS_FAILURE;
+        break;
+      case BuildStatusScanner::RESULT_UNSTABLE:
+        resultFlag = BUILDSTATUS_UNSTABLE;
+        break;
+      case BuildStatusScanner::RESULT_NOT_BUILT:
+      case BuildStatusScanner::RESULT_ABORTED:
+        resultFlag = BUILDSTATUS_OTHER;
+        break;
+      default:
+        // Still building (null) or unrecognized: keep the previous status
+        break;
+    }
+    if(resultFlag)
+    {
+      // Clear all status flags except building, then set the new result
+      buildStatus &= BUILDSTATUS_BUILDING;
+      buildStatus |= resultFlag;
+    }
   }
-  // Key is always a string, so don't include the first double quote
-  key = responseStart + findOffset + 1;
-  responseStart = key;
 
-  findOffset = strcspn(responseStart, "\"");
-  if(responseStart[findOffset] != '\"')
+  #if DEBUG
+  Serial.print(F("Build status: "));
+  Serial.println(buildStatus);
+  #endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Shows every job on the status rings (all but the top ring).  With
+///        fewer jobs than rings, each job gets a band of neighboring rings;
+///        a single job lights them all.
+////////////////////////////////////////////////////////////////////////////////
+void UpdateRings()
+{
+  uint8_t numJobs = scheduler.getNumJobs();
+  uint8_t statusRings = tree.getNumRings() - 1;
+  if(0 == numJobs)
   {
-    // No key end found
-    return false;
+    return;
   }
-  keyLen = findOffset;
-  responseStart += findOffset;
+  for(uint8_t i = 0; i < statusRings; i++)
+  {
+    updatePatterns(tree, i, jobStatus[(uint16_t)i * numJobs / statusRings]);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Sets new TCP port for ethercard library.  This is the port used for
+///        responses and requests
+/// @param newPort New port to listen on/send to
+////////////////////////////////////////////////////////////////////////////////
+void SetPort(uint16_t newPort)
+{
+  ether.hisport = newPort;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Answers a request to the config server.
+/// @param pos Offset of the request in Ethernet::buffer, from packetLoop().
+////////////////////////////////////////////////////////////////////////////////
+static void HandleRequest(word pos)
+{
+  static bool pendingPut = false;
+  bool generalMemCopy = true;
 
-  // A colon will always appear immediately before the value
-  findOffset = strcspn(responseStart, ":");
-  if(responseStart[findOffset] != ':')
+  int sz = BUFFERSIZE - pos;
+  char* data = (char*) Ethernet::buffer + pos;
+  char* sendData = NULL;
+  bool paced = false; // Response goes out from SendPage()
+
+  #if DEBUG
+  Serial.println(pos);
+  #endif
+
+  ether.httpServerReplyAck();
+
+  if (strncmp("GET / ", data, 6) == 0)
   {
-    // No KV pair separator found
-    return false;
+    pendingPut = false;
+
+    #if DEBUG
+    Serial.println(F("GET /:"));
+    Serial.println(data);
+    #endif
+    if(HaveCurrentPage(data))
+    {
+      sendData = const_cast<char*>(http_NotModified);
+      sz = sizeof(http_NotModified) - 1; // A 304 has no body
+    }
+    else
+    {
+      BeginPage();
+      paced = true;
+    }
   }
-  value = responseStart + findOffset + 1;
-  responseStart = value;
+  // else if (strncmp("GET /favicon.ico", data, 16) == 0)
+  // {
+  //   pendingPut = false;
+
+  //   Serial.println(F("GET /favicon.ico:"));
+  //   Serial.println(data);
+  //   sendData = const_cast<char*>(favicon_ico);
+  //   if(sizeof(favicon_ico) < sz)
+  //   {
+  //     sz = sizeof(favicon_ico);
+  //     complete = true;
+  //   }
+  //   else
+  //   {
+  //     do
+  //     {
+  //       memcpy_P(data, sendData + startPoint, sz); // Copy data from flash to RAM
+  //       ether.httpServerReply_with_flags(sz, TCP_FLAGS_ACK_V);
+  //       startPoint += sz;
+  //       sz = BUFFERSIZE - pos;
+  //       if(sizeof(favicon_ico) - startPoint < sz)
+  //       {
+  //         sz = sizeof(favicon_ico) - startPoint;
+  //         complete = true;
+  //       }
+  //     } while (false == complete);
+  //     sendData += startPoint;
+  //   }
+  // }
+  else if (strncmp("GET /apiURL", data, 10) == 0)
+  {
+    pendingPut = false;
 
-  // Comma separates keys, end brace indicates end of selection
-  findOffset = strcspn(responseStart, ",}");
-  if(responseStart[findOffset] != ',' &&
-     responseStart[findOffset] != '}')
+    #if DEBUG
+    Serial.println(F("GET /apiURL:"));
+    Serial.println(data);
+    #endif
+    generalMemCopy = false; // Doing memcopy here to build response
+    sz = sizeof(http_OK);
+    memcpy_P(data, http_OK, sz);
+    uint16_t urlSize = 0;
+    urlSize = LoadURL(data+sz-1); // Start at null character from header string
+    sz += (urlSize-1); // Don't send null characters
+  }
+#if PERF_COUNTERS
+  else if (strncmp("GET /stats", data, 10) == 0)
   {
-    // No value end found
-    return false;
+    pendingPut = false;
+
+    generalMemCopy = false; // Doing memcopy here to build response
+    sz = sizeof(http_JSON);
+    memcpy_P(data, http_JSON, sz);
+    // Start at null character from header string
+    sz += perf.format(data + sz - 1, BUFFERSIZE - pos - sz + 1,
+                      FreeRam(), millis()) - 1;
   }
-  valueLen = findOffset;
-  return true;
-}
+#endif
+  else if (strncmp("PUT /program", data, 12) == 0)
+  {
+    pendingPut = false;
 
-void updatePatterns(NeoPixelRing& lTree, uint8_t status)
-{
-  uint32_t illuminateColor = 0;
-  if(status & BUILDSTATUS_SUCCESS)
+    #if DEBUG
+    Serial.println(F("PUT /program:"));
+    Serial.println(data);
+    #endif
+    char* body = strstr(data, "\r\n\r\n");
+    uint8_t length = 0;
+    if(NULL != body &&
+       DecodeProgram(body + 4, length) &&
+       tree.setProgram((const uint8_t*)(body + 4), length))
+    {
+      SaveProgram((const uint8_t*)(body + 4), length);
+      sendData = const_cast<char*>(http_OK);
+      sz = sizeof(http_OK);
+    }
+    else
+    {
+      sendData = const_cast<char*>(http_BadRequest);
+      sz = sizeof(http_BadRequest);
+    }
+  }
+  else if (strncmp("PUT /apiURL", data, 10) == 0)
   {
-    illuminateColor = COLOR_GREEN;
+    pendingPut = false;
+
+    #if DEBUG
+    Serial.println(F("PUT /apiURL:"));
+    Serial.println(data);
+    #endif
+    char* headerEnd = strstr(data, "\r\n\r\n");
+    #if DEBUG
+    Serial.print(F("After Header: "));
+    Serial.println(headerEnd + 4);
+    #endif
+    if(SaveURL(headerEnd + 4))
+    {
+      sendData = const_cast<char*>(http_OK);
+      sz = sizeof(http_OK);
+      ServerChanged();
+      tree.setPattern(0,
+                      NeoPixelRing::SOLID,
+                      COLOR_GREEN,
+                      1000,
+                      0);
+      tree.setPattern(1,
+                      NeoPixelRing::SOLID,
+                      COLOR_GREEN,
+                      1000,
+                      0);
+      tree.setPattern(2,
+                      NeoPixelRing::PULSE,
+                      COLOR_YELLOW,
+                      1000,
+                      0);
+      tree.setPattern(3,
+                      NeoPixelRing::PULSE,
+                      COLOR_YELLOW,
+                      1000,
+                      0);
+      tree.setPattern(4,
+                      NeoPixelRing::SOLID,
+                      COLOR_RED,
+                      1000,
+                      0);
+    }
+    else if('\0' == *(headerEnd + 4))
+    {
+      // 2-part put message
+      #if DEBUG
+      Serial.println(F("Pending PUT"));
+      #endif
+      sendData = const_cast<char*>(http_OK);
+      sz = sizeof(http_OK);
+      pendingPut = true;
+    }
+    else
+    {
+      sendData = const_cast<char*>(http_BadRequest);
+      sz = sizeof(http_BadRequest);
+    }
   }
-  else if(status & BUILDSTATUS_FAILURE)
+  else if(true == pendingPut)
   {
-    illuminateColor = COLOR_RED;
+    pendingPut = false;
+
+    #if DEBUG
+    Serial.println(F("PUT pt2"));
+    Serial.println(data);
+    #endif
+    if(SaveURL(data))
+    {
+      sendData = const_cast<char*>(http_OK);
+      sz = sizeof(http_OK);
+      ServerChanged();
+      tree.setPattern(0,
+                      NeoPixelRing::SOLID,
+                      COLOR_GREEN,
+                      1000,
+                      0);
+      tree.setPattern(1,
+                      NeoPixelRing::SOLID,
+                      COLOR_GREEN,
+                      1000,
+                      0);
+      tree.setPattern(2,
+                      NeoPixelRing::PULSE,
+                      COLOR_YELLOW,
+                      1000,
+                      0);
+      tree.setPattern(3,
+                      NeoPixelRing::PULSE,
+                      COLOR_YELLOW,
+                      1000,
+                      0);
+      tree.setPattern(4,
+                      NeoPixelRing::SOLID,
+                      COLOR_RED,
+                      1000,
+                      0);
+    }
+    else
+    {
+      #if DEBUG
+      Serial.println(F("Not PUT pt2!"));
+      #endif
+      sendData = const_cast<char*>(http_Unauthorized);
+      if(sizeof(http_Unauthorized) < sz)
+      {
+        sz = sizeof(http_Unauthorized);
+      }
+    }
   }
   else
   {
-    illuminateColor = COLOR_YELLOW;
+    // Page not found
+    #if DEBUG
+    Serial.println(F("???:"));
+    Serial.println(data);
+    #endif
+    sendData = const_cast<char*>(http_Unauthorized);
+    if(sizeof(http_Unauthorized) < sz)
+    {
+      sz = sizeof(http_Unauthorized);
+    }
   }
-  // While building, pulse light corresponding to previous build status
-  if(status & BUILDSTATUS_BUILDING)
+
+  // Send http response
+  if(!paced)
   {
-    for(uint8_t i = 0; i < (lTree.getNumRings() - 1); i++)
+    if(generalMemCopy)
     {
-      lTree.setPattern(i,
-                       NeoPixelRing::SPIN,
-                       illuminateColor,
-                       2000,
-                       0);
+      memcpy_P(data, sendData, sz); // Copy data from flash to RAM
     }
+    // ether.httpServerReply(sz-1);
+    ether.httpServerReply_with_flags(sz,TCP_FLAGS_ACK_V|TCP_FLAGS_PUSH_V);
+    ether.httpServerReply_with_flags(0,TCP_FLAGS_ACK_V|TCP_FLAGS_FIN_V);
   }
-  else
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////// Server Lookup /////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+DnsResolver resolver;
+bool haveDNS = false;            // ether.hisip holds an address for the server
+bool dnsConfirmed = false;       // It was looked up since boot or the last change
+unsigned long lastDNSLookup = 0; // When the last lookup started
+uint8_t dnsTask;
+uint8_t pollTask;
+
+// Last lease and server address, used straight after a reset
+NetworkCache netCache(myMAC);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Looks the server up again, right away, after the configuration was
+///        saved.
+////////////////////////////////////////////////////////////////////////////////
+void ServerChanged()
+{
+  #if DEBUG
+  Serial.println(F("Pending DNS"));
+  #endif
+  haveDNS = false;
+  RefreshServer();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Looks the server up again, right away, while polling carries on
+///        at the address it has.
+////////////////////////////////////////////////////////////////////////////////
+void RefreshServer()
+{
+  dnsConfirmed = false;
+  // A lookup still in flight is dropped
+  lastDNSLookup = millis();
+  resolver.begin(lastDNSLookup);
+  tasks.wake(dnsTask);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Starts polling once the server's address is known.
+////////////////////////////////////////////////////////////////////////////////
+void ServerResolved()
+{
+  #if DEBUG
+  ether.printIp(F("Server: "), ether.hisip);
+  #endif
+  haveDNS = true;
+  // One job per status ring at most
+  uint8_t numJobs = LoadJobCount();
+  if(numJobs > tree.getNumRings() - 1)
   {
-    // Unknown flash all lights
-    if(status & BUILDSTATUS_UNKNOWN)
+    numJobs = tree.getNumRings() - 1;
+  }
+  memset(jobStatus, 0, sizeof(jobStatus));
+  scheduler.begin(numJobs, millis());
+  tree.setPattern(0,
+                  NeoPixelRing::PULSE,
+                  COLOR_GREEN,
+                  1000,
+                  0);
+  tree.setPattern(1,
+                  NeoPixelRing::PULSE,
+                  COLOR_GREEN,
+                  1000,
+                  0);
+  tree.setPattern(2,
+                  NeoPixelRing::PULSE,
+                  COLOR_YELLOW,
+                  1000,
+                  0);
+  tree.setPattern(3,
+                  NeoPixelRing::PULSE,
+                  COLOR_YELLOW,
+                  1000,
+                  0);
+  tree.setPattern(4,
+                  NeoPixelRing::PULSE,
+                  COLOR_RED,
+                  1000,
+                  0);
+  tasks.wake(pollTask);
+}
+
+// Callback for answers from the DNS server; see DnsResolver.h
+void udpDnsReceived(uint16_t dest_port, uint8_t src_ip[IP_LEN], uint16_t src_port, const char *data, uint16_t len){
+  if(resolver.receive((const uint8_t*)data, len))
+  {
+    if(DnsResolver::RESOLVED == resolver.getState())
     {
-      for(uint8_t i = 0; i < (lTree.getNumRings() - 1); i++)
+      ether.copyIp(ether.hisip, resolver.getAddress());
+      netCache.saveServer(config.getDomain(), ether.hisip);
+      dnsConfirmed = true;
+      if(!haveDNS)
       {
-        lTree.setPattern(i,
-                         NeoPixelRing::PULSE,
-                         illuminateColor,
-                         2000,
-                         0);
+        ServerResolved();
       }
     }
-    // Solid corresponding to build status
     else
     {
-      for(uint8_t i = 0; i < (lTree.getNumRings() - 1); i++)
-      {
-        lTree.setPattern(i,
-                         NeoPixelRing::SOLID,
-                         illuminateColor,
-                         2000,
-                         0);
-      }
+      #if DEBUG
+      Serial.println(F("DNS lookup failed"));
+      #endif
     }
+    tasks.wake(dnsTask);
   }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief Sets new TCP port for ethercard library.  This is the port used for
-///        responses and requests
-/// @param newPort New port to listen on/send to
+/// @brief Sends the query that is due.  It is built straight into the UDP
+///        payload of Ethernet::buffer.
 ////////////////////////////////////////////////////////////////////////////////
-void SetPort(uint16_t newPort)
+static void SendDnsQuery()
 {
-  ether.hisport = newPort;
+  ether.udpPrepare(DNS_CLIENT_PORT, ether.dnsip, DNS_SERVER_PORT);
+  uint16_t len = resolver.fillQuery(Ethernet::buffer + UDP_DATA_P,
+                                    BUFFERSIZE - UDP_DATA_P,
+                                    config.getDomain(),
+                                    millis());
+  if(len > 0)
+  {
+    ether.udpTransmit(len);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Task resolving the server's name.  Replaces the blocking
+///        ether.dnsLookup(): it sends a query and returns, and the answer
+///        comes through udpDnsReceived().
+////////////////////////////////////////////////////////////////////////////////
+unsigned long DnsTask(unsigned long now)
+{
+  if(dnsConfirmed || !HaveURL() || !HaveAddress())
+  {
+    return TASK_IDLE;
+  }
+  unsigned long ms = millis();
+  DnsResolver::State state = resolver.poll(ms);
+  if(DnsResolver::IDLE == state || DnsResolver::FAILED == state)
+  {
+    // The first lookup goes out as soon as the link is up; retries wait
+    unsigned long sinceLookup = ms - lastDNSLookup;
+    if(DnsResolver::FAILED == state && sinceLookup <= DNS_RETRY_INTERVAL_MS)
+    {
+      return (DNS_RETRY_INTERVAL_MS + 1 - sinceLookup) * 1000UL;
+    }
+    if(!ether.isLinkUp() || ether.clientWaitingGw())
+    {
+      return DNS_LINK_CHECK_MS * 1000UL;
+    }
+    lastDNSLookup = ms;
+    resolver.begin(ms);
+    state = DnsResolver::SEND;
+  }
+  if(DnsResolver::SEND == state)
+  {
+    SendDnsQuery();
+  }
+  if(DnsResolver::WAITING == resolver.getState())
+  {
+    return resolver.msUntilPoll(ms) * 1000UL;
+  }
+  // The name was invalid; wait for the next retry
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Task sending the next Jenkins request when one is due.
+////////////////////////////////////////////////////////////////////////////////
+unsigned long PollTask(unsigned long now)
+{
+  if(!haveDNS || !HaveURL() || !HaveAddress())
+  {
+    return TASK_IDLE;
+  }
+
+  // Unanswered requests mark their job unknown until it answers again
+  uint8_t failedJob = scheduler.checkTimeout(millis());
+  if(JOB_NONE != failedJob)
+  {
+#if PERF_COUNTERS
+    perf.pollFailed();
+#endif
+    jobStatus[failedJob] |= BUILDSTATUS_UNKNOWN;
+    UpdateRings();
+  }
+
+  uint8_t job = scheduler.nextJob(millis());
+  if(JOB_NONE != job)
+  {
+    scheduler.started(job, millis());
+    statusBeforePoll = jobStatus[job];
+#if PERF_COUNTERS
+    pollSentAt = millis();
+#endif
+    pollSession = ether.clientTcpReq(ReceiveServerResponse, FillServerQuery,
+                                     LoadPort());
+  }
+  RedrawIfChanged();
+  return POLL_INTERVAL_US;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Task sending the config page a burst at a time.
+////////////////////////////////////////////////////////////////////////////////
+unsigned long ConfigTask(unsigned long now)
+{
+  SendPage();
+  return pageSender.isActive() ? CONFIG_INTERVAL_US : TASK_IDLE;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////// Address ////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+#if STATIC
+
+bool HaveAddress()
+{
+  return true;
+}
+
+#else
+
+DhcpClient dhcp;
+uint8_t dhcpTask;
+
+bool HaveAddress()
+{
+  return dhcp.hasLease();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Takes up a lease the DHCP server granted or confirmed.  A lease
+///        that differs from the one in use is cached, and the server is
+///        looked up again through the new network's DNS server.
+////////////////////////////////////////////////////////////////////////////////
+void LeaseBound()
+{
+  const DhcpLease& lease = dhcp.getLease();
+  if(0 != memcmp(ether.myip, lease.ip, IP_LEN) ||
+     0 != memcmp(ether.gwip, lease.gateway, IP_LEN) ||
+     0 != memcmp(ether.dnsip, lease.dns, IP_LEN) ||
+     0 != memcmp(ether.netmask, lease.mask, IP_LEN))
+  {
+    ether.staticSetup(lease.ip, lease.gateway, lease.dns, lease.mask);
+    #if DEBUG
+    ether.printIp(F("IP: "), ether.myip);
+    ether.printIp(F("GW: "), ether.gwip);
+    ether.printIp(F("DNS: "), ether.dnsip);
+    #endif
+    if(haveDNS)
+    {
+      RefreshServer();
+    }
+  }
+  // Writes only what changed, usually nothing
+  netCache.saveLease(lease);
+  tasks.wake(dnsTask);
+  tasks.wake(pollTask);
+}
+
+// Callback for answers from DHCP servers; see DhcpClient.h
+void udpDhcpReceived(uint16_t dest_port, uint8_t src_ip[IP_LEN], uint16_t src_port, const char *data, uint16_t len){
+  if(dhcp.receive((const uint8_t*)data, len, millis()))
+  {
+    if(DhcpClient::BOUND == dhcp.getState())
+    {
+      LeaseBound();
+    }
+    tasks.wake(dhcpTask);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Broadcasts the DHCP message that is due.  It is built straight into
+///        the UDP payload of Ethernet::buffer.
+////////////////////////////////////////////////////////////////////////////////
+static void SendDhcpMessage()
+{
+  static const uint8_t broadcastIp[IP_LEN] = { 255, 255, 255, 255 };
+  ether.udpPrepare(DHCP_CLIENT_PORT, broadcastIp, DHCP_SERVER_PORT);
+  uint16_t len = dhcp.fillMessage(Ethernet::buffer + UDP_DATA_P,
+                                  BUFFERSIZE - UDP_DATA_P,
+                                  millis());
+  if(len > 0)
+  {
+    ether.udpTransmit(len);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Task getting and renewing the lease.  Replaces the blocking
+///        ether.dhcpSetup(): it sends a message and returns, and the answer
+///        comes through udpDhcpReceived().
+////////////////////////////////////////////////////////////////////////////////
+unsigned long DhcpTask(unsigned long now)
+{
+  unsigned long ms = millis();
+  if(DhcpClient::SEND == dhcp.poll(ms))
+  {
+    if(!ether.isLinkUp())
+    {
+      return DHCP_LINK_CHECK_MS * 1000UL;
+    }
+    SendDhcpMessage();
+  }
+  unsigned long wait = dhcp.msUntilPoll(ms);
+  return (wait < DHCP_CHECK_MS ? wait : DHCP_CHECK_MS) * 1000UL;
+}
+
+#endif // STATIC
+
 #endif //STANDALONE
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Idles the CPU until the next interrupt.  Timer 0 fires every
+///        millisecond to drive millis(), so this sleeps for at most ~1 ms and
+///        the next loop() still polls the Ethernet controller promptly; the
+///        ENC28J60 buffers incoming packets in the meantime.
+////////////////////////////////////////////////////////////////////////////////
+void IdleUntilNextTick()
+{
+#ifdef __AVR__
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_mode();
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Has the render task draw soon if the patterns have changed.  Called
+///        by the tasks that may change them.
+////////////////////////////////////////////////////////////////////////////////
+void RedrawIfChanged()
+{
+  if(0 == tree.msUntilUpdate(fleet.toFleet(millis())))
+  {
+    tasks.wake(renderTask);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Task drawing the tree.  Runs again when the output next changes.
+////////////////////////////////////////////////////////////////////////////////
+unsigned long RenderTask(unsigned long now)
+{
+#if PERF_COUNTERS
+  if(tree.update(fleet.toFleet(millis())))
+  {
+    unsigned long showUs = tree.getShowMicros();
+    perf.frame(micros() - now - showUs, showUs, millis());
+  }
+#else
+  tree.update(fleet.toFleet(millis()));
+#endif
+  unsigned long ms = tree.msUntilUpdate(fleet.toFleet(millis()));
+  return ((unsigned long)-1 == ms) ? TASK_IDLE : ms * 1000UL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Task handling received packets: UDP callbacks, TCP client replies
+///        and, in standalone mode, requests to the config server.
+////////////////////////////////////////////////////////////////////////////////
+unsigned long NetworkTask(unsigned long now)
+{
+  word len = ether.packetReceive();
+#if STANDALONE
+  CheckPageAck(len);
+#endif
+#if PERF_COUNTERS
+  unsigned long start = micros();
+#endif
+  word pos = ether.packetLoop(len);
+#if PERF_COUNTERS
+  if(len)
+  {
+    perf.packet(micros() - start);
+    // packetReceive() cuts packets down to the buffer size
+    if(len >= BUFFERSIZE - 1)
+    {
+      perf.dropped();
+    }
+  }
+#endif
+
+#if STANDALONE
+  if(pos)
+  {
+    HandleRequest(pos);
+  }
+#else
+  stream.checkTimeout(tree, millis());
+#endif
+
+  RedrawIfChanged();
+  // Straight back while packets arrive; they may have follow-up work
+  return len ? 0 : NETWORK_INTERVAL_US;
+}
+
+#if DEBUG
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Task printing where loop() time went since the last print.
+////////////////////////////////////////////////////////////////////////////////
+unsigned long StatsTask(unsigned long now)
+{
+  Serial.println(F("task runs missed avg_us max_us"));
+  for(uint8_t i = 0; i < tasks.getNumTasks(); i++)
+  {
+    const LoopScheduler::TaskStats& stats = tasks.getStats(i);
+    Serial.print(i);
+    Serial.print(' ');
+    Serial.print(stats.runs);
+    Serial.print(' ');
+    Serial.print(stats.missed);
+    Serial.print(' ');
+    Serial.print(stats.runs ? stats.totalUs / stats.runs : 0);
+    Serial.print(' ');
+    Serial.println(stats.maxUs);
+  }
+  tasks.resetStats();
+  return STATS_INTERVAL_MS * 1000UL;
+}
+#endif
+
+#if FLEET_LEADER
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Task broadcasting this tree's fleet time to its group.
+////////////////////////////////////////////////////////////////////////////////
+unsigned long BeaconTask(unsigned long now)
+{
+  static const uint8_t broadcastIP[IP_LEN] = { 255, 255, 255, 255 };
+  ether.udpPrepare(SYNC_UDP_PORT, broadcastIP, SYNC_UDP_PORT);
+  FleetClock::fillBeacon(Ethernet::buffer + UDP_DATA_P, FLEET_GROUP,
+                         fleet.toFleet(millis()));
+  ether.udpTransmit(SYNC_BEACON_SIZE);
+  return SYNC_BEACON_INTERVAL_MS * 1000UL;
+}
+#endif
+
+#if PERF_COUNTERS && PERF_SERIAL_INTERVAL_MS
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Task printing the performance counters.  The text is built in
+///        Ethernet::buffer, which is free between tasks.
+////////////////////////////////////////////////////////////////////////////////
+unsigned long PerfTask(unsigned long now)
+{
+  char* text = (char*)Ethernet::buffer;
+  perf.format(text, BUFFERSIZE, FreeRam(), millis());
+  Serial.println(text);
+  return PERF_SERIAL_INTERVAL_MS * 1000UL;
+}
+#endif
+
 void setup()
 {
   Serial.begin(9600);
@@ -707,11 +1562,17 @@ void setup()
 #if STATIC
   ether.staticSetup(myIP);
 #else
-  if(false == ether.dhcpSetup())
+  // A lease from before the reset is used at once and confirmed in the
+  // background; without one, the DHCP task asks for a new lease
+  DhcpLease lease;
+  if(netCache.loadLease(lease))
   {
-    #if DEBUG
-    Serial.println(F("DHCP failed"));
-    #endif
+    ether.staticSetup(lease.ip, lease.gateway, lease.dns, lease.mask);
+    dhcp.reboot(myMAC, lease, millis());
+  }
+  else
+  {
+    dhcp.begin(myMAC, millis());
   }
 #endif
 
@@ -721,12 +1582,28 @@ void setup()
   ether.printIp("DNS: ", ether.dnsip);
   #endif
 
+  // Beacons and group control datagrams are broadcast
+  ether.enableBroadcast();
+  fleet.setGroup(FLEET_GROUP);
+  ether.udpServerListenOnPort(&udpSyncReceived, SYNC_UDP_PORT);
 #if STANDALONE == 0
+  control.setGroup(FLEET_GROUP);
   ether.udpServerListenOnPort(&udpDataReceived, 8733);
+  ether.udpServerListenOnPort(&udpProgramReceived, PROGRAM_UDP_PORT);
+  ether.udpServerListenOnPort(&udpStreamReceived, STREAM_UDP_PORT);
+#else
+  ether.udpServerListenOnPort(&udpDnsReceived, DNS_CLIENT_PORT);
+  #if !STATIC
+  ether.udpServerListenOnPort(&udpDhcpReceived, DHCP_CLIENT_PORT);
+  #endif
 #endif
 
   tree.begin();
   tree.setBrightness(75);
+  LoadProgram();
+#if STANDALONE
+  config.begin();
+#endif
   tree.update(); // Initialize all pixels to 'off'
   tree.setPattern(0,
                   NeoPixelRing::SPIN,
@@ -758,306 +1635,45 @@ void setup()
                   COLOR_RED,
                   4000,
                   0);
-}
-
-void loop()
-{
-  word pos = ether.packetLoop(ether.packetReceive());
+  // The boot pattern appears at once; later changes fade in
+  tree.setCrossfade(STATUS_FADE_MS);
 
+  // The render task gets the frame: other tasks wait rather than delay it
+  renderTask = tasks.add(RenderTask, RENDER_DEADLINE_US, RENDER_BUDGET_US);
+  tasks.setFrameTask(renderTask);
+  tasks.add(NetworkTask, NETWORK_DEADLINE_US, NETWORK_BUDGET_US);
 #if STANDALONE
-  static bool pendingPut = false;
-  bool generalMemCopy = true;
-
-  static bool haveDNS = false;
-  static long lastDNSLookup = 0;
-  static long lastServerPoll = 0;
-
-  if (pos)
-  {
-    uint16_t startPoint = 0; // Multi-packet response
-    int sz = BUFFERSIZE - pos;
-    char* data = (char*) Ethernet::buffer + pos;
-    char* sendData = NULL;
-    bool complete = false;
-
-    #if DEBUG
-    Serial.println(pos);
-    #endif
-
-    ether.httpServerReplyAck();
-
-    if (strncmp("GET / ", data, 6) == 0)
-    {
-      pendingPut = false;
-
-      #if DEBUG
-      Serial.println(F("GET /:"));
-      Serial.println(data);
-      #endif
-      sendData = const_cast<char*>(config_html);
-      if(sizeof(config_html) < sz)
-      {
-        sz = sizeof(config_html);
-      }
-      else
-      {
-        do
-        {
-          memcpy_P(data, sendData + startPoint, sz); // Copy data from flash to RAM
-          ether.httpServerReply_with_flags(sz, TCP_FLAGS_ACK_V);
-          startPoint += sz;
-          sz = BUFFERSIZE - pos;
-          if(sizeof(config_html) - startPoint < sz)
-          {
-            sz = sizeof(config_html) - startPoint;
-            complete = true;
-          }
-        } while (false == complete);
-        sendData += startPoint;
-      }
-    }
-    // else if (strncmp("GET /favicon.ico", data, 16) == 0)
-    // {
-    //   pendingPut = false;
-
-    //   Serial.println(F("GET /favicon.ico:"));
-    //   Serial.println(data);
-    //   sendData = const_cast<char*>(favicon_ico);
-    //   if(sizeof(favicon_ico) < sz)
-    //   {
-    //     sz = sizeof(favicon_ico);
-    //     complete = true;
-    //   }
-    //   else
-    //   {
-    //     do
-    //     {
-    //       memcpy_P(data, sendData + startPoint, sz); // Copy data from flash to RAM
-    //       ether.httpServerReply_with_flags(sz, TCP_FLAGS_ACK_V);
-    //       startPoint += sz;
-    //       sz = BUFFERSIZE - pos;
-    //       if(sizeof(favicon_ico) - startPoint < sz)
-    //       {
-    //         sz = sizeof(favicon_ico) - startPoint;
-    //         complete = true;
-    //       }
-    //     } while (false == complete);
-    //     sendData += startPoint;
-    //   }
-    // }
-    else if (strncmp("GET /apiURL", data, 10) == 0)
-    {
-      pendingPut = false;
-
-      #if DEBUG
-      Serial.println(F("GET /apiURL:"));
-      Serial.println(data);
-      #endif
-      generalMemCopy = false; // Doing memcopy here to build response
-      sz = sizeof(http_OK);
-      memcpy_P(data, http_OK, sz);
-      uint16_t urlSize = 0;
-      urlSize = LoadURL(data+sz-1); // Start at null character from header string
-      sz += (urlSize-1); // Don't send null characters
-    }
-    else if (strncmp("PUT /apiURL", data, 10) == 0)
-    {
-      pendingPut = false;
-
-      #if DEBUG
-      Serial.println(F("PUT /apiURL:"));
-      Serial.println(data);
-      #endif
-      char* headerEnd = strstr(data, "\r\n\r\n");
-      #if DEBUG
-      Serial.print(F("After Header: "));
-      Serial.println(headerEnd + 4);
-      #endif
-      if(SaveURL(headerEnd + 4))
-      {
-        sendData = const_cast<char*>(http_OK);
-        sz = sizeof(http_OK);
-        haveDNS = false;
-        #if DEBUG
-        Serial.println(F("Pending DNS"));
-        #endif
-        tree.setPattern(0,
-                        NeoPixelRing::SOLID,
-                        COLOR_GREEN,
-                        1000,
-                        0);
-        tree.setPattern(1,
-                        NeoPixelRing::SOLID,
-                        COLOR_GREEN,
-                        1000,
-                        0);
-        tree.setPattern(2,
-                        NeoPixelRing::PULSE,
-                        COLOR_YELLOW,
-                        1000,
-                        0);
-        tree.setPattern(3,
-                        NeoPixelRing::PULSE,
-                        COLOR_YELLOW,
-                        1000,
-                        0);
-        tree.setPattern(4,
-                        NeoPixelRing::SOLID,
-                        COLOR_RED,
-                        1000,
-                        0);
-      }
-      else if('\0' == *(headerEnd + 4))
-      {
-        // 2-part put message
-        #if DEBUG
-        Serial.println(F("Pending PUT"));
-        #endif
-        sendData = const_cast<char*>(http_OK);
-        sz = sizeof(http_OK);
-        pendingPut = true;
-      }
-      else
-      {
-        sendData = const_cast<char*>(http_BadRequest);
-        sz = sizeof(http_BadRequest);
-      }
-    }
-    else if(true == pendingPut)
-    {
-      pendingPut = false;
-
-      #if DEBUG
-      Serial.println(F("PUT pt2"));
-      Serial.println(data);
-      #endif
-      if(SaveURL(data))
-      {
-        sendData = const_cast<char*>(http_OK);
-        sz = sizeof(http_OK);
-        haveDNS = false;
-        #if DEBUG
-        Serial.println(F("Pending DNS"));
-        #endif
-        tree.setPattern(0,
-                        NeoPixelRing::SOLID,
-                        COLOR_GREEN,
-                        1000,
-                        0);
-        tree.setPattern(1,
-                        NeoPixelRing::SOLID,
-                        COLOR_GREEN,
-                        1000,
-                        0);
-        tree.setPattern(2,
-                        NeoPixelRing::PULSE,
-                        COLOR_YELLOW,
-                        1000,
-                        0);
-        tree.setPattern(3,
-                        NeoPixelRing::PULSE,
-                        COLOR_YELLOW,
-                        1000,
-                        0);
-        tree.setPattern(4,
-                        NeoPixelRing::SOLID,
-                        COLOR_RED,
-                        1000,
-                        0);
-      }
-      else
-      {
-        #if DEBUG
-        Serial.println(F("Not PUT pt2!"));
-        #endif
-        sendData = const_cast<char*>(http_Unauthorized);
-        if(sizeof(http_Unauthorized) < sz)
-        {
-          sz = sizeof(http_Unauthorized);
-        }
-      }
-    }
-    else
-    {
-      // Page not found
-      #if DEBUG
-      Serial.println(F("???:"));
-      Serial.println(data);
-      #endif
-      sendData = const_cast<char*>(http_Unauthorized);
-      if(sizeof(http_Unauthorized) < sz)
-      {
-        sz = sizeof(http_Unauthorized);
-      }
-    }
-
-    // Send http response
-    if(generalMemCopy)
-    {
-      memcpy_P(data, sendData, sz); // Copy data from flash to RAM
-    }
-    // ether.httpServerReply(sz-1);
-    ether.httpServerReply_with_flags(sz,TCP_FLAGS_ACK_V|TCP_FLAGS_PUSH_V);
-    ether.httpServerReply_with_flags(0,TCP_FLAGS_ACK_V|TCP_FLAGS_FIN_V);
-    startPoint = 0;
-  }
-
-  if( !haveDNS
-      && HaveURL()
-      && (millis() - lastDNSLookup) > DNS_RETRY_INTERVAL_MS
-      && ether.isLinkUp() )
+  configTask = tasks.add(ConfigTask, CONFIG_DEADLINE_US, CONFIG_BUDGET_US);
+  dnsTask = tasks.add(DnsTask, DNS_DEADLINE_US, DNS_BUDGET_US);
+  pollTask = tasks.add(PollTask, POLL_DEADLINE_US, POLL_BUDGET_US);
+  #if !STATIC
+  dhcpTask = tasks.add(DhcpTask, DHCP_DEADLINE_US, DHCP_BUDGET_US);
+  #endif
+#endif
+#if DEBUG
+  tasks.add(StatsTask, STATS_INTERVAL_MS * 1000UL, STATS_INTERVAL_MS * 1000UL);
+#endif
+#if FLEET_LEADER
+  tasks.add(BeaconTask, SYNC_BEACON_INTERVAL_MS * 1000UL, SYNC_BEACON_INTERVAL_MS * 1000UL);
+#endif
+#if PERF_COUNTERS && PERF_SERIAL_INTERVAL_MS
+  tasks.add(PerfTask, PERF_SERIAL_INTERVAL_MS * 1000UL, PERF_SERIAL_INTERVAL_MS * 1000UL);
+#endif
+#if STANDALONE
+  // The server address from before the reset is polled at once, while the
+  // DNS task looks it up again
+  if(HaveURL() && netCache.loadServer(config.getDomain(), ether.hisip))
   {
-    lastDNSLookup = millis();
-    LoadDomain(Ethernet::buffer+60);
-    if(!ether.dnsLookup(Ethernet::buffer+60,true))
-    {
-      #if DEBUG
-      Serial.println(F("DNS lookup failed"));
-      #endif
-    }
-    else
-    {
-      #if DEBUG
-      ether.printIp(F("Server: "), ether.hisip);
-      #endif
-      haveDNS = true;
-      tree.setPattern(0,
-                      NeoPixelRing::PULSE,
-                      COLOR_GREEN,
-                      1000,
-                      0);
-      tree.setPattern(1,
-                      NeoPixelRing::PULSE,
-                      COLOR_GREEN,
-                      1000,
-                      0);
-      tree.setPattern(2,
-                      NeoPixelRing::PULSE,
-                      COLOR_YELLOW,
-                      1000,
-                      0);
-      tree.setPattern(3,
-                      NeoPixelRing::PULSE,
-                      COLOR_YELLOW,
-                      1000,
-                      0);
-      tree.setPattern(4,
-                      NeoPixelRing::PULSE,
-                      COLOR_RED,
-                      1000,
-                      0);
-    }
+    ServerResolved();
   }
+#endif
+}
 
-  if( haveDNS
-      && HaveURL()
-      && (millis() - lastServerPoll) > SERVER_POLL_INTERVAL_MS )
+void loop()
+{
+  // Sleep until the next tick unless a task is due within it
+  if(!tasks.runNext() && tasks.usUntilNext() >= 1000)
   {
-    ether.clientTcpReq(ReceiveServerResponse, FillServerQuery, LoadPort());
-    updatePatterns(tree, buildStatus);
-    lastServerPoll = millis();
+    IdleUntilNextTick();
   }
-#endif
-
-  tree.update();
 }
@@ -0,0 +1,141 @@
+#include "LoopScheduler.h"
+
+LoopScheduler::LoopScheduler() :
+  numTasks(0),
+  frameTask(TASK_NONE)
+{
+}
+
+uint8_t LoopScheduler::add(TaskFunction fn,
+                           unsigned long deadline,
+                           unsigned long budget)
+{
+  if(numTasks >= TASK_MAX)
+  {
+    return TASK_NONE;
+  }
+  Task& task = tasks[numTasks];
+  task.fn = fn;
+  task.due = micros();
+  task.deadline = deadline;
+  task.budget = budget;
+  task.idle = false;
+  memset(&task.stats, 0, sizeof(task.stats));
+  return numTasks++;
+}
+
+void LoopScheduler::wake(uint8_t task, unsigned long delay)
+{
+  if(task >= numTasks)
+  {
+    return;
+  }
+  unsigned long due = micros() + delay;
+  // Signed difference so the comparison survives micros() wrapping
+  if(tasks[task].idle || (long)(due - tasks[task].due) < 0)
+  {
+    tasks[task].due = due;
+    tasks[task].idle = false;
+  }
+}
+
+bool LoopScheduler::Deferred(uint8_t task, unsigned long now) const
+{
+  if(TASK_NONE == frameTask || task == frameTask || tasks[frameTask].idle)
+  {
+    return false;
+  }
+  long untilFrame = (long)(tasks[frameTask].due - now);
+  if(untilFrame < 0 || (unsigned long)untilFrame >= tasks[task].budget)
+  {
+    // The frame is due already, and wins on its deadline, or there is room
+    return false;
+  }
+  // Past its own deadline the task goes anyway
+  return (long)(now - tasks[task].due) <= (long)tasks[task].deadline;
+}
+
+bool LoopScheduler::runNext()
+{
+  unsigned long now = micros();
+  uint8_t next = TASK_NONE;
+  long nextSlack = 0;
+  for(uint8_t i = 0; i < numTasks; i++)
+  {
+    const Task& task = tasks[i];
+    if(task.idle || (long)(now - task.due) < 0 || Deferred(i, now))
+    {
+      continue;
+    }
+    // Time left until the deadline; earliest deadline first
+    long slack = (long)(task.due + task.deadline - now);
+    if(TASK_NONE == next || slack < nextSlack)
+    {
+      next = i;
+      nextSlack = slack;
+    }
+  }
+  if(TASK_NONE == next)
+  {
+    return false;
+  }
+
+  Task& task = tasks[next];
+  if(nextSlack < 0)
+  {
+    task.stats.missed++;
+  }
+  // Idle while running, so a wake() from inside the task is not lost
+  task.idle = true;
+  unsigned long delay = task.fn(now);
+  unsigned long elapsed = micros() - now;
+  task.stats.runs++;
+  task.stats.totalUs += elapsed;
+  if(elapsed > task.stats.maxUs)
+  {
+    task.stats.maxUs = elapsed;
+  }
+
+  if(TASK_IDLE != delay)
+  {
+    // Keeps the earlier time if the task was woken while it ran
+    unsigned long due = now + delay;
+    if(task.idle || (long)(due - task.due) < 0)
+    {
+      task.due = due;
+    }
+    task.idle = false;
+  }
+  return true;
+}
+
+unsigned long LoopScheduler::usUntilNext() const
+{
+  unsigned long now = micros();
+  unsigned long soonest = TASK_IDLE;
+  for(uint8_t i = 0; i < numTasks; i++)
+  {
+    if(tasks[i].idle)
+    {
+      continue;
+    }
+    long remaining = (long)(tasks[i].due - now);
+    if(remaining <= 0)
+    {
+      return 0;
+    }
+    if((unsigned long)remaining < soonest)
+    {
+      soonest = remaining;
+    }
+  }
+  return soonest;
+}
+
+void LoopScheduler::resetStats()
+{
+  for(uint8_t i = 0; i < numTasks; i++)
+  {
+    memset(&tasks[i].stats, 0, sizeof(tasks[i].stats));
+  }
+}
@@ -0,0 +1,126 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file LoopScheduler.h
+///
+/// @brief Cooperative scheduler for the work done in loop().
+///
+/// Each task is a function that runs to completion and says how long it
+/// wants to wait before its next run.  runNext() runs one task per call:
+/// of the tasks that are due, the one whose deadline comes first.  A task's
+/// deadline is how long after becoming due it should start; starting later
+/// counts as a missed deadline.
+///
+/// One task can be given the frame: it is the render task, and no other
+/// task is started if its budget (the longest it is expected to run) would
+/// run past the frame's next due time.  A deferred task still starts once
+/// its own deadline has passed, so nothing starves, but the miss is counted
+/// against it rather than against the frame.
+///
+/// Times are in microseconds from micros().  Every task's runs, missed
+/// deadlines and execution time are recorded, to see where loop time goes.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef LOOPSCHEDULER_H
+#define LOOPSCHEDULER_H
+
+#include <Arduino.h>
+
+#define TASK_MAX 9                ///< Most tasks: all of the sketch's at once
+#define TASK_NONE 0xFF            ///< No task
+#define TASK_IDLE 0xFFFFFFFFUL    ///< Delay meaning "until woken"
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Body of a task.
+/// @param now micros() when the task was started.
+/// @return Microseconds until the task should run again, or TASK_IDLE to
+///         wait for wake().
+////////////////////////////////////////////////////////////////////////////////
+typedef unsigned long (*TaskFunction)(unsigned long now);
+
+class LoopScheduler
+{
+  public:
+    struct TaskStats
+    {
+      unsigned long runs;
+      unsigned long missed;   ///< Runs started after their deadline
+      unsigned long totalUs;  ///< Execution time of all runs
+      unsigned long maxUs;    ///< Longest run
+    };
+
+    LoopScheduler();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Adds a task, due immediately.
+    /// @param fn Task body.
+    /// @param deadline Microseconds after becoming due by which it should
+    ///                 start.
+    /// @param budget Longest the task is expected to run, in microseconds.
+    /// @return Task index, or TASK_NONE if TASK_MAX tasks exist already.
+    ////////////////////////////////////////////////////////////////////////////
+    uint8_t add(TaskFunction fn, unsigned long deadline, unsigned long budget);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Makes a task the render task, whose due time other tasks must
+    ///        not run into.
+    ////////////////////////////////////////////////////////////////////////////
+    void setFrameTask(uint8_t task)
+    {
+      frameTask = task;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Brings a task's next run forward.  Never delays a task that is
+    ///        due sooner already.
+    /// @param task Task index.
+    /// @param delay Microseconds from now.
+    ////////////////////////////////////////////////////////////////////////////
+    void wake(uint8_t task, unsigned long delay = 0);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Runs the most urgent task that is due.
+    /// @return True if a task ran.
+    ////////////////////////////////////////////////////////////////////////////
+    bool runNext();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Microseconds until a task is due; 0 if one is due now, or
+    ///        TASK_IDLE if every task waits to be woken.
+    ////////////////////////////////////////////////////////////////////////////
+    unsigned long usUntilNext() const;
+
+    uint8_t getNumTasks() const
+    {
+      return numTasks;
+    }
+
+    const TaskStats& getStats(uint8_t task) const
+    {
+      return tasks[task].stats;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Zeroes every task's statistics.
+    ////////////////////////////////////////////////////////////////////////////
+    void resetStats();
+
+  private:
+    struct Task
+    {
+      TaskFunction fn;
+      unsigned long due;       ///< micros() at which the task is due
+      unsigned long deadline;
+      unsigned long budget;
+      TaskStats stats;
+      bool idle;               ///< Waiting for wake()
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Whether a due task has to wait for the render task.
+    ////////////////////////////////////////////////////////////////////////////
+    bool Deferred(uint8_t task, unsigned long now) const;
+
+    Task tasks[TASK_MAX];
+    uint8_t numTasks;
+    uint8_t frameTask;         ///< Render task, or TASK_NONE
+};
+
+#endif // LOOPSCHEDULER_H
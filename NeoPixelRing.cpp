@@ -1,120 +1,881 @@
 #include "NeoPixelRing.h"
 
+// Lookup tables are computed by the compiler and kept in flash, so boot does
+// no floating point math and they cost no SRAM.  TABLE256 expands F(i) for
+// every i in 0-255.
+#define TABLE4(F, i)   F(i), F(i + 1), F(i + 2), F(i + 3)
+#define TABLE16(F, i)  TABLE4(F, i), TABLE4(F, i + 4), TABLE4(F, i + 8), TABLE4(F, i + 12)
+#define TABLE64(F, i)  TABLE16(F, i), TABLE16(F, i + 16), TABLE16(F, i + 32), TABLE16(F, i + 48)
+#define TABLE256(F)    TABLE64(F, 0), TABLE64(F, 64), TABLE64(F, 128), TABLE64(F, 192)
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Largest r in [lo, hi] with r * r <= n.
+////////////////////////////////////////////////////////////////////////////////
+static constexpr uint32_t ISqrt(uint64_t n, uint32_t lo = 0, uint32_t hi = 255)
+{
+  return (lo == hi) ? lo :
+         ((uint64_t)((lo + hi + 1) / 2) * ((lo + hi + 1) / 2) <= n) ?
+           ISqrt(n, (lo + hi + 1) / 2, hi) :
+           ISqrt(n, lo, (lo + hi + 1) / 2 - 1);
+}
+
+// Gamma correction for x is:
+// ( x / MAXVAL )^2.5 * MAXVAL
+// which is sqrt( x^5 / MAXVAL^3 ), rounded down like the float version was
+#define GAMMA_ENTRY(x) \
+  (uint8_t)ISqrt((uint64_t)(x) * (x) * (x) * (x) * (x) / (255ULL * 255 * 255))
+
+static const uint8_t GAMMA[256] PROGMEM = { TABLE256(GAMMA_ENTRY) };
+
+// Maximum saturation color wheel, adapted from Adafruit NeoPixel library
+// example code.  Colors are raw; ApplyTransfer() gamma corrects them.
+#define WHEEL_ENTRY(pos) \
+  { (uint8_t)((255 - (pos)) < 85 ? 255 - (255 - (pos)) * 3 : \
+              (255 - (pos)) < 170 ? 0 : (255 - (pos) - 170) * 3), \
+    (uint8_t)((255 - (pos)) < 85 ? 0 : \
+              (255 - (pos)) < 170 ? (255 - (pos) - 85) * 3 : 255 - (255 - (pos) - 170) * 3), \
+    (uint8_t)((255 - (pos)) < 85 ? (255 - (pos)) * 3 : \
+              (255 - (pos)) < 170 ? 255 - (255 - (pos) - 85) * 3 : 0) }
+
+static const uint8_t WHEEL[256][3] PROGMEM = { TABLE256(WHEEL_ENTRY) };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Linear fade of one 8-bit channel.  (range * (level + 1)) >> 8
+///        reaches the full range at level 255 with a single 8x8 multiply.
+////////////////////////////////////////////////////////////////////////////////
+static inline uint8_t FadeChannel(uint8_t off, uint8_t on, uint8_t level)
+{
+  if(on >= off)
+  {
+    uint8_t range = on - off;
+    return off + (((uint16_t)range * level + range) >> 8);
+  }
+  uint8_t range = off - on;
+  return off - (((uint16_t)range * level + range) >> 8);
+}
+
+// Pattern types.  Kernels draw raw colors into the strip buffer; the
+// transfer pass gamma corrects them and applies the brightness afterwards.
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Sets every LED to the ring color with one span fill.  Uses color.
+////////////////////////////////////////////////////////////////////////////////
+struct NeoPixelRing::Solid
+{
+  static const uint8_t ID = SOLID;
+  static const uint8_t FLAGS = 0;
+
+  template<typename Writer>
+  static void Draw(NeoPixelRing&, const Writer& writer, const PatternFrame& frame)
+  {
+    writer.Fill(frame.pixels, frame.ring.size, frame.ring.color);
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Fades every LED in to the ring color and out to off, together, so
+///        this is one span fill.  Uses color and period.
+////////////////////////////////////////////////////////////////////////////////
+struct NeoPixelRing::Pulse
+{
+  static const uint8_t ID = PULSE;
+  static const uint8_t FLAGS = PATTERN_ANIMATED | PATTERN_SMOOTH;
+
+  template<typename Writer>
+  static void Draw(NeoPixelRing& tree, const Writer& writer,
+                   const PatternFrame& frame)
+  {
+    const RingState& ring = frame.ring;
+    writer.Fill(frame.pixels, ring.size,
+                tree.PulseColor(ring.clock.Phase(), ring.color));
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Pulses the first param percent of the LEDs while maintaining the
+///        rest at a dim value.  Uses color, period and param (0-100).
+////////////////////////////////////////////////////////////////////////////////
+struct NeoPixelRing::Progress
+{
+  static const uint8_t ID = PROGRESS;
+  static const uint8_t FLAGS = PATTERN_ANIMATED | PATTERN_SMOOTH;
+
+  template<typename Writer>
+  static void Draw(NeoPixelRing& tree, const Writer& writer,
+                   const PatternFrame& frame)
+  {
+    const RingState& ring = frame.ring;
+    uint16_t numProgress = ring.size * ring.param;
+    numProgress /= 100;
+    if(numProgress > ring.size)
+    {
+      // param comes off the wire and may be over 100
+      numProgress = ring.size;
+    }
+    uint32_t minColor = DimColor(ring.color);
+    uint32_t pulseColor = tree.PulseColor(ring.clock.Phase(), ring.color,
+                                          minColor);
+    writer.Fill(frame.pixels, numProgress, pulseColor);
+    writer.Fill(frame.pixels + numProgress * writer.Bytes(),
+                ring.size - numProgress, minColor);
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Pulses the LEDs with a time offset from each other, creating a
+///        chase around the ring.  The clock's step spreads one period across
+///        the ring, so the pattern takes the period to go round.  Uses color
+///        and period.
+////////////////////////////////////////////////////////////////////////////////
+struct NeoPixelRing::Spin
+{
+  static const uint8_t ID = SPIN;
+  static const uint8_t FLAGS = PATTERN_ANIMATED | PATTERN_SMOOTH;
+
+  template<typename Writer>
+  static void Draw(NeoPixelRing& tree, const Writer& writer,
+                   const PatternFrame& frame)
+  {
+    const RingState& ring = frame.ring;
+    uint8_t* pixels = frame.pixels;
+    uint16_t phase = ring.clock.Phase();
+    for(uint8_t i = 0; i < ring.size; i++, pixels += writer.Bytes())
+    {
+      writer.Write(pixels, tree.PulseColor(phase, ring.color));
+      phase += ring.clock.step;
+    }
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Cycles the LEDs through maximum saturation rainbow colors.  The
+///        wheel position follows the tree-wide pixel index, so the rainbow
+///        is continuous across rings.  Uses period.
+////////////////////////////////////////////////////////////////////////////////
+struct NeoPixelRing::Rainbow
+{
+  static const uint8_t ID = RAINBOW;
+  static const uint8_t FLAGS = PATTERN_ANIMATED;
+
+  template<typename Writer>
+  static void Draw(NeoPixelRing& tree, const Writer& writer,
+                   const PatternFrame& frame)
+  {
+    uint8_t* pixels = frame.pixels;
+    uint8_t pos = (frame.ring.clock.Phase() >> 8) + frame.treeStart;
+    for(uint8_t i = 0; i < frame.ring.size; i++, pixels += writer.Bytes())
+    {
+      writer.Write(pixels, tree.Wheel(pos++));
+    }
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Runs the program from setProgram().  Uses color, period and param
+///        as the program reads them.
+////////////////////////////////////////////////////////////////////////////////
+struct NeoPixelRing::Program
+{
+  static const uint8_t ID = PROGRAM;
+  static const uint8_t FLAGS = PATTERN_ANIMATED | PATTERN_SMOOTH;
+
+  template<typename Writer>
+  static void Draw(NeoPixelRing& tree, const Writer& writer,
+                   const PatternFrame& frame)
+  {
+    tree.RunProgram(writer, frame);
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Sweeps a band of color up the tree over the first half of the wave
+///        and back down over the second.  LEDs below the band's edge are the
+///        color, those above are off, and those within WIPE_EDGE of it fade
+///        between the two.  Uses color and period.
+////////////////////////////////////////////////////////////////////////////////
+struct NeoPixelRing::Wipe
+{
+  static const uint8_t ID = WIPE;
+  static const uint8_t FLAGS = PATTERN_ANIMATED | PATTERN_SMOOTH |
+                               PATTERN_SPATIAL;
+
+  template<typename Writer>
+  static void Draw(NeoPixelRing& tree, const Writer& writer,
+                   const PatternFrame& frame)
+  {
+    const RingState& ring = frame.ring;
+    const SpatialPoint* points = tree.spatialMap + frame.treeStart;
+    uint8_t* pixels = frame.pixels;
+    // The edge rises from the bottom to WIPE_EDGE past the top, so the top
+    // pixels light fully
+    uint16_t phase = ring.clock.Phase();
+    uint16_t rise = ((phase & 0x8000) ? (uint16_t)~phase : phase) << 1;
+    int16_t edge = ((uint32_t)rise * (256 + WIPE_EDGE)) >> 16;
+    for(uint8_t i = 0; i < ring.size; i++, pixels += writer.Bytes())
+    {
+      int16_t depth = edge - tree.SpatialByte(&points[i].height);
+      if(depth <= 0)
+      {
+        writer.Write(pixels, 0);
+      }
+      else if(depth >= WIPE_EDGE)
+      {
+        writer.Write(pixels, ring.color);
+      }
+      else
+      {
+        // The rising half of PulseColor()'s wave is a plain fade
+        writer.Write(pixels, tree.PulseColor(depth * (0x8000 / WIPE_EDGE),
+                                             ring.color));
+      }
+    }
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Progress across the whole tree: pulses the LEDs in the bottom
+///        param percent of its height while maintaining the rest at a dim
+///        value.  Uses color, period and param (0-100).
+////////////////////////////////////////////////////////////////////////////////
+struct NeoPixelRing::Fill
+{
+  static const uint8_t ID = FILL;
+  static const uint8_t FLAGS = PATTERN_ANIMATED | PATTERN_SMOOTH |
+                               PATTERN_SPATIAL;
+
+  template<typename Writer>
+  static void Draw(NeoPixelRing& tree, const Writer& writer,
+                   const PatternFrame& frame)
+  {
+    const RingState& ring = frame.ring;
+    const SpatialPoint* points = tree.spatialMap + frame.treeStart;
+    uint8_t* pixels = frame.pixels;
+    uint16_t top = ((uint16_t)ring.param << 8) / 100;
+    uint32_t minColor = DimColor(ring.color);
+    uint32_t pulseColor = tree.PulseColor(ring.clock.Phase(), ring.color,
+                                          minColor);
+    for(uint8_t i = 0; i < ring.size; i++, pixels += writer.Bytes())
+    {
+      writer.Write(pixels, (tree.SpatialByte(&points[i].height) < top) ?
+                           pulseColor : minColor);
+    }
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Spin with each LED's offset taken from its angle and height, so
+///        the pulse winds param turns up the tree; 0 is a vertical stripe.
+///        One wave turns the spiral once.  Uses color, period and param.
+////////////////////////////////////////////////////////////////////////////////
+struct NeoPixelRing::Spiral
+{
+  static const uint8_t ID = SPIRAL;
+  static const uint8_t FLAGS = PATTERN_ANIMATED | PATTERN_SMOOTH |
+                               PATTERN_SPATIAL;
+
+  template<typename Writer>
+  static void Draw(NeoPixelRing& tree, const Writer& writer,
+                   const PatternFrame& frame)
+  {
+    const RingState& ring = frame.ring;
+    const SpatialPoint* points = tree.spatialMap + frame.treeStart;
+    uint8_t* pixels = frame.pixels;
+    uint16_t phase = ring.clock.Phase();
+    for(uint8_t i = 0; i < ring.size; i++, pixels += writer.Bytes())
+    {
+      // A height of 256 would wind param whole turns
+      uint8_t turn = tree.SpatialByte(&points[i].angle) +
+                     tree.SpatialByte(&points[i].height) * ring.param;
+      writer.Write(pixels, tree.PulseColor(phase + ((uint16_t)turn << 8),
+                                           ring.color));
+    }
+  }
+};
+
+struct NeoPixelRing::Off
+{
+  static const uint16_t ID = 0x100; ///< Not a Pattern value
+  static const uint8_t FLAGS = 0;
+
+  template<typename Writer>
+  static void Draw(NeoPixelRing&, const Writer& writer, const PatternFrame& frame)
+  {
+    writer.Fill(frame.pixels, frame.ring.size, 0);
+  }
+};
+
+// Pattern registry.  The types in NEOPIXELRING_PATTERNS are laid out by the
+// compiler into tables in flash indexed by Pattern value, so drawing a ring
+// is one table load and an indirect call however many patterns there are,
+// and a type left out of the list is never instantiated.
+
+template<bool Condition, typename IfTrue, typename IfFalse>
+struct SelectType
+{
+  typedef IfTrue type;
+};
+
+template<typename IfTrue, typename IfFalse>
+struct SelectType<false, IfTrue, IfFalse>
+{
+  typedef IfFalse type;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief The first of Patterns whose ID is Id, or Off.
+////////////////////////////////////////////////////////////////////////////////
+template<uint16_t Id, typename... Patterns>
+struct PatternWithId
+{
+  typedef NeoPixelRing::Off type;
+};
+
+template<uint16_t Id, typename First, typename... Rest>
+struct PatternWithId<Id, First, Rest...>
+{
+  typedef typename SelectType<First::ID == Id, First,
+                              typename PatternWithId<Id, Rest...>::type>::type type;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief One more than the largest ID among Patterns: the table length.
+////////////////////////////////////////////////////////////////////////////////
+template<typename... Patterns>
+struct PatternSlots
+{
+  static const uint16_t value = 0;
+};
+
+template<typename First, typename... Rest>
+struct PatternSlots<First, Rest...>
+{
+  static const uint16_t value = (First::ID + 1 > PatternSlots<Rest...>::value) ?
+                                First::ID + 1 : PatternSlots<Rest...>::value;
+};
+
+typedef MakeIndexList<PatternSlots<NEOPIXELRING_PATTERNS>::value>::type PatternValues;
+
+template<uint16_t... S, typename... Patterns>
+struct NeoPixelRing::PatternTraits<IndexList<S...>, Patterns...>
+{
+  static const uint8_t flags[sizeof...(S)];
+};
+
+template<uint16_t... S, typename... Patterns>
+const uint8_t NeoPixelRing::PatternTraits<IndexList<S...>, Patterns...>::flags[] PROGMEM = {
+  (uint8_t)(PatternWithId<S, Patterns...>::type::FLAGS |
+            ((PatternWithId<S, Patterns...>::type::ID == S) ? PATTERN_COMPILED : 0))...
+};
+
+template<typename Writer, uint16_t... S, typename... Patterns>
+struct NeoPixelRing::PatternKernels<Writer, IndexList<S...>, Patterns...>
+{
+  typedef void (*Kernel)(NeoPixelRing&, const Writer&, const PatternFrame&);
+  static const Kernel draw[sizeof...(S)];
+};
+
+template<typename Writer, uint16_t... S, typename... Patterns>
+const typename NeoPixelRing::PatternKernels<Writer, IndexList<S...>, Patterns...>::Kernel
+NeoPixelRing::PatternKernels<Writer, IndexList<S...>, Patterns...>::draw[] PROGMEM = {
+  &PatternWithId<S, Patterns...>::type::template Draw<Writer>...
+};
+
 NeoPixelRing::NeoPixelRing(uint8_t pinNum,
                            neoPixelType npType,
                            uint8_t nRings,
-                           const uint8_t* rings)
+                           const uint8_t* rings) :
+  NeoPixelRing(npType, nRings, rings, 1, &pinNum, &nRings)
+{
+}
+
+NeoPixelRing::NeoPixelRing(neoPixelType npType,
+                           uint8_t nRings,
+                           const uint8_t* rings,
+                           uint8_t nStrips,
+                           const uint8_t* pins,
+                           const uint8_t* stripRings) :
+  NeoPixelRing(npType, nRings, rings, nStrips, pins, stripRings,
+               NULL, NULL, NULL, NULL)
 {
+}
+
+NeoPixelRing::NeoPixelRing(neoPixelType npType,
+                           uint8_t nRings,
+                           const uint8_t* rings,
+                           uint8_t nStrips,
+                           const uint8_t* pins,
+                           const uint8_t* stripRings,
+                           RingState* ringStorage,
+                           Adafruit_NeoPixel* stripStorage,
+                           bool* stripChangedStorage,
+                           uint8_t* sparkleStorage)
+{
+  ownsStorage = (NULL == ringStorage);
   numRings = nRings;
-  ringSizes = new uint8_t [numRings];
+  numStrips = nStrips;
+  ringStates = ringStorage;
+  strips = stripStorage;
+  stripChanged = stripChangedStorage;
+  if(ownsStorage)
+  {
+    ringStates = new RingState [numRings];
+    strips = new Adafruit_NeoPixel [numStrips];
+    stripChanged = new bool [numStrips];
+  }
+
+  // Configure each strip in place.  Assigning a temporary Adafruit_NeoPixel
+  // would leave the strip pointing at the pixel buffer the temporary frees
+  // in its destructor.
+  totalPixels = 0;
+  uint8_t ring = 0;
+  for(uint8_t s = 0; s < numStrips; s++)
+  {
+    uint16_t stripLength = 0;
+    for(uint8_t r = 0; r < stripRings[s] && ring < numRings; r++, ring++)
+    {
+      ringStates[ring].size = rings[ring];
+      ringStates[ring].strip = s;
+      ringStates[ring].start = stripLength;
+      stripLength += rings[ring];
+    }
+    strips[s].updateType(npType);
+    strips[s].updateLength(stripLength);
+    strips[s].setPin(pins[s]);
+    stripChanged[s] = false;
+    totalPixels += stripLength;
+  }
+  // Rings beyond the last strip are never drawn
+  numRings = ring;
+
+  sparklePixels = sparkleStorage;
+  if(ownsStorage)
+  {
+    sparklePixels = new uint8_t [totalPixels];
+  }
+
+  condensedNow = 0;
+  uint16_t treeStart = 0;
   for(uint8_t i = 0; i < numRings; i++)
   {
-    ringSizes[i] = rings[i];
+    RingState& state = ringStates[i];
+    state.pattern = SOLID;
+    state.flags = PatternFlags(SOLID);
+    state.color = 0;
+    state.period = 2000;
+    state.param = 0;
+    state.clock.Reset(state.period, true, condensedNow);
+    state.clock.Spread(state.period, state.size);
+    state.fade = NULL;
+    state.sparkleCount = 0;
+    setSparkle(i, SPARKLE_DENSITY);
+    for(uint8_t p = 0; p < state.size; p++)
+    {
+      sparklePixels[treeStart + p] = p;
+    }
+    treeStart += state.size;
   }
-  uint8_t totalLength = 0;
+  // First update() draws every ring
+  MarkAllDirty();
+
+  flashEnabled = true;
+  crossfadeMs = 0;
+
+  runtimeWriter.SetType(npType);
+  bytesPerPixel = runtimeWriter.Bytes();
+  fixedOrder = (npType & 0xFF) == (NEOPIXELRING_WIRE_ORDER & 0xFF);
+
+  brightness = 255;
+#if PERF_COUNTERS
+  showMicros = 0;
+#endif
+  programLength = 0;
+  programUsesPos = false;
+  streaming = false;
+  spatialMap = NULL;
+  spatialInFlash = false;
+  ownsSpatialMap = false;
+}
+
+NeoPixelRing::~NeoPixelRing()
+{
+  // Crossfades are always allocated here, whoever owns the rest
   for(uint8_t i = 0; i < numRings; i++)
   {
-    totalLength += ringSizes[i];
+    if(ringStates[i].fade != NULL)
+      delete [] (uint8_t*)ringStates[i].fade;
+  }
+  if(ownsSpatialMap)
+    delete [] spatialMap;
+  if(!ownsStorage)
+    return;
+  if(strips!= NULL)
+    delete [] strips;
+  if(stripChanged!= NULL)
+    delete [] stripChanged;
+  if(ringStates!= NULL)
+    delete [] ringStates;
+  if(sparklePixels!= NULL)
+    delete [] sparklePixels;
+}
+
+void NeoPixelRing::begin()
+{
+  for(uint8_t s = 0; s < numStrips; s++)
+  {
+    strips[s].begin();
+  }
+}
+
+bool NeoPixelRing::update(unsigned long now)
+{
+  unsigned long elapsed;
+  if(!BeginFrame(now, elapsed))
+  {
+    return false;
+  }
+
+  bool rendered = false;
+  uint16_t treeStart = 0;
+  for(uint8_t i = 0; i < numRings; i++)
+  {
+    rendered |= RenderRing(ringStates[i], treeStart, elapsed);
+    treeStart += ringStates[i].size;
+  }
+
+  EndFrame();
+  return rendered;
+}
+
+bool NeoPixelRing::BeginFrame(unsigned long now, unsigned long& elapsed)
+{
+  unsigned long condensed = now / PERIODDIVISOR;
+  if((long)(condensed - condensedNow) < 0)
+  {
+    Rephase(condensed);
+  }
+  elapsed = condensed - condensedNow;
+  if(streaming)
+  {
+    // Keep the time base current so patterns resume in phase
+    condensedNow += elapsed;
+    for(uint8_t i = 0; i < numRings; i++)
+    {
+      ringStates[i].clock.Advance(elapsed);
+      ringStates[i].sparkleClock.Advance(elapsed);
+      if(ringStates[i].fade != NULL)
+      {
+        ringStates[i].fade->from.clock.Advance(elapsed);
+      }
+    }
+    return false;
+  }
+  if(0 == elapsed && !anyDirty)
+  {
+    // Every pattern is quantized to PERIODDIVISOR ms, so nothing can have
+    // changed since the last frame
+    return false;
+  }
+  condensedNow += elapsed;
+  return true;
+}
+
+void NeoPixelRing::Rephase(unsigned long condensed)
+{
+  // Reset() and Advance() keep every clock's tick equal to condensedNow
+  // modulo its cycle, so each clock only needs that worked out again
+  unsigned long back = condensedNow - condensed;
+  condensedNow = condensed;
+  for(uint8_t i = 0; i < numRings; i++)
+  {
+    RingState& ring = ringStates[i];
+    ring.clock.Rephase(condensed);
+    ring.sparkleClock.Rephase(condensed);
+    if(ring.fade != NULL)
+    {
+      ring.fade->from.clock.Rephase(condensed);
+      ring.fade->start -= back; // Keep the fade's progress
+    }
+  }
+  MarkAllDirty();
+}
+
+bool NeoPixelRing::RenderRing(RingState& ring, uint16_t treeStart,
+                              unsigned long elapsed)
+{
+  ring.clock.Advance(elapsed);
+  ring.sparkleClock.Advance(elapsed);
+
+  // Sparkles blend against the raw pattern colors and the transfer is
+  // applied to whole strips after them, so while the overlay is drawn every
+  // ring is redrawn
+  if(!flashEnabled &&
+     !ring.dirty &&
+     (elapsed == 0 ||
+      (!(ring.flags & PATTERN_ANIMATED) && NULL == ring.fade)))
+  {
+    return false;
+  }
+
+  uint8_t ringNum = &ring - ringStates;
+  DrawPattern(ring, ringNum, treeStart);
+  if(ring.fade != NULL)
+  {
+    DrawCrossfade(ring, ringNum, treeStart, elapsed);
+  }
+  if(!flashEnabled)
+  {
+    ApplyTransfer(strips[ring.strip], ring.start, ring.size);
   }
-  ringPatterns = new Pattern [numRings];
-  ringColors = new uint32_t [numRings];
-  ringPeriods = new uint16_t [numRings];
-  ringParams = new uint8_t [numRings];
+  ring.dirty = false;
+  stripChanged[ring.strip] = true;
+  return true;
+}
 
-  if(totalLength > 7)
+void NeoPixelRing::DrawPattern(const RingState& ring, uint8_t ringNum,
+                               uint16_t treeStart)
+{
+  if(fixedOrder)
   {
-    numFlash = totalLength >> 3; // Divide by 8
+    DrawPatternAs(PixelWriter<NEOPIXELRING_WIRE_ORDER>(), ring, ringNum,
+                  treeStart);
   }
   else
   {
-    numFlash = 1;
+    DrawPatternAs(runtimeWriter, ring, ringNum, treeStart);
   }
-  flashPixels = new uint8_t [numFlash];
+}
 
-  strip = Adafruit_NeoPixel(totalLength, pinNum, npType);
+template<typename Writer>
+void NeoPixelRing::DrawPatternAs(const Writer& writer, const RingState& ring,
+                                 uint8_t ringNum, uint16_t treeStart)
+{
+  typedef PatternKernels<Writer, PatternValues, NEOPIXELRING_PATTERNS> Kernels;
+  typename Kernels::Kernel draw = &Off::Draw<Writer>;
+  // Spatial patterns draw black if there was no memory for the map
+  if((ring.flags & PATTERN_COMPILED) &&
+     !((ring.flags & PATTERN_SPATIAL) && NULL == spatialMap))
+  {
+    draw = (typename Kernels::Kernel)pgm_read_ptr(&Kernels::draw[ring.pattern]);
+  }
+  PatternFrame frame = {
+    strips[ring.strip].getPixels() + ring.start * writer.Bytes(),
+    ring, ringNum, treeStart
+  };
+  draw(*this, writer, frame);
+}
 
-  // Gamma correction for x is:
-  // ( x / MAXVAL )^2.5 * MAXVAL
-  //
-  // Inverse gamma correction for x is:
-  // ( x / MAXVAL )^0.4 * MAXVAL
-  for(int i = 0; i < 256; i++)
+uint8_t NeoPixelRing::PatternFlags(uint8_t p)
+{
+  typedef PatternTraits<PatternValues, NEOPIXELRING_PATTERNS> Traits;
+  if(p >= sizeof(Traits::flags))
   {
-    float x = i;
-    x /= 255;
-    x = pow(x, 2.5);
-    x *= 255;
+    return 0;
+  }
+  return pgm_read_byte(&Traits::flags[p]);
+}
 
-    GAMMA[i] = x;
+bool NeoPixelRing::hasPattern(uint8_t p)
+{
+  return PatternFlags(p) & PATTERN_COMPILED;
+}
 
-    x = i;
-    x /= 255;
-    x = pow(x, 0.4);
-    x *= 255;
+void NeoPixelRing::StartCrossfade(RingState& ring)
+{
+  if(NULL == ring.fade)
+  {
+    // One block holds the fade and its pixels, so it costs one heap header
+    uint16_t bytes = ring.size * bytesPerPixel;
+    uint8_t* block = new uint8_t [sizeof(Crossfade) + bytes];
+    if(NULL == block)
+    {
+      return;
+    }
+    ring.fade = (Crossfade*)block;
+    ring.fade->pixels = block + sizeof(Crossfade);
+  }
+  // A fade cut short starts again from the pattern it was fading to
+  Crossfade& fade = *ring.fade;
+  fade.from = ring;
+  fade.start = condensedNow;
+  fade.length = crossfadeMs / PERIODDIVISOR;
+  if(0 == fade.length)
+  {
+    fade.length = 1;
+  }
+  fade.scale = (1UL << 24) / fade.length;
+}
 
-    GAMMA_INV[i] = round(x); // Round is more accurate than floor here
+void NeoPixelRing::DrawCrossfade(RingState& ring, uint8_t ringNum,
+                                 uint16_t treeStart, unsigned long elapsed)
+{
+  Crossfade& fade = *ring.fade;
+  fade.from.clock.Advance(elapsed);
+  unsigned long ticks = condensedNow - fade.start;
+  if(ticks >= fade.length)
+  {
+    // The strip already holds the new pattern alone
+    delete [] (uint8_t*)ring.fade;
+    ring.fade = NULL;
+    return;
+  }
+  uint8_t level = (ticks * fade.scale) >> 16;
+
+  // Move the new pattern to the layer, draw the old one in its place, then
+  // fade the old toward the new
+  uint8_t* pixels = strips[ring.strip].getPixels() + ring.start * bytesPerPixel;
+  uint16_t numBytes = ring.size * bytesPerPixel;
+  memcpy(fade.pixels, pixels, numBytes);
+  DrawPattern(fade.from, ringNum, treeStart);
+  for(uint16_t i = 0; i < numBytes; i++)
+  {
+    pixels[i] = FadeChannel(pixels[i], fade.pixels[i], level);
   }
 }
 
-NeoPixelRing::~NeoPixelRing()
+void NeoPixelRing::EndFrame()
 {
-  if(ringSizes!= NULL)
-    delete [] ringSizes;
-  if(ringPatterns!= NULL)
-    delete [] ringPatterns;
-  if(ringColors!= NULL)
-    delete [] ringColors;
-  if(ringPeriods!= NULL)
-    delete [] ringPeriods;
-  if(ringParams!= NULL)
-    delete [] ringParams;
-  if(flashPixels!= NULL)
-    delete [] flashPixels;
+  anyDirty = false;
+
+  if(flashEnabled)
+  {
+    DrawSparkles();
+    for(uint8_t s = 0; s < numStrips; s++)
+    {
+      ApplyTransfer(strips[s], 0, strips[s].numPixels());
+    }
+  }
+
+  ShowChanged();
 }
 
-void NeoPixelRing::begin()
+unsigned long NeoPixelRing::msUntilUpdate(unsigned long now) const
 {
-  strip.begin();
+  if(streaming)
+  {
+    return (unsigned long)-1;
+  }
+  if(anyDirty)
+  {
+    return 0;
+  }
+
+  bool animated = false;
+  for(uint8_t i = 0; i < numRings && !animated; i++)
+  {
+    animated = (ringStates[i].flags & PATTERN_ANIMATED) ||
+               (ringStates[i].fade != NULL) ||
+               (flashEnabled && ringStates[i].sparkleCount > 0);
+  }
+  if(!animated)
+  {
+    return (unsigned long)-1;
+  }
+
+  // Animated output changes at most once per PERIODDIVISOR ms
+  unsigned long nextChange = (condensedNow + 1) * PERIODDIVISOR;
+  if((long)(nextChange - now) <= 0 ||
+     nextChange - now > PERIODDIVISOR) // Time stepped back
+  {
+    return 0;
+  }
+  return nextChange - now;
 }
 
-void NeoPixelRing::update()
+void NeoPixelRing::enableFlash(bool enable)
 {
-  now = millis();
-  uint8_t start = 0;
-  for(uint8_t i = 0; i < numRings; i++)
+  if(enable != flashEnabled)
+  {
+    flashEnabled = enable;
+    MarkAllDirty();
+  }
+}
+
+void NeoPixelRing::setStreaming(bool enable)
+{
+  if(enable != streaming)
+  {
+    streaming = enable;
+    MarkAllDirty();
+  }
+}
+
+void NeoPixelRing::writePixels(uint16_t firstPixel, const uint8_t* rgb,
+                               uint16_t count)
+{
+  if(firstPixel >= totalPixels)
   {
-    uint8_t end = start + ringSizes[i] - 1;
-    switch(ringPatterns[i])
+    return;
+  }
+  if(count > totalPixels - firstPixel)
+  {
+    count = totalPixels - firstPixel;
+  }
+  uint16_t scale = (uint16_t)brightness + 1;
+  uint16_t pixel = firstPixel;
+  Adafruit_NeoPixel* strip = &PixelStrip(pixel);
+  uint8_t s = strip - strips;
+  while(count > 0)
+  {
+    // Write the run of pixels that lands on this strip
+    uint16_t run = strip->numPixels() - pixel;
+    if(run > count)
     {
-      case SOLID:
-        SetSolid(start, end, ringColors[i]);
-        break;
-      case PULSE:
-        SetPulse(start, end, ringColors[i], ringPeriods[i]);
-        break;
-      case PROGRESS:
-        SetProgress(start, end, ringColors[i], ringPeriods[i], ringParams[i]);
-        break;
-      case SPIN:
-        SetSpin(start, end, ringColors[i], ringPeriods[i]);
-        break;
-      case RAINBOW:
-        SetRainbow(start, end, ringPeriods[i]);
-        break;
-      default:
-        SetSolid(start, end, 0);
+      run = count;
+    }
+    for(uint16_t i = 0; i < run; i++, rgb += 3)
+    {
+      strip->setPixelColor(pixel + i,
+                           (pgm_read_byte(&GAMMA[rgb[0]]) * scale) >> 8,
+                           (pgm_read_byte(&GAMMA[rgb[1]]) * scale) >> 8,
+                           (pgm_read_byte(&GAMMA[rgb[2]]) * scale) >> 8);
     }
-    start += ringSizes[i];
+    stripChanged[s] = true;
+    count -= run;
+    pixel = 0;
+    strip++;
+    s++;
   }
+}
 
-  SetFlash();
+void NeoPixelRing::showPixels()
+{
+  ShowChanged();
+}
 
-  strip.show();
+void NeoPixelRing::ShowChanged()
+{
+#if PERF_COUNTERS
+  unsigned long start = micros();
+  bool shown = false;
+#endif
+  for(uint8_t s = 0; s < numStrips; s++)
+  {
+    if(stripChanged[s])
+    {
+      strips[s].show();
+      stripChanged[s] = false;
+#if PERF_COUNTERS
+      shown = true;
+#endif
+    }
+  }
+#if PERF_COUNTERS
+  if(shown)
+  {
+    showMicros = micros() - start;
+  }
+#endif
 }
 
 void NeoPixelRing::setBrightness(uint8_t b)
 {
-  strip.setBrightness(b);
+  // Brightness is applied by ApplyTransfer(), so the strip is left unscaled
+  // and its buffer holds exactly what was written to it
+  if(b != brightness)
+  {
+    brightness = b;
+    MarkAllDirty();
+  }
 }
 
 void NeoPixelRing::setPattern(uint8_t ringNum,
@@ -125,269 +886,601 @@ void NeoPixelRing::setPattern(uint8_t ringNum,
 {
   if(ringNum < numRings)
   {
-    ringPatterns[ringNum] = p;
-    ringColors[ringNum] = color;
-    ringPeriods[ringNum] = period;
-    ringParams[ringNum] = param;
+    RingState& ring = ringStates[ringNum];
+    // Status pollers resend the same pattern repeatedly; only real changes
+    // cost a redraw
+    if(ring.pattern == p &&
+       ring.color == color &&
+       ring.period == period &&
+       ring.param == param)
+    {
+      return;
+    }
+    if(crossfadeMs > 0 && !streaming)
+    {
+      StartCrossfade(ring);
+    }
+    ring.pattern = p;
+    ring.flags = PatternFlags(p);
+    ring.color = color;
+    ring.period = period;
+    ring.param = param;
+    ring.clock.Reset(period, ring.flags & PATTERN_SMOOTH, condensedNow);
+    ring.clock.Spread(period, ring.size);
+    if(ring.flags & PATTERN_SPATIAL)
+    {
+      buildSpatialMap();
+    }
+    MarkDirty(ringNum);
   }
 }
 
 void NeoPixelRing::setColor(uint8_t ringNum, uint32_t color)
 {
-  if(ringNum < numRings)
+  if(ringNum < numRings && ringStates[ringNum].color != color)
   {
-    ringColors[ringNum] = color;
+    ringStates[ringNum].color = color;
+    MarkDirty(ringNum);
   }
 }
 
 void NeoPixelRing::setPeriod(uint8_t ringNum, uint16_t period)
 {
-  if(ringNum < numRings)
+  if(ringNum < numRings && ringStates[ringNum].period != period)
   {
-    ringPeriods[ringNum] = period;
+    RingState& ring = ringStates[ringNum];
+    ring.period = period;
+    ring.clock.Reset(period, ring.flags & PATTERN_SMOOTH, condensedNow);
+    ring.clock.Spread(period, ring.size);
+    MarkDirty(ringNum);
   }
 }
 
 void NeoPixelRing::setParam(uint8_t ringNum, uint8_t param)
 {
-  if(ringNum < numRings)
+  if(ringNum < numRings && ringStates[ringNum].param != param)
   {
-    ringParams[ringNum] = param;
+    ringStates[ringNum].param = param;
+    MarkDirty(ringNum);
   }
 }
 
-void NeoPixelRing::SetSolid(uint8_t startPixel,
-                            uint8_t endPixel,
-                            uint32_t color)
+void NeoPixelRing::setSparkle(uint8_t ringNum, uint8_t density,
+                              uint32_t color, uint16_t period)
 {
-  for(uint8_t i = startPixel; i <= endPixel; i++)
+  if(ringNum >= numRings)
   {
-    strip.setPixelColor(i, GammaColor(color));
+    return;
   }
+  RingState& ring = ringStates[ringNum];
+  uint8_t count = ((uint16_t)ring.size * density) >> 8;
+  if(count != ring.sparkleCount)
+  {
+    ring.sparkleCount = count;
+    ring.sparkleShuffle = true;
+  }
+  ring.sparkleColor = color;
+  // Each sparkle rises for half the period and falls for the other half
+  ring.sparkleClock.Reset(period / 2, true, condensedNow);
+  ring.sparkleClock.Spread(period, count);
+  MarkDirty(ringNum);
 }
 
-void NeoPixelRing::SetPulse(uint8_t startPixel, uint8_t endPixel,
-                            uint32_t color, uint16_t period)
+bool NeoPixelRing::setProgram(const uint8_t* code, uint8_t length)
 {
-  uint32_t pulseColor = CalcPulseColor(color, period, true);
-  for(uint8_t i = startPixel; i <= endPixel; i++)
+  if(!ValidateProgram(code, length))
+  {
+    return false;
+  }
+  memcpy(program, code, length);
+  programLength = length;
+  programUsesPos = (memchr(program, OP_POS, programLength) != NULL);
+  if(memchr(program, OP_HEIGHT, programLength) != NULL ||
+     memchr(program, OP_ANGLE, programLength) != NULL ||
+     memchr(program, OP_RADIUS, programLength) != NULL)
+  {
+    buildSpatialMap();
+  }
+  for(uint8_t i = 0; i < numRings; i++)
   {
-    strip.setPixelColor(i, GammaColor(pulseColor));
+    if(ringStates[i].pattern == PROGRAM)
+    {
+      MarkDirty(i);
+    }
   }
+  return true;
 }
 
-void NeoPixelRing::SetProgress(uint8_t startPixel, uint8_t endPixel,
-                              uint32_t color, uint16_t period, uint8_t param)
+bool NeoPixelRing::buildSpatialMap()
 {
-  uint8_t length = endPixel - startPixel + 1;
-  uint16_t numProgress = length * param;
-  numProgress /= 100;
-  numProgress += startPixel;
-  uint8_t minRed = ((color >> 16) & 0xFF) / 4;
-  uint8_t minGreen = ((color >> 8) & 0xFF) / 4;
-  uint8_t minBlue = (color & 0xFF) / 4;
-  uint32_t minColor = strip.Color(minRed, minGreen, minBlue);
-  uint32_t pulseColor = CalcPulseColor(color, period, true, minColor);
-  for(uint8_t i = startPixel; i < numProgress; i++)
+  if(spatialMap != NULL)
   {
-    strip.setPixelColor(i, GammaColor(pulseColor));
+    return true;
   }
-  for(uint8_t i = numProgress; i <= endPixel; i++)
+  SpatialPoint* points = new SpatialPoint [totalPixels];
+  if(NULL == points)
   {
-    strip.setPixelColor(i, GammaColor(minColor));
+    return false;
   }
+  uint8_t largest = 0;
+  for(uint8_t r = 0; r < numRings; r++)
+  {
+    if(ringStates[r].size > largest)
+    {
+      largest = ringStates[r].size;
+    }
+  }
+  uint16_t pixel = 0;
+  for(uint8_t r = 0; r < numRings; r++)
+  {
+    for(uint8_t i = 0; i < ringStates[r].size; i++)
+    {
+      points[pixel++] = SpatialPointOf(r, i, numRings, ringStates[r].size,
+                                       largest);
+    }
+  }
+  spatialMap = points;
+  spatialInFlash = false;
+  ownsSpatialMap = true;
+  return true;
 }
 
-void NeoPixelRing::SetSpin(uint8_t startPixel, uint8_t endPixel,
-                           uint32_t color, uint16_t period)
+void NeoPixelRing::MarkDirty(uint8_t ringNum)
 {
-  uint8_t length = endPixel - startPixel + 1;
-  uint16_t offsetPerPixel = period / length;
-  for(uint8_t i = startPixel; i <= endPixel; i++)
-  {
-    uint16_t offset = offsetPerPixel * (i - startPixel);
-    uint32_t pixelColor = CalcPulseColor(color, period, true, 0, offset);
-    strip.setPixelColor(i, GammaColor(pixelColor));
-  }
+  ringStates[ringNum].dirty = true;
+  anyDirty = true;
 }
 
-void NeoPixelRing::SetRainbow(uint8_t startPixel, uint8_t endPixel,
-                              uint16_t period)
+void NeoPixelRing::MarkAllDirty()
 {
-  period /= PERIODDIVISOR;
-  unsigned long condensedNow = now / PERIODDIVISOR;
-  uint16_t curPhase = condensedNow % period;
-  uint32_t pos = 255 * curPhase;
-  pos /= period;
-  for(uint8_t i = startPixel; i <= endPixel; i++)
+  for(uint8_t i = 0; i < numRings; i++)
   {
-    strip.setPixelColor(i, GammaColor(Wheel(i+pos)));
+    ringStates[i].dirty = true;
   }
+  anyDirty = true;
 }
 
-void NeoPixelRing::SetFlash()
+template<typename Writer>
+void NeoPixelRing::RunProgram(const Writer& writer, const PatternFrame& frame)
 {
-  static bool first = true;
-  static uint8_t lastUpdate = 0;
-  if(first)
+  const RingState& ring = frame.ring;
+  uint8_t* pixels = frame.pixels;
+  uint16_t time = ring.clock.Phase();
+  uint16_t spread = 0;
+  uint16_t pos = 0;
+  uint16_t posStep = 0;
+  if(programUsesPos)
   {
-    // On first update, generate all flashing pixels
-    GenFlash();
-    first = false;
+    posStep = 0x10000UL / ring.size;
   }
-  if((now - flashStart) >= FLASH_PERIOD)
+  const SpatialPoint* points = NULL;
+  if(spatialMap != NULL)
   {
-    // Start of period may have been in the past
-    flashStart = now - (now % FLASH_PERIOD);
-    GenFlash(0);
-    lastUpdate = numFlash;
+    points = spatialMap + frame.treeStart;
   }
+  uint8_t colorRed = ring.color >> 16;
+  uint8_t colorGreen = ring.color >> 8;
+  uint8_t colorBlue = ring.color;
 
-  uint16_t offsetPerPixel = FLASH_PERIOD/numFlash;
-
-  for(int16_t i = numFlash-1; i >= 0; i--)
+  uint16_t stack[PROGRAM_MAX_STACK];
+  for(uint16_t index = 0; index < ring.size; index++, pixels += writer.Bytes())
   {
-    uint16_t curOffset = offsetPerPixel * i;
-
-    if( (now-flashStart) > (FLASH_PERIOD - curOffset) &&
-        lastUpdate == (uint8_t)(i + 1) )
+    // Programs were validated when set, so the stack cannot under or
+    // overflow and every immediate is present
+    uint8_t sp = 0;
+    uint32_t out = 0;
+    for(uint8_t pc = 0; pc < programLength; pc++)
     {
-      GenFlash(i);
-      lastUpdate = i;
+      uint16_t b;
+      switch(program[pc])
+      {
+        case OP_PUSH8:
+          stack[sp++] = program[++pc];
+          break;
+        case OP_PUSH16:
+          stack[sp++] = ((uint16_t)program[pc + 1] << 8) | program[pc + 2];
+          pc += 2;
+          break;
+        case OP_TIME:
+          stack[sp++] = time;
+          break;
+        case OP_SPREAD:
+          stack[sp++] = spread;
+          break;
+        case OP_POS:
+          stack[sp++] = pos;
+          break;
+        case OP_INDEX:
+          stack[sp++] = index;
+          break;
+        case OP_PIXEL:
+          stack[sp++] = frame.treeStart + index;
+          break;
+        case OP_RING:
+          stack[sp++] = frame.ringNum;
+          break;
+        case OP_PARAM:
+          stack[sp++] = ring.param;
+          break;
+        case OP_HEIGHT:
+          stack[sp++] = points ? SpatialByte(&points[index].height) << 8 : 0;
+          break;
+        case OP_ANGLE:
+          stack[sp++] = points ? SpatialByte(&points[index].angle) << 8 : 0;
+          break;
+        case OP_RADIUS:
+          stack[sp++] = points ? SpatialByte(&points[index].radius) << 8 : 0;
+          break;
+        case OP_ADD:
+          b = stack[--sp];
+          stack[sp - 1] += b;
+          break;
+        case OP_SUB:
+          b = stack[--sp];
+          stack[sp - 1] -= b;
+          break;
+        case OP_MUL:
+          b = stack[--sp];
+          stack[sp - 1] = ((uint32_t)stack[sp - 1] * b) >> 16;
+          break;
+        case OP_AND:
+          b = stack[--sp];
+          stack[sp - 1] &= b;
+          break;
+        case OP_OR:
+          b = stack[--sp];
+          stack[sp - 1] |= b;
+          break;
+        case OP_XOR:
+          b = stack[--sp];
+          stack[sp - 1] ^= b;
+          break;
+        case OP_MIN:
+          b = stack[--sp];
+          if(b < stack[sp - 1])
+          {
+            stack[sp - 1] = b;
+          }
+          break;
+        case OP_MAX:
+          b = stack[--sp];
+          if(b > stack[sp - 1])
+          {
+            stack[sp - 1] = b;
+          }
+          break;
+        case OP_LT:
+          b = stack[--sp];
+          stack[sp - 1] = (stack[sp - 1] < b) ? 0xFFFF : 0;
+          break;
+        case OP_SHL:
+          stack[sp - 1] <<= program[++pc];
+          break;
+        case OP_SHR:
+          stack[sp - 1] >>= program[++pc];
+          break;
+        case OP_TRI:
+          b = stack[sp - 1];
+          stack[sp - 1] = ((b & 0x8000) ? (uint16_t)~b : b) << 1;
+          break;
+        case OP_NOT:
+          stack[sp - 1] = ~stack[sp - 1];
+          break;
+        case OP_DUP:
+          stack[sp] = stack[sp - 1];
+          sp++;
+          break;
+        case OP_SWAP:
+          b = stack[sp - 1];
+          stack[sp - 1] = stack[sp - 2];
+          stack[sp - 2] = b;
+          break;
+        case OP_DROP:
+          sp--;
+          break;
+        case OP_SEL:
+          sp -= 2;
+          stack[sp - 1] = stack[sp - 1] ? stack[sp] : stack[sp + 1];
+          break;
+        case OP_FADE:
+        {
+          uint8_t level = stack[--sp] >> 8;
+          out = Adafruit_NeoPixel::Color(FadeChannel(0, colorRed, level),
+                                         FadeChannel(0, colorGreen, level),
+                                         FadeChannel(0, colorBlue, level));
+          break;
+        }
+        case OP_WHEEL:
+          out = Wheel(stack[--sp] >> 8);
+          break;
+        case OP_RGB:
+          sp -= 3;
+          out = Adafruit_NeoPixel::Color(stack[sp] >> 8,
+                                         stack[sp + 1] >> 8,
+                                         stack[sp + 2] >> 8);
+          break;
+      }
     }
-
-    uint32_t flashColor = CalcPulseColor(FLASH_COLOR,
-                                         FLASH_PERIOD/2,
-                                         true,
-                                         GammaInvColor(strip.getPixelColor(flashPixels[i])),
-                                         curOffset);
-
-    strip.setPixelColor(flashPixels[i], GammaColor(flashColor));
+    writer.Write(pixels, out);
+    spread += ring.clock.step;
+    pos += posStep;
   }
 }
 
-void NeoPixelRing::GenFlash(uint8_t index)
+bool NeoPixelRing::ValidateProgram(const uint8_t* code, uint8_t length)
 {
-  int curIndex = 0;
-  uint8_t flashCheck = 0;
-  uint8_t numPixels = strip.numPixels();
-  if(index < numFlash)
+  if(length > PROGRAM_MAX_LENGTH)
   {
-    curIndex = index;
+    return false;
   }
-  while(curIndex < numFlash &&
-        curIndex <= index)
+  uint8_t depth = 0;
+  uint8_t cost = 0;
+  for(uint8_t pc = 0; pc < length; pc++)
   {
-    // Don't flash the last pixel (tip of cone)
-    if(numPixels > 1)
+    uint8_t pops = 0;
+    uint8_t pushes = 0;
+    uint8_t immediates = 0;
+    uint8_t opCost = 1;
+    switch(code[pc])
+    {
+      case OP_PUSH8:
+        pushes = 1;
+        immediates = 1;
+        break;
+      case OP_PUSH16:
+        pushes = 1;
+        immediates = 2;
+        break;
+      case OP_TIME:
+      case OP_SPREAD:
+      case OP_POS:
+      case OP_INDEX:
+      case OP_PIXEL:
+      case OP_RING:
+      case OP_PARAM:
+      case OP_HEIGHT:
+      case OP_ANGLE:
+      case OP_RADIUS:
+        pushes = 1;
+        break;
+      case OP_MUL:
+        opCost = 3;
+        // Fall through
+      case OP_ADD:
+      case OP_SUB:
+      case OP_AND:
+      case OP_OR:
+      case OP_XOR:
+      case OP_MIN:
+      case OP_MAX:
+      case OP_LT:
+        pops = 2;
+        pushes = 1;
+        break;
+      case OP_SHL:
+      case OP_SHR:
+        if(pc + 1 < length && code[pc + 1] > 15)
+        {
+          return false;
+        }
+        pops = 1;
+        pushes = 1;
+        immediates = 1;
+        break;
+      case OP_TRI:
+      case OP_NOT:
+        pops = 1;
+        pushes = 1;
+        break;
+      case OP_DUP:
+        pops = 1;
+        pushes = 2;
+        break;
+      case OP_SWAP:
+        pops = 2;
+        pushes = 2;
+        break;
+      case OP_DROP:
+      case OP_FADE:
+      case OP_WHEEL:
+        pops = 1;
+        break;
+      case OP_SEL:
+        pops = 3;
+        pushes = 1;
+        break;
+      case OP_RGB:
+        pops = 3;
+        break;
+      default:
+        return false;
+    }
+    if(depth < pops ||
+       depth - pops + pushes > PROGRAM_MAX_STACK ||
+       pc + immediates >= length)
     {
-      flashCheck = random(numPixels-1);
+      return false;
     }
-    else
+    depth = depth - pops + pushes;
+    cost += opCost;
+    if(cost > PROGRAM_MAX_COST)
     {
-      flashCheck = 0;
+      return false;
     }
+    pc += immediates;
+  }
+  return true;
+}
 
-    bool repeat = false;
-    // Check if pixel has already been selected
-    // If regenerating all, only check up to current index
-    // If regenerating one pixel, check all values
-    int checkIndex = curIndex;
-    if(index < numFlash)
+void NeoPixelRing::DrawSparkles()
+{
+  if(fixedOrder)
+  {
+    DrawSparklesAs(PixelWriter<NEOPIXELRING_WIRE_ORDER>());
+  }
+  else
+  {
+    DrawSparklesAs(runtimeWriter);
+  }
+}
+
+template<typename Writer>
+void NeoPixelRing::DrawSparklesAs(const Writer& writer)
+{
+  uint16_t treeStart = 0;
+  // Rings with the same period would otherwise light their first sparkles
+  // together; 0x9E37 is 65536 over the golden ratio
+  uint16_t ringOffset = 0;
+  for(uint8_t r = 0; r < numRings; r++, ringOffset += 0x9E37)
+  {
+    RingState& ring = ringStates[r];
+    uint8_t* pixels = sparklePixels + treeStart;
+    treeStart += ring.size;
+    if(0 == ring.sparkleCount)
     {
-      checkIndex = numFlash;
+      continue;
     }
-    for(int i = 0; i < checkIndex; i++)
+
+    uint16_t phase = ring.sparkleClock.Phase() + ringOffset;
+    if(ring.sparkleShuffle)
     {
-      if(flashPixels[i] == flashCheck &&
-         i != index)
-      {
-        repeat = true;
-        break;
-      }
+      ShuffleSparkles(ring, pixels);
+      ring.sparkleShuffle = false;
+      ring.sparklePhase = phase;
     }
+    uint16_t lastPhase = ring.sparklePhase;
+    ring.sparklePhase = phase;
 
-    // If repeated, get a new pixel index
-    if(repeat)
+    uint8_t* ringPixels = strips[ring.strip].getPixels() +
+                          ring.start * writer.Bytes();
+    uint8_t poolSize = ring.size - ring.sparkleCount;
+    uint16_t step = ring.sparkleClock.step;
+    for(uint8_t i = 0; i < ring.sparkleCount; i++, phase += step, lastPhase += step)
     {
-      continue;
+      // A sparkle whose phase wrapped since the last frame has just faded
+      // out, so its pixel can be swapped for one from the pool unseen
+      if(phase < lastPhase && poolSize > 0)
+      {
+        uint8_t j = ring.sparkleCount + random(poolSize);
+        uint8_t swap = pixels[i];
+        pixels[i] = pixels[j];
+        pixels[j] = swap;
+      }
+
+      // The strip still holds the raw pattern color at this point, so the
+      // sparkle fades from exactly what the pattern produced
+      uint8_t* pixel = ringPixels + pixels[i] * writer.Bytes();
+      writer.Write(pixel, PulseColor(phase, ring.sparkleColor,
+                                     writer.Read(pixel)));
     }
+  }
+}
 
-    // Save pixel index
-    flashPixels[curIndex] = flashCheck;
-    curIndex++;
+void NeoPixelRing::ShuffleSparkles(const RingState& ring, uint8_t* pixels)
+{
+  for(uint8_t i = 0; i < ring.sparkleCount; i++)
+  {
+    uint8_t j = i + random(ring.size - i);
+    uint8_t swap = pixels[i];
+    pixels[i] = pixels[j];
+    pixels[j] = swap;
   }
 }
 
-uint32_t NeoPixelRing::CalcPulseColor(uint32_t color, uint16_t period, bool smooth,
-                                      uint32_t offColor, uint16_t offset)
+void NeoPixelRing::PhaseClock::Reset(uint16_t period, bool smooth,
+                                     unsigned long condensedNow)
 {
-  bool invert = false;
-  period /= PERIODDIVISOR;
-  offset /= PERIODDIVISOR;
-  unsigned long condensedNow = now / PERIODDIVISOR;
-  if(smooth)
+  uint16_t condensedPeriod = period / PERIODDIVISOR;
+  if(condensedPeriod == 0)
   {
-    invert = ((condensedNow + offset) % (2 * period)) !=
-             ((condensedNow + offset) % period);
+    condensedPeriod = 1;
   }
-  uint16_t curPhase = ((condensedNow + offset) % period);
-  if(invert)
+  // A smooth wave fades 'off' to 'on' and back, so one wave is two periods
+  cycle = smooth ? 2 * condensedPeriod : condensedPeriod;
+  scale = (1UL << 24) / cycle;
+  tick = condensedNow % cycle;
+  step = 0;
+}
+
+void NeoPixelRing::PhaseClock::Spread(uint16_t span, uint16_t count)
+{
+  if(count == 0)
   {
-    curPhase = period - curPhase;
+    count = 1;
   }
-  uint16_t redRange = ((color >> 16) & 0xFF) - ((offColor >> 16) & 0xFF);
-  uint32_t red = curPhase * redRange;
-  red /= period;
-  red += ((offColor >> 16) & 0xFF);
-  uint16_t greenRange = ((color >> 8) & 0xFF) - ((offColor >> 8) & 0xFF);
-  uint32_t green = curPhase * greenRange;
-  green /= period;
-  green += ((offColor >> 8) & 0xFF);
-  uint16_t blueRange = (color & 0xFF) - (offColor & 0xFF);
-  uint32_t blue = curPhase * blueRange;
-  blue /= period;
-  blue += (offColor & 0xFF);
-  return strip.Color(red,green,blue);
+  // (span / count) ms per pixel is (span / count) / PERIODDIVISOR ticks.
+  // Wrapping past 65536 is harmless because phase is modulo one wave.
+  step = ((uint32_t)(span / count) * scale) / (256 * PERIODDIVISOR);
 }
 
-uint32_t NeoPixelRing::Wheel(uint8_t WheelPos) {
-  WheelPos = 255 - WheelPos;
-  if(WheelPos < 85) {
-    return strip.Color(255 - WheelPos * 3, 0, WheelPos * 3);
+void NeoPixelRing::PhaseClock::Advance(unsigned long elapsed)
+{
+  if(elapsed >= cycle)
+  {
+    // Only after a stall longer than a whole wave
+    elapsed %= cycle;
   }
-  if(WheelPos < 170) {
-    WheelPos -= 85;
-    return strip.Color(0, WheelPos * 3, 255 - WheelPos * 3);
+  tick += elapsed;
+  if(tick >= cycle)
+  {
+    tick -= cycle;
   }
-  WheelPos -= 170;
-  return strip.Color(WheelPos * 3, 255 - WheelPos * 3, 0);
 }
 
-uint32_t NeoPixelRing::GammaColor(uint32_t color)
+Adafruit_NeoPixel& NeoPixelRing::PixelStrip(uint16_t& pixel)
+{
+  uint8_t s = 0;
+  while(s < numStrips - 1 && pixel >= strips[s].numPixels())
+  {
+    pixel -= strips[s].numPixels();
+    s++;
+  }
+  return strips[s];
+}
+
+uint32_t NeoPixelRing::PulseColor(uint16_t phase, uint32_t color,
+                                  uint32_t offColor)
+{
+  // Triangle wave: rise over the first half of the phase, fall over the second
+  uint8_t level = (phase & 0x8000) ? (uint16_t)~phase >> 7 : phase >> 7;
+
+  return Adafruit_NeoPixel::Color(FadeChannel(offColor >> 16, color >> 16, level),
+                     FadeChannel(offColor >> 8, color >> 8, level),
+                     FadeChannel(offColor, color, level));
+}
+
+uint32_t NeoPixelRing::DimColor(uint32_t color)
+{
+  return Adafruit_NeoPixel::Color(((color >> 16) & 0xFF) / 4,
+                                  ((color >> 8) & 0xFF) / 4,
+                                  (color & 0xFF) / 4);
+}
+
+uint32_t NeoPixelRing::Wheel(uint8_t pos)
 {
-  uint8_t red = (color >> 16) & 0xFF;
-  red = GAMMA[red];
-  uint8_t green = (color >> 8) & 0xFF;
-  green = GAMMA[green];
-  uint8_t blue = color & 0xFF;
-  blue = GAMMA[blue];
-  uint32_t outColor = ((uint32_t)red   << 16) |
-                      ((uint32_t)green << 8)  |
-                      ((uint32_t)blue);
-  return outColor;
+  const uint8_t* entry = WHEEL[pos];
+  return Adafruit_NeoPixel::Color(pgm_read_byte(&entry[0]),
+                                  pgm_read_byte(&entry[1]),
+                                  pgm_read_byte(&entry[2]));
 }
 
-uint32_t NeoPixelRing::GammaInvColor(uint32_t color)
+void NeoPixelRing::ApplyTransfer(Adafruit_NeoPixel& strip,
+                                 uint16_t startPixel, uint16_t numPixels)
 {
-  uint8_t red = (color >> 16) & 0xFF;
-  red = GAMMA_INV[red];
-  uint8_t green = (color >> 8) & 0xFF;
-  green = GAMMA_INV[green];
-  uint8_t blue = color & 0xFF;
-  blue = GAMMA_INV[blue];
-  uint32_t outColor = ((uint32_t)red   << 16) |
-                      ((uint32_t)green << 8)  |
-                      ((uint32_t)blue);
-  return outColor;
+  uint8_t* pixels = strip.getPixels() + startPixel * bytesPerPixel;
+  uint16_t numBytes = numPixels * bytesPerPixel;
+  if(255 == brightness)
+  {
+    for(uint16_t i = 0; i < numBytes; i++)
+    {
+      pixels[i] = pgm_read_byte(&GAMMA[pixels[i]]);
+    }
+    return;
+  }
+  // Same scaling the NeoPixel library applies per pixel: (x * (b + 1)) >> 8
+  uint16_t scale = (uint16_t)brightness + 1;
+  for(uint16_t i = 0; i < numBytes; i++)
+  {
+    pixels[i] = (pgm_read_byte(&GAMMA[pixels[i]]) * scale) >> 8;
+  }
 }
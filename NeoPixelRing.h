@@ -1,22 +1,115 @@
+#ifndef NEOPIXELRING_H
+#define NEOPIXELRING_H
+
 #include <Arduino.h>
 #include <Adafruit_NeoPixel.h>
+#include "PatternProgram.h"
+#include "PixelWriter.h"
+#include "SpatialMap.h"
+#include "PerfCounters.h"
 
 #define PERIODDIVISOR 16
 
+// Height, out of 256, over which the edge of WIPE fades in
+#define WIPE_EDGE 32
+
+// Pattern traits, declared by each pattern type (see NeoPixelRing::Solid)
+#define PATTERN_ANIMATED 0x01 ///< Output changes with time
+#define PATTERN_SMOOTH 0x02   ///< The clock's wave lasts two periods
+#define PATTERN_SPATIAL 0x04  ///< Drawn from the spatial map
+#define PATTERN_COMPILED 0x80 ///< Added to every pattern compiled in
+
+// Pattern types compiled in.  Patterns left out draw black and their
+// kernels cost no flash; a tree that only shows build status with
+// updatePatterns() can build with
+//   -DNEOPIXELRING_PATTERNS="NeoPixelRing::Solid,NeoPixelRing::Pulse,NeoPixelRing::Spin"
+#ifndef NEOPIXELRING_PATTERNS
+  #define NEOPIXELRING_PATTERNS \
+    NeoPixelRing::Solid, NeoPixelRing::Pulse, NeoPixelRing::Progress, \
+    NeoPixelRing::Spin, NeoPixelRing::Rainbow, NeoPixelRing::Program, \
+    NeoPixelRing::Wipe, NeoPixelRing::Fill, NeoPixelRing::Spiral
+#endif
+
+// Sparkle settings every ring starts with; see setSparkle()
+#define SPARKLE_DENSITY 32        ///< One pixel in eight
+#define SPARKLE_COLOR 0xFFFF00UL
+#define SPARKLE_PERIOD 4000       ///< Milliseconds
+
 class NeoPixelRing
 {
   public:
+    // Values selecting each pattern type below, as sent by the control
+    // protocols
     enum Pattern
     {
       SOLID = 0,
       PULSE = 1,
       PROGRESS = 2,
       SPIN = 3,
-      RAINBOW = 4
+      RAINBOW = 4,
+      PROGRAM = 5,  ///< Runs the program set with setProgram()
+
+      // Patterns placed by the pixels' positions on the tree (see
+      // SpatialMap.h), so every ring given one shows a single effect across
+      // the whole tree
+      WIPE = 6,     ///< Color rises up the tree over one period, drains back
+                    ///  over the next
+      FILL = 7,     ///< PROGRESS by height: the bottom param percent pulses
+      SPIRAL = 8    ///< SPIN wound param turns up the tree
     };
 
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Pattern types.  Each carries the Pattern value that selects it
+    ///        (ID), its traits (FLAGS, PATTERN_*) and its render kernel, a
+    ///        static Draw() template over the strip's PixelWriter, and reads
+    ///        its parameters from the ring's color, period and param.  They
+    ///        are defined in NeoPixelRing.cpp and dispatched through a table
+    ///        built at compile time from NEOPIXELRING_PATTERNS.  A new pattern
+    ///        needs a Pattern value, a type and an entry in that list.
+    ////////////////////////////////////////////////////////////////////////////
+    struct Solid;
+    struct Pulse;
+    struct Progress;
+    struct Spin;
+    struct Rainbow;
+    struct Program;
+    struct Wipe;
+    struct Fill;
+    struct Spiral;
+    struct Off;     ///< Drawn for Pattern values with no type compiled in
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Checks whether a pattern was compiled in.
+    /// @param p Pattern value.
+    /// @return False if rings set to p draw black.
+    ////////////////////////////////////////////////////////////////////////////
+    static bool hasPattern(uint8_t p);
+
     // Constructors/destructors
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Creates a set of rings driven from a single data pin.
+    /// @param pinNum Data pin of the strip.
+    /// @param npType Pixel type flags (color order and bitstream speed).
+    /// @param nRings Number of rings.
+    /// @param rings Number of pixels in each ring, starting at the strip input.
+    ////////////////////////////////////////////////////////////////////////////
     NeoPixelRing(uint8_t pinNum, neoPixelType npType, uint8_t nRings, const uint8_t* rings);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Creates a set of rings split across several strips, each on its
+    ///        own data pin.  All strips share one time base and are drawn by
+    ///        one call to update().
+    /// @param npType Pixel type flags shared by every strip.
+    /// @param nRings Number of rings.
+    /// @param rings Number of pixels in each ring.
+    /// @param nStrips Number of strips.
+    /// @param pins Data pin of each strip.
+    /// @param stripRings Number of consecutive rings on each strip.  Rings are
+    ///                   assigned to strips in order and never span two strips.
+    ////////////////////////////////////////////////////////////////////////////
+    NeoPixelRing(neoPixelType npType, uint8_t nRings, const uint8_t* rings,
+                 uint8_t nStrips, const uint8_t* pins, const uint8_t* stripRings);
     ~NeoPixelRing();
 
     // Strip control functions
@@ -26,8 +119,43 @@ class NeoPixelRing
     /// @brief Updates all LEDs in accordance with the set parameters for each
     ///        ring.  All patterns are time-based, so the rate at which update()
     ///        is called will not change the speed of patterns.
+    ///
+    ///        Only rings whose output has changed since the last call are
+    ///        redrawn, and the strip is only shown when something was redrawn.
+    /// @return True if the strip was shown.
+    ////////////////////////////////////////////////////////////////////////////
+    bool update()
+    {
+      return update(millis());
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Same as update(), at a time given by the caller rather than read
+    ///        from millis(), so a timeline can be replayed exactly and faster
+    ///        than real time, or on a clock shared by several trees (see
+    ///        FleetClock.h).  Such a clock may step back a little; patterns
+    ///        are then redrawn as they were at the earlier time.
+    /// @param now Current time in milliseconds.
+    ////////////////////////////////////////////////////////////////////////////
+    bool update(unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Predicts when update() will next have something to show.  Callers
+    ///        may idle until then; configuration changes made in the meantime
+    ///        make this return 0.
+    /// @return Milliseconds until the output next changes, 0 if update() has
+    ///         work now, or (unsigned long)-1 if the output is static.
     ////////////////////////////////////////////////////////////////////////////
-    void update();
+    unsigned long msUntilUpdate() const
+    {
+      return msUntilUpdate(millis());
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Same as msUntilUpdate(), at a time given by the caller.
+    /// @param now Current time in milliseconds.
+    ////////////////////////////////////////////////////////////////////////////
+    unsigned long msUntilUpdate(unsigned long now) const;
     void setBrightness(uint8_t b);
 
     // Pattern control
@@ -51,6 +179,18 @@ class NeoPixelRing
                     uint16_t period = 2000, // 0.5 Hz
                     uint8_t param = 0);
 
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Sets how long setPattern() takes to change a ring.  While a
+    ///        ring changes, its old pattern keeps running and is crossfaded
+    ///        into the new one.  The other setters always apply at once.
+    /// @param ms Length of the crossfade in milliseconds.  0, the default,
+    ///           switches patterns instantly.
+    ////////////////////////////////////////////////////////////////////////////
+    void setCrossfade(uint16_t ms)
+    {
+      crossfadeMs = ms;
+    }
+
     ////////////////////////////////////////////////////////////////////////////
     /// @brief Changes only the color of one ring.  These changes will be
     ///        reflected on the next call to update().
@@ -84,6 +224,47 @@ class NeoPixelRing
     void setParam(uint8_t ringNum,
                   uint8_t param);
 
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Sets the sparkle overlay of one ring.  Each sparkle pulses one
+    ///        pixel from the pattern color to its own color and back, then
+    ///        moves to a random pixel of the ring that is not sparkling.
+    ///        Sparkles are spread evenly over the period, so the number lit
+    ///        at any time stays the same.
+    /// @param ringNum Index of the ring to update parameters.  If index is
+    ///                invalid, no update will occur.
+    /// @param density Sparkling pixels per 256 pixels of the ring, rounded
+    ///                down; rings smaller than 256 / density get none.  0
+    ///                turns the ring's sparkles off.
+    /// @param color Color at the peak of each sparkle.
+    /// @param period Milliseconds each sparkle lasts.
+    ////////////////////////////////////////////////////////////////////////////
+    void setSparkle(uint8_t ringNum,
+                    uint8_t density,
+                    uint32_t color = SPARKLE_COLOR,
+                    uint16_t period = SPARKLE_PERIOD);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Replaces the program drawn by rings using the PROGRAM pattern.
+    ///        The program is checked before it is accepted: every opcode must
+    ///        be known, the stack must stay within PROGRAM_MAX_STACK, and the
+    ///        cost must be within PROGRAM_MAX_COST.  See PatternProgram.h.
+    /// @param code Bytecode to copy.
+    /// @param length Number of bytes in code.  0 clears the program.
+    /// @return True if the program was accepted.  The previous program is
+    ///         kept otherwise.
+    ////////////////////////////////////////////////////////////////////////////
+    bool setProgram(const uint8_t* code, uint8_t length);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Builds the table of pixel positions read by WIPE, FILL, SPIRAL
+    ///        and the map opcodes of programs, 3 bytes of RAM per pixel.  Done
+    ///        by setPattern() and setProgram() when first needed, or at setup
+    ///        to keep the allocation off the control path.  StaticNeoPixelRing
+    ///        has its table in flash and never needs this.
+    /// @return True if there is a table.  Without one the patterns draw black.
+    ////////////////////////////////////////////////////////////////////////////
+    bool buildSpatialMap();
+
     ////////////////////////////////////////////////////////////////////////////
     /// @brief Returns the number of rings configured in the object
     /// @return Number of rings
@@ -93,146 +274,577 @@ class NeoPixelRing
         return numRings;
     }
 
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Returns the number of pixels across all rings and strips
+    /// @return Number of pixels
+    ////////////////////////////////////////////////////////////////////////////
+    uint16_t getNumPixels() const
+    {
+        return totalPixels;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Enables or disables the sparkle overlay drawn on top of all
+    ///        ring patterns.  Enabled by default.  See setSparkle().
+    /// @param enable True to draw the overlay on subsequent calls to update()
+    ////////////////////////////////////////////////////////////////////////////
+    void enableFlash(bool enable);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Hands the pixels to an external source.  While streaming,
+    ///        update() draws nothing and the strips only change through
+    ///        writePixels() and showPixels().  Turning streaming off redraws
+    ///        every ring on the next update().
+    /// @param enable True to suspend the ring patterns.
+    ////////////////////////////////////////////////////////////////////////////
+    void setStreaming(bool enable);
+
+    bool isStreaming() const
+    {
+      return streaming;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Writes raw colors straight into the strip buffers, applying
+    ///        gamma correction and brightness on the way.  Nothing is shown
+    ///        until showPixels(), so the strip buffers act as the back buffer
+    ///        and the LEDs, which only latch on show(), as the front buffer.
+    /// @param firstPixel Index of the first pixel counted across all strips.
+    /// @param rgb Red, green and blue bytes for each pixel.
+    /// @param count Number of pixels.  Pixels past the end of the tree are
+    ///              ignored.
+    ////////////////////////////////////////////////////////////////////////////
+    void writePixels(uint16_t firstPixel, const uint8_t* rgb, uint16_t count);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Shows every strip changed by writePixels().
+    ////////////////////////////////////////////////////////////////////////////
+    void showPixels();
+
+#if PERF_COUNTERS
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Microseconds spent in show() by the last update() or
+    ///        showPixels() that showed anything.
+    ////////////////////////////////////////////////////////////////////////////
+    unsigned long getShowMicros() const
+    {
+      return showMicros;
+    }
+#endif
+
+  protected:
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Division-free phase accumulator for one time-based wave.
+    ///
+    /// Time is counted in condensed ticks of PERIODDIVISOR milliseconds.  The
+    /// position within the wave is kept as a tick count that only advances by
+    /// addition, and is converted to a 16-bit phase (65536 == one full wave)
+    /// with a reciprocal computed when the period is set.  Adjacent pixels are
+    /// offset by a constant phase step, so a whole ring is generated with one
+    /// add per pixel.
+    ////////////////////////////////////////////////////////////////////////////
+    struct PhaseClock
+    {
+      uint16_t cycle; ///< Condensed ticks in one full wave
+      uint16_t tick;  ///< Position within the wave, 0 to cycle-1
+      uint32_t scale; ///< 2^24 / cycle.  Converts ticks to phase.
+      uint16_t step;  ///< Phase offset between adjacent pixels
+
+      //////////////////////////////////////////////////////////////////////////
+      /// @brief Restarts the clock for a new period.  This is the only place a
+      ///        division happens, so it belongs on the configuration path.
+      /// @param period Milliseconds from 'off' to 'on'.  When smooth is true
+      ///               the full wave is double this value.
+      /// @param smooth True for a triangle wave, false for a sawtooth.
+      /// @param condensedNow Current time in condensed ticks.
+      //////////////////////////////////////////////////////////////////////////
+      void Reset(uint16_t period, bool smooth, unsigned long condensedNow);
+
+      //////////////////////////////////////////////////////////////////////////
+      /// @brief Sets the time offset between adjacent pixels so that count
+      ///        pixels are spread evenly across span milliseconds.
+      //////////////////////////////////////////////////////////////////////////
+      void Spread(uint16_t span, uint16_t count);
+
+      //////////////////////////////////////////////////////////////////////////
+      /// @brief Moves the clock forward.
+      /// @param elapsed Condensed ticks since the previous call.
+      //////////////////////////////////////////////////////////////////////////
+      void Advance(unsigned long elapsed);
+
+      //////////////////////////////////////////////////////////////////////////
+      /// @brief Moves the clock to an arbitrary time, forwards or back.  Costs
+      ///        a division, so only for when the time base jumps.
+      /// @param condensedNow New time in condensed ticks.
+      //////////////////////////////////////////////////////////////////////////
+      void Rephase(unsigned long condensedNow)
+      {
+        tick = condensedNow % cycle;
+      }
+
+      //////////////////////////////////////////////////////////////////////////
+      /// @brief Current phase of the wave.  65536 corresponds to one full wave.
+      //////////////////////////////////////////////////////////////////////////
+      uint16_t Phase() const
+      {
+        return ((uint32_t)tick * scale) >> 8;
+      }
+    };
+
+    struct Crossfade;
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Everything update() needs to know about one ring, packed into
+    ///        one descriptor so a ring is a single contiguous record.
+    ////////////////////////////////////////////////////////////////////////////
+    struct RingState
+    {
+      uint32_t color;
+      PhaseClock clock;
+      uint16_t start;   ///< First pixel of the ring within its strip
+      uint16_t period;
+      uint8_t size;
+      uint8_t strip;    ///< Index into strips holding the ring
+      uint8_t pattern;  ///< Pattern, stored in one byte
+      uint8_t flags;    ///< Traits of the pattern, PATTERN_*
+      uint8_t param;
+      bool dirty;       ///< Ring must be redrawn on the next update()
+
+      uint32_t sparkleColor;
+      PhaseClock sparkleClock;  ///< Phase of the first sparkle
+      uint16_t sparklePhase;    ///< First sparkle's phase in the last frame
+      uint8_t sparkleCount;     ///< Pixels sparkling at once
+      bool sparkleShuffle;      ///< Sparkling pixels must be picked afresh
+
+      Crossfade* fade;          ///< Crossfade in progress, or NULL
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Transition layer of a ring changing pattern.  Allocated by
+    ///        setPattern() in one block with the layer's pixels, and freed
+    ///        by the frame that completes it.
+    ////////////////////////////////////////////////////////////////////////////
+    struct Crossfade
+    {
+      RingState from;            ///< Pattern being faded out
+      unsigned long start;       ///< condensedNow when the fade began
+      uint16_t length;           ///< Condensed ticks the fade lasts
+      uint32_t scale;            ///< 2^24 / length
+      uint8_t* pixels;           ///< Old pattern's raw colors this frame
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Creates a set of rings in caller-provided storage.  Nothing is
+    ///        allocated or freed by this object when all storage is given.
+    /// @param npType Pixel type flags shared by every strip.
+    /// @param nRings Number of rings.
+    /// @param rings Number of pixels in each ring.
+    /// @param nStrips Number of strips.
+    /// @param pins Data pin of each strip.
+    /// @param stripRings Number of consecutive rings on each strip.
+    /// @param ringStorage nRings descriptors, or NULL to allocate them.
+    /// @param stripStorage nStrips strips, or NULL to allocate them.
+    /// @param stripChangedStorage nStrips flags, or NULL to allocate them.
+    /// @param sparkleStorage One entry per pixel, or NULL to allocate it.
+    ////////////////////////////////////////////////////////////////////////////
+    NeoPixelRing(neoPixelType npType, uint8_t nRings, const uint8_t* rings,
+                 uint8_t nStrips, const uint8_t* pins, const uint8_t* stripRings,
+                 RingState* ringStorage, Adafruit_NeoPixel* stripStorage,
+                 bool* stripChangedStorage, uint8_t* sparkleStorage);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief First step of update().  Advances the time base.
+    /// @param now Current time in milliseconds.
+    /// @param elapsed Set to the condensed ticks since the last frame.
+    /// @return False if nothing can have changed since the last frame.
+    ////////////////////////////////////////////////////////////////////////////
+    bool BeginFrame(unsigned long now, unsigned long& elapsed);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Moves every clock back to an earlier time and marks every ring
+    ///        for redrawing.
+    /// @param condensed New time in condensed ticks.
+    ////////////////////////////////////////////////////////////////////////////
+    void Rephase(unsigned long condensed);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Advances one ring's clock and redraws the ring if its output
+    ///        has changed.
+    /// @param ring Ring to draw.
+    /// @param treeStart Index of the ring's first pixel counted across all
+    ///                  strips.
+    /// @param elapsed Condensed ticks since the last frame.
+    /// @return True if the ring was redrawn.
+    ////////////////////////////////////////////////////////////////////////////
+    bool RenderRing(RingState& ring, uint16_t treeStart, unsigned long elapsed);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Last step of update().  Draws the sparkle overlay and shows
+    ///        every strip that was redrawn.
+    ////////////////////////////////////////////////////////////////////////////
+    void EndFrame();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Uses a table of pixel positions kept by the caller instead of
+    ///        building one.
+    /// @param points One entry per pixel counted across all strips.
+    /// @param inFlash True if the table is in PROGMEM.
+    ////////////////////////////////////////////////////////////////////////////
+    void UseSpatialMap(const SpatialPoint* points, bool inFlash)
+    {
+      spatialMap = points;
+      spatialInFlash = inFlash;
+    }
+
   private:
+    // Storage may belong to this object or to a derived class
+    NeoPixelRing(const NeoPixelRing&) = delete;
+    NeoPixelRing& operator=(const NeoPixelRing&) = delete;
+
     ////////////////////////////////////////////////////////////////////////////
-    /// @brief Sets a set of LEDs to a constant color.
-    /// @param startPixel The first pixel index to set.
-    /// @param endPixel The last pixel index to set.
-    /// @param color Color to set all pixels to.  This value will be gamma
-    ///              corrected before displaying.
+    /// @brief Flags one ring to be redrawn on the next update().
+    /// @param ringNum Index of the ring.  Must be valid.
     ////////////////////////////////////////////////////////////////////////////
-    void SetSolid(uint8_t startPixel, uint8_t endPixel,
-                  uint32_t color);
+    void MarkDirty(uint8_t ringNum);
 
     ////////////////////////////////////////////////////////////////////////////
-    /// @brief Sets a set of LEDs to fade in to a given color and out to off.
-    /// @param startPixel The first pixel index to set.
-    /// @param endPixel The last pixel index to set.
-    /// @param color Color to fade all pixels to.  This value will be gamma
-    ///              corrected before displaying.
-    /// @param period Milliseconds from off to the given color.  Full pulse
-    ///               period is actually double this value.
+    /// @brief Flags every ring to be redrawn on the next update().
     ////////////////////////////////////////////////////////////////////////////
-    void SetPulse(uint8_t startPixel, uint8_t endPixel,
-                  uint32_t color, uint16_t period);
+    void MarkAllDirty();
 
     ////////////////////////////////////////////////////////////////////////////
-    /// @brief Pulses a percentage of the LEDs while maintaining the remaining
-    ///        LEDs at a dim value.
-    /// @param startPixel The first pixel index to set.
-    /// @param endPixel The last pixel index to set.
-    /// @param color Color to fade all pixels to.  This value will be gamma
-    ///              corrected before displaying.
-    /// @param period Milliseconds from off to the given color.  Full pulse
-    ///               period is actually double this value.
-    /// @param param Percentage of LEDs to pulse.  Range is 0-100.  LEDs are
-    ///              illuminated starting at startPixel index.
+    /// @brief Draws a ring's pattern into the strip buffer as raw colors.
+    /// @param ring Pattern settings and clock to draw with.
+    /// @param ringNum Index of the ring.
+    /// @param treeStart Index of the ring's first pixel counted across all
+    ///                  strips.
     ////////////////////////////////////////////////////////////////////////////
-    void SetProgress(uint8_t startPixel, uint8_t endPixel,
-                     uint32_t color, uint16_t period, uint8_t param);
+    void DrawPattern(const RingState& ring, uint8_t ringNum, uint16_t treeStart);
 
     ////////////////////////////////////////////////////////////////////////////
-    /// @brief Sets a set of LEDs to fade in to a given color and out to off.
-    ///        LEDs in the range have a time offset from each other creating a
-    ///        chase pattern around the ring.
-    /// @param startPixel The first pixel index to set.
-    /// @param endPixel The last pixel index to set.
-    /// @param color Color to fade all pixels to.  This value will be gamma
-    ///              corrected before displaying.
-    /// @param period Milliseconds from off to the given color.  Full pulse
-    ///               period is actually double this value.
-    ///               The time for the pattern to propagate around the ring is
-    ///               the period value.
+    /// @brief Starts fading a ring out of its current pattern.  Must be
+    ///        called before the ring's settings change.  Leaves the ring
+    ///        without a fade if there is no memory for one.
     ////////////////////////////////////////////////////////////////////////////
-    void SetSpin(uint8_t startPixel, uint8_t endPixel,
-                 uint32_t color, uint16_t period);
+    void StartCrossfade(RingState& ring);
 
     ////////////////////////////////////////////////////////////////////////////
-    /// @brief Sets a set of LEDs to cycle through max saturation rainbow colors.
-    ///        The Colors have an offset to create a chase pattern around the
-    ///        ring.
-    /// @param startPixel The first pixel index to set.
-    /// @param endPixel The last pixel index to set.
-    /// @param period Milliseconds to complete one rainbow cycle.
+    /// @brief Blends the old pattern under a ring's freshly drawn new one,
+    ///        ending the fade once the new pattern is fully in.
+    /// @param ring Ring with a fade in progress, already drawn.
+    /// @param ringNum Index of the ring.
+    /// @param treeStart Index of the ring's first pixel counted across all
+    ///                  strips.
+    /// @param elapsed Condensed ticks since the last frame.
     ////////////////////////////////////////////////////////////////////////////
-    void SetRainbow(uint8_t startPixel, uint8_t endPixel,
-                    uint16_t period);
+    void DrawCrossfade(RingState& ring, uint8_t ringNum, uint16_t treeStart,
+                       unsigned long elapsed);
 
     ////////////////////////////////////////////////////////////////////////////
-    /// @brief Calculate a color to use in the pulse sequence.  The pulse may
-    ///        be a linear fade between any two colors in the RGB color space.
+    /// @brief What a pattern kernel draws: one ring, into the strip buffer
+    ///        as raw colors.
+    ////////////////////////////////////////////////////////////////////////////
+    struct PatternFrame
+    {
+      uint8_t* pixels;        ///< First byte of the ring in the strip buffer
+      const RingState& ring;  ///< Pattern settings and clock to draw with
+      uint8_t ringNum;
+      uint16_t treeStart;     ///< Index of the ring's first pixel counted
+                              ///  across all strips
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Dense tables over the compiled pattern types, indexed by
+    ///        Pattern value: each value's traits, and its kernel for one
+    ///        Writer.  Values with no type get Off.  See NeoPixelRing.cpp.
+    ////////////////////////////////////////////////////////////////////////////
+    template<typename Slots, typename... Patterns>
+    struct PatternTraits;
+    template<typename Writer, typename Slots, typename... Patterns>
+    struct PatternKernels;
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Traits of a Pattern value, PATTERN_*, 0 if it is not compiled
+    ///        in.
+    ////////////////////////////////////////////////////////////////////////////
+    static uint8_t PatternFlags(uint8_t p);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief DrawPattern() for one wire order: one load from the kernel
+    ///        table and an indirect call.
+    ////////////////////////////////////////////////////////////////////////////
+    template<typename Writer>
+    void DrawPatternAs(const Writer& writer, const RingState& ring,
+                       uint8_t ringNum, uint16_t treeStart);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Reads one coordinate from the spatial map, wherever it is kept.
+    ////////////////////////////////////////////////////////////////////////////
+    uint8_t SpatialByte(const uint8_t* coordinate) const
+    {
+      return spatialInFlash ? pgm_read_byte(coordinate) : *coordinate;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Draws a ring with the program from setProgram().  The kernel of
+    ///        Program.
+    /// @param writer Wire order of the strip.
+    /// @param frame Ring to draw.  Supplies the inputs to the program.
+    ////////////////////////////////////////////////////////////////////////////
+    template<typename Writer>
+    void RunProgram(const Writer& writer, const PatternFrame& frame);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Checks a program's opcodes, stack use and cost.
+    /// @return True if the program is safe to run.
+    ////////////////////////////////////////////////////////////////////////////
+    static bool ValidateProgram(const uint8_t* code, uint8_t length);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Calculate a color to use in the pulse sequence.  The pulse is a
+    ///        linear fade from 'off' to 'on' over the first half of the wave
+    ///        and back to 'off' over the second half.  Uses only 8x8-bit
+    ///        multiplies, adds and shifts.
+    /// @param phase Position in the wave from PhaseClock::Phase().
     /// @param color Color used as the 'on' color in the fade.
-    /// @param period Milliseconds from 'on' to 'off' color.  Full sequence may
-    ///               be double this value if smooth is set to true.
-    /// @param smooth When true, there is first a linear fade from 'off' to 'on'
-    ///               then a linear fade from 'on' to 'off'.  When false, there
-    ///               is a linear fade from 'off' to 'on', then this repeats
-    ///               without a transition.
-    /// @param offset Time offset in milliseconds for the pattern.  Each pattern
-    ///               starts when
-    ///               ((ms since startup) + offset) % period == 0
-    /// @return Color value matching parameters and current system time
+    /// @param offColor Color used as the 'off' color in the fade.
+    /// @return Color value matching parameters
+    ////////////////////////////////////////////////////////////////////////////
+    uint32_t PulseColor(uint16_t phase, uint32_t color, uint32_t offColor = 0);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief The dim color PROGRESS and FILL leave unlit pixels at: a
+    ///        quarter of each channel.
+    ////////////////////////////////////////////////////////////////////////////
+    static uint32_t DimColor(uint32_t color);
+
     ////////////////////////////////////////////////////////////////////////////
-    uint32_t CalcPulseColor(uint32_t color, uint16_t period, bool smooth = false,
-                            uint32_t offColor = 0, uint16_t offset = 0);
+    /// @brief Draws every ring's sparkles over the raw pattern colors.
+    ///
+    ///        Each ring's entries in sparklePixels are a permutation of its
+    ///        pixel offsets; the first sparkleCount entries are sparkling and
+    ///        the rest are the pool.  A sparkle that has faded out swaps its
+    ///        entry with a random one from the pool, so picking a new unique
+    ///        pixel costs one random() and a swap however dense the ring.
+    ////////////////////////////////////////////////////////////////////////////
+    void DrawSparkles();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief DrawSparkles() for one wire order.
+    ////////////////////////////////////////////////////////////////////////////
+    template<typename Writer>
+    void DrawSparklesAs(const Writer& writer);
 
     ////////////////////////////////////////////////////////////////////////////
-    /// @brief Flashes random LEDs according to FLASH_COLOR and FLASH_PERIOD.
-    ///        This produces a 'twinkling' effect on top of other patterns.
-    ///        Calls GenFlash() as necessary to update flashing pixels.
+    /// @brief Picks all of a ring's sparkling pixels at random: the first
+    ///        sparkleCount steps of a Fisher-Yates shuffle.
+    /// @param ring Ring to pick for.
+    /// @param pixels The ring's entries in sparklePixels.
     ////////////////////////////////////////////////////////////////////////////
-    void SetFlash();
+    void ShuffleSparkles(const RingState& ring, uint8_t* pixels);
 
     ////////////////////////////////////////////////////////////////////////////
-    /// @brief Updates flashPixels to contain new random pixels to flash.
-    ///        When selecting pixels, no two values will be identical
-    ///        (i.e. flashPixels is a unique set of indices)
-    /// @param index Index of flashPixels to update.  If set to 255, update all
-    ///              values.
+    /// @brief Finds the strip holding a pixel.
+    /// @param pixel Index counted across all strips.  Replaced with the index
+    ///              within the returned strip.
+    /// @return Strip holding the pixel.
     ////////////////////////////////////////////////////////////////////////////
-    void GenFlash(uint8_t index = 255);
+    Adafruit_NeoPixel& PixelStrip(uint16_t& pixel);
 
     ////////////////////////////////////////////////////////////////////////////
-    /// @brief Generates a value in a maximum saturation color wheel.  Adapted
-    ///        from Adafruit NeoPixel library example code.
+    /// @brief Looks up a value in a maximum saturation color wheel stored in
+    ///        flash.
     /// @param pos Position in color wheel.  0 and 255 are adjacent, creating
     ///            a continuous wheel.
     ////////////////////////////////////////////////////////////////////////////
     uint32_t Wheel(uint8_t pos);
 
     ////////////////////////////////////////////////////////////////////////////
-    /// @brief Converts a raw color to a gamma-corrected color.  This
-    ///        adjusts for human perception of brightness.
-    /// @param color Raw RGB color for conversion
-    /// @return Converted color in 8-bit RGB.
-    ////////////////////////////////////////////////////////////////////////////
-    uint32_t GammaColor(uint32_t color);
+    /// @brief Converts a range of the strip buffer from raw colors to the
+    ///        values sent to the LEDs: gamma correction through the GAMMA
+    ///        table in flash, then the global brightness.  Patterns and the
+    ///        flash overlay render raw colors; this is the only gamma and
+    ///        brightness step in a frame, so it must run exactly once per
+    ///        redrawn pixel.
+    /// @param strip Strip holding the pixels.
+    /// @param startPixel The first pixel index to convert.
+    /// @param numPixels Number of pixels to convert, which may be 0.
+    ////////////////////////////////////////////////////////////////////////////
+    void ApplyTransfer(Adafruit_NeoPixel& strip, uint16_t startPixel, uint16_t numPixels);
 
     ////////////////////////////////////////////////////////////////////////////
-    /// @brief Converts a gamma-corrected color to a raw color.  Using this in
-    ///        conjunction with GammaColor() is lossy, but should yield visually
-    ///        acceptable results.
-    /// @param color Gamma-corrected RGB color for conversion
-    /// @return Raw color in 8-bit RGB.
+    /// @brief Shows every strip that was redrawn since it was last shown.
     ////////////////////////////////////////////////////////////////////////////
-    uint32_t GammaInvColor(uint32_t color);
+    void ShowChanged();
 
-    Adafruit_NeoPixel strip;
+    Adafruit_NeoPixel* strips;
+    uint8_t numStrips;
+    bool* stripChanged;     ///< Strip was redrawn and must be shown
+    uint16_t totalPixels;
     uint8_t numRings;
-    uint8_t* ringSizes;
-    Pattern* ringPatterns;
-    uint32_t* ringColors;
-    uint16_t* ringPeriods;
-    uint8_t* ringParams;
-
-    const uint16_t FLASH_PERIOD = 4000;
-    const uint32_t FLASH_COLOR = 0xFFFF00;
-    uint8_t numFlash;
-    uint8_t* flashPixels;
-    unsigned long flashStart;
-    unsigned long now;
-
-    uint8_t GAMMA[256];     ///< This is used to transform raw colors to gamma-corrected colors
-                            ///  to compensate for brightness perception
-    uint8_t GAMMA_INV[256]; ///< This is used to transform gamma-corrected colors to raw colors
+    RingState* ringStates;
+    bool anyDirty;          ///< At least one ring is marked dirty
+    bool ownsStorage;       ///< Storage was allocated by the constructor
+
+    uint8_t* sparklePixels; ///< Each ring's pixel offsets in sparkle order
+    uint16_t crossfadeMs;   ///< See setCrossfade()
+    bool flashEnabled;
+    bool streaming;         ///< Pixels come from writePixels(), not patterns
+    unsigned long condensedNow; ///< now / PERIODDIVISOR as of the last update()
+
+    uint8_t program[PROGRAM_MAX_LENGTH]; ///< Validated bytecode for PROGRAM rings
+    uint8_t programLength;
+    bool programUsesPos;    ///< Program reads OP_POS, which costs a division per ring
+
+    const SpatialPoint* spatialMap; ///< Position of every pixel, or NULL
+    bool spatialInFlash;    ///< spatialMap is in PROGMEM
+    bool ownsSpatialMap;    ///< spatialMap was built by buildSpatialMap()
+
+    uint8_t bytesPerPixel;  ///< 3 for RGB strips, 4 for RGBW
+    RuntimePixelWriter runtimeWriter; ///< Wire order of the strips
+    bool fixedOrder;        ///< Strips are NEOPIXELRING_WIRE_ORDER
+    uint8_t brightness;     ///< Global brightness applied by ApplyTransfer()
+
+#if PERF_COUNTERS
+    unsigned long showMicros; ///< See getShowMicros()
+#endif
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Compile-time arithmetic over a ring layout.
+////////////////////////////////////////////////////////////////////////////////
+template<uint8_t... Sizes>
+struct RingLayout
+{
+  static constexpr uint16_t pixels = 0;
+
+  //////////////////////////////////////////////////////////////////////////////
+  /// @brief Index of the first pixel of ring I.
+  //////////////////////////////////////////////////////////////////////////////
+  template<uint8_t I>
+  struct Start
+  {
+    static constexpr uint16_t value = 0;
+  };
+};
+
+template<uint8_t First, uint8_t... Rest>
+struct RingLayout<First, Rest...>
+{
+  static constexpr uint16_t pixels = First + RingLayout<Rest...>::pixels;
+
+  template<uint8_t I, bool = (I == 0)>
+  struct Start
+  {
+    static constexpr uint16_t value =
+      First + RingLayout<Rest...>::template Start<I - 1>::value;
+  };
+
+  template<uint8_t I>
+  struct Start<I, true>
+  {
+    static constexpr uint16_t value = 0;
+  };
 };
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Storage for StaticNeoPixelRing.  Kept in a base class so it is
+///        constructed before NeoPixelRing configures it.
+////////////////////////////////////////////////////////////////////////////////
+template<typename Ring, uint8_t NumRings, uint16_t NumPixels>
+struct NeoPixelRingStorage
+{
+  Ring ringStorage[NumRings];
+  Adafruit_NeoPixel stripStorage;
+  bool stripChangedStorage;
+  uint8_t sparkleStorage[NumPixels];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief NeoPixelRing with the ring layout fixed at compile time, e.g.
+///        StaticNeoPixelRing<32,24,16,12,8,1>.  All ring state lives inside
+///        the object, so a global instance needs no heap beyond the strip's
+///        pixel buffer, and update() is unrolled with constant ring offsets.
+///        The spatial map is built by the compiler into flash.
+////////////////////////////////////////////////////////////////////////////////
+template<uint8_t... Sizes>
+class StaticNeoPixelRing :
+  private NeoPixelRingStorage<NeoPixelRing::RingState, sizeof...(Sizes),
+                              RingLayout<Sizes...>::pixels>,
+  public NeoPixelRing
+{
+    typedef NeoPixelRingStorage<NeoPixelRing::RingState, sizeof...(Sizes),
+                                RingLayout<Sizes...>::pixels> Storage;
+
+  public:
+    static constexpr uint8_t NUM_RINGS = sizeof...(Sizes);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Creates the rings on a single data pin.
+    /// @param pinNum Data pin of the strip.
+    /// @param npType Pixel type flags (color order and bitstream speed).
+    ////////////////////////////////////////////////////////////////////////////
+    StaticNeoPixelRing(uint8_t pinNum, neoPixelType npType) :
+      Storage(),
+      NeoPixelRing(npType, NUM_RINGS, SIZES, 1, &pinNum, &NUM_RINGS,
+                   this->ringStorage, &this->stripStorage,
+                   &this->stripChangedStorage, this->sparkleStorage)
+    {
+      UseSpatialMap(StaticSpatialMap<RingLayout<Sizes...>::pixels,
+                                     Sizes...>::points, true);
+    }
+
+    bool update()
+    {
+      return update(millis());
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Same as NeoPixelRing::update(), with the per-ring loop unrolled.
+    /// @param now Current time in milliseconds.
+    /// @return True if the strip was shown.
+    ////////////////////////////////////////////////////////////////////////////
+    bool update(unsigned long now)
+    {
+      unsigned long elapsed;
+      if(!BeginFrame(now, elapsed))
+      {
+        return false;
+      }
+      bool rendered = RenderRings(elapsed, RingIndex<0>());
+      EndFrame();
+      return rendered;
+    }
+
+  private:
+    static_assert(NUM_RINGS > 0, "At least one ring is required");
+
+    static constexpr uint8_t SIZES[NUM_RINGS] = { Sizes... };
+
+    template<uint8_t I>
+    struct RingIndex
+    {
+    };
+
+    template<uint8_t I>
+    bool RenderRings(unsigned long elapsed, RingIndex<I>)
+    {
+      bool drawn = RenderRing(this->ringStorage[I],
+                              RingLayout<Sizes...>::template Start<I>::value,
+                              elapsed);
+      return RenderRings(elapsed, RingIndex<I + 1>()) || drawn;
+    }
+
+    bool RenderRings(unsigned long, RingIndex<NUM_RINGS>)
+    {
+      return false;
+    }
+};
+
+template<uint8_t... Sizes>
+constexpr uint8_t StaticNeoPixelRing<Sizes...>::NUM_RINGS;
+
+template<uint8_t... Sizes>
+constexpr uint8_t StaticNeoPixelRing<Sizes...>::SIZES[];
+
+#endif // NEOPIXELRING_H
@@ -0,0 +1,138 @@
+#include "NetworkCache.h"
+
+#include <EEPROM.h>
+
+// Offsets in the record; see NetworkCache.h
+#define NETCACHE_CONTENTS 1
+#define NETCACHE_MAC 2
+#define NETCACHE_IP 8
+#define NETCACHE_GATEWAY 12
+#define NETCACHE_DNS 16
+#define NETCACHE_MASK 20
+#define NETCACHE_DHCP_SERVER 24
+#define NETCACHE_LEASE_SECONDS 28
+#define NETCACHE_SERVER_IP 32
+#define NETCACHE_DOMAIN_CRC 36
+#define NETCACHE_CRC 38
+
+static uint16_t GetWord(const uint8_t* p)
+{
+  return p[0] | ((uint16_t)p[1] << 8);
+}
+
+static void SetWord(uint8_t* p, uint16_t val)
+{
+  p[0] = val & 0xFF;
+  p[1] = val >> 8;
+}
+
+NetworkCache::NetworkCache(const uint8_t* mac) :
+  mac(mac)
+{
+}
+
+bool NetworkCache::loadLease(DhcpLease& lease) const
+{
+  uint8_t record[NETCACHE_SIZE];
+  if(!Read(record) || !(record[NETCACHE_CONTENTS] & NETCACHE_LEASE))
+  {
+    return false;
+  }
+  memcpy(lease.ip, record + NETCACHE_IP, 4);
+  memcpy(lease.gateway, record + NETCACHE_GATEWAY, 4);
+  memcpy(lease.dns, record + NETCACHE_DNS, 4);
+  memcpy(lease.mask, record + NETCACHE_MASK, 4);
+  memcpy(lease.server, record + NETCACHE_DHCP_SERVER, 4);
+  const uint8_t* seconds = record + NETCACHE_LEASE_SECONDS;
+  lease.seconds = GetWord(seconds) | ((uint32_t)GetWord(seconds + 2) << 16);
+  return true;
+}
+
+void NetworkCache::saveLease(const DhcpLease& lease)
+{
+  uint8_t record[NETCACHE_SIZE];
+  Open(record);
+  memcpy(record + NETCACHE_IP, lease.ip, 4);
+  memcpy(record + NETCACHE_GATEWAY, lease.gateway, 4);
+  memcpy(record + NETCACHE_DNS, lease.dns, 4);
+  memcpy(record + NETCACHE_MASK, lease.mask, 4);
+  memcpy(record + NETCACHE_DHCP_SERVER, lease.server, 4);
+  SetWord(record + NETCACHE_LEASE_SECONDS, lease.seconds & 0xFFFF);
+  SetWord(record + NETCACHE_LEASE_SECONDS + 2, lease.seconds >> 16);
+  record[NETCACHE_CONTENTS] |= NETCACHE_LEASE;
+  Write(record);
+}
+
+bool NetworkCache::loadServer(const char* domain, uint8_t* ip) const
+{
+  uint8_t record[NETCACHE_SIZE];
+  if(!Read(record) ||
+     !(record[NETCACHE_CONTENTS] & NETCACHE_SERVER) ||
+     GetWord(record + NETCACHE_DOMAIN_CRC) != DomainCrc(domain))
+  {
+    return false;
+  }
+  memcpy(ip, record + NETCACHE_SERVER_IP, 4);
+  return true;
+}
+
+void NetworkCache::saveServer(const char* domain, const uint8_t* ip)
+{
+  uint8_t record[NETCACHE_SIZE];
+  Open(record);
+  memcpy(record + NETCACHE_SERVER_IP, ip, 4);
+  SetWord(record + NETCACHE_DOMAIN_CRC, DomainCrc(domain));
+  record[NETCACHE_CONTENTS] |= NETCACHE_SERVER;
+  Write(record);
+}
+
+bool NetworkCache::Read(uint8_t* record) const
+{
+  uint16_t crc = 0xFFFF;
+  for(uint8_t i = 0; i < NETCACHE_SIZE; i++)
+  {
+    record[i] = EEPROM.read(NETCACHE_ADDRESS + i);
+    if(i < NETCACHE_CRC)
+    {
+      crc = ConfigStore::Crc(crc, record[i]);
+    }
+  }
+  return NETCACHE_VERSION == record[0] &&
+         crc == GetWord(record + NETCACHE_CRC) &&
+         0 == memcmp(record + NETCACHE_MAC, mac, 6);
+}
+
+void NetworkCache::Open(uint8_t* record) const
+{
+  // An unreadable record, or one for another board, is started afresh
+  if(!Read(record))
+  {
+    memset(record, 0, NETCACHE_SIZE);
+    record[0] = NETCACHE_VERSION;
+    memcpy(record + NETCACHE_MAC, mac, 6);
+  }
+}
+
+void NetworkCache::Write(uint8_t* record)
+{
+  uint16_t crc = 0xFFFF;
+  for(uint8_t i = 0; i < NETCACHE_CRC; i++)
+  {
+    crc = ConfigStore::Crc(crc, record[i]);
+  }
+  SetWord(record + NETCACHE_CRC, crc);
+  for(uint8_t i = 0; i < NETCACHE_SIZE; i++)
+  {
+    EEPROM.update(NETCACHE_ADDRESS + i, record[i]);
+  }
+}
+
+uint16_t NetworkCache::DomainCrc(const char* domain)
+{
+  uint16_t crc = 0xFFFF;
+  for(; '\0' != *domain; domain++)
+  {
+    crc = ConfigStore::Crc(crc, *domain);
+  }
+  return crc;
+}
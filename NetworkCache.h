@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file NetworkCache.h
+///
+/// @brief The last DHCP lease and Jenkins server address, kept in EEPROM so
+///        a tree can use them straight after a reset.
+///
+/// A standalone tree otherwise waits for a DHCP server and then a DNS
+/// server before it can poll at all.  With the cache it configures the
+/// cached address and polls the cached server at once, and confirms both
+/// in the background (see DhcpClient::reboot()); answers that differ
+/// replace the cached values.
+///
+/// One record follows the configuration slots:
+///
+///   0      NETCACHE_VERSION
+///   1      What the record holds, NETCACHE_LEASE and NETCACHE_SERVER
+///   2-7    Hardware address the lease was granted to
+///   8-27   Address, gateway, DNS server, netmask, DHCP server
+///   28-31  Lease length in seconds (little endian)
+///   32-35  Jenkins server address
+///   36-37  CRC-16/CCITT of the domain it was looked up for (little endian)
+///   38-39  CRC-16/CCITT of bytes 0-37 (little endian)
+///
+/// Nothing is kept in RAM; the record is read at boot and rewritten when an
+/// answer differs from it.  Only bytes that change are written, so renewing
+/// an unchanged lease writes nothing.  The record is a cache: if a write is
+/// cut short, its CRC fails and the next boot simply starts from nothing.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef NETWORKCACHE_H
+#define NETWORKCACHE_H
+
+#include <Arduino.h>
+#include "ConfigStore.h"
+#include "DhcpClient.h"
+
+#define NETCACHE_VERSION 1
+#define NETCACHE_ADDRESS CONFIG_END   ///< Right after the configuration slots
+#define NETCACHE_SIZE 40
+#define NETCACHE_END (NETCACHE_ADDRESS + NETCACHE_SIZE)
+
+#define NETCACHE_LEASE 0x01
+#define NETCACHE_SERVER 0x02
+
+class NetworkCache
+{
+  public:
+    ////////////////////////////////////////////////////////////////////////////
+    /// @param mac Hardware address of the tree, 6 bytes, kept by pointer.  A
+    ///            lease cached for another address is not loaded.
+    ////////////////////////////////////////////////////////////////////////////
+    NetworkCache(const uint8_t* mac);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Reads the cached lease.
+    /// @return False, leaving lease as it was, if none is cached.
+    ////////////////////////////////////////////////////////////////////////////
+    bool loadLease(DhcpLease& lease) const;
+
+    void saveLease(const DhcpLease& lease);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Reads the cached server address.
+    /// @param domain Name the address is wanted for.
+    /// @param ip Destination for the address, 4 bytes.
+    /// @return False, leaving ip as it was, if no address is cached or it was
+    ///         looked up for another name.
+    ////////////////////////////////////////////////////////////////////////////
+    bool loadServer(const char* domain, uint8_t* ip) const;
+
+    void saveServer(const char* domain, const uint8_t* ip);
+
+  private:
+    bool Read(uint8_t* record) const;
+    void Open(uint8_t* record) const;
+    void Write(uint8_t* record);
+    static uint16_t DomainCrc(const char* domain);
+
+    const uint8_t* mac;
+};
+
+#endif // NETWORKCACHE_H
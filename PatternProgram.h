@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file PatternProgram.h
+///
+/// @brief Bytecode for user-defined patterns run by NeoPixelRing's PROGRAM
+///        pattern.
+///
+/// A program is a straight-line list of stack operations evaluated once per
+/// pixel.  There are no jumps or loops, so every instruction runs exactly
+/// once per pixel and a program's cost is known when it is loaded.
+/// NeoPixelRing::setProgram() rejects programs that exceed
+/// PROGRAM_MAX_COST, so a frame never takes longer than
+/// PROGRAM_MAX_COST dispatches per pixel however the program is written.
+///
+/// Stack values are 16 bits.  Phases and levels are fractions where 65536 is
+/// one full wave or full brightness; counts are plain integers.  Arithmetic
+/// wraps.  Output instructions set the pixel's raw color and the last one
+/// executed wins; a program that outputs nothing draws black.
+///
+/// Example programs:
+///   SPIN:    OP_TIME OP_SPREAD OP_ADD OP_TRI OP_FADE
+///   RAINBOW: OP_TIME OP_PIXEL OP_SHL 8 OP_ADD OP_WHEEL
+////////////////////////////////////////////////////////////////////////////////
+#ifndef PATTERNPROGRAM_H
+#define PATTERNPROGRAM_H
+
+#define PROGRAM_MAX_LENGTH 32 ///< Bytes of bytecode, including immediates
+#define PROGRAM_MAX_STACK 8   ///< Deepest stack a program may use
+#define PROGRAM_MAX_COST 32   ///< Cost units per pixel.  One unit is one
+                              ///  instruction dispatch; OP_MUL costs 3.
+
+enum ProgramOpcode
+{
+  // Constants (0 in, 1 out)
+  OP_PUSH8 = 0x01,  ///< Push the next byte
+  OP_PUSH16 = 0x02, ///< Push the next two bytes, high byte first
+
+  // Inputs (0 in, 1 out)
+  OP_TIME = 0x10,   ///< Ring clock phase.  65536 per two periods, the same
+                    ///  clock PULSE and SPIN use.
+  OP_SPREAD = 0x11, ///< Pixel index times the phase step SPIN uses
+  OP_POS = 0x12,    ///< Position around the ring, 65536 per revolution
+  OP_INDEX = 0x13,  ///< Pixel index within the ring
+  OP_PIXEL = 0x14,  ///< Pixel index counted across the tree
+  OP_RING = 0x15,   ///< Ring index
+  OP_PARAM = 0x16,  ///< Ring param
+  OP_HEIGHT = 0x17, ///< Pixel height on the tree, 65536 at the top.  The
+                    ///  map opcodes read the table in SpatialMap.h and
+                    ///  push 0 if there is none.
+  OP_ANGLE = 0x18,  ///< Pixel angle around its ring, 65536 per revolution
+  OP_RADIUS = 0x19, ///< Radius of the pixel's ring, 65536 for the largest
+
+  // Binary (pop b, pop a, push a op b)
+  OP_ADD = 0x20,
+  OP_SUB = 0x21,
+  OP_MUL = 0x22,    ///< (a * b) >> 16, i.e. a scaled by the fraction b
+  OP_AND = 0x23,
+  OP_OR = 0x24,
+  OP_XOR = 0x25,
+  OP_MIN = 0x26,
+  OP_MAX = 0x27,
+  OP_LT = 0x28,     ///< 0xFFFF if a < b, else 0
+
+  // Shifts (1 in, 1 out, shift count in the next byte, 0-15)
+  OP_SHL = 0x29,
+  OP_SHR = 0x2A,
+
+  // Unary and stack
+  OP_TRI = 0x30,    ///< Triangle wave of a phase: 0 at 0, 0xFFFE at 0x8000
+  OP_NOT = 0x31,
+  OP_DUP = 0x32,
+  OP_SWAP = 0x33,
+  OP_DROP = 0x34,
+  OP_SEL = 0x35,    ///< Pop c, b, a; push a ? b : c
+
+  // Outputs
+  OP_FADE = 0x40,   ///< Pop level; ring color scaled by level (as PULSE)
+  OP_WHEEL = 0x41,  ///< Pop hue; color wheel at hue >> 8 (as RAINBOW)
+  OP_RGB = 0x42     ///< Pop b, g, r; color from the high byte of each
+};
+
+#endif // PATTERNPROGRAM_H
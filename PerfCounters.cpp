@@ -0,0 +1,120 @@
+#include "PerfCounters.h"
+
+#if PERF_COUNTERS
+
+#include <stdarg.h>
+#include <stdio.h>
+
+PerfSeries::PerfSeries() :
+  next(0),
+  count(0)
+{
+  memset(samples, 0, sizeof(samples));
+}
+
+void PerfSeries::summarize(uint16_t& min, uint16_t& avg, uint16_t& max) const
+{
+  min = 0;
+  avg = 0;
+  max = 0;
+  if(0 == count)
+  {
+    return;
+  }
+  uint32_t sum = 0;
+  min = 0xFFFF;
+  for(uint8_t i = 0; i < count; i++)
+  {
+    uint16_t sample = samples[i];
+    sum += sample;
+    if(sample < min)
+    {
+      min = sample;
+    }
+    if(sample > max)
+    {
+      max = sample;
+    }
+  }
+  avg = sum / count;
+}
+
+PerfCounters::PerfCounters() :
+  packets(0),
+  droppedPackets(0),
+  pollFailures(0),
+  windowStart(0),
+  windowFrames(0),
+  fps(0)
+{
+}
+
+void PerfCounters::frame(unsigned long renderUs, unsigned long showUs,
+                         unsigned long now)
+{
+  renderTime.add(renderUs);
+  showTime.add(showUs);
+  unsigned long window = now - windowStart;
+  if(window >= 1000)
+  {
+    // A gap of more than a second counts as a second of no frames
+    fps = window < 2000 ? (uint32_t)windowFrames * 1000 / window : 0;
+    windowStart = now;
+    windowFrames = 0;
+  }
+  windowFrames++;
+}
+
+uint16_t PerfCounters::getFps(unsigned long now) const
+{
+  return (now - windowStart < 2000) ? fps : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Appends formatted text, never past the end of the buffer.
+/// @param len Length of the text so far; advanced by the text added.
+////////////////////////////////////////////////////////////////////////////////
+static void Append(char* buf, uint16_t size, uint16_t& len, const char* format, ...)
+{
+  if(len + 1 >= size)
+  {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  int added = vsnprintf_P(buf + len, size - len, format, args);
+  va_end(args);
+  if(added > 0)
+  {
+    len = (len + added < size) ? len + added : size - 1;
+  }
+}
+
+// Format strings stay in flash, so each series spells out its own name
+#define APPEND_SERIES(name, series) \
+  do \
+  { \
+    uint16_t min, avg, max; \
+    series.summarize(min, avg, max); \
+    Append(buf, size, len, PSTR("\"" name "\":[%u,%u,%u],"), min, avg, max); \
+  } while(0)
+
+uint16_t PerfCounters::format(char* buf, uint16_t size, int freeRam,
+                              unsigned long now) const
+{
+  uint16_t len = 0;
+  buf[0] = '\0';
+  Append(buf, size, len, PSTR("{"));
+  APPEND_SERIES("render_us", renderTime);
+  APPEND_SERIES("show_us", showTime);
+  Append(buf, size, len, PSTR("\"fps\":%u,"), getFps(now));
+  APPEND_SERIES("packetloop_us", packetLoopTime);
+  Append(buf, size, len, PSTR("\"packets\":%lu,\"dropped\":%lu,"),
+         packets, droppedPackets);
+  APPEND_SERIES("poll_ms", pollLatency);
+  Append(buf, size, len, PSTR("\"poll_failures\":%lu,\"free_ram\":%d}"),
+         pollFailures, freeRam);
+  return len;
+}
+
+#endif // PERF_COUNTERS
@@ -0,0 +1,150 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file PerfCounters.h
+///
+/// @brief Runtime performance counters, read over HTTP (GET /stats) and
+///        optionally printed to serial.
+///
+/// Timings are kept as the last PERF_SAMPLES samples of each series in a
+/// ring buffer, so recording one is a store and an increment; min, average
+/// and max are worked out only when the counters are read.  Events are
+/// plain counts.
+///
+///   render_us      update() per shown frame, less show()
+///   show_us        show() per shown frame
+///   fps            frames shown over the last second
+///   packetloop_us  packetLoop() per received packet, callbacks included
+///   packets        packets received
+///   dropped        packets truncated to the buffer or datagrams rejected
+///   poll_ms        Jenkins request to complete response
+///   poll_failures  Jenkins requests that went unanswered
+///   free_ram       bytes between the heap and the stack
+///
+/// Setting PERF_COUNTERS to 0 compiles all of it out.  It is set here rather
+/// than in the sketch so the library sources see the same value.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#define PERF_COUNTERS 1  ///< 0 compiles the counters out
+#define PERF_SAMPLES 8   ///< Samples kept per series, a power of two
+
+#if PERF_COUNTERS
+
+#include <Arduino.h>
+
+#define PERF_TEXT_MAX 200  ///< Longest text from PerfCounters::format()
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief The latest PERF_SAMPLES samples of one timing.
+////////////////////////////////////////////////////////////////////////////////
+class PerfSeries
+{
+  public:
+    PerfSeries();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Records a sample, replacing the oldest.  Values above 65535
+    ///        are kept as 65535.
+    ////////////////////////////////////////////////////////////////////////////
+    void add(unsigned long sample)
+    {
+      samples[next] = sample > 0xFFFF ? 0xFFFF : sample;
+      next = (next + 1) & (PERF_SAMPLES - 1);
+      if(count < PERF_SAMPLES)
+      {
+        count++;
+      }
+    }
+
+    uint8_t getCount() const
+    {
+      return count;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Smallest, mean and largest of the samples kept; all 0 if there
+    ///        are none.
+    ////////////////////////////////////////////////////////////////////////////
+    void summarize(uint16_t& min, uint16_t& avg, uint16_t& max) const;
+
+  private:
+    static_assert((PERF_SAMPLES & (PERF_SAMPLES - 1)) == 0,
+                  "PERF_SAMPLES must be a power of two");
+
+    uint16_t samples[PERF_SAMPLES];
+    uint8_t next;   ///< Slot the next sample goes in
+    uint8_t count;  ///< Slots holding a sample
+};
+
+class PerfCounters
+{
+  public:
+    PerfCounters();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Records a shown frame.
+    /// @param renderUs Time spent in update() other than show().
+    /// @param showUs Time spent in show().
+    /// @param now Current time in milliseconds.
+    ////////////////////////////////////////////////////////////////////////////
+    void frame(unsigned long renderUs, unsigned long showUs, unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Records a received packet and the packetLoop() call for it.
+    ////////////////////////////////////////////////////////////////////////////
+    void packet(unsigned long packetLoopUs)
+    {
+      packetLoopTime.add(packetLoopUs);
+      packets++;
+    }
+
+    void dropped()
+    {
+      droppedPackets++;
+    }
+
+    void pollCompleted(unsigned long latencyMs)
+    {
+      pollLatency.add(latencyMs);
+    }
+
+    void pollFailed()
+    {
+      pollFailures++;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Frames shown over the last whole second; 0 once no frame has
+    ///        been shown for a second.
+    /// @param now Current time in milliseconds.
+    ////////////////////////////////////////////////////////////////////////////
+    uint16_t getFps(unsigned long now) const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Writes the counters as one line of JSON, e.g.
+    ///        {"render_us":[1210,1302,1580],...,"free_ram":412}
+    /// @param buf Destination.  PERF_TEXT_MAX bytes always suffice.
+    /// @param size Room in buf, including the terminating null.
+    /// @param freeRam Free SRAM in bytes, measured by the caller.
+    /// @param now Current time in milliseconds.
+    /// @return Length of the text, not counting the null.
+    ////////////////////////////////////////////////////////////////////////////
+    uint16_t format(char* buf, uint16_t size, int freeRam,
+                    unsigned long now) const;
+
+  private:
+    PerfSeries renderTime;
+    PerfSeries showTime;
+    PerfSeries packetLoopTime;
+    PerfSeries pollLatency;
+    unsigned long packets;
+    unsigned long droppedPackets;
+    unsigned long pollFailures;
+    unsigned long windowStart;  ///< Start of the second frames are counted in
+    uint16_t windowFrames;      ///< Frames shown since windowStart
+    uint16_t fps;               ///< Frames shown in the last whole second
+};
+
+#endif // PERF_COUNTERS
+
+#endif // PERFCOUNTERS_H
@@ -0,0 +1,78 @@
+#include "PixelStream.h"
+
+PixelStream::PixelStream() :
+  lastReceived(0),
+  pending(0),
+  frameId(0),
+  active(false)
+{
+}
+
+PixelStream::Status PixelStream::receive(NeoPixelRing& tree,
+                                         const uint8_t* data,
+                                         uint16_t len,
+                                         unsigned long now)
+{
+  if(!isStreamDatagram(data, len))
+  {
+    return IGNORED;
+  }
+  uint16_t id = ((uint16_t)data[1] << 8) | data[2];
+  uint8_t segment = data[3];
+  uint8_t segmentCount = data[4];
+  uint16_t firstPixel = ((uint16_t)data[5] << 8) | data[6];
+  uint16_t payload = len - STREAM_HEADER_SIZE;
+  if(0 == segmentCount ||
+     segmentCount > STREAM_MAX_SEGMENTS ||
+     segment >= segmentCount ||
+     payload % 3 != 0)
+  {
+    return IGNORED;
+  }
+
+  if(!active || (int16_t)(id - frameId) > 0)
+  {
+    // Start a new frame; whatever is left of the previous one is abandoned
+    // and its pixels are overwritten by this one
+    frameId = id;
+    pending = (segmentCount == 32) ? 0xFFFFFFFFUL
+                                   : ((1UL << segmentCount) - 1);
+    if(!active)
+    {
+      active = true;
+      tree.setStreaming(true);
+    }
+  }
+  else if(id != frameId)
+  {
+    return IGNORED;
+  }
+  lastReceived = now;
+
+  uint32_t bit = 1UL << segment;
+  if(0 == (pending & bit))
+  {
+    // Duplicate, or a segment of a frame already shown
+    return IGNORED;
+  }
+  tree.writePixels(firstPixel, data + STREAM_HEADER_SIZE, payload / 3);
+  pending &= ~bit;
+  if(0 != pending)
+  {
+    return BUFFERED;
+  }
+  tree.showPixels();
+  return SHOWN;
+}
+
+bool PixelStream::checkTimeout(NeoPixelRing& tree, unsigned long now)
+{
+  if(!active || now - lastReceived < STREAM_TIMEOUT_MS)
+  {
+    return false;
+  }
+  active = false;
+  pending = 0;
+  tree.setStreaming(false);
+  return true;
+}
@@ -0,0 +1,93 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file PixelStream.h
+///
+/// @brief Decoder for raw pixel frames streamed over UDP.
+///
+/// A frame is split into segments, one per datagram, each carrying the colors
+/// of a run of pixels.  All multi-byte fields are big endian.
+///
+///   Header (7 bytes)
+///     0    STREAM_MAGIC
+///     1-2  Frame ID
+///     3    Segment index, below the segment count
+///     4    Segment count, 1 to STREAM_MAX_SEGMENTS
+///     5-6  Index of the first pixel, counted across all strips
+///
+///   Payload
+///     Red, green and blue for each pixel, at least one pixel
+///
+/// Segments are written into the strip buffers as they arrive and the frame
+/// is shown once every segment of its frame ID has been received.  A segment
+/// of a newer frame (serial number arithmetic, as for control datagrams)
+/// abandons the frame in progress; segments of older frames are dropped.
+///
+/// The first segment takes the tree over from its ring patterns.  If no
+/// segment arrives for STREAM_TIMEOUT_MS the patterns take over again.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef PIXELSTREAM_H
+#define PIXELSTREAM_H
+
+#include <Arduino.h>
+#include "NeoPixelRing.h"
+
+#define STREAM_MAGIC 0x46 // 'F'
+
+#define STREAM_HEADER_SIZE 7
+#define STREAM_MAX_SEGMENTS 32
+#define STREAM_TIMEOUT_MS 2000
+
+class PixelStream
+{
+  public:
+    enum Status
+    {
+      IGNORED = 0,   ///< Malformed or stale; nothing was written
+      BUFFERED = 1,  ///< Written; the frame is still incomplete
+      SHOWN = 2      ///< Written and the completed frame was shown
+    };
+
+    PixelStream();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Checks whether a datagram is a frame segment.
+    ////////////////////////////////////////////////////////////////////////////
+    static bool isStreamDatagram(const uint8_t* data, uint16_t len)
+    {
+      return len >= STREAM_HEADER_SIZE + 3 && STREAM_MAGIC == data[0];
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Writes one segment into the tree and shows the frame once it is
+    ///        complete.  The colors are read where they lie, so data may point
+    ///        straight into the receive buffer.
+    /// @param tree Tree to draw on.  Streaming is turned on if it was off.
+    /// @param data Datagram payload.
+    /// @param len Number of bytes in data.
+    /// @param now Current time in milliseconds, for the timeout.
+    /// @return Outcome of the segment.
+    ////////////////////////////////////////////////////////////////////////////
+    Status receive(NeoPixelRing& tree, const uint8_t* data, uint16_t len,
+                   unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Hands the tree back to its patterns if the stream has gone
+    ///        quiet.  Call from every loop.
+    /// @param tree Tree being streamed to.
+    /// @param now Current time in milliseconds.
+    /// @return True if the stream timed out on this call.
+    ////////////////////////////////////////////////////////////////////////////
+    bool checkTimeout(NeoPixelRing& tree, unsigned long now);
+
+    bool isActive() const
+    {
+      return active;
+    }
+
+  private:
+    unsigned long lastReceived; ///< Time of the last accepted segment
+    uint32_t pending;           ///< One bit per segment still to arrive
+    uint16_t frameId;           ///< Frame being assembled or last shown
+    bool active;                ///< Stream owns the tree
+};
+
+#endif // PIXELSTREAM_H
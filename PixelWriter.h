@@ -0,0 +1,153 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file PixelWriter.h
+///
+/// @brief Writes colors straight into a strip's pixel buffer in wire order.
+///
+/// Adafruit_NeoPixel::setPixelColor() checks the index, tests for a
+/// brightness to scale by, works out the pixel's address and splits the
+/// color into the strip's byte order, for every pixel.  NeoPixelRing
+/// applies brightness itself and only writes pixels it knows are there, so
+/// it writes the bytes directly through one of these writers instead.
+///
+/// PixelWriter<Type> has the byte offsets of a neoPixelType as constants, so
+/// each write is a few stores at fixed displacements.  RuntimePixelWriter
+/// reads the same offsets from a type given at run time.  NeoPixelRing
+/// compiles its patterns for PixelWriter<NEOPIXELRING_WIRE_ORDER> and for
+/// RuntimePixelWriter, and uses the first when the strip type matches.
+///
+/// Both take colors as Adafruit_NeoPixel::Color() packs them: white in the
+/// top byte, then red, green and blue.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef PIXELWRITER_H
+#define PIXELWRITER_H
+
+#include <Arduino.h>
+#include <Adafruit_NeoPixel.h>
+
+// Color order NeoPixelRing is specialized for; the stock tree is NEO_GRB.
+// Other orders still work, a little slower.
+#ifndef NEOPIXELRING_WIRE_ORDER
+  #define NEOPIXELRING_WIRE_ORDER NEO_GRB
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Copies the first pixel of a span over the rest of it, doubling the
+///        copied length each time, so a span of n pixels takes log2(n)
+///        memcpy() calls.
+////////////////////////////////////////////////////////////////////////////////
+inline void RepeatPixel(uint8_t* p, uint16_t count, uint8_t bytes)
+{
+  uint16_t total = count * bytes;
+  uint16_t done = bytes;
+  while(done < total)
+  {
+    uint16_t chunk = (done < total - done) ? done : total - done;
+    memcpy(p + done, p, chunk);
+    done += chunk;
+  }
+}
+
+template<neoPixelType Type>
+struct PixelWriter
+{
+  static const uint8_t W = (Type >> 6) & 0b11;
+  static const uint8_t R = (Type >> 4) & 0b11;
+  static const uint8_t G = (Type >> 2) & 0b11;
+  static const uint8_t B = Type & 0b11;
+  static const uint8_t BYTES = (W == R) ? 3 : 4; ///< RGB types repeat R as W
+
+  uint8_t Bytes() const
+  {
+    return BYTES;
+  }
+
+  void Write(uint8_t* p, uint32_t c) const
+  {
+    if(4 == BYTES)
+    {
+      p[W] = c >> 24;
+    }
+    p[R] = c >> 16;
+    p[G] = c >> 8;
+    p[B] = c;
+  }
+
+  uint32_t Read(const uint8_t* p) const
+  {
+    uint32_t c = ((uint32_t)p[R] << 16) | ((uint16_t)p[G] << 8) | p[B];
+    if(4 == BYTES)
+    {
+      c |= (uint32_t)p[W] << 24;
+    }
+    return c;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////
+  /// @brief Sets count pixels from p on to one color.
+  ////////////////////////////////////////////////////////////////////////////
+  void Fill(uint8_t* p, uint16_t count, uint32_t c) const
+  {
+    if(0 == count)
+    {
+      return;
+    }
+    Write(p, c);
+    RepeatPixel(p, count, BYTES);
+  }
+};
+
+struct RuntimePixelWriter
+{
+  uint8_t w;
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+  uint8_t bytes;
+
+  void SetType(neoPixelType type)
+  {
+    w = (type >> 6) & 0b11;
+    r = (type >> 4) & 0b11;
+    g = (type >> 2) & 0b11;
+    b = type & 0b11;
+    bytes = (w == r) ? 3 : 4;
+  }
+
+  uint8_t Bytes() const
+  {
+    return bytes;
+  }
+
+  void Write(uint8_t* p, uint32_t c) const
+  {
+    if(4 == bytes)
+    {
+      p[w] = c >> 24;
+    }
+    p[r] = c >> 16;
+    p[g] = c >> 8;
+    p[b] = c;
+  }
+
+  uint32_t Read(const uint8_t* p) const
+  {
+    uint32_t c = ((uint32_t)p[r] << 16) | ((uint16_t)p[g] << 8) | p[b];
+    if(4 == bytes)
+    {
+      c |= (uint32_t)p[w] << 24;
+    }
+    return c;
+  }
+
+  void Fill(uint8_t* p, uint16_t count, uint32_t c) const
+  {
+    if(0 == count)
+    {
+      return;
+    }
+    Write(p, c);
+    RepeatPixel(p, count, bytes);
+  }
+};
+
+#endif // PIXELWRITER_H
@@ -0,0 +1,119 @@
+#include "ResponseSender.h"
+
+ResponseSender::ResponseSender() :
+  firstSeq(0),
+  lastSent(0),
+  length(0),
+  segmentSize(1),
+  acked(0),
+  sentEnd(0),
+  retries(0),
+  due(false),
+  active(false)
+{
+}
+
+void ResponseSender::begin(uint16_t length,
+                           uint16_t segmentSize,
+                           uint32_t firstSeq,
+                           unsigned long now)
+{
+  this->firstSeq = firstSeq;
+  this->length = length;
+  this->segmentSize = segmentSize > 0 ? segmentSize : 1;
+  lastSent = now;
+  acked = 0;
+  sentEnd = 0;
+  retries = 0;
+  due = true;
+  active = true;
+}
+
+bool ResponseSender::acknowledged(uint32_t ackSeq, unsigned long now)
+{
+  if(!active)
+  {
+    return false;
+  }
+  // Offset from the first byte; stale or bogus acknowledgements fall
+  // outside the response once taken modulo 2^32
+  uint32_t offset = ackSeq - firstSeq;
+  if(offset <= acked || offset > sentEnd)
+  {
+    return false;
+  }
+  acked = offset;
+  retries = 0;
+  lastSent = now;
+  if(acked == (uint32_t)length + 1)
+  {
+    active = false;
+  }
+  else if(acked == sentEnd)
+  {
+    due = true;
+  }
+  return true;
+}
+
+bool ResponseSender::sendDue(unsigned long now)
+{
+  if(!active)
+  {
+    return false;
+  }
+  if(due)
+  {
+    return true;
+  }
+  if(now - lastSent < RESPONSE_RETRY_MS)
+  {
+    return false;
+  }
+  if(retries >= RESPONSE_MAX_RETRIES)
+  {
+    active = false;
+    return false;
+  }
+  retries++;
+  return true;
+}
+
+uint8_t ResponseSender::burstSegments() const
+{
+  if(acked >= length)
+  {
+    return 0;
+  }
+  uint16_t segments = (length - acked + segmentSize - 1) / segmentSize;
+  return segments < RESPONSE_WINDOW ? segments : RESPONSE_WINDOW;
+}
+
+void ResponseSender::segment(uint8_t i, uint16_t& offset, uint16_t& size) const
+{
+  offset = acked + (uint16_t)i * segmentSize;
+  size = length - offset < segmentSize ? length - offset : segmentSize;
+}
+
+bool ResponseSender::burstEnds() const
+{
+  return (uint32_t)acked + (uint32_t)burstSegments() * segmentSize >= length;
+}
+
+void ResponseSender::sent(unsigned long now)
+{
+  uint16_t offset;
+  uint16_t size;
+  uint8_t segments = burstSegments();
+  if(segments > 0)
+  {
+    segment(segments - 1, offset, size);
+    sentEnd = offset + size;
+  }
+  if(burstEnds())
+  {
+    sentEnd = length + 1;
+  }
+  due = false;
+  lastSent = now;
+}
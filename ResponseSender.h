@@ -0,0 +1,132 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file ResponseSender.h
+///
+/// @brief Paces an HTTP response that is too large for one Ethernet segment,
+///        so it goes out a little per loop() instead of all at once.
+///
+/// The response is sent in bursts of up to RESPONSE_WINDOW segments.  The
+/// next burst is sent once the client has acknowledged everything in
+/// flight, which is usually one round trip: a receiver acknowledges every
+/// second segment at once rather than waiting on its delayed ACK timer.
+/// Between bursts loop() carries on rendering and handling other packets.
+///
+/// Every burst starts at the last byte the client acknowledged.  If no
+/// acknowledgement comes within RESPONSE_RETRY_MS the burst is sent again
+/// from there, and after RESPONSE_MAX_RETRIES the response is abandoned.
+///
+/// The connection is closed with a FIN after the last segment.  The FIN
+/// takes one sequence number, so the response is complete once the client
+/// has acknowledged length + 1.
+///
+/// This class only does the bookkeeping; the sketch moves the bytes.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef RESPONSESENDER_H
+#define RESPONSESENDER_H
+
+#include <Arduino.h>
+
+#define RESPONSE_WINDOW 2          ///< Segments sent per burst
+#define RESPONSE_RETRY_MS 500UL
+#define RESPONSE_MAX_RETRIES 4
+
+class ResponseSender
+{
+  public:
+    ResponseSender();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Starts a response.  The first burst is due immediately.
+    /// @param length Response size in bytes.
+    /// @param segmentSize Most bytes sent in one segment.
+    /// @param firstSeq Sequence number of the first response byte.
+    /// @param now Current time in milliseconds.
+    ////////////////////////////////////////////////////////////////////////////
+    void begin(uint16_t length, uint16_t segmentSize, uint32_t firstSeq,
+               unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Abandons the response in progress.
+    ////////////////////////////////////////////////////////////////////////////
+    void stop()
+    {
+      active = false;
+    }
+
+    bool isActive() const
+    {
+      return active;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Records an acknowledgement from the client.
+    /// @param ackSeq Acknowledgement number of the client's packet.
+    /// @param now Current time in milliseconds.
+    /// @return True if it acknowledged new data.  The response may have
+    ///         completed; check isActive().
+    ////////////////////////////////////////////////////////////////////////////
+    bool acknowledged(uint32_t ackSeq, unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Checks whether a burst should be sent now: the first one, the
+    ///        next one after everything in flight was acknowledged, or a
+    ///        retry.  Gives up on the response after too many retries.
+    /// @param now Current time in milliseconds.
+    ////////////////////////////////////////////////////////////////////////////
+    bool sendDue(unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Number of data segments in the burst that is due.  May be 0
+    ///        when only the FIN is left to send.
+    ////////////////////////////////////////////////////////////////////////////
+    uint8_t burstSegments() const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Locates one segment of the burst that is due.
+    /// @param i Segment index, below burstSegments().
+    /// @param offset Set to the offset of its first byte in the response.
+    /// @param size Set to its size in bytes.
+    ////////////////////////////////////////////////////////////////////////////
+    void segment(uint8_t i, uint16_t& offset, uint16_t& size) const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief The burst that is due reaches the end of the response, so a
+    ///        FIN follows its last segment.
+    ////////////////////////////////////////////////////////////////////////////
+    bool burstEnds() const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Offset in the response of the FIN, which follows the last byte.
+    ///        A FIN resent on its own goes out here, not after a segment.
+    ////////////////////////////////////////////////////////////////////////////
+    uint16_t finOffset() const
+    {
+      return length;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Records that the burst that was due has been sent.
+    /// @param now Current time in milliseconds.
+    ////////////////////////////////////////////////////////////////////////////
+    void sent(unsigned long now);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Bytes the client has acknowledged, counting the FIN as one.
+    ////////////////////////////////////////////////////////////////////////////
+    uint16_t getAcked() const
+    {
+      return acked;
+    }
+
+  private:
+    uint32_t firstSeq;       ///< Sequence number of the first byte
+    unsigned long lastSent;  ///< Time the last burst was sent
+    uint16_t length;
+    uint16_t segmentSize;
+    uint16_t acked;          ///< Acknowledged, counting the FIN
+    uint16_t sentEnd;        ///< End of the last burst, counting the FIN
+    uint8_t retries;         ///< Bursts resent without progress
+    bool due;                ///< Send a burst without waiting for a retry
+    bool active;
+};
+
+#endif // RESPONSESENDER_H
@@ -0,0 +1,130 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file SpatialMap.h
+///
+/// @brief Where each pixel sits on the tree, as one byte per coordinate.
+///
+/// Rings are stacked into a cone: the first ring at the bottom, the last at
+/// the top, evenly spaced.  Each pixel gets
+///
+///   height  0 at the bottom ring to 255 at the top one
+///   angle   Around its ring from its first pixel, 256 per revolution.
+///           The rings' first pixels are taken to line up.
+///   radius  255 for the largest ring, smaller rings in proportion to their
+///           pixel count (the pixel pitch is about the same on every ring);
+///           0 for a single pixel
+///
+/// Patterns that sweep across the whole tree read these from a table built
+/// once, instead of working out trigonometry per pixel per frame.
+/// SpatialPointOf() is the one formula for the table.  NeoPixelRing builds
+/// the table in RAM from its rings; StaticSpatialMap has the compiler build
+/// it into flash from a layout known at compile time.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef SPATIALMAP_H
+#define SPATIALMAP_H
+
+#include <Arduino.h>
+
+struct SpatialPoint
+{
+  uint8_t height;
+  uint8_t angle;
+  uint8_t radius;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Coordinates of one pixel.
+/// @param ring Index of the pixel's ring, 0 at the bottom.
+/// @param index Index of the pixel within its ring.
+/// @param numRings Number of rings in the tree.
+/// @param size Number of pixels in the ring.
+/// @param largest Number of pixels in the tree's largest ring.
+////////////////////////////////////////////////////////////////////////////////
+constexpr SpatialPoint SpatialPointOf(uint8_t ring, uint8_t index,
+                                      uint8_t numRings, uint8_t size,
+                                      uint8_t largest)
+{
+  return SpatialPoint{
+    (uint8_t)((numRings > 1) ? ring * 255 / (numRings - 1) : 0),
+    (uint8_t)(index * 256 / size),
+    (uint8_t)((size > 1) ? size * 255 / largest : 0)
+  };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Number of pixels in the largest of count rings.
+////////////////////////////////////////////////////////////////////////////////
+constexpr uint8_t LargestRing(const uint8_t* sizes, uint8_t count,
+                              uint8_t largest = 0)
+{
+  return (0 == count) ? largest :
+         LargestRing(sizes + 1, count - 1,
+                     (sizes[0] > largest) ? sizes[0] : largest);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Coordinates of a pixel counted across the tree.
+/// @param sizes Number of pixels in each ring.
+/// @param numRings Number of rings.
+/// @param pixel Pixel index, less than the total of sizes.
+////////////////////////////////////////////////////////////////////////////////
+constexpr SpatialPoint LayoutPoint(const uint8_t* sizes, uint8_t numRings,
+                                   uint16_t pixel, uint8_t ring = 0)
+{
+  return (pixel < sizes[ring]) ?
+         SpatialPointOf(ring, pixel, numRings, sizes[ring],
+                        LargestRing(sizes, numRings)) :
+         LayoutPoint(sizes, numRings, pixel - sizes[ring], ring + 1);
+}
+
+template<uint16_t... I>
+struct IndexList
+{
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief IndexList<0, 1, ... N-1>, for expanding a table entry per index.
+////////////////////////////////////////////////////////////////////////////////
+template<uint16_t N, uint16_t... I>
+struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...>
+{
+};
+
+template<uint16_t... I>
+struct MakeIndexList<0, I...>
+{
+  typedef IndexList<I...> type;
+};
+
+template<typename Indices, uint8_t... Sizes>
+struct SpatialTable;
+
+template<uint16_t... I, uint8_t... Sizes>
+struct SpatialTable<IndexList<I...>, Sizes...>
+{
+  static constexpr uint8_t sizes[sizeof...(Sizes)] = { Sizes... };
+  static const SpatialPoint points[sizeof...(I)];
+};
+
+template<uint16_t... I, uint8_t... Sizes>
+constexpr uint8_t SpatialTable<IndexList<I...>, Sizes...>::sizes[];
+
+// Every entry is a constant expression, so the table is laid out by the
+// compiler and never touched at boot
+template<uint16_t... I, uint8_t... Sizes>
+const SpatialPoint SpatialTable<IndexList<I...>, Sizes...>::points[] PROGMEM = {
+  LayoutPoint(sizes, sizeof...(Sizes), I)...
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief The map of a ring layout fixed at compile time, in flash, e.g.
+///        StaticSpatialMap<93, 32,24,16,12,8,1>::points.  Entries must be
+///        read with pgm_read_byte().
+/// @tparam NumPixels Total of Sizes (RingLayout<Sizes...>::pixels).
+////////////////////////////////////////////////////////////////////////////////
+template<uint16_t NumPixels, uint8_t... Sizes>
+struct StaticSpatialMap :
+  SpatialTable<typename MakeIndexList<NumPixels>::type, Sizes...>
+{
+};
+
+#endif // SPATIALMAP_H
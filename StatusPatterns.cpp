@@ -0,0 +1,45 @@
+#include "StatusPatterns.h"
+
+void updatePatterns(NeoPixelRing& lTree, uint8_t ring, uint8_t status)
+{
+  uint32_t illuminateColor = 0;
+  if(status & BUILDSTATUS_SUCCESS)
+  {
+    illuminateColor = COLOR_GREEN;
+  }
+  else if(status & BUILDSTATUS_FAILURE)
+  {
+    illuminateColor = COLOR_RED;
+  }
+  else
+  {
+    illuminateColor = COLOR_YELLOW;
+  }
+  // While building, pulse light corresponding to previous build status
+  if(status & BUILDSTATUS_BUILDING)
+  {
+    lTree.setPattern(ring,
+                     NeoPixelRing::SPIN,
+                     illuminateColor,
+                     2000,
+                     0);
+  }
+  // Unknown flash all lights
+  else if(status & BUILDSTATUS_UNKNOWN)
+  {
+    lTree.setPattern(ring,
+                     NeoPixelRing::PULSE,
+                     illuminateColor,
+                     2000,
+                     0);
+  }
+  // Solid corresponding to build status
+  else
+  {
+    lTree.setPattern(ring,
+                     NeoPixelRing::SOLID,
+                     illuminateColor,
+                     2000,
+                     0);
+  }
+}
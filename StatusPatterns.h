@@ -0,0 +1,34 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file StatusPatterns.h
+///
+/// @brief How a Jenkins job's build status is shown on a ring.  Kept out of
+///        the sketch so the host tools can drive the tree exactly as the
+///        board does.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef STATUSPATTERNS_H
+#define STATUSPATTERNS_H
+
+#include <Arduino.h>
+#include "NeoPixelRing.h"
+
+#define BUILDSTATUS_SUCCESS    0x01
+#define BUILDSTATUS_UNSTABLE   0x02
+#define BUILDSTATUS_FAILURE    0x04
+#define BUILDSTATUS_OTHER      0x08
+#define BUILDSTATUS_UNKNOWN    0x10
+#define BUILDSTATUS_BUILDING   0x80
+
+// Colors
+#define COLOR_RED    0x00FF0000
+#define COLOR_GREEN  0x0000FF00
+#define COLOR_YELLOW 0x00FFBF00
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Shows a job's build status on one ring.
+/// @param lTree Tree to update
+/// @param ring Ring to set
+/// @param status BUILDSTATUS_* flags of the job
+////////////////////////////////////////////////////////////////////////////////
+void updatePatterns(NeoPixelRing& lTree, uint8_t ring, uint8_t status);
+
+#endif // STATUSPATTERNS_H
@@ -25,10 +25,10 @@ CONFIG_PAGE="config.html"
 CONFIG_PAGE_MIN="config.min.html"
 CONFIG_HEADER="config_html.h"
 
-VAR_TYPE="const PROGMEM char"
-VAR_NAME="config_html[]"
+CONFIG_PAGE_GZ="config.min.html.gz"
 
-HTTP_HEADER="HTTP/1.0 200 OK\r\nContent-Type: text/html\r\nContent-Encoding: gzip\r\nPragma: no-cache\r\n\r\n"
+VAR_TYPE="const uint8_t"
+VAR_NAME="config_html[] PROGMEM"
 
 # Get directory of generator script
 DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
@@ -63,17 +63,30 @@ sed -i '' -e 's/^ *//' "$DIR/$CONFIG_PAGE_MIN"
 tr -d '\n' < "$DIR/$CONFIG_PAGE_MIN" > "$DIR/${CONFIG_PAGE_MIN}_"
 mv "$DIR/${CONFIG_PAGE_MIN}_" "$DIR/$CONFIG_PAGE_MIN"
 
-# Compress page content
-gzip --best -c "$DIR/${CONFIG_PAGE_MIN}" | hexdump -v -e '/1 "_x%02X"' | sed 's/_/\\/g' > "$DIR/${CONFIG_PAGE_MIN}_"
+# Compress page content.  -n leaves out the name and time stamp so the
+# same page always compresses to the same bytes and the same ETag.
+gzip --best -n -c "$DIR/$CONFIG_PAGE_MIN" > "$DIR/$CONFIG_PAGE_GZ"
+rm "$DIR/$CONFIG_PAGE_MIN"
 
-# Remove any remaining newlines (should be only one at end of file)
-tr -d '\n' < "$DIR/${CONFIG_PAGE_MIN}_" > "$DIR/${CONFIG_PAGE_MIN}"
-rm "$DIR/${CONFIG_PAGE_MIN}_"
+GZIP_LENGTH=$(wc -c < "$DIR/$CONFIG_PAGE_GZ" | tr -d ' ')
+ETAG=$(shasum -a 1 "$DIR/$CONFIG_PAGE_GZ" | cut -c1-16)
 
-# Write compressed html/js with http headers to c++ header file as constant string
-echo -n "$VAR_TYPE $VAR_NAME = \"$HTTP_HEADER" > "$DIR/$CONFIG_HEADER"
-cat "$DIR/$CONFIG_PAGE_MIN" >> "$DIR/$CONFIG_HEADER"
-echo "\";" >> "$DIR/$CONFIG_HEADER"
+# Browsers revalidate on every visit (no-cache) and get 304 Not Modified
+# while the ETag still matches
+HTTP_HEADER="HTTP/1.0 200 OK\r\nContent-Type: text/html\r\nContent-Encoding: gzip\r\nContent-Length: $GZIP_LENGTH\r\nCache-Control: no-cache\r\nETag: \"$ETAG\"\r\n\r\n"
+HEADER_LENGTH=$(printf "$HTTP_HEADER" | wc -c | tr -d ' ')
+
+# Write http headers and compressed page to c++ header file as a byte array
+{
+  echo "// Generated by $(basename "${BASH_SOURCE[0]}") from $CONFIG_PAGE; do not edit."
+  echo "#define CONFIG_HTML_ETAG \"\\\"$ETAG\\\"\""
+  echo "#define CONFIG_HTML_GZIP_LENGTH $GZIP_LENGTH // Compressed page"
+  echo "#define CONFIG_HTML_LENGTH $((HEADER_LENGTH + GZIP_LENGTH)) // Headers and compressed page"
+  echo "$VAR_TYPE $VAR_NAME = {"
+  { printf "$HTTP_HEADER"; cat "$DIR/$CONFIG_PAGE_GZ"; } | \
+    od -An -v -tx1 | sed -e 's/ *\([0-9a-f][0-9a-f]\)/0x\1,/g' -e 's/^/  /'
+  echo "};"
+} > "$DIR/$CONFIG_HEADER"
 
 # Delete temporary file
-rm "$DIR/$CONFIG_PAGE_MIN"
+rm "$DIR/$CONFIG_PAGE_GZ"
@@ -0,0 +1,265 @@
+#include "Adafruit_NeoPixel.h"
+
+uint32_t Adafruit_NeoPixel::totalShowCount = 0;
+uint64_t Adafruit_NeoPixel::totalShowMicros = 0;
+uint32_t Adafruit_NeoPixel::totalShowChecksum = 0;
+Adafruit_NeoPixel::ShowHook Adafruit_NeoPixel::showHook = NULL;
+
+Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, uint16_t p, neoPixelType t) :
+  begun(false), numLEDs(0), numBytes(0), pin(-1), brightness(0), pixels(NULL),
+  rOffset(1), gOffset(0), bOffset(2), wOffset(1), is800KHz(true),
+  showCount(0), showMicros(0), showChecksum(0)
+{
+  updateType(t);
+  updateLength(n);
+  setPin(p);
+}
+
+Adafruit_NeoPixel::Adafruit_NeoPixel() :
+  begun(false), numLEDs(0), numBytes(0), pin(-1), brightness(0), pixels(NULL),
+  rOffset(1), gOffset(0), bOffset(2), wOffset(1), is800KHz(true),
+  showCount(0), showMicros(0), showChecksum(0)
+{
+}
+
+// The real library has no copy semantics (a copy double-frees the pixel
+// buffer).  The stand-in deep copies so accidental copies show up as wrong
+// output rather than heap corruption.
+Adafruit_NeoPixel::Adafruit_NeoPixel(const Adafruit_NeoPixel& other) :
+  pixels(NULL)
+{
+  *this = other;
+}
+
+Adafruit_NeoPixel& Adafruit_NeoPixel::operator=(const Adafruit_NeoPixel& other)
+{
+  if(this != &other)
+  {
+    free(pixels);
+    begun = other.begun;
+    numLEDs = other.numLEDs;
+    numBytes = other.numBytes;
+    pin = other.pin;
+    brightness = other.brightness;
+    rOffset = other.rOffset;
+    gOffset = other.gOffset;
+    bOffset = other.bOffset;
+    wOffset = other.wOffset;
+    is800KHz = other.is800KHz;
+    showCount = other.showCount;
+    showMicros = other.showMicros;
+    showChecksum = other.showChecksum;
+    pixels = NULL;
+    if(other.pixels != NULL)
+    {
+      pixels = (uint8_t*)malloc(numBytes);
+      memcpy(pixels, other.pixels, numBytes);
+    }
+  }
+  return *this;
+}
+
+Adafruit_NeoPixel::~Adafruit_NeoPixel()
+{
+  free(pixels);
+}
+
+void Adafruit_NeoPixel::begin()
+{
+  begun = true;
+}
+
+void Adafruit_NeoPixel::show()
+{
+  if(pixels == NULL)
+  {
+    return;
+  }
+  // Bitstream time plus the 50 us latch
+  uint32_t duration = (uint32_t)numBytes * 8 * (is800KHz ? 5 : 10) / 4 + 50;
+  showCount++;
+  showMicros += duration;
+  totalShowCount++;
+  totalShowMicros += duration;
+  for(uint16_t i = 0; i < numBytes; i++)
+  {
+    showChecksum = (showChecksum << 5) + showChecksum + pixels[i];
+    totalShowChecksum = (totalShowChecksum << 5) + totalShowChecksum + pixels[i];
+  }
+  if(showHook != NULL)
+  {
+    showHook(*this);
+  }
+}
+
+void Adafruit_NeoPixel::setPin(uint16_t p)
+{
+  pin = p;
+}
+
+void Adafruit_NeoPixel::updateLength(uint16_t n)
+{
+  free(pixels);
+  numBytes = n * ((wOffset == rOffset) ? 3 : 4);
+  pixels = (uint8_t*)calloc(numBytes, 1);
+  if(pixels != NULL)
+  {
+    numLEDs = n;
+  }
+  else
+  {
+    numLEDs = numBytes = 0;
+  }
+}
+
+void Adafruit_NeoPixel::updateType(neoPixelType t)
+{
+  bool oldThreeBytesPerPixel = (wOffset == rOffset);
+
+  wOffset = (t >> 6) & 0b11;
+  rOffset = (t >> 4) & 0b11;
+  gOffset = (t >> 2) & 0b11;
+  bOffset = t & 0b11;
+  is800KHz = (t < 256);
+
+  if(pixels != NULL)
+  {
+    bool newThreeBytesPerPixel = (wOffset == rOffset);
+    if(newThreeBytesPerPixel != oldThreeBytesPerPixel)
+    {
+      updateLength(numLEDs);
+    }
+  }
+}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b)
+{
+  if(n < numLEDs)
+  {
+    if(brightness)
+    {
+      r = (r * brightness) >> 8;
+      g = (g * brightness) >> 8;
+      b = (b * brightness) >> 8;
+    }
+    uint8_t* p;
+    if(wOffset == rOffset)
+    {
+      p = &pixels[n * 3];
+    }
+    else
+    {
+      p = &pixels[n * 4];
+      p[wOffset] = 0;
+    }
+    p[rOffset] = r;
+    p[gOffset] = g;
+    p[bOffset] = b;
+  }
+}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+{
+  if(n < numLEDs)
+  {
+    if(brightness)
+    {
+      r = (r * brightness) >> 8;
+      g = (g * brightness) >> 8;
+      b = (b * brightness) >> 8;
+      w = (w * brightness) >> 8;
+    }
+    uint8_t* p;
+    if(wOffset == rOffset)
+    {
+      p = &pixels[n * 3];
+    }
+    else
+    {
+      p = &pixels[n * 4];
+      p[wOffset] = w;
+    }
+    p[rOffset] = r;
+    p[gOffset] = g;
+    p[bOffset] = b;
+  }
+}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint32_t c)
+{
+  setPixelColor(n, (uint8_t)(c >> 16), (uint8_t)(c >> 8), (uint8_t)c,
+                (uint8_t)(c >> 24));
+}
+
+void Adafruit_NeoPixel::setBrightness(uint8_t b)
+{
+  // Stored brightness value is different than what's passed.  This
+  // simplifies the actual scaling math later, allowing a fast 8x8-bit
+  // multiply and taking the MSB.  'brightness' is a uint8_t, adding 1
+  // here may (intentionally) roll over...so 0 = max brightness (color
+  // values are interpreted literally; no scaling), 1 = min brightness
+  // (off), 255 = just below max brightness.
+  uint8_t newBrightness = b + 1;
+  if(newBrightness != brightness)
+  {
+    uint8_t oldBrightness = brightness - 1;
+    uint16_t scale;
+    if(oldBrightness == 0)
+    {
+      scale = 0; // Avoid divide by 0
+    }
+    else if(b == 255)
+    {
+      scale = 65535 / oldBrightness;
+    }
+    else
+    {
+      scale = (((uint16_t)newBrightness << 8) - 1) / oldBrightness;
+    }
+    for(uint16_t i = 0; i < numBytes; i++)
+    {
+      pixels[i] = (pixels[i] * scale) >> 8;
+    }
+    brightness = newBrightness;
+  }
+}
+
+void Adafruit_NeoPixel::clear()
+{
+  memset(pixels, 0, numBytes);
+}
+
+uint32_t Adafruit_NeoPixel::getPixelColor(uint16_t n) const
+{
+  if(n >= numLEDs)
+  {
+    return 0;
+  }
+
+  uint8_t* p;
+  uint32_t w = 0;
+  if(wOffset == rOffset)
+  {
+    p = &pixels[n * 3];
+  }
+  else
+  {
+    p = &pixels[n * 4];
+    w = p[wOffset];
+  }
+  uint32_t r = p[rOffset];
+  uint32_t g = p[gOffset];
+  uint32_t b = p[bOffset];
+  if(brightness)
+  {
+    // Stored color was decimated by setBrightness().  Returned value
+    // attempts to scale back to an approximation of the original 24-bit
+    // value used when setting the pixel color, but there will always be
+    // some error -- those bits are simply gone.
+    r = (r << 8) / brightness;
+    g = (g << 8) / brightness;
+    b = (b << 8) / brightness;
+    w = (w << 8) / brightness;
+  }
+  return (w << 24) | (r << 16) | (g << 8) | b;
+}
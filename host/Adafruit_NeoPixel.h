@@ -0,0 +1,133 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file Adafruit_NeoPixel.h
+///
+/// @brief Host stand-in for the Adafruit NeoPixel library.  Pixels live in an
+///        in-memory buffer laid out exactly like the real library (wire order,
+///        brightness applied on write) and show() is instrumented instead of
+///        driving a pin.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef HOST_ADAFRUIT_NEOPIXEL_H
+#define HOST_ADAFRUIT_NEOPIXEL_H
+
+#include <Arduino.h>
+
+// Color order and speed flags match the real library bit for bit
+#define NEO_RGB  ((0 << 6) | (0 << 4) | (1 << 2) | (2))
+#define NEO_RBG  ((0 << 6) | (0 << 4) | (2 << 2) | (1))
+#define NEO_GRB  ((1 << 6) | (1 << 4) | (0 << 2) | (2))
+#define NEO_GBR  ((2 << 6) | (2 << 4) | (0 << 2) | (1))
+#define NEO_BRG  ((1 << 6) | (1 << 4) | (2 << 2) | (0))
+#define NEO_BGR  ((2 << 6) | (2 << 4) | (1 << 2) | (0))
+#define NEO_RGBW ((3 << 6) | (0 << 4) | (1 << 2) | (2))
+#define NEO_GRBW ((3 << 6) | (1 << 4) | (0 << 2) | (2))
+
+#define NEO_KHZ800 0x0000
+#define NEO_KHZ400 0x0100
+
+typedef uint16_t neoPixelType;
+
+class Adafruit_NeoPixel
+{
+  public:
+    Adafruit_NeoPixel(uint16_t n, uint16_t pin = 6,
+                      neoPixelType type = NEO_GRB + NEO_KHZ800);
+    Adafruit_NeoPixel();
+    Adafruit_NeoPixel(const Adafruit_NeoPixel& other);
+    Adafruit_NeoPixel& operator=(const Adafruit_NeoPixel& other);
+    ~Adafruit_NeoPixel();
+
+    void begin();
+    void show();
+    void setPin(uint16_t p);
+    void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b);
+    void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w);
+    void setPixelColor(uint16_t n, uint32_t c);
+    void setBrightness(uint8_t b);
+    void clear();
+    void updateLength(uint16_t n);
+    void updateType(neoPixelType t);
+
+    uint8_t* getPixels() const { return pixels; }
+    uint8_t getBrightness() const { return brightness - 1; }
+    int16_t getPin() const { return pin; }
+    uint16_t numPixels() const { return numLEDs; }
+    uint32_t getPixelColor(uint16_t n) const;
+
+    static uint32_t Color(uint8_t r, uint8_t g, uint8_t b)
+    {
+      return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+    }
+    static uint32_t Color(uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+    {
+      return ((uint32_t)w << 24) | ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+    }
+
+    // Host-only instrumentation
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Number of times show() has been called since construction.
+    ////////////////////////////////////////////////////////////////////////////
+    uint32_t hostShowCount() const { return showCount; }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Total time interrupts would have been masked by show() on real
+    ///        hardware, in microseconds.  Estimated from the bitstream rate
+    ///        (1.25 us per bit at 800 KHz, 2.5 us at 400 KHz).
+    ////////////////////////////////////////////////////////////////////////////
+    uint32_t hostShowMicros() const { return showMicros; }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Running checksum of every buffer passed to show().  Lets hosts
+    ///        compare output between implementations and keeps the compiler
+    ///        from discarding rendering work in benchmarks.
+    ////////////////////////////////////////////////////////////////////////////
+    uint32_t hostShowChecksum() const { return showChecksum; }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Totals of hostShowCount(), hostShowMicros() and
+    ///        hostShowChecksum() across every strip, for hosts that cannot
+    ///        reach the strip object itself.
+    ////////////////////////////////////////////////////////////////////////////
+    static uint32_t hostTotalShowCount() { return totalShowCount; }
+    static uint64_t hostTotalShowMicros() { return totalShowMicros; }
+    static uint32_t hostTotalShowChecksum() { return totalShowChecksum; }
+    static void hostResetTotals()
+    {
+      totalShowCount = 0;
+      totalShowMicros = 0;
+      totalShowChecksum = 0;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Called by show() with the strip being shown, for hosts that
+    ///        record the output.  NULL, the default, records nothing.
+    ////////////////////////////////////////////////////////////////////////////
+    typedef void (*ShowHook)(const Adafruit_NeoPixel& strip);
+    static void hostSetShowHook(ShowHook hook) { showHook = hook; }
+
+    uint16_t hostNumBytes() const { return numBytes; }
+
+  protected:
+    bool begun;
+    uint16_t numLEDs;
+    uint16_t numBytes;
+    int16_t pin;
+    uint8_t brightness;
+    uint8_t* pixels;
+    uint8_t rOffset;
+    uint8_t gOffset;
+    uint8_t bOffset;
+    uint8_t wOffset;
+    bool is800KHz;
+
+    uint32_t showCount;
+    uint32_t showMicros;
+    uint32_t showChecksum;
+
+    static uint32_t totalShowCount;
+    static uint64_t totalShowMicros;
+    static uint32_t totalShowChecksum;
+    static ShowHook showHook;
+};
+
+#endif // HOST_ADAFRUIT_NEOPIXEL_H
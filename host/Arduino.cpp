@@ -0,0 +1,61 @@
+#include "Arduino.h"
+
+static unsigned long hostMicros = 0;
+static uint32_t hostRandomState = 1;
+
+unsigned long millis()
+{
+  return hostMicros / 1000;
+}
+
+unsigned long micros()
+{
+  return hostMicros;
+}
+
+void delay(unsigned long ms)
+{
+  hostAdvanceMillis(ms);
+}
+
+void hostSetMillis(unsigned long ms)
+{
+  hostMicros = ms * 1000;
+}
+
+void hostAdvanceMillis(unsigned long ms)
+{
+  hostMicros += ms * 1000;
+}
+
+void hostAdvanceMicros(unsigned long us)
+{
+  hostMicros += us;
+}
+
+long random(long howBig)
+{
+  if(howBig <= 0)
+  {
+    return 0;
+  }
+  // xorshift32 keeps sequences identical across host C libraries
+  hostRandomState ^= hostRandomState << 13;
+  hostRandomState ^= hostRandomState >> 17;
+  hostRandomState ^= hostRandomState << 5;
+  return hostRandomState % howBig;
+}
+
+long random(long howSmall, long howBig)
+{
+  if(howSmall >= howBig)
+  {
+    return howSmall;
+  }
+  return howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed)
+{
+  hostRandomState = (seed != 0) ? seed : 1;
+}
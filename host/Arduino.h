@@ -0,0 +1,62 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file Arduino.h
+///
+/// @brief Host stand-in for the Arduino core.  Provides just enough of the
+///        core API for NeoPixelRing to compile and run natively on Linux.
+///
+/// Time is virtual: millis() and micros() return a counter that is advanced
+/// explicitly by the host program with hostSetMillis()/hostAdvanceMillis().
+/// This makes pattern output reproducible and lets benchmarks sweep through
+/// pattern phases without waiting on the wall clock.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define pgm_read_ptr(addr) (*(const void* const*)(addr))
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+#define PSTR(str) (str)
+#define F(str) (str)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Sets the virtual clock returned by millis() and micros().
+/// @param ms New time in milliseconds since "boot".
+////////////////////////////////////////////////////////////////////////////////
+void hostSetMillis(unsigned long ms);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Moves the virtual clock forward.
+/// @param ms Number of milliseconds to advance.
+////////////////////////////////////////////////////////////////////////////////
+void hostAdvanceMillis(unsigned long ms);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Moves the virtual clock forward with microsecond resolution.
+/// @param us Number of microseconds to advance.
+////////////////////////////////////////////////////////////////////////////////
+void hostAdvanceMicros(unsigned long us);
+
+#endif // HOST_ARDUINO_H
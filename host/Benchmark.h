@@ -0,0 +1,96 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file Benchmark.h
+///
+/// @brief Minimal timing harness shared by the host benchmarks.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef HOST_BENCHMARK_H
+#define HOST_BENCHMARK_H
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+struct BenchResult
+{
+  double nsPerFrame;
+  double framesPerSec;
+  uint32_t frames;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Repeatedly calls frame() until at least minSeconds of wall time have
+///        elapsed.  The iteration count grows geometrically so the clock is
+///        read rarely relative to the work being measured.
+/// @param frame Callable rendering one frame.
+/// @param minSeconds Minimum measured duration.
+/// @return Per-frame timing.
+////////////////////////////////////////////////////////////////////////////////
+template<typename Frame>
+BenchResult RunBenchmark(Frame frame, double minSeconds)
+{
+  typedef std::chrono::steady_clock Clock;
+
+  // Warm caches and branch predictors
+  for(int i = 0; i < 64; i++)
+  {
+    frame();
+  }
+
+  uint32_t batch = 64;
+  uint32_t frames = 0;
+  double elapsed = 0;
+  while(elapsed < minSeconds)
+  {
+    Clock::time_point start = Clock::now();
+    for(uint32_t i = 0; i < batch; i++)
+    {
+      frame();
+    }
+    elapsed += std::chrono::duration<double>(Clock::now() - start).count();
+    frames += batch;
+    if(batch < (1u << 20))
+    {
+      batch *= 2;
+    }
+  }
+
+  BenchResult result;
+  result.frames = frames;
+  result.nsPerFrame = elapsed * 1e9 / frames;
+  result.framesPerSec = frames / elapsed;
+  return result;
+}
+
+inline void PrintBenchHeader(const char* title)
+{
+  printf("\n%s\n", title);
+  printf("%-28s %7s %12s %14s\n", "case", "pixels", "ns/frame", "frames/sec");
+}
+
+inline void PrintBenchResult(const char* name, uint16_t pixels,
+                             const BenchResult& r)
+{
+  printf("%-28s %7u %12.1f %14.0f\n", name, pixels, r.nsPerFrame,
+         r.framesPerSec);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Parses the optional per-case duration argument shared by all
+///        benchmark programs.
+////////////////////////////////////////////////////////////////////////////////
+inline double BenchSecondsFromArgs(int argc, char** argv)
+{
+  double seconds = 0.25;
+  if(argc > 1)
+  {
+    seconds = atof(argv[1]);
+    if(seconds <= 0)
+    {
+      seconds = 0.25;
+    }
+  }
+  return seconds;
+}
+
+#endif // HOST_BENCHMARK_H
@@ -0,0 +1,147 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file BuildStatusScannerBenchmark.cpp
+///
+/// @brief Measures BuildStatusScanner throughput over the recorded Jenkins
+///        responses, and compares its answers with the previous parser,
+///        which scanned each segment on its own with strcspn().
+///
+/// The segment size is 846 bytes, the most the 900 byte Ethernet::buffer
+/// holds after headers.
+///
+/// Usage: BuildStatusScannerBenchmark [seconds-per-case]
+////////////////////////////////////////////////////////////////////////////////
+#include <vector>
+
+#include "Benchmark.h"
+#include "Responses.h"
+
+static const uint16_t segmentSize = 846;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief The previous parser, reduced to what it reported: the last
+///        `building` and `result` it saw in any segment, at any depth.
+////////////////////////////////////////////////////////////////////////////////
+struct LegacyParser
+{
+  bool haveBuilding;
+  bool building;
+  int result;
+
+  static bool GetKVPair(char* start, char*& key, uint8_t& keyLen,
+                        char*& value, uint8_t& valueLen)
+  {
+    size_t offset = strcspn(start, "\"");
+    if(start[offset] != '\"')
+    {
+      return false;
+    }
+    key = start + offset + 1;
+    offset = strcspn(key, "\"");
+    if(key[offset] != '\"')
+    {
+      return false;
+    }
+    keyLen = offset;
+    start = key + offset;
+    offset = strcspn(start, ":");
+    if(start[offset] != ':')
+    {
+      return false;
+    }
+    value = start + offset + 1;
+    offset = strcspn(value, ",}");
+    if(value[offset] != ',' && value[offset] != '}')
+    {
+      return false;
+    }
+    valueLen = offset;
+    return true;
+  }
+
+  void Segment(char* data)
+  {
+    char* start = data + strcspn(data, "{");
+    if(*start != '{')
+    {
+      return;
+    }
+    char* key;
+    uint8_t keyLen;
+    char* value;
+    uint8_t valueLen;
+    while(GetKVPair(start, key, keyLen, value, valueLen))
+    {
+      if(keyLen > 0 && valueLen > 0 && 0 == strncmp(key, "building", keyLen))
+      {
+        haveBuilding = true;
+        building = (0 == strncmp(value, "true", valueLen));
+      }
+      else if(keyLen > 0 && valueLen > 0 && 0 == strncmp(key, "result", keyLen))
+      {
+        static const char* names[] = { "\"SUCCESS\"", "\"UNSTABLE\"", "\"FAILURE\"",
+                                       "\"NOT_BUILT\"", "\"ABORTED\"" };
+        for(uint8_t i = 0; i < 5; i++)
+        {
+          if(0 == strncmp(value, names[i], valueLen))
+          {
+            result = BuildStatusScanner::RESULT_SUCCESS + i;
+          }
+        }
+      }
+      start = value + valueLen + 1;
+    }
+  }
+
+  void Parse(const std::string& data)
+  {
+    haveBuilding = false;
+    building = false;
+    result = -1;
+    std::vector<char> buffer(segmentSize + 1);
+    for(size_t pos = 0; pos < data.size(); pos += segmentSize)
+    {
+      size_t len = data.size() - pos < segmentSize ? data.size() - pos : segmentSize;
+      memcpy(buffer.data(), data.data() + pos, len);
+      buffer[len] = '\0';
+      Segment(buffer.data());
+    }
+  }
+};
+
+int main(int argc, char** argv)
+{
+  double seconds = BenchSecondsFromArgs(argc, argv);
+
+  printf("\nScanning recorded responses in %u byte segments\n", segmentSize);
+  printf("%-28s %7s %8s %5s %10s %10s %8s %8s\n", "response", "bytes", "scanned",
+         "segs", "ns/resp", "MB/s", "scanner", "legacy");
+  bool ok = true;
+  for(const RecordedResponse& r : recordedResponses)
+  {
+    std::string data = LoadResponse(r.file);
+    BuildStatusScanner scanner;
+    uint16_t segments = 0;
+    BenchResult b = RunBenchmark([&]() {
+      scanner.reset();
+      segments = FeedSegments(scanner, data, segmentSize);
+    }, seconds);
+    bool correct = scanner.isDone() &&
+                   scanner.building() == r.building &&
+                   scanner.result() == r.result;
+    ok = ok && correct;
+
+    LegacyParser legacy;
+    legacy.Parse(data);
+    bool legacyCorrect = legacy.haveBuilding &&
+                         legacy.building == r.building &&
+                         (legacy.result == r.result ||
+                          (legacy.result < 0 && r.result == BuildStatusScanner::RESULT_OTHER));
+
+    const char* name = strchr(r.file, '/') + 1;
+    printf("%-28s %7zu %8u %5u %10.0f %10.1f %8s %8s\n", name, data.size(),
+           scanner.bytesScanned(), segments, b.nsPerFrame,
+           scanner.bytesScanned() * 1e3 / b.nsPerFrame,
+           correct ? "correct" : "WRONG", legacyCorrect ? "correct" : "wrong");
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file BuildStatusScannerTest.cpp
+///
+/// @brief Feeds the recorded Jenkins responses through BuildStatusScanner in
+///        segments of many sizes, and split at every byte, and checks the
+///        status it extracts.
+////////////////////////////////////////////////////////////////////////////////
+#include "Test.h"
+#include "Responses.h"
+
+static void CheckScanner(const BuildStatusScanner& scanner,
+                         const RecordedResponse& expected)
+{
+  CHECK(scanner.isDone());
+  CHECK(scanner.haveBuilding());
+  CHECK(scanner.haveResult());
+  CHECK_EQUAL(expected.building, scanner.building());
+  CHECK_EQUAL(expected.result, scanner.result());
+}
+
+static void TestSegmentSizes()
+{
+  // 846 bytes is the largest segment the 900 byte Ethernet::buffer holds
+  const uint16_t sizes[] = { 1, 2, 3, 7, 64, 536, 846, 1460, 0xFFFF };
+  for(const RecordedResponse& r : recordedResponses)
+  {
+    std::string data = LoadResponse(r.file);
+    uint16_t wholeScan = 0;
+    for(uint16_t size : sizes)
+    {
+      BuildStatusScanner scanner;
+      FeedSegments(scanner, data, size);
+      CheckScanner(scanner, r);
+      if(0 == wholeScan)
+      {
+        wholeScan = scanner.bytesScanned();
+      }
+      // Stops at the same byte however the response is split
+      CHECK_EQUAL(wholeScan, scanner.bytesScanned());
+    }
+    // Never needs the tail of the response
+    CHECK(wholeScan < data.size());
+  }
+}
+
+static void TestEverySplit()
+{
+  for(const RecordedResponse& r : recordedResponses)
+  {
+    std::string data = LoadResponse(r.file);
+    const uint8_t* bytes = (const uint8_t*)data.data();
+    bool allMatch = true;
+    for(size_t split = 0; split <= data.size(); split++)
+    {
+      BuildStatusScanner scanner;
+      if(!scanner.feed(bytes, split))
+      {
+        scanner.feed(bytes + split, data.size() - split);
+      }
+      allMatch = allMatch &&
+                 scanner.isDone() &&
+                 scanner.building() == r.building &&
+                 scanner.result() == r.result;
+    }
+    CHECK(allMatch);
+  }
+}
+
+static void TestStopsEarly()
+{
+  std::string data = LoadResponse("responses/success.http");
+  BuildStatusScanner scanner;
+  uint16_t segments = FeedSegments(scanner, data, 846);
+  CHECK(scanner.isDone());
+  CHECK(segments * 846 < data.size());
+
+  // Later segments are not looked at
+  uint16_t scanned = scanner.bytesScanned();
+  CHECK(scanner.feed((const uint8_t*)"garbage", 7));
+  CHECK_EQUAL(scanned, scanner.bytesScanned());
+  CHECK_EQUAL(BuildStatusScanner::RESULT_SUCCESS, scanner.result());
+}
+
+static void TestReset()
+{
+  std::string failure = LoadResponse("responses/failure-result-first.http");
+  std::string building = LoadResponse("responses/building.http");
+  BuildStatusScanner scanner;
+  FeedSegments(scanner, failure, 846);
+  CHECK_EQUAL(BuildStatusScanner::RESULT_FAILURE, scanner.result());
+  scanner.reset();
+  CHECK(!scanner.isDone());
+  CHECK(!scanner.haveBuilding());
+  CHECK(!scanner.haveResult());
+  FeedSegments(scanner, building, 846);
+  CheckScanner(scanner, recordedResponses[0]);
+}
+
+static void TestIncomplete()
+{
+  // Cut off before the result: building is reported, result is not
+  std::string data = LoadResponse("responses/building.http");
+  size_t result = data.find("\"queueId\"");
+  BuildStatusScanner scanner;
+  CHECK(!scanner.feed((const uint8_t*)data.data(), result));
+  CHECK(scanner.haveBuilding());
+  CHECK(scanner.building());
+  CHECK(!scanner.haveResult());
+
+  // Braces in headers and members missing from the object
+  const char* odd = "HTTP/1.0 200 OK\r\nX-Note: {\"result\":\"SUCCESS\"}\r\n\r\n"
+                    "{\"result\" : \"NOT_A_RESULT\", \"building\" : false }";
+  scanner.reset();
+  CHECK(scanner.feed((const uint8_t*)odd, strlen(odd)));
+  CHECK(!scanner.building());
+  CHECK_EQUAL(BuildStatusScanner::RESULT_OTHER, scanner.result());
+
+  const char* empty = "HTTP/1.0 200 OK\r\n\r\n{\"number\":3,\"result\":\"SUCCESS\"}";
+  scanner.reset();
+  CHECK(scanner.feed((const uint8_t*)empty, strlen(empty)));
+  CHECK(!scanner.haveBuilding());
+  CHECK(scanner.haveResult());
+  CHECK_EQUAL(BuildStatusScanner::RESULT_SUCCESS, scanner.result());
+}
+
+int main()
+{
+  TestSegmentSizes();
+  TestEverySplit();
+  TestStopsEarly();
+  TestReset();
+  TestIncomplete();
+  return TestResult("BuildStatusScannerTest");
+}
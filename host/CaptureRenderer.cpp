@@ -0,0 +1,492 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file CaptureRenderer.cpp
+///
+/// @brief Renders a scripted timeline on the stock tree offline, as fast as
+///        the host can, and writes every shown frame to a capture file or
+///        compares it with a golden capture.
+///
+/// Usage:
+///   CaptureRenderer [--step ms] <timeline> <capture>   render and write
+///   CaptureRenderer [--step ms] --check <timeline> <golden>
+///                                                      render and compare
+///
+/// update() is called every --step milliseconds (default PERIODDIVISOR) of
+/// timeline time, with the time passed in rather than read from a clock, so
+/// a run is exactly repeatable.  The sparkles draw from random(), which is
+/// seeded with 1 at the start.
+///
+/// Timeline: one event per line, "<ms> <command> <args>", in time order.
+/// Numbers are decimal except colors and status flags, which are hex.  #
+/// starts a comment.
+///
+///   brightness <0-255>
+///   pattern <ring> <SOLID|PULSE|PROGRESS|SPIN|RAINBOW|WIPE|FILL|SPIRAL>
+///           <color> [period] [param]
+///   status <ring|all> <flags>        updatePatterns() with BUILDSTATUS_* flags;
+///                                    all is every ring but the top one
+///   crossfade <ms>
+///   sparkle <ring> <density> [color] [period]
+///   flash <on|off>
+///   end                              last frame; required
+///
+/// Capture: "LTC1", the frame size in bytes (16-bit little endian), then one
+/// record per shown frame.  A record is the milliseconds since the previous
+/// frame, then runs of changed bytes against the previous frame (zeros
+/// before the first): bytes to skip, bytes that follow, the bytes.  A run of
+/// length 0 ends the record.  All counts are LEB128 varints.  Frames hold
+/// the strip buffer as shown: wire order, gamma and brightness applied.
+////////////////////////////////////////////////////////////////////////////////
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "NeoPixelRing.h"
+#include "StatusPatterns.h"
+
+static const uint8_t rings[] = { 32, 24, 16, 12, 8, 1 };
+static const uint8_t numRings = sizeof(rings);
+
+struct Event
+{
+  unsigned long time;
+  int line;
+  std::vector<std::string> words;  ///< Command and its arguments
+};
+
+typedef std::vector<uint8_t> Bytes;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Reads a timeline.  Prints the offending line and returns false on
+///        a syntax error.
+////////////////////////////////////////////////////////////////////////////////
+static bool ReadTimeline(const char* path, std::vector<Event>& events)
+{
+  FILE* file = fopen(path, "r");
+  if(file == NULL)
+  {
+    perror(path);
+    return false;
+  }
+  char text[256];
+  int line = 0;
+  unsigned long last = 0;
+  while(fgets(text, sizeof(text), file))
+  {
+    line++;
+    char* comment = strchr(text, '#');
+    if(comment != NULL)
+    {
+      *comment = '\0';
+    }
+    Event event;
+    event.line = line;
+    for(char* word = strtok(text, " \t\r\n"); word; word = strtok(NULL, " \t\r\n"))
+    {
+      event.words.push_back(word);
+    }
+    if(event.words.empty())
+    {
+      continue;
+    }
+    char* end;
+    event.time = strtoul(event.words[0].c_str(), &end, 10);
+    if(*end != '\0' || event.words.size() < 2 || event.time < last)
+    {
+      fprintf(stderr, "%s:%d: expected <ms> <command>, in time order\n", path, line);
+      fclose(file);
+      return false;
+    }
+    last = event.time;
+    event.words.erase(event.words.begin());
+    events.push_back(event);
+  }
+  fclose(file);
+  if(events.empty() || events.back().words[0] != "end")
+  {
+    fprintf(stderr, "%s: timeline must finish with end\n", path);
+    return false;
+  }
+  return true;
+}
+
+static unsigned long Arg(const Event& event, size_t i, int base, unsigned long fallback)
+{
+  return i < event.words.size() ? strtoul(event.words[i].c_str(), NULL, base) : fallback;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Applies one timeline event to the tree.
+/// @return False if the command is unknown.
+////////////////////////////////////////////////////////////////////////////////
+static bool Apply(NeoPixelRing& tree, const Event& event)
+{
+  // Indexed by NeoPixelRing::Pattern; PROGRAM needs a program, so is left out
+  static const char* patterns[] = { "SOLID", "PULSE", "PROGRESS", "SPIN",
+                                    "RAINBOW", "", "WIPE", "FILL", "SPIRAL" };
+  const std::string& command = event.words[0];
+  if(command == "brightness")
+  {
+    tree.setBrightness(Arg(event, 1, 10, 255));
+  }
+  else if(command == "pattern" && event.words.size() >= 4)
+  {
+    for(uint8_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++)
+    {
+      if(event.words[2] == patterns[p])
+      {
+        tree.setPattern(Arg(event, 1, 10, 0), (NeoPixelRing::Pattern)p,
+                        Arg(event, 3, 16, 0), Arg(event, 4, 10, 2000),
+                        Arg(event, 5, 10, 0));
+        return true;
+      }
+    }
+    return false;
+  }
+  else if(command == "status" && event.words.size() >= 3)
+  {
+    uint8_t status = Arg(event, 2, 16, 0);
+    if(event.words[1] == "all")
+    {
+      for(uint8_t i = 0; i < tree.getNumRings() - 1; i++)
+      {
+        updatePatterns(tree, i, status);
+      }
+    }
+    else
+    {
+      updatePatterns(tree, Arg(event, 1, 10, 0), status);
+    }
+  }
+  else if(command == "crossfade")
+  {
+    tree.setCrossfade(Arg(event, 1, 10, 0));
+  }
+  else if(command == "sparkle" && event.words.size() >= 3)
+  {
+    tree.setSparkle(Arg(event, 1, 10, 0), Arg(event, 2, 10, 0),
+                    Arg(event, 3, 16, SPARKLE_COLOR), Arg(event, 4, 10, SPARKLE_PERIOD));
+  }
+  else if(command == "flash" && event.words.size() >= 2)
+  {
+    tree.enableFlash(event.words[1] == "on");
+  }
+  else if(command != "end")
+  {
+    return false;
+  }
+  return true;
+}
+
+static void PutVarint(Bytes& out, uint32_t value)
+{
+  while(value >= 0x80)
+  {
+    out.push_back((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  out.push_back(value);
+}
+
+static bool GetVarint(const Bytes& in, size_t& pos, uint32_t& value)
+{
+  value = 0;
+  for(uint8_t shift = 0; shift < 32 && pos < in.size(); shift += 7)
+  {
+    uint8_t byte = in[pos++];
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    if(!(byte & 0x80))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Appends one frame record.  Unchanged stretches shorter than a run
+///        header are sent as changed bytes so runs are not split needlessly.
+////////////////////////////////////////////////////////////////////////////////
+static void EncodeFrame(Bytes& out, const Bytes& prev, const Bytes& frame,
+                        uint32_t dt)
+{
+  PutVarint(out, dt);
+  size_t pos = 0;
+  size_t size = frame.size();
+  while(pos < size)
+  {
+    size_t start = pos;
+    while(start < size && frame[start] == prev[start])
+    {
+      start++;
+    }
+    if(start == size)
+    {
+      break;
+    }
+    size_t end = start;
+    size_t same = 0;
+    while(end + same < size && same < 3)
+    {
+      if(frame[end + same] == prev[end + same])
+      {
+        same++;
+      }
+      else
+      {
+        end += same + 1;
+        same = 0;
+      }
+    }
+    PutVarint(out, start - pos);
+    PutVarint(out, end - start);
+    out.insert(out.end(), frame.begin() + start, frame.begin() + end);
+    pos = end;
+  }
+  PutVarint(out, 0);
+  PutVarint(out, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Reads one frame record, applying it to frame.
+/// @return False at the end of the capture or if the record is malformed.
+////////////////////////////////////////////////////////////////////////////////
+static bool DecodeFrame(const Bytes& in, size_t& pos, Bytes& frame, uint32_t& dt)
+{
+  if(pos >= in.size() || !GetVarint(in, pos, dt))
+  {
+    return false;
+  }
+  size_t at = 0;
+  for(;;)
+  {
+    uint32_t skip;
+    uint32_t length;
+    if(!GetVarint(in, pos, skip) || !GetVarint(in, pos, length))
+    {
+      return false;
+    }
+    if(0 == length)
+    {
+      return true;
+    }
+    at += skip;
+    if(at + length > frame.size() || pos + length > in.size())
+    {
+      return false;
+    }
+    memcpy(&frame[at], &in[pos], length);
+    at += length;
+    pos += length;
+  }
+}
+
+static void StartCapture(Bytes& capture, uint16_t frameBytes)
+{
+  capture.assign({ 'L', 'T', 'C', '1' });
+  capture.push_back(frameBytes & 0xFF);
+  capture.push_back(frameBytes >> 8);
+}
+
+// Buffer of the last show(); the stock tree has a single strip
+static Bytes shown;
+
+static void RecordShow(const Adafruit_NeoPixel& strip)
+{
+  shown.assign(strip.getPixels(), strip.getPixels() + strip.hostNumBytes());
+}
+
+struct RenderStats
+{
+  uint32_t frames;
+  unsigned long simulatedMs;
+  double wallSeconds;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Plays the timeline and encodes every shown frame into capture.
+/// @return False if an event could not be applied.
+////////////////////////////////////////////////////////////////////////////////
+static bool Render(const std::vector<Event>& events, unsigned long step,
+                   Bytes& capture, RenderStats& stats)
+{
+  typedef std::chrono::steady_clock Clock;
+
+  randomSeed(1);
+  NeoPixelRing tree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+  tree.begin();
+  uint16_t frameBytes = tree.getNumPixels() * 3;
+  StartCapture(capture, frameBytes);
+  Bytes prev(frameBytes, 0);
+  Adafruit_NeoPixel::hostSetShowHook(RecordShow);
+
+  Clock::time_point start = Clock::now();
+  stats.frames = 0;
+  unsigned long endTime = events.back().time;
+  unsigned long lastFrame = 0;
+  size_t next = 0;
+  for(unsigned long now = 0; now <= endTime; now += step)
+  {
+    while(next < events.size() && events[next].time <= now)
+    {
+      if(!Apply(tree, events[next]))
+      {
+        fprintf(stderr, "line %d: cannot apply %s\n", events[next].line,
+                events[next].words[0].c_str());
+        Adafruit_NeoPixel::hostSetShowHook(NULL);
+        return false;
+      }
+      next++;
+    }
+    if(tree.update(now))
+    {
+      EncodeFrame(capture, prev, shown, now - lastFrame);
+      prev.swap(shown);
+      lastFrame = now;
+      stats.frames++;
+    }
+  }
+  stats.wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+  stats.simulatedMs = endTime;
+  Adafruit_NeoPixel::hostSetShowHook(NULL);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Compares two captures frame by frame and describes the first
+///        difference.
+/// @return True if they hold the same frames.
+////////////////////////////////////////////////////////////////////////////////
+static bool Compare(const Bytes& golden, const Bytes& actual)
+{
+  if(golden.size() < 6 || memcmp(golden.data(), actual.data(), 6) != 0)
+  {
+    printf("golden capture has a different header\n");
+    return false;
+  }
+  uint16_t frameBytes = golden[4] | (golden[5] << 8);
+  Bytes expectedFrame(frameBytes, 0);
+  Bytes actualFrame(frameBytes, 0);
+  size_t goldenPos = 6;
+  size_t actualPos = 6;
+  unsigned long time = 0;
+  for(uint32_t frame = 0; ; frame++)
+  {
+    uint32_t expectedDt;
+    uint32_t actualDt;
+    bool haveExpected = DecodeFrame(golden, goldenPos, expectedFrame, expectedDt);
+    bool haveActual = DecodeFrame(actual, actualPos, actualFrame, actualDt);
+    if(!haveExpected && !haveActual)
+    {
+      return true;
+    }
+    if(haveExpected != haveActual || expectedDt != actualDt)
+    {
+      printf("frame %u: golden %s at +%u ms, rendered %s at +%u ms\n", frame,
+             haveExpected ? "shows" : "has ended", haveExpected ? expectedDt : 0,
+             haveActual ? "shows" : "has ended", haveActual ? actualDt : 0);
+      return false;
+    }
+    time += expectedDt;
+    for(uint16_t i = 0; i < frameBytes; i++)
+    {
+      if(expectedFrame[i] != actualFrame[i])
+      {
+        printf("frame %u at %lu ms: pixel %u byte %u is %u, golden %u\n", frame,
+               time, i / 3, i % 3, actualFrame[i], expectedFrame[i]);
+        return false;
+      }
+    }
+  }
+}
+
+static bool ReadFile(const char* path, Bytes& data)
+{
+  FILE* file = fopen(path, "rb");
+  if(file == NULL)
+  {
+    perror(path);
+    return false;
+  }
+  uint8_t buffer[4096];
+  size_t n;
+  while((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+  {
+    data.insert(data.end(), buffer, buffer + n);
+  }
+  fclose(file);
+  return true;
+}
+
+static bool WriteFile(const char* path, const Bytes& data)
+{
+  FILE* file = fopen(path, "wb");
+  if(file == NULL)
+  {
+    perror(path);
+    return false;
+  }
+  bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+  ok = (fclose(file) == 0) && ok;
+  return ok;
+}
+
+int main(int argc, char** argv)
+{
+  unsigned long step = PERIODDIVISOR;
+  bool check = false;
+  int arg = 1;
+  for(; arg < argc && argv[arg][0] == '-'; arg++)
+  {
+    if(strcmp(argv[arg], "--step") == 0 && arg + 1 < argc)
+    {
+      step = strtoul(argv[++arg], NULL, 10);
+    }
+    else if(strcmp(argv[arg], "--check") == 0)
+    {
+      check = true;
+    }
+    else
+    {
+      break;
+    }
+  }
+  if(argc - arg != 2 || 0 == step)
+  {
+    fprintf(stderr, "usage: %s [--step ms] [--check] <timeline> <capture>\n", argv[0]);
+    return 2;
+  }
+  const char* timelinePath = argv[arg];
+  const char* capturePath = argv[arg + 1];
+
+  std::vector<Event> events;
+  Bytes capture;
+  RenderStats stats;
+  if(!ReadTimeline(timelinePath, events) || !Render(events, step, capture, stats))
+  {
+    return 2;
+  }
+
+  uint32_t rawBytes = stats.frames * (capture[4] | (capture[5] << 8));
+  printf("%s: %u frames over %.1f s in %.1f ms (%.0f frames/sec, %.0fx real time)\n",
+         timelinePath, stats.frames, stats.simulatedMs / 1000.0,
+         stats.wallSeconds * 1000, stats.frames / stats.wallSeconds,
+         stats.simulatedMs / 1000.0 / stats.wallSeconds);
+  printf("capture %zu bytes, %.1f%% of %u raw\n", capture.size(),
+         100.0 * capture.size() / rawBytes, rawBytes);
+
+  if(!check)
+  {
+    return WriteFile(capturePath, capture) ? 0 : 2;
+  }
+  Bytes golden;
+  if(!ReadFile(capturePath, golden))
+  {
+    return 2;
+  }
+  bool same = Compare(golden, capture);
+  printf("%s %s\n", capturePath, same ? "matches" : "DIFFERS");
+  return same ? 0 : 1;
+}
@@ -0,0 +1,394 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file ConfigStoreTest.cpp
+///
+/// @brief Checks ConfigStore against the EEPROM stand-in and counts the
+///        EEPROM reads and writes per poll and per save, next to the
+///        previous code, which read the configuration from EEPROM on every
+///        poll and rewrote all of it on every save.
+////////////////////////////////////////////////////////////////////////////////
+#include <EEPROM.h>
+
+#include "Test.h"
+#include "ConfigStore.h"
+#include "PatternProgram.h"
+
+static const char* twoJobs =
+  "jenkins.example.com\n8080\n"
+  "/job/LED-Tree/lastBuild/api/json?tree=building,result\n"
+  "/job/Firmware/lastBuild/api/json?tree=building,result\n";
+
+static const char* twoJobsChanged =
+  "jenkins.example.com\n8080\n"
+  "/job/LED-Tree/lastBuild/api/json?tree=building,result\n"
+  "/job/Hardware/lastBuild/api/json?tree=building,result\n";
+
+static const char* threeJobs =
+  "jenkins.example.com\n8080\n"
+  "/job/LED-Tree/lastBuild/api/json?tree=building,result\n"
+  "/job/Firmware/lastBuild/api/json?tree=building,result\n"
+  "/job/Docs/lastBuild/api/json?tree=building,result\n";
+
+static const double msPerWrite = 3.3;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief The previous EEPROM code, cut down to what a poll and a save did.
+////////////////////////////////////////////////////////////////////////////////
+namespace Legacy
+{
+  uint16_t GetWord(uint16_t address)
+  {
+    return EEPROM.read(address) | (EEPROM.read(address + 1) << 8);
+  }
+
+  void SetWord(uint16_t address, uint16_t val)
+  {
+    EEPROM.write(address, val & 0xFF);
+    EEPROM.write(address + 1, val >> 8);
+  }
+
+  bool HaveURL()
+  {
+    return GetWord(2) >= 8;
+  }
+
+  uint8_t LoadJobCount()
+  {
+    if(!HaveURL())
+    {
+      return 0;
+    }
+    return 3 == EEPROM.read(0) ? EEPROM.read(1) : 1;
+  }
+
+  uint16_t LoadString(uint16_t address, char* dest)
+  {
+    uint16_t size = 0;
+    char c;
+    do
+    {
+      c = EEPROM.read(address++);
+      dest[size++] = c;
+    } while('\0' != c);
+    return size - 1;
+  }
+
+  uint16_t LoadDomain(char* dest)
+  {
+    if(!HaveURL())
+    {
+      return 0;
+    }
+    return LoadString(GetWord(2), dest);
+  }
+
+  uint16_t LoadPort()
+  {
+    if(!HaveURL())
+    {
+      return 0;
+    }
+    return GetWord(GetWord(4));
+  }
+
+  uint16_t LoadEndpoint(uint8_t job, char* dest)
+  {
+    uint16_t address = GetWord(6);
+    if(!HaveURL() || job >= LoadJobCount())
+    {
+      return 0;
+    }
+    for(uint8_t i = 0; i < job; i++)
+    {
+      while(EEPROM.read(address) != '\0')
+      {
+        address++;
+      }
+      address++;
+    }
+    return LoadString(address, dest);
+  }
+
+  // One poll: FillServerQuery() and the port for clientTcpReq()
+  void Poll(uint8_t job)
+  {
+    char buffer[200];
+    LoadEndpoint(job, buffer);
+    LoadDomain(buffer);
+    LoadPort();
+  }
+
+  // SaveURL(), given the parts already split up
+  void Save(const char* domain, uint16_t port, const char* const* endpoints,
+            uint8_t count)
+  {
+    uint16_t address = 8;
+    SetWord(2, address);
+    for(const char* p = domain; ; p++)
+    {
+      EEPROM.write(address++, *p);
+      if('\0' == *p)
+      {
+        break;
+      }
+    }
+    SetWord(4, address);
+    SetWord(address, port);
+    address += 2;
+    SetWord(6, address);
+    for(uint8_t i = 0; i < count; i++)
+    {
+      for(const char* p = endpoints[i]; ; p++)
+      {
+        EEPROM.write(address++, *p);
+        if('\0' == *p)
+        {
+          break;
+        }
+      }
+    }
+    EEPROM.write(1, count);
+    EEPROM.write(0, 3);
+  }
+}
+
+static const char* legacyEndpoints[] = {
+  "/job/LED-Tree/lastBuild/api/json?tree=building,result",
+  "/job/Firmware/lastBuild/api/json?tree=building,result",
+};
+
+static void Poll(const ConfigStore& config, uint8_t job)
+{
+  // What FillServerQuery() and the clientTcpReq() call now do
+  char buffer[200];
+  strcpy(buffer, config.getEndpoint(job));
+  strcat(buffer, config.getDomain());
+  (void)config.getPort();
+}
+
+static void TestSaveAndLoad()
+{
+  EEPROM.hostErase();
+  ConfigStore config;
+  CHECK(!config.begin());
+  CHECK(!config.haveURL());
+  CHECK_EQUAL(0, config.getJobCount());
+  CHECK_EQUAL(0, strlen(config.getDomain()));
+
+  CHECK(config.save(twoJobs));
+  CHECK(config.haveURL());
+  CHECK_EQUAL(8080, config.getPort());
+  CHECK_EQUAL(2, config.getJobCount());
+  CHECK(0 == strcmp("jenkins.example.com", config.getDomain()));
+  CHECK(0 == strcmp(legacyEndpoints[0], config.getEndpoint(0)));
+  CHECK(0 == strcmp(legacyEndpoints[1], config.getEndpoint(1)));
+  CHECK_EQUAL(0, strlen(config.getEndpoint(2)));
+
+  // A reboot finds it again
+  ConfigStore reloaded;
+  CHECK(reloaded.begin());
+  CHECK_EQUAL(8080, reloaded.getPort());
+  CHECK_EQUAL(2, reloaded.getJobCount());
+  CHECK(0 == strcmp(legacyEndpoints[1], reloaded.getEndpoint(1)));
+
+  // CRLF line breaks, blank lines and jobs past JOB_MAX
+  CHECK(config.save("a.co\r\n80\r\n/a\r\n\r\n/b\r\n/c\n/d\n/e\n/f\n/g\n/h\n/i\n"));
+  CHECK_EQUAL(80, config.getPort());
+  CHECK_EQUAL(JOB_MAX, config.getJobCount());
+  CHECK(0 == strcmp("a.co", config.getDomain()));
+  CHECK(0 == strcmp("/b", config.getEndpoint(1)));
+  CHECK(0 == strcmp("/h", config.getEndpoint(7)));
+}
+
+static void TestRejects()
+{
+  EEPROM.hostErase();
+  ConfigStore config;
+  config.begin();
+  CHECK(config.save(twoJobs));
+  EEPROM.hostResetCounts();
+
+  CHECK(!config.save("a.c\n80\n/a\n"));              // Domain too short
+  CHECK(!config.save("a.co\n8x\n/a\n"));             // Port not a number
+  CHECK(!config.save("a.co\n\n/a\n"));               // No port
+  CHECK(!config.save("a.co\n80\n\r\n"));             // No endpoint
+  CHECK(!config.save("a.co\n80"));                   // Truncated
+  char tooLong[CONFIG_STRINGS_MAX + 32] = "a.co\n80\n/";
+  memset(tooLong + 9, 'x', CONFIG_STRINGS_MAX);
+  tooLong[9 + CONFIG_STRINGS_MAX] = '\0';
+  CHECK(!config.save(tooLong));
+
+  // Nothing changed, in RAM or EEPROM
+  CHECK_EQUAL(0, EEPROM.writes);
+  CHECK_EQUAL(8080, config.getPort());
+  CHECK(0 == strcmp(legacyEndpoints[1], config.getEndpoint(1)));
+}
+
+static void TestRecovery()
+{
+  EEPROM.hostErase();
+  ConfigStore config;
+  config.begin();
+  CHECK(config.save(twoJobs));          // Slot 0
+  CHECK(config.save(twoJobsChanged));   // Slot 1
+  uint8_t before[E2END + 1];
+  memcpy(before, EEPROM.data, sizeof(before));
+  CHECK(config.save(threeJobs));        // Slot 0 again
+
+  // Power lost before the new record's header was written: the old header
+  // no longer matches the record, so the previous save is loaded
+  memcpy(EEPROM.data + CONFIG_ADDRESS, before + CONFIG_ADDRESS, CONFIG_HEADER_SIZE);
+  ConfigStore afterLoss;
+  CHECK(afterLoss.begin());
+  CHECK_EQUAL(2, afterLoss.getJobCount());
+  CHECK(0 == strcmp("/job/Hardware/lastBuild/api/json?tree=building,result", afterLoss.getEndpoint(1)));
+
+  // Power lost before the sequence number was written: complete, but older
+  memcpy(EEPROM.data, before, sizeof(before));
+  ConfigStore again;
+  again.begin();
+  CHECK(again.save(threeJobs));
+  EEPROM.data[CONFIG_ADDRESS] = before[CONFIG_ADDRESS];
+  ConfigStore beforeSequence;
+  CHECK(beforeSequence.begin());
+  CHECK_EQUAL(2, beforeSequence.getJobCount());
+
+  // A corrupt byte in the newest slot also falls back to the older one
+  memcpy(EEPROM.data, before, sizeof(before));
+  again.begin();
+  CHECK(again.save(threeJobs));
+  EEPROM.data[CONFIG_ADDRESS + CONFIG_HEADER_SIZE + 10] ^= 0x20;
+  ConfigStore afterCorruption;
+  CHECK(afterCorruption.begin());
+  CHECK_EQUAL(2, afterCorruption.getJobCount());
+
+  // Sequence numbers wrap
+  EEPROM.hostErase();
+  ConfigStore wrapping;
+  wrapping.begin();
+  for(uint16_t i = 0; i < 300; i++)
+  {
+    CHECK(wrapping.save(i & 1 ? twoJobs : threeJobs));
+  }
+  ConfigStore wrapped;
+  CHECK(wrapped.begin());
+  CHECK_EQUAL(2, wrapped.getJobCount());
+}
+
+static void TestLegacyImport()
+{
+  EEPROM.hostErase();
+  Legacy::Save("jenkins.example.com", 8080, legacyEndpoints, 2);
+  ConfigStore config;
+  CHECK(config.begin());
+  CHECK_EQUAL(8080, config.getPort());
+  CHECK_EQUAL(2, config.getJobCount());
+  CHECK(0 == strcmp("jenkins.example.com", config.getDomain()));
+  CHECK(0 == strcmp(legacyEndpoints[1], config.getEndpoint(1)));
+
+  // Imported once; the next boot loads the slot
+  ConfigStore reloaded;
+  CHECK(reloaded.begin());
+  CHECK_EQUAL(2, reloaded.getJobCount());
+  CHECK(0 == strcmp(legacyEndpoints[0], reloaded.getEndpoint(0)));
+}
+
+static void Row(const char* what, unsigned long legacyReads,
+                unsigned long legacyWrites, unsigned long reads,
+                unsigned long writes)
+{
+  printf("%-26s %7lu %7lu %8.1f   %7lu %7lu %8.1f\n", what,
+         legacyReads, legacyWrites, legacyWrites * msPerWrite,
+         reads, writes, writes * msPerWrite);
+}
+
+static void TestCounts()
+{
+  printf("\n%-26s %25s   %25s\n", "", "before", "ConfigStore");
+  printf("%-26s %7s %7s %8s   %7s %7s %8s\n", "", "reads", "writes", "ms",
+         "reads", "writes", "ms");
+
+  // Poll of the second job
+  EEPROM.hostErase();
+  Legacy::Save("jenkins.example.com", 8080, legacyEndpoints, 2);
+  EEPROM.hostResetCounts();
+  Legacy::Poll(1);
+  unsigned long legacyReads = EEPROM.reads;
+  ConfigStore config;
+  config.begin();
+  unsigned long bootReads = EEPROM.reads - legacyReads;
+  unsigned long bootWrites = EEPROM.writes;
+  EEPROM.hostResetCounts();
+  Poll(config, 1);
+  Row("poll", legacyReads, 0, EEPROM.reads, EEPROM.writes);
+  CHECK_EQUAL(0, EEPROM.reads);
+  CHECK(legacyReads > 100);
+  Row("boot, importing old layout", 0, 0, bootReads, bootWrites);
+
+  // Saves: the same again, one job renamed, one job added
+  const char* saves[] = { twoJobs, twoJobs, twoJobsChanged, twoJobs, threeJobs };
+  const char* names[] = { "first save", "same again", "one job renamed",
+                          "renamed back", "job added" };
+  EEPROM.hostErase();
+  ConfigStore fresh;
+  fresh.begin();
+  for(uint8_t i = 0; i < 5; i++)
+  {
+    // The previous code rewrote every byte
+    EEPROM.hostResetCounts();
+    uint8_t saved[E2END + 1];
+    memcpy(saved, EEPROM.data, sizeof(saved));
+    const char* endpoints[3] = { legacyEndpoints[0],
+                                 2 == i ? "/job/Hardware/lastBuild/api/json?tree=building,result" : legacyEndpoints[1],
+                                 "/job/Docs/lastBuild/api/json?tree=building,result" };
+    Legacy::Save("jenkins.example.com", 8080, endpoints, 4 == i ? 3 : 2);
+    unsigned long legacyWrites = EEPROM.writes;
+    memcpy(EEPROM.data, saved, sizeof(saved));
+
+    EEPROM.hostResetCounts();
+    CHECK(fresh.save(saves[i]));
+    Row(names[i], 0, legacyWrites, EEPROM.reads, EEPROM.writes);
+    if(1 == i)
+    {
+      CHECK_EQUAL(0, EEPROM.writes);
+      CHECK_EQUAL(0, EEPROM.reads);
+    }
+    else if(3 == i)
+    {
+      // The other slot still holds this configuration
+      CHECK(EEPROM.writes <= CONFIG_HEADER_SIZE);
+    }
+    else
+    {
+      CHECK(EEPROM.writes <= legacyWrites + CONFIG_HEADER_SIZE);
+    }
+  }
+
+  // Wear from switching between two configurations a thousand times: each
+  // slot keeps one of them, so only the headers change
+  EEPROM.hostErase();
+  memset(EEPROM.cellWrites, 0, sizeof(EEPROM.cellWrites));
+  ConfigStore wear;
+  wear.begin();
+  for(uint16_t i = 0; i < 1000; i++)
+  {
+    wear.save(i & 1 ? twoJobsChanged : twoJobs);
+  }
+  unsigned long worst = 0;
+  for(uint16_t i = 0; i <= E2END; i++)
+  {
+    worst = EEPROM.cellWrites[i] > worst ? EEPROM.cellWrites[i] : worst;
+  }
+  printf("most writes to one cell over 1000 saves: %lu (before: 1000)\n", worst);
+  CHECK(worst <= 500);
+}
+
+int main()
+{
+  CHECK(CONFIG_END <= E2END - PROGRAM_MAX_LENGTH);
+  TestSaveAndLoad();
+  TestRejects();
+  TestRecovery();
+  TestLegacyImport();
+  TestCounts();
+  return TestResult("ConfigStoreTest");
+}
@@ -0,0 +1,315 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file ControlProtocolTest.cpp
+///
+/// @brief Checks the batched control datagram decoder against trees
+///        configured directly with setPattern().
+////////////////////////////////////////////////////////////////////////////////
+#include <algorithm>
+#include <vector>
+
+#include "Test.h"
+#include "ControlProtocol.h"
+
+static const uint8_t rings[] = { 32, 24, 16, 12, 8, 1 };
+static const uint8_t numRings = sizeof(rings);
+
+struct Command
+{
+  uint8_t ring;
+  NeoPixelRing::Pattern pattern;
+  uint32_t color;
+  uint16_t period;
+  uint8_t param;
+};
+
+static std::vector<uint8_t> Datagram(uint16_t sequence, uint8_t flags,
+                                     uint8_t brightness,
+                                     const std::vector<Command>& commands)
+{
+  std::vector<uint8_t> d;
+  d.push_back(CONTROL_MAGIC);
+  d.push_back(flags);
+  d.push_back(sequence >> 8);
+  d.push_back(sequence & 0xFF);
+  d.push_back(brightness);
+  d.push_back(commands.size());
+  for(const Command& c : commands)
+  {
+    d.push_back(c.ring);
+    d.push_back(c.pattern);
+    d.push_back(c.color >> 16);
+    d.push_back(c.color >> 8);
+    d.push_back(c.color);
+    d.push_back(c.period >> 8);
+    d.push_back(c.period & 0xFF);
+    d.push_back(c.param);
+  }
+  return d;
+}
+
+static std::vector<uint8_t> GroupDatagram(uint16_t sequence, uint8_t group,
+                                          const std::vector<Command>& commands)
+{
+  std::vector<uint8_t> d = Datagram(sequence, CONTROL_FLAG_GROUP, 0, commands);
+  d.insert(d.begin() + CONTROL_HEADER_SIZE, group);
+  return d;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Draws one frame at a given time and returns a checksum of what was
+///        shown.
+////////////////////////////////////////////////////////////////////////////////
+static uint32_t Frame(NeoPixelRing& tree, unsigned long ms)
+{
+  Adafruit_NeoPixel::hostResetTotals();
+  hostSetMillis(ms);
+  tree.update();
+  return Adafruit_NeoPixel::hostTotalShowChecksum();
+}
+
+static NeoPixelRing* NewTree()
+{
+  NeoPixelRing* tree = new NeoPixelRing(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+  tree->begin();
+  tree->enableFlash(false);
+  return tree;
+}
+
+static void TestPerRingCommands()
+{
+  hostSetMillis(0);
+  NeoPixelRing* decoded = NewTree();
+  NeoPixelRing* direct = NewTree();
+  ControlProtocol control;
+
+  std::vector<Command> commands = {
+    { 0, NeoPixelRing::SOLID, 0x00FF0000, 2000, 0 },
+    { 2, NeoPixelRing::SPIN, 0x0000FF00, 1500, 0 },
+    { 4, NeoPixelRing::PROGRESS, 0x000000FF, 3000, 40 },
+    { 9, NeoPixelRing::PULSE, 0x00FFFFFF, 1000, 0 }, // No such ring
+  };
+  std::vector<uint8_t> d = Datagram(1, CONTROL_FLAG_BRIGHTNESS, 75, commands);
+  CHECK_EQUAL(ControlProtocol::APPLIED, control.apply(*decoded, d.data(), d.size()));
+
+  direct->setBrightness(75);
+  for(const Command& c : commands)
+  {
+    direct->setPattern(c.ring, c.pattern, c.color, c.period, c.param);
+  }
+  for(uint8_t i = 1; i <= 20; i++)
+  {
+    CHECK_EQUAL(Frame(*direct, i * PERIODDIVISOR), Frame(*decoded, i * PERIODDIVISOR));
+  }
+  delete decoded;
+  delete direct;
+}
+
+static void TestAllRings()
+{
+  hostSetMillis(0);
+  NeoPixelRing* decoded = NewTree();
+  NeoPixelRing* direct = NewTree();
+  ControlProtocol control;
+
+  std::vector<Command> commands = {
+    { CONTROL_ALL_RINGS, NeoPixelRing::PULSE, 0x00FFBF00, 2000, 0 },
+    { 5, NeoPixelRing::RAINBOW, 0, 4000, 0 },
+  };
+  std::vector<uint8_t> d = Datagram(7, 0, 0, commands);
+  CHECK_EQUAL(ControlProtocol::APPLIED, control.apply(*decoded, d.data(), d.size()));
+
+  for(uint8_t i = 0; i < numRings; i++)
+  {
+    direct->setPattern(i, NeoPixelRing::PULSE, 0x00FFBF00, 2000, 0);
+  }
+  direct->setPattern(5, NeoPixelRing::RAINBOW, 0, 4000, 0);
+  CHECK_EQUAL(Frame(*direct, 500), Frame(*decoded, 500));
+  delete decoded;
+  delete direct;
+}
+
+static void TestSequence()
+{
+  hostSetMillis(0);
+  NeoPixelRing* tree = NewTree();
+  ControlProtocol control;
+  std::vector<Command> red = { { CONTROL_ALL_RINGS, NeoPixelRing::SOLID, 0x00FF0000, 2000, 0 } };
+  std::vector<Command> green = { { CONTROL_ALL_RINGS, NeoPixelRing::SOLID, 0x0000FF00, 2000, 0 } };
+
+  std::vector<uint8_t> d = Datagram(100, 0, 0, red);
+  CHECK_EQUAL(ControlProtocol::APPLIED, control.apply(*tree, d.data(), d.size()));
+  Frame(*tree, PERIODDIVISOR);
+
+  // Duplicate and older datagrams are dropped without redrawing anything
+  CHECK_EQUAL(ControlProtocol::STALE, control.apply(*tree, d.data(), d.size()));
+  d = Datagram(99, 0, 0, green);
+  CHECK_EQUAL(ControlProtocol::STALE, control.apply(*tree, d.data(), d.size()));
+  hostAdvanceMillis(PERIODDIVISOR);
+  CHECK(!tree->update());
+
+  // Newer, including across the 16-bit wrap
+  d = Datagram(101, 0, 0, green);
+  CHECK_EQUAL(ControlProtocol::APPLIED, control.apply(*tree, d.data(), d.size()));
+  d = Datagram(0xFFFF, 0, 0, red);
+  CHECK_EQUAL(ControlProtocol::STALE, control.apply(*tree, d.data(), d.size()));
+  d = Datagram(30000, 0, 0, red);
+  CHECK_EQUAL(ControlProtocol::APPLIED, control.apply(*tree, d.data(), d.size()));
+  d = Datagram(60000, 0, 0, green);
+  CHECK_EQUAL(ControlProtocol::APPLIED, control.apply(*tree, d.data(), d.size()));
+  d = Datagram(0xFFFF, 0, 0, red);
+  CHECK_EQUAL(ControlProtocol::APPLIED, control.apply(*tree, d.data(), d.size()));
+  d = Datagram(3, 0, 0, red);
+  CHECK_EQUAL(ControlProtocol::APPLIED, control.apply(*tree, d.data(), d.size()));
+
+  // A restarted sender resynchronizes
+  d = Datagram(1, CONTROL_FLAG_RESYNC, 0, green);
+  CHECK_EQUAL(ControlProtocol::APPLIED, control.apply(*tree, d.data(), d.size()));
+  d = Datagram(2, 0, 0, red);
+  CHECK_EQUAL(ControlProtocol::APPLIED, control.apply(*tree, d.data(), d.size()));
+  delete tree;
+}
+
+static void TestMalformed()
+{
+  hostSetMillis(0);
+  NeoPixelRing* tree = NewTree();
+  ControlProtocol control;
+  std::vector<Command> one = { { 0, NeoPixelRing::SOLID, 0x00FF0000, 2000, 0 } };
+  std::vector<uint8_t> d = Datagram(1, 0, 0, one);
+
+  // Original 5 and 6 byte messages are not control datagrams
+  CHECK(!ControlProtocol::isControlDatagram(d.data(), 5));
+  CHECK(!ControlProtocol::isControlDatagram(d.data(), 6));
+  CHECK(ControlProtocol::isControlDatagram(d.data(), d.size()));
+
+  // Truncated, padded, wrong count or wrong magic: nothing applied, and the
+  // sequence number is not consumed
+  CHECK_EQUAL(ControlProtocol::MALFORMED, control.apply(*tree, d.data(), d.size() - 1));
+  std::vector<uint8_t> padded = d;
+  padded.push_back(0);
+  CHECK_EQUAL(ControlProtocol::MALFORMED, control.apply(*tree, padded.data(), padded.size()));
+  std::vector<uint8_t> badCount = d;
+  badCount[5] = 2;
+  CHECK_EQUAL(ControlProtocol::MALFORMED, control.apply(*tree, badCount.data(), badCount.size()));
+  std::vector<uint8_t> badMagic = d;
+  badMagic[0] = 0;
+  CHECK_EQUAL(ControlProtocol::MALFORMED, control.apply(*tree, badMagic.data(), badMagic.size()));
+  CHECK_EQUAL(ControlProtocol::APPLIED, control.apply(*tree, d.data(), d.size()));
+  delete tree;
+}
+
+static void TestGroups()
+{
+  hostSetMillis(0);
+  NeoPixelRing* decoded = NewTree();
+  NeoPixelRing* direct = NewTree();
+  ControlProtocol control;
+  control.setGroup(3);
+  CHECK_EQUAL(3, control.getGroup());
+  std::vector<Command> red = { { CONTROL_ALL_RINGS, NeoPixelRing::SPIN, 0x00FF0000, 2000, 0 } };
+  std::vector<Command> green = { { 1, NeoPixelRing::PULSE, 0x0000FF00, 1000, 0 } };
+
+  // Another group's datagram is neither applied nor counted
+  std::vector<uint8_t> d = GroupDatagram(10, 4, red);
+  CHECK(ControlProtocol::isControlDatagram(d.data(), d.size()));
+  CHECK_EQUAL(ControlProtocol::NOT_ADDRESSED, control.apply(*decoded, d.data(), d.size()));
+  CHECK_EQUAL(Frame(*direct, PERIODDIVISOR), Frame(*decoded, PERIODDIVISOR));
+
+  // This tree's group, then every group
+  d = GroupDatagram(5, 3, red);
+  CHECK_EQUAL(ControlProtocol::APPLIED, control.apply(*decoded, d.data(), d.size()));
+  d = GroupDatagram(6, CONTROL_GROUP_ALL, green);
+  CHECK_EQUAL(ControlProtocol::APPLIED, control.apply(*decoded, d.data(), d.size()));
+  for(uint8_t i = 0; i < numRings; i++)
+  {
+    direct->setPattern(i, NeoPixelRing::SPIN, 0x00FF0000, 2000, 0);
+  }
+  direct->setPattern(1, NeoPixelRing::PULSE, 0x0000FF00, 1000, 0);
+  CHECK_EQUAL(Frame(*direct, 700), Frame(*decoded, 700));
+
+  // Group datagrams share the sender's sequence count with the others
+  d = GroupDatagram(6, 3, green);
+  CHECK_EQUAL(ControlProtocol::STALE, control.apply(*decoded, d.data(), d.size()));
+  d = Datagram(7, 0, 0, red);
+  CHECK_EQUAL(ControlProtocol::APPLIED, control.apply(*decoded, d.data(), d.size()));
+
+  // The group byte counts towards the length
+  d = GroupDatagram(8, 3, red);
+  CHECK_EQUAL(ControlProtocol::MALFORMED, control.apply(*decoded, d.data(), d.size() - 1));
+  d[1] = 0;
+  CHECK_EQUAL(ControlProtocol::MALFORMED, control.apply(*decoded, d.data(), d.size()));
+  delete decoded;
+  delete direct;
+}
+
+static std::vector<uint8_t> shown;
+
+static void RecordShow(const Adafruit_NeoPixel& strip)
+{
+  shown.assign(strip.getPixels(), strip.getPixels() + strip.hostNumBytes());
+}
+
+static void TestProgressOverRange()
+{
+  hostSetMillis(0);
+  NeoPixelRing* tree = NewTree();
+  ControlProtocol control;
+  Adafruit_NeoPixel::hostSetShowHook(RecordShow);
+  Frame(*tree, PERIODDIVISOR);
+  const std::vector<uint8_t> dark = shown;
+
+  // Ring 3 is 12 pixels, followed by rings 4 and 5 and the end of the strip
+  uint16_t start = 0;
+  for(uint8_t i = 0; i < 3; i++)
+  {
+    start += rings[i];
+  }
+  uint16_t end = start + rings[3];
+
+  static const uint8_t params[] = { 101, 255 };
+  for(uint8_t i = 0; i < sizeof(params); i++)
+  {
+    std::vector<Command> progress = {
+      { 3, NeoPixelRing::PROGRESS, 0x00FF0000, 2000, params[i] }
+    };
+    std::vector<uint8_t> d = Datagram(i + 1, 0, 0, progress);
+    CHECK_EQUAL(ControlProtocol::APPLIED, control.apply(*tree, d.data(), d.size()));
+    Frame(*tree, (i + 2) * PERIODDIVISOR);
+
+    // The whole ring pulses and nothing outside it is written
+    CHECK_EQUAL(dark.size(), shown.size());
+    CHECK(std::equal(dark.begin(), dark.begin() + start * 3, shown.begin()));
+    CHECK(std::equal(dark.begin() + end * 3, dark.end(), shown.begin() + end * 3));
+    CHECK(shown[(end - 1) * 3 + 1] > 0);  // Last pixel's red, in GRB order
+  }
+  Adafruit_NeoPixel::hostSetShowHook(NULL);
+  delete tree;
+}
+
+static void TestAck()
+{
+  std::vector<Command> one = { { 0, NeoPixelRing::SOLID, 0x00FF0000, 2000, 0 } };
+  std::vector<uint8_t> d = Datagram(0x1234, CONTROL_FLAG_ACK, 0, one);
+  CHECK(ControlProtocol::ackRequested(d.data(), d.size()));
+  d[1] = 0;
+  CHECK(!ControlProtocol::ackRequested(d.data(), d.size()));
+
+  uint8_t ack[CONTROL_ACK_SIZE];
+  ControlProtocol::fillAck(ack, d.data(), ControlProtocol::STALE);
+  CHECK_EQUAL(CONTROL_ACK_MAGIC, ack[0]);
+  CHECK_EQUAL(ControlProtocol::STALE, ack[1]);
+  CHECK_EQUAL(0x12, ack[2]);
+  CHECK_EQUAL(0x34, ack[3]);
+}
+
+int main()
+{
+  TestPerRingCommands();
+  TestAllRings();
+  TestSequence();
+  TestMalformed();
+  TestGroups();
+  TestProgressOverRange();
+  TestAck();
+  return TestResult("ControlProtocolTest");
+}
@@ -0,0 +1,141 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file CrossfadeBenchmark.cpp
+///
+/// @brief Measures a frame of the stock layout with and without a crossfade
+///        running on every status ring, and checks that a finished crossfade
+///        leaves exactly what an instant switch would have drawn.
+///
+/// To keep the crossfades running for the whole measurement the status
+/// rings are switched between two patterns every 1000 frames, well inside
+/// the fade length.
+///
+/// Usage: CrossfadeBenchmark [seconds-per-case]
+////////////////////////////////////////////////////////////////////////////////
+#include "Benchmark.h"
+#include "NeoPixelRing.h"
+
+static const uint8_t rings[] = { 32, 24, 16, 12, 8, 1 };
+static const uint8_t numRings = sizeof(rings);
+static const uint8_t statusRings = numRings - 1;
+
+static void SetStatus(NeoPixelRing& tree, NeoPixelRing::Pattern pattern,
+                      uint32_t color)
+{
+  for(uint8_t i = 0; i < statusRings; i++)
+  {
+    tree.setPattern(i, pattern, color, 2000, 0);
+  }
+}
+
+static BenchResult BenchFrame(NeoPixelRing::Pattern from, NeoPixelRing::Pattern to,
+                              bool fading, bool flash, double seconds)
+{
+  hostSetMillis(0);
+  randomSeed(1);
+  NeoPixelRing tree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+  tree.begin();
+  tree.setBrightness(75);
+  tree.enableFlash(flash);
+  tree.setPattern(statusRings, NeoPixelRing::PULSE, 0x000000FF, 2000, 0);
+  SetStatus(tree, from, 0x0000FF00);
+  tree.update();
+  tree.setCrossfade(fading ? 60000 : 0);
+
+  uint32_t frame = 0;
+  return RunBenchmark([&]() {
+    if(0 == frame++ % 1000)
+    {
+      bool back = (frame / 1000) & 1;
+      SetStatus(tree, back ? from : to, back ? 0x0000FF00 : 0x00FF0000);
+    }
+    hostAdvanceMillis(PERIODDIVISOR);
+    tree.update();
+  }, seconds);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Draws a frame and returns the checksum of what was shown.
+////////////////////////////////////////////////////////////////////////////////
+static uint32_t ShownChecksum(NeoPixelRing& tree)
+{
+  Adafruit_NeoPixel::hostResetTotals();
+  tree.update();
+  return Adafruit_NeoPixel::hostTotalShowChecksum();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Switches one tree with a crossfade and one instantly, and compares
+///        their pixels once the crossfade is over.
+////////////////////////////////////////////////////////////////////////////////
+static bool CheckFadeEnds()
+{
+  NeoPixelRing faded(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+  NeoPixelRing instant(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+  NeoPixelRing* trees[] = { &faded, &instant };
+
+  hostSetMillis(0);
+  for(NeoPixelRing* tree : trees)
+  {
+    tree->begin();
+    tree->enableFlash(false);
+    SetStatus(*tree, NeoPixelRing::SPIN, 0x0000FF00);
+    tree->update();
+  }
+  faded.setCrossfade(500);
+  for(NeoPixelRing* tree : trees)
+  {
+    SetStatus(*tree, NeoPixelRing::PULSE, 0x00FF0000);
+  }
+
+  bool differedDuringFade = false;
+  for(uint16_t ms = 0; ms < 1000; ms += PERIODDIVISOR)
+  {
+    hostAdvanceMillis(PERIODDIVISOR);
+    bool same = ShownChecksum(faded) == ShownChecksum(instant);
+    if(ms < 400)
+    {
+      differedDuringFade |= !same;
+    }
+    else if(ms > 500 && !same)
+    {
+      return false;
+    }
+  }
+  return differedDuringFade;
+}
+
+int main(int argc, char** argv)
+{
+  double seconds = BenchSecondsFromArgs(argc, argv);
+
+  PrintBenchHeader("Status rings with and without a crossfade (stock layout)");
+  struct Case
+  {
+    const char* name;
+    NeoPixelRing::Pattern from;
+    NeoPixelRing::Pattern to;
+  };
+  const Case cases[] = {
+    { "SOLID->SOLID", NeoPixelRing::SOLID, NeoPixelRing::SOLID },
+    { "SPIN->SOLID", NeoPixelRing::SPIN, NeoPixelRing::SOLID },
+    { "SPIN->PULSE", NeoPixelRing::SPIN, NeoPixelRing::PULSE },
+    { "RAINBOW->SPIN", NeoPixelRing::RAINBOW, NeoPixelRing::SPIN },
+  };
+  for(const Case& c : cases)
+  {
+    for(uint8_t flash = 0; flash < 2; flash++)
+    {
+      for(uint8_t fading = 0; fading < 2; fading++)
+      {
+        char name[40];
+        snprintf(name, sizeof(name), "%s%s%s", c.name, flash ? "+flash" : "",
+                 fading ? " fading" : "");
+        PrintBenchResult(name, 93, BenchFrame(c.from, c.to, fading, flash, seconds));
+      }
+    }
+  }
+
+  bool ok = CheckFadeEnds();
+  printf("\ncrossfade %s\n", ok ? "ends on the new pattern" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file DhcpClientTest.cpp
+///
+/// @brief Checks the messages DhcpClient sends, the answers it accepts and
+///        rejects, reuse of a cached lease, retries, renewal and expiry.
+////////////////////////////////////////////////////////////////////////////////
+#include "Test.h"
+#include "NetworkStandins.h"
+
+static const uint8_t mac[6] = { 0x6, 0x5, 0x4, 0x3, 0x2, 0x1 };
+static uint8_t buf[DHCP_MESSAGE_LEN];
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Sends what is due to the server and delivers its answers until
+///        the client is bound or until time runs out.
+/// @return Time the exchange ended.
+////////////////////////////////////////////////////////////////////////////////
+static unsigned long Exchange(DhcpClient& client, DhcpServerStandin& server,
+                              unsigned long now, unsigned long until)
+{
+  for(; now < until; now++)
+  {
+    uint16_t len = server.receive(buf, now);
+    if(len > 0 && client.receive(buf, len, now) &&
+       DhcpClient::BOUND == client.getState())
+    {
+      return now;
+    }
+    if(DhcpClient::SEND == client.poll(now))
+    {
+      len = client.fillMessage(buf, sizeof(buf), now);
+      server.send(buf, len, now);
+    }
+  }
+  return now;
+}
+
+// Value of an option in the last message the server saw, NULL if absent
+static const uint8_t* Option(const DhcpServerStandin& server, uint8_t option)
+{
+  for(uint16_t pos = 240; pos + 1 < server.lastLen && 255 != server.last[pos];
+      pos += 2 + server.last[pos + 1])
+  {
+    if(option == server.last[pos])
+    {
+      return server.last + pos + 2;
+    }
+  }
+  return NULL;
+}
+
+static void TestDiscover()
+{
+  DhcpClient client;
+  CHECK_EQUAL(DhcpClient::IDLE, client.poll(0));
+  CHECK_EQUAL((unsigned long)-1, client.msUntilPoll(0));
+  client.begin(mac, 0);
+  CHECK(!client.hasLease());
+  CHECK_EQUAL(DhcpClient::SEND, client.poll(0));
+  CHECK_EQUAL(0, client.fillMessage(buf, DHCP_MESSAGE_LEN - 1, 0));
+  CHECK_EQUAL(DHCP_MESSAGE_LEN, client.fillMessage(buf, sizeof(buf), 0));
+  CHECK_EQUAL(DhcpClient::WAITING, client.getState());
+  CHECK_EQUAL(DHCP_TIMEOUT_MS, client.msUntilPoll(0));
+
+  // BOOTREQUEST over Ethernet, broadcast reply asked for, the magic cookie
+  CHECK_EQUAL(1, buf[0]);
+  CHECK_EQUAL(1, buf[1]);
+  CHECK_EQUAL(6, buf[2]);
+  CHECK_EQUAL(0x80, buf[10]);
+  CHECK(0 == memcmp(buf + 28, mac, 6));
+  static const uint8_t cookie[] = { 99, 130, 83, 99 };
+  CHECK(0 == memcmp(buf + 236, cookie, 4));
+  static const uint8_t discover[] = { 53, 1, 1, 55, 3, 1, 3, 6, 255 };
+  CHECK(0 == memcmp(buf + 240, discover, sizeof(discover)));
+}
+
+static void TestBind()
+{
+  DhcpClient client;
+  DhcpServerStandin server;
+  client.begin(mac, 0);
+  unsigned long bound = Exchange(client, server, 0, 1000);
+  CHECK_EQUAL(DhcpClient::BOUND, client.getState());
+  CHECK_EQUAL(2 * server.delayMs, bound);
+  CHECK_EQUAL(1, server.discovers);
+  CHECK_EQUAL(1, server.requests);
+
+  // The request named the offer and the server that made it
+  const uint8_t* requested = Option(server, 50);
+  const uint8_t* serverId = Option(server, 54);
+  CHECK(NULL != requested && 0 == memcmp(requested, server.address, 4));
+  CHECK(NULL != serverId && 0 == memcmp(serverId, server.id, 4));
+
+  const DhcpLease& lease = client.getLease();
+  CHECK(client.hasLease());
+  CHECK(0 == memcmp(lease.ip, server.address, 4));
+  CHECK(0 == memcmp(lease.gateway, server.gateway, 4));
+  CHECK(0 == memcmp(lease.dns, server.dns, 4));
+  CHECK(0 == memcmp(lease.mask, server.mask, 4));
+  CHECK(0 == memcmp(lease.server, server.id, 4));
+  CHECK_EQUAL(86400UL, lease.seconds);
+  CHECK_EQUAL(43200000UL, client.msUntilPoll(bound));
+}
+
+static void TestIgnored()
+{
+  DhcpClient client;
+  DhcpServerStandin server;
+  client.begin(mac, 0);
+  uint16_t len = client.fillMessage(buf, sizeof(buf), 0);
+  server.send(buf, len, 0);
+  len = server.receive(buf, server.delayMs);
+  CHECK_EQUAL(DHCP_MESSAGE_LEN, len);
+
+  // Another transaction, another client, no cookie, truncated: all ignored
+  uint8_t other[DHCP_MESSAGE_LEN];
+  memcpy(other, buf, len);
+  other[7] ^= 1;
+  CHECK(!client.receive(other, len, 20));
+  memcpy(other, buf, len);
+  other[33] ^= 1;
+  CHECK(!client.receive(other, len, 20));
+  memcpy(other, buf, len);
+  other[236] = 0;
+  CHECK(!client.receive(other, len, 20));
+  CHECK(!client.receive(buf, 242, 20));
+
+  // An acknowledgement before any request, then the offer
+  memcpy(other, buf, len);
+  other[242] = 5;
+  CHECK(!client.receive(other, len, 20));
+  CHECK(client.receive(buf, len, 20));
+  CHECK_EQUAL(DhcpClient::SEND, client.getState());
+
+  // An acknowledgement without a lease time is no lease
+  len = client.fillMessage(buf, sizeof(buf), 20);
+  server.send(buf, len, 20);
+  len = server.receive(buf, 40);
+  memcpy(other, buf, len);
+  other[249] = 0;  // Lease time option turned into padding
+  CHECK(!client.receive(other, len, 40));
+  CHECK(client.receive(buf, len, 40));
+  CHECK_EQUAL(DhcpClient::BOUND, client.getState());
+
+  // Nothing is expected once bound
+  CHECK(!client.receive(buf, len, 41));
+}
+
+static void TestReboot()
+{
+  DhcpServerStandin server;
+  DhcpLease cached;
+  memset(&cached, 0, sizeof(cached));
+  memcpy(cached.ip, server.address, 4);
+  memcpy(cached.gateway, server.gateway, 4);
+  cached.seconds = 3600;
+
+  // The server still has the address for the tree
+  DhcpClient client;
+  client.reboot(mac, cached, 0);
+  CHECK(client.hasLease());
+  CHECK_EQUAL(DhcpClient::SEND, client.poll(0));
+  unsigned long bound = Exchange(client, server, 0, 1000);
+  CHECK_EQUAL(server.delayMs, bound);
+  CHECK_EQUAL(0, server.discovers);
+  CHECK_EQUAL(1, server.requests);
+  const uint8_t* requested = Option(server, 50);
+  CHECK(NULL != requested && 0 == memcmp(requested, cached.ip, 4));
+  CHECK(NULL == Option(server, 54));
+  CHECK_EQUAL(0, server.last[12]);  // No ciaddr while rebooting
+  CHECK_EQUAL(86400UL, client.getLease().seconds);
+  CHECK(0 == memcmp(client.getLease().dns, server.dns, 4));
+
+  // It does not: refused, then a new lease from scratch
+  static const uint8_t moved[4] = { 10, 1, 1, 7 };
+  memcpy(server.address, moved, 4);
+  server.discovers = 0;
+  DhcpClient refused;
+  refused.reboot(mac, cached, 0);
+  bound = Exchange(refused, server, 0, 1000);
+  CHECK_EQUAL(3 * server.delayMs, bound);
+  CHECK_EQUAL(1, server.discovers);
+  CHECK(refused.hasLease());
+  CHECK(0 == memcmp(refused.getLease().ip, moved, 4));
+}
+
+static void TestRetries()
+{
+  DhcpServerStandin server;
+  server.up = false;
+  DhcpClient client;
+  client.begin(mac, 0);
+  Exchange(client, server, 0, DHCP_MAX_TRIES * DHCP_TIMEOUT_MS);
+  CHECK_EQUAL(DhcpClient::WAITING, client.getState());
+  CHECK_EQUAL(DHCP_RETRY_MS - (DHCP_TIMEOUT_MS - 1),
+              client.msUntilPoll(DHCP_MAX_TRIES * DHCP_TIMEOUT_MS - 1));
+
+  // After the pause it starts over, and a server that comes back answers
+  server.up = true;
+  unsigned long pause = (DHCP_MAX_TRIES - 1) * DHCP_TIMEOUT_MS + DHCP_RETRY_MS;
+  unsigned long bound = Exchange(client, server,
+                                 DHCP_MAX_TRIES * DHCP_TIMEOUT_MS, 60000);
+  CHECK_EQUAL(DhcpClient::BOUND, client.getState());
+  CHECK_EQUAL(pause + 2 * server.delayMs, bound);
+}
+
+static void TestRenewal()
+{
+  DhcpServerStandin server;
+  server.seconds = 600;
+  DhcpClient client;
+  client.begin(mac, 0);
+  unsigned long bound = Exchange(client, server, 0, 1000);
+  unsigned long half = bound + 300000;
+  CHECK_EQUAL(DhcpClient::BOUND, client.poll(half - 1));
+  CHECK_EQUAL(DhcpClient::SEND, client.poll(half));
+  CHECK(client.hasLease());
+  client.fillMessage(buf, sizeof(buf), half);
+  CHECK(0 == memcmp(buf + 12, server.address, 4));  // ciaddr
+  CHECK_EQUAL(0, buf[10]);                          // Unicast reply is fine
+
+  // Unanswered renewals keep the lease until it runs out
+  server.up = false;
+  Exchange(client, server, half, bound + 600000 - 1);
+  CHECK(client.hasLease());
+  CHECK_EQUAL(DhcpClient::WAITING, client.getState());
+  CHECK_EQUAL(1, client.msUntilPoll(bound + 600000 - 1));
+  client.poll(bound + 600000);
+  CHECK(!client.hasLease());
+  CHECK_EQUAL(DhcpClient::SEND, client.getState());
+  client.fillMessage(buf, sizeof(buf), bound + 600000);
+  CHECK_EQUAL(1, buf[242]);  // DISCOVER
+}
+
+int main()
+{
+  TestDiscover();
+  TestBind();
+  TestIgnored();
+  TestReboot();
+  TestRetries();
+  TestRenewal();
+  return TestResult("DhcpClientTest");
+}
@@ -0,0 +1,146 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file DnsResolverTest.cpp
+///
+/// @brief Checks the queries DnsResolver builds, the answers it accepts and
+///        rejects, and its retries.
+////////////////////////////////////////////////////////////////////////////////
+#include "Test.h"
+#include "DnsResolver.h"
+
+static uint8_t query[128];
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Builds an answer to the query in query[]: the header and question
+///        copied back, then the given records.
+////////////////////////////////////////////////////////////////////////////////
+static uint16_t Answer(uint8_t* buf, uint16_t queryLen, uint8_t rcode,
+                       uint8_t answers, const uint8_t* records,
+                       uint16_t recordsLen)
+{
+  memcpy(buf, query, queryLen);
+  buf[2] = 0x81;
+  buf[3] = 0x80 | rcode;
+  buf[6] = 0;
+  buf[7] = answers;
+  if(recordsLen)
+  {
+    // records may be NULL, which memcpy() is not given even for 0 bytes
+    memcpy(buf + queryLen, records, recordsLen);
+  }
+  return queryLen + recordsLen;
+}
+
+static void TestQuery()
+{
+  DnsResolver resolver;
+  CHECK_EQUAL(DnsResolver::IDLE, resolver.poll(0));
+  resolver.begin(0);
+  CHECK_EQUAL(DnsResolver::SEND, resolver.poll(0));
+  CHECK_EQUAL(0, resolver.msUntilPoll(0));
+
+  uint16_t len = resolver.fillQuery(query, sizeof(query), "ci.example.com", 0);
+  static const uint8_t expected[] = {
+    0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    2, 'c', 'i', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0,
+    0x00, 0x01, 0x00, 0x01
+  };
+  CHECK_EQUAL(2 + sizeof(expected), len);
+  CHECK(0 == memcmp(expected, query + 2, sizeof(expected)));
+  CHECK_EQUAL(DnsResolver::WAITING, resolver.getState());
+  CHECK_EQUAL(DNS_TIMEOUT_MS, resolver.msUntilPoll(0));
+}
+
+static void TestInvalidNames()
+{
+  DnsResolver resolver;
+  resolver.begin(0);
+  CHECK_EQUAL(0, resolver.fillQuery(query, sizeof(query), "a..b", 0));
+  CHECK_EQUAL(DnsResolver::FAILED, resolver.getState());
+  resolver.begin(0);
+  CHECK_EQUAL(0, resolver.fillQuery(query, sizeof(query), "", 0));
+  resolver.begin(0);
+  CHECK_EQUAL(0, resolver.fillQuery(query, 20, "jenkins.example.com", 0));
+  char longLabel[80];
+  memset(longLabel, 'x', 70);
+  longLabel[70] = '\0';
+  resolver.begin(0);
+  CHECK_EQUAL(0, resolver.fillQuery(query, sizeof(query), longLabel, 0));
+}
+
+static void TestAnswer()
+{
+  DnsResolver resolver;
+  resolver.begin(0);
+  uint16_t queryLen = resolver.fillQuery(query, sizeof(query), "ci.example.com", 0);
+
+  // A CNAME to a name spelled out, then the A record behind a pointer
+  static const uint8_t records[] = {
+    0xC0, 0x0C, 0, 5, 0, 1, 0, 0, 1, 0, 0, 6, 3, 'w', 'e', 'b', 0xC0, 0x0F,
+    0xC0, 0x2C, 0, 1, 0, 1, 0, 0, 1, 0, 0, 4, 192, 168, 1, 20
+  };
+  uint8_t answer[128];
+  uint16_t len = Answer(answer, queryLen, 0, 2, records, sizeof(records));
+
+  // Wrong ID, not a response, truncated: all ignored
+  answer[1] ^= 1;
+  CHECK(!resolver.receive(answer, len));
+  answer[1] ^= 1;
+  answer[2] &= 0x7F;
+  CHECK(!resolver.receive(answer, len));
+  answer[2] |= 0x80;
+  CHECK(!resolver.receive(answer, len - 2));
+  CHECK_EQUAL(DnsResolver::WAITING, resolver.getState());
+
+  CHECK(resolver.receive(answer, len));
+  CHECK_EQUAL(DnsResolver::RESOLVED, resolver.getState());
+  CHECK_EQUAL(192, resolver.getAddress()[0]);
+  CHECK_EQUAL(20, resolver.getAddress()[3]);
+  // A duplicate answer changes nothing
+  CHECK(!resolver.receive(answer, len));
+}
+
+static void TestRetriesAndFailure()
+{
+  DnsResolver resolver;
+  resolver.begin(0);
+  unsigned long now = 0;
+  for(uint8_t i = 0; i < DNS_MAX_TRIES; i++)
+  {
+    CHECK_EQUAL(DnsResolver::SEND, resolver.poll(now));
+    CHECK(resolver.fillQuery(query, sizeof(query), "ci.example.com", now) > 0);
+    CHECK_EQUAL(DnsResolver::WAITING, resolver.poll(now + DNS_TIMEOUT_MS - 1));
+    now += DNS_TIMEOUT_MS;
+  }
+  CHECK_EQUAL(DnsResolver::FAILED, resolver.poll(now));
+
+  // An answer to the first try arriving late is not taken for the new one
+  uint16_t oldId = (query[0] << 8) | query[1];
+  resolver.begin(now);
+  uint16_t queryLen = resolver.fillQuery(query, sizeof(query), "ci.example.com", now);
+  uint8_t answer[128];
+  uint16_t len = Answer(answer, queryLen, 0, 0, NULL, 0);
+  answer[0] = oldId >> 8;
+  answer[1] = oldId & 0xFF;
+  CHECK(!resolver.receive(answer, len));
+
+  // The name does not exist
+  len = Answer(answer, queryLen, 3, 0, NULL, 0);
+  CHECK(resolver.receive(answer, len));
+  CHECK_EQUAL(DnsResolver::FAILED, resolver.getState());
+
+  // A server failure waits for the retry
+  resolver.begin(now);
+  queryLen = resolver.fillQuery(query, sizeof(query), "ci.example.com", now);
+  len = Answer(answer, queryLen, 2, 0, NULL, 0);
+  CHECK(!resolver.receive(answer, len));
+  CHECK_EQUAL(DnsResolver::WAITING, resolver.getState());
+}
+
+int main()
+{
+  TestQuery();
+  TestInvalidNames();
+  TestAnswer();
+  TestRetriesAndFailure();
+  return TestResult("DnsResolverTest");
+}
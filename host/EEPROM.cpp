@@ -0,0 +1,42 @@
+#include "EEPROM.h"
+
+EEPROMClass EEPROM;
+
+EEPROMClass::EEPROMClass()
+{
+  hostErase();
+  memset(cellWrites, 0, sizeof(cellWrites));
+  hostResetCounts();
+}
+
+uint8_t EEPROMClass::read(int idx)
+{
+  reads++;
+  return data[idx];
+}
+
+void EEPROMClass::write(int idx, uint8_t val)
+{
+  writes++;
+  cellWrites[idx]++;
+  data[idx] = val;
+}
+
+void EEPROMClass::update(int idx, uint8_t val)
+{
+  if(read(idx) != val)
+  {
+    write(idx, val);
+  }
+}
+
+void EEPROMClass::hostErase()
+{
+  memset(data, 0xFF, sizeof(data));
+}
+
+void EEPROMClass::hostResetCounts()
+{
+  reads = 0;
+  writes = 0;
+}
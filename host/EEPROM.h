@@ -0,0 +1,55 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file EEPROM.h
+///
+/// @brief Host stand-in for the Arduino EEPROM library: 1 KB of EEPROM, as on
+///        the ATmega32u4, that counts every byte read and written so tests
+///        can check what a code path costs.  A real write takes about 3.3 ms
+///        and wears the cell.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include <Arduino.h>
+
+#ifndef E2END
+  #define E2END 0x3FF
+#endif
+
+class EEPROMClass
+{
+  public:
+    EEPROMClass();
+
+    uint8_t read(int idx);
+    void write(int idx, uint8_t val);
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Writes only if the byte differs, after reading it, as the real
+    ///        library does.
+    ////////////////////////////////////////////////////////////////////////////
+    void update(int idx, uint8_t val);
+
+    uint16_t length() const
+    {
+      return E2END + 1;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Sets every byte to the erased value 0xFF.
+    ////////////////////////////////////////////////////////////////////////////
+    void hostErase();
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Clears the read and write counters.
+    ////////////////////////////////////////////////////////////////////////////
+    void hostResetCounts();
+
+    uint8_t data[E2END + 1];
+    unsigned long reads;
+    unsigned long writes;
+    unsigned long cellWrites[E2END + 1];  ///< Writes per address, for wear
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // HOST_EEPROM_H
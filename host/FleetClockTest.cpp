@@ -0,0 +1,120 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file FleetClockTest.cpp
+///
+/// @brief Checks beacon decoding, skew learning and that a tree drawn at a
+///        time that steps back shows what it showed at that time.
+////////////////////////////////////////////////////////////////////////////////
+#include "Test.h"
+#include "FleetClock.h"
+
+static void TestBeaconFraming()
+{
+  FleetClock fleet;
+  fleet.setGroup(2);
+  CHECK(!fleet.isSynced());
+  CHECK_EQUAL(1234UL, fleet.toFleet(1234));
+
+  uint8_t beacon[SYNC_BEACON_SIZE];
+  FleetClock::fillBeacon(beacon, 2, 0x01020304UL);
+  CHECK_EQUAL(SYNC_MAGIC, beacon[0]);
+  CHECK_EQUAL(2, beacon[1]);
+  CHECK_EQUAL(0x01, beacon[2]);
+  CHECK_EQUAL(0x04, beacon[5]);
+
+  CHECK_EQUAL(FleetClock::MALFORMED, fleet.receive(beacon, SYNC_BEACON_SIZE - 1, 0));
+  beacon[0] = CONTROL_MAGIC;
+  CHECK_EQUAL(FleetClock::MALFORMED, fleet.receive(beacon, SYNC_BEACON_SIZE, 0));
+
+  FleetClock::fillBeacon(beacon, 3, 50000);
+  CHECK_EQUAL(FleetClock::IGNORED, fleet.receive(beacon, SYNC_BEACON_SIZE, 100));
+  CHECK(!fleet.isSynced());
+
+  FleetClock::fillBeacon(beacon, CONTROL_GROUP_ALL, 50000);
+  CHECK_EQUAL(FleetClock::STEPPED, fleet.receive(beacon, SYNC_BEACON_SIZE, 100));
+  CHECK(fleet.isSynced());
+  CHECK_EQUAL(50000UL, fleet.toFleet(100));
+  CHECK_EQUAL(51000UL, fleet.toFleet(1100));
+
+  // Duplicates change nothing
+  CHECK_EQUAL(FleetClock::IGNORED, fleet.receive(beacon, SYNC_BEACON_SIZE, 120));
+  CHECK_EQUAL(51000UL, fleet.toFleet(1100));
+}
+
+static void TestSkew()
+{
+  // This board's millis() runs 0.2% slow against the fleet
+  FleetClock fleet;
+  unsigned long fleetTime = 1000000;
+  unsigned long local = 7;
+  CHECK_EQUAL(FleetClock::STEPPED, fleet.beacon(fleetTime, local));
+
+  long error = 0;
+  for(int i = 0; i < 20; i++)
+  {
+    fleetTime += 5000;
+    local += 4990;
+    error = (long)(fleetTime - fleet.toFleet(local));
+    CHECK_EQUAL(FleetClock::ADJUSTED, fleet.beacon(fleetTime, local));
+  }
+  // 10 ms in 4990 is 33621 in units of 2^-24
+  CHECK(fleet.getSkew() > 33571 && fleet.getSkew() < 33671);
+  CHECK(error >= -1 && error <= 1);
+
+  // Half way to the next beacon the prediction is still right
+  long halfway = (long)(fleetTime + 2500 - fleet.toFleet(local + 2495));
+  CHECK(halfway >= 0 && halfway <= 1);
+
+  // Far off: the controller restarted, so start over
+  CHECK_EQUAL(FleetClock::STEPPED, fleet.beacon(5, local + 10));
+  CHECK_EQUAL(0, fleet.getSkew());
+  CHECK_EQUAL(105UL, fleet.toFleet(local + 110));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Draws one frame at a given time and returns a checksum of what was
+///        shown.
+////////////////////////////////////////////////////////////////////////////////
+static uint32_t Frame(NeoPixelRing& tree, unsigned long ms)
+{
+  Adafruit_NeoPixel::hostResetTotals();
+  tree.update(ms);
+  return Adafruit_NeoPixel::hostTotalShowChecksum();
+}
+
+static void TestStepBack()
+{
+  static const uint8_t rings[] = { 16, 12, 8 };
+  NeoPixelRing stepped(9, NEO_GRB + NEO_KHZ800, sizeof(rings), rings);
+  NeoPixelRing steady(9, NEO_GRB + NEO_KHZ800, sizeof(rings), rings);
+  NeoPixelRing* trees[] = { &stepped, &steady };
+  for(NeoPixelRing* tree : trees)
+  {
+    tree->begin();
+    tree->enableFlash(false);
+    tree->update(0);
+    tree->setPattern(0, NeoPixelRing::PULSE, 0x00FF0000, 2000, 0);
+    tree->setPattern(1, NeoPixelRing::SPIN, 0x0000FF00, 1500, 0);
+    tree->setPattern(2, NeoPixelRing::RAINBOW, 0, 3000, 0);
+  }
+
+  Frame(steady, 10000);
+  uint32_t ahead = Frame(stepped, 10400);
+  uint32_t expected = Frame(steady, 10100);
+  CHECK(ahead != expected);
+
+  // A step back redraws at once, at the earlier time
+  CHECK_EQUAL(0UL, stepped.msUntilUpdate(10100));
+  CHECK_EQUAL(expected, Frame(stepped, 10100));
+  for(unsigned long ms = 10116; ms < 14000; ms += 40)
+  {
+    CHECK_EQUAL(Frame(steady, ms), Frame(stepped, ms));
+  }
+}
+
+int main()
+{
+  TestBeaconFraming();
+  TestSkew();
+  TestStepBack();
+  return TestResult("FleetClockTest");
+}
@@ -0,0 +1,284 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file FleetSimulation.cpp
+///
+/// @brief Simulates a row of trees in two groups for 20 minutes and reports
+///        how far apart their patterns run and how many datagrams a status
+///        change costs.
+///
+/// Each virtual tree's millis() starts at a random boot time and runs up to
+/// 0.3% fast or slow, about what the boards' ceramic resonators manage.
+/// Every SIM_STATUS_MS one group's status changes.  With sync on, a beacon
+/// goes out every SYNC_BEACON_INTERVAL_MS to all groups, reaching each tree
+/// 0-3 ms late or not at all (5% lost).
+///
+/// A tree is "in step" on a frame if it shows exactly what a reference tree
+/// drawn at the true fleet time shows.  Patterns move once every
+/// PERIODDIVISOR ms, so a tree up to half that off is still in step.
+///
+/// Simulated time does not depend on the benchmark seconds argument.
+///
+/// Usage: FleetSimulation
+////////////////////////////////////////////////////////////////////////////////
+#include <vector>
+
+#include "FleetClock.h"
+
+#define SIM_TREES 12
+#define SIM_GROUPS 2
+#define SIM_MINUTES 20
+#define SIM_STATUS_MS 60000UL
+#define SIM_WARMUP_MS 60000UL   ///< Not counted: the skew needs a baseline
+#define SIM_BEACON_MS 5000UL    ///< Same as the sketch's SYNC_BEACON_INTERVAL_MS
+
+static const uint8_t rings[] = { 32, 24, 16, 12, 8, 1 };
+static const uint8_t numRings = sizeof(rings);
+
+struct VirtualTree
+{
+  NeoPixelRing* tree;
+  FleetClock clock;
+  ControlProtocol control;
+  unsigned long boot;  ///< Local time at true time 0
+  long ppm;            ///< How fast the local clock runs
+  uint8_t group;
+  uint32_t shown;      ///< Checksum of the last frame shown
+
+  unsigned long Local(unsigned long t) const
+  {
+    return boot + t + (long)((int64_t)t * ppm / 1000000);
+  }
+};
+
+struct SimResult
+{
+  double meanErrorMs;
+  long maxErrorMs;
+  double inStep;          ///< Fraction of frames matching the reference
+  double datagramsPerChange;
+  double beaconsPerChange;
+  bool converged;         ///< Every tree ended on its group's status
+};
+
+static NeoPixelRing* NewTree()
+{
+  NeoPixelRing* tree = new NeoPixelRing(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+  tree->begin();
+  tree->enableFlash(false);
+  tree->setCrossfade(800);
+  return tree;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Draws one frame and returns the checksum of what is on the tree,
+///        which is the previous frame's if nothing was shown.
+////////////////////////////////////////////////////////////////////////////////
+static uint32_t Draw(NeoPixelRing& tree, unsigned long ms, uint32_t& shown)
+{
+  Adafruit_NeoPixel::hostResetTotals();
+  if(tree.update(ms))
+  {
+    shown = Adafruit_NeoPixel::hostTotalShowChecksum();
+  }
+  return shown;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Builds the control datagram for a status: every status ring shows
+///        the same pattern, the top ring a slow rainbow.
+////////////////////////////////////////////////////////////////////////////////
+static std::vector<uint8_t> StatusDatagram(uint16_t sequence, bool grouped,
+                                           uint8_t group, uint8_t status)
+{
+  static const NeoPixelRing::Pattern patterns[] = {
+    NeoPixelRing::SPIN, NeoPixelRing::PULSE, NeoPixelRing::PROGRESS
+  };
+  static const uint32_t colors[] = { 0x0000FF00, 0x00FF0000, 0x00FFBF00 };
+  std::vector<uint8_t> d;
+  d.push_back(CONTROL_MAGIC);
+  d.push_back(grouped ? CONTROL_FLAG_GROUP : 0);
+  d.push_back(sequence >> 8);
+  d.push_back(sequence & 0xFF);
+  d.push_back(0);
+  d.push_back(2);
+  if(grouped)
+  {
+    d.push_back(group);
+  }
+  const uint8_t commands[2][8] = {
+    { CONTROL_ALL_RINGS, (uint8_t)patterns[status % 3],
+      (uint8_t)(colors[status % 3] >> 16), (uint8_t)(colors[status % 3] >> 8),
+      (uint8_t)colors[status % 3], 2000 >> 8, 2000 & 0xFF, 60 },
+    { numRings - 1, NeoPixelRing::RAINBOW, 0, 0, 0, 6000 >> 8, 6000 & 0xFF, 0 },
+  };
+  for(const uint8_t* c : commands)
+  {
+    d.insert(d.end(), c, c + CONTROL_COMMAND_SIZE);
+  }
+  return d;
+}
+
+static SimResult Simulate(bool sync, bool grouped)
+{
+  randomSeed(42);
+  std::vector<VirtualTree> trees(SIM_TREES);
+  for(uint8_t i = 0; i < SIM_TREES; i++)
+  {
+    VirtualTree& v = trees[i];
+    v.tree = NewTree();
+    v.boot = random(60000);
+    v.ppm = random(-3000, 3001);
+    v.group = i % SIM_GROUPS;
+    v.shown = 0;
+    v.clock.setGroup(v.group);
+    v.control.setGroup(v.group);
+  }
+  NeoPixelRing* reference[SIM_GROUPS];
+  ControlProtocol referenceControl[SIM_GROUPS];
+  uint32_t referenceShown[SIM_GROUPS] = {};
+  for(uint8_t g = 0; g < SIM_GROUPS; g++)
+  {
+    reference[g] = NewTree();
+    referenceControl[g].setGroup(g);
+  }
+
+  uint16_t sequence = 0;
+  unsigned long changes = 0, datagrams = 0, beacons = 0;
+  unsigned long frames = 0, framesInStep = 0;
+  double errorSum = 0;
+  long maxError = 0;
+
+  const unsigned long end = SIM_MINUTES * 60000UL;
+  for(unsigned long t = 0; t < end; t += PERIODDIVISOR)
+  {
+    if(sync && t % SIM_BEACON_MS < PERIODDIVISOR)
+    {
+      uint8_t beacon[SYNC_BEACON_SIZE];
+      FleetClock::fillBeacon(beacon, CONTROL_GROUP_ALL, t);
+      beacons++;
+      for(VirtualTree& v : trees)
+      {
+        if(random(100) >= 5)
+        {
+          v.clock.receive(beacon, sizeof(beacon), v.Local(t + random(4)));
+        }
+      }
+    }
+
+    if(t % SIM_STATUS_MS < PERIODDIVISOR)
+    {
+      uint8_t group = changes % SIM_GROUPS;
+      uint8_t status = changes / SIM_GROUPS;
+      changes++;
+      std::vector<uint8_t> d = StatusDatagram(++sequence, true, group, status);
+      referenceControl[group].apply(*reference[group], d.data(), d.size());
+      if(grouped)
+      {
+        // One broadcast, heard by every tree
+        datagrams++;
+        for(VirtualTree& v : trees)
+        {
+          v.control.apply(*v.tree, d.data(), d.size());
+        }
+      }
+      else
+      {
+        // One datagram to each tree in the group
+        d = StatusDatagram(sequence, false, group, status);
+        for(VirtualTree& v : trees)
+        {
+          if(v.group == group)
+          {
+            datagrams++;
+            v.control.apply(*v.tree, d.data(), d.size());
+          }
+        }
+      }
+    }
+
+    // Frames are drawn half way between pattern steps, so being in step
+    // does not hinge on which side of a step a tree lands
+    unsigned long at = t + PERIODDIVISOR / 2;
+    for(uint8_t g = 0; g < SIM_GROUPS; g++)
+    {
+      Draw(*reference[g], at, referenceShown[g]);
+    }
+    for(VirtualTree& v : trees)
+    {
+      unsigned long fleetTime = sync ? v.clock.toFleet(v.Local(at)) : v.Local(at);
+      uint32_t shown = Draw(*v.tree, fleetTime, v.shown);
+      if(t < SIM_WARMUP_MS)
+      {
+        continue;
+      }
+      long error = labs((long)(fleetTime - at));
+      errorSum += error;
+      maxError = (error > maxError) ? error : maxError;
+      framesInStep += (shown == referenceShown[v.group]);
+      frames++;
+    }
+  }
+
+  // Long after the last status change every tree shows its group's status
+  // exactly as the reference does
+  bool converged = true;
+  for(VirtualTree& v : trees)
+  {
+    unsigned long t = end + SIM_STATUS_MS / 2 + PERIODDIVISOR / 2;
+    unsigned long fleetTime = sync ? v.clock.toFleet(v.Local(t)) : v.Local(t);
+    Draw(*reference[v.group], t, referenceShown[v.group]);
+    converged &= (Draw(*v.tree, fleetTime, v.shown) == referenceShown[v.group]);
+  }
+
+  for(VirtualTree& v : trees)
+  {
+    delete v.tree;
+  }
+  for(uint8_t g = 0; g < SIM_GROUPS; g++)
+  {
+    delete reference[g];
+  }
+
+  SimResult r;
+  r.meanErrorMs = errorSum / frames;
+  r.maxErrorMs = maxError;
+  r.inStep = (double)framesInStep / frames;
+  r.datagramsPerChange = (double)datagrams / changes;
+  r.beaconsPerChange = (double)beacons / changes;
+  r.converged = converged;
+  return r;
+}
+
+int main()
+{
+  printf("\n%u trees in %u groups, %u simulated minutes, a status change every %lu s\n",
+         SIM_TREES, SIM_GROUPS, SIM_MINUTES, SIM_STATUS_MS / 1000);
+  printf("%-18s %12s %12s %10s %16s %16s\n", "case", "mean err ms",
+         "max err ms", "in step", "datagrams/change", "beacons/change");
+
+  struct Case
+  {
+    const char* name;
+    bool sync;
+    bool grouped;
+  };
+  const Case cases[] = {
+    { "own millis()", false, false },
+    { "synced, unicast", true, false },
+    { "synced, group", true, true },
+  };
+  bool ok = true;
+  for(const Case& c : cases)
+  {
+    SimResult r = Simulate(c.sync, c.grouped);
+    printf("%-18s %12.1f %12ld %9.1f%% %16.1f %16.1f\n", c.name, r.meanErrorMs,
+           r.maxErrorMs, 100.0 * r.inStep, r.datagramsPerChange,
+           r.beaconsPerChange);
+    if(c.sync)
+    {
+      ok &= r.converged && r.maxErrorMs < PERIODDIVISOR / 2;
+    }
+  }
+
+  printf("\nfleet sync %s\n", ok ? "keeps every tree in step" : "FAILED");
+  return ok ? 0 : 1;
+}
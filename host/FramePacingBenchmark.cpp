@@ -0,0 +1,99 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file FramePacingBenchmark.cpp
+///
+/// @brief Simulates ten seconds of the sketch's loop() to compare how often
+///        the strip is shown, and how long interrupts are masked, when
+///        update() is called unconditionally versus when loop() idles until
+///        NeoPixelRing::msUntilUpdate().
+///
+/// The simulation charges each show() its bitstream time (interrupts are
+/// masked for all of it) and each idle slice one millisecond, the period of
+/// the AVR timer 0 interrupt that wakes the CPU from idle sleep.  Rendering
+/// itself is not charged, so the duty cycle figures are lower bounds.
+////////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include "NeoPixelRing.h"
+
+static const uint8_t rings[] = { 32, 24, 16, 12, 8, 1 };
+static const uint8_t numRings = sizeof(rings);
+static const unsigned long simulatedMs = 10000;
+
+struct PacingResult
+{
+  uint32_t shows;
+  uint64_t maskedMicros;
+};
+
+static PacingResult Simulate(NeoPixelRing::Pattern pattern, bool flash)
+{
+  hostSetMillis(0);
+  randomSeed(1);
+  NeoPixelRing tree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+  tree.begin();
+  tree.setBrightness(75);
+  tree.enableFlash(flash);
+  for(uint8_t i = 0; i < numRings; i++)
+  {
+    tree.setPattern(i, pattern, 0x0000FF00, 2000, 50);
+  }
+  tree.update();
+
+  Adafruit_NeoPixel::hostResetTotals();
+  while(millis() < simulatedMs)
+  {
+    uint64_t maskedBefore = Adafruit_NeoPixel::hostTotalShowMicros();
+    bool shown = tree.update();
+    uint64_t masked = Adafruit_NeoPixel::hostTotalShowMicros() - maskedBefore;
+    hostAdvanceMicros(masked);
+    if(!shown && tree.msUntilUpdate() > 0)
+    {
+      hostAdvanceMillis(1);
+    }
+  }
+
+  PacingResult result;
+  result.shows = Adafruit_NeoPixel::hostTotalShowCount();
+  result.maskedMicros = Adafruit_NeoPixel::hostTotalShowMicros();
+  return result;
+}
+
+// Unpaced baseline: every update() renders and shows, as before dirty tracking
+static PacingResult Baseline()
+{
+  // 93 pixels * 24 bits * 1.25 us + 50 us latch; shown back to back
+  uint32_t showMicros = 93 * 24 * 5 / 4 + 50;
+  PacingResult result;
+  result.shows = simulatedMs * 1000 / showMicros;
+  result.maskedMicros = (uint64_t)result.shows * showMicros;
+  return result;
+}
+
+static void Print(const char* name, const PacingResult& r)
+{
+  printf("%-28s %10.1f %13.1f %11.1f%%\n", name,
+         r.shows * 1000.0 / simulatedMs,
+         r.maskedMicros / 1000.0 / (simulatedMs / 1000.0),
+         r.maskedMicros / 10.0 / simulatedMs);
+}
+
+int main()
+{
+  printf("\nFrame pacing, stock layout, %lu s simulated\n", simulatedMs / 1000);
+  printf("%-28s %10s %13s %12s\n", "case", "shows/s", "masked ms/s", "masked");
+
+  Print("unconditional update()", Baseline());
+
+  const NeoPixelRing::Pattern patterns[] = { NeoPixelRing::SOLID, NeoPixelRing::PULSE, NeoPixelRing::SPIN };
+  const char* names[] = { "SOLID", "PULSE", "SPIN" };
+  for(uint8_t p = 0; p < 3; p++)
+  {
+    for(uint8_t flash = 0; flash < 2; flash++)
+    {
+      char name[40];
+      snprintf(name, sizeof(name), "paced %s%s", names[p], flash ? "+flash" : "");
+      Print(name, Simulate(patterns[p], flash));
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,272 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file JobSchedulerTest.cpp
+///
+/// @brief Simulates four hours of polling five Jenkins jobs, with JobScheduler
+///        and with a fixed 10 s round-robin poll, and compares the request
+///        rate and how long each build state change takes to reach the tree.
+///
+/// The simulated server answers after 150 ms.  Builds start every 12 to 45
+/// minutes and run for 3 to 9 minutes; one job is unreachable for half an
+/// hour.  host/jenkins_standin.py serves the same scenario over HTTP for
+/// trying the firmware against.
+////////////////////////////////////////////////////////////////////////////////
+#include "Test.h"
+#include "JobScheduler.h"
+
+static const uint8_t numJobs = 5;
+static const unsigned long minute = 60000UL;
+static const unsigned long duration = 240 * minute;
+static const unsigned long latency = 150;
+static const unsigned long step = 10;
+
+// Job 4 does not answer between these times
+static const uint8_t unreachableJob = 4;
+static const unsigned long outageStart = 60 * minute;
+static const unsigned long outageEnd = 90 * minute;
+
+struct Server
+{
+  unsigned long period;  ///< Time between build starts
+  unsigned long offset;  ///< First build start
+  unsigned long length;  ///< Build duration
+
+  ////////////////////////////////////////////////////////////////////////////
+  /// @brief State at a time: 0 before the first build, otherwise twice the
+  ///        number of builds started, less one while the latest is running.
+  ///        Every change of state is a change the tree should show.
+  ////////////////////////////////////////////////////////////////////////////
+  unsigned long State(unsigned long t) const
+  {
+    if(t < offset)
+    {
+      return 0;
+    }
+    unsigned long builds = (t - offset) / period + 1;
+    bool building = (t - offset) % period < length;
+    return builds * 2 - (building ? 1 : 0);
+  }
+};
+
+static const Server servers[numJobs] = {
+  { 12 * minute, 2 * minute, 3 * minute },
+  { 20 * minute, 7 * minute, 5 * minute },
+  { 30 * minute, 11 * minute, 9 * minute },
+  { 45 * minute, 25 * minute, 6 * minute },
+  { 15 * minute, 4 * minute, 4 * minute },
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief The previous behavior extended to several jobs: every job polled
+///        every 10 s, taking the jobs in turn.
+////////////////////////////////////////////////////////////////////////////////
+struct FixedPoller
+{
+  static const unsigned long gap = 10000 / numJobs;
+
+  unsigned long lastPoll;
+  uint8_t next;
+  uint8_t current;
+  unsigned long sentAt;
+
+  FixedPoller() : lastPoll(0), next(0), current(JOB_NONE), sentAt(0) {}
+  void begin(uint8_t, unsigned long now) { lastPoll = now - gap; }
+  uint8_t nextJob(unsigned long now) const
+  {
+    return (JOB_NONE == current && now - lastPoll >= gap) ? next : JOB_NONE;
+  }
+  void started(uint8_t job, unsigned long now)
+  {
+    current = job;
+    sentAt = now;
+    lastPoll = now;
+    next = (job + 1) % numJobs;
+  }
+  void completed(bool, bool, unsigned long) { current = JOB_NONE; }
+  uint8_t checkTimeout(unsigned long now)
+  {
+    if(JOB_NONE != current && now - sentAt >= JOB_REQUEST_TIMEOUT_MS)
+    {
+      uint8_t failed = current;
+      current = JOB_NONE;
+      return failed;
+    }
+    return JOB_NONE;
+  }
+  uint8_t inFlight() const { return current; }
+};
+
+struct Measurement
+{
+  unsigned long requests;
+  unsigned long outageRequests;   ///< Sent to the unreachable job while down
+  unsigned long changes[2];       ///< Build starts, build ends
+  unsigned long totalDelay[2];
+  unsigned long maxDelay[2];
+};
+
+template<typename Poller>
+static Measurement Simulate()
+{
+  Poller poller;
+  Measurement m = {};
+  unsigned long shown[numJobs] = {};       // State the tree shows
+  unsigned long changedAt[numJobs] = {};   // When the server state last changed
+  unsigned long serverState[numJobs] = {};
+  unsigned long answerAt = 0;
+  unsigned long answerState = 0;
+
+  poller.begin(numJobs, 0);
+  for(unsigned long t = 0; t < duration; t += step)
+  {
+    for(uint8_t j = 0; j < numJobs; j++)
+    {
+      unsigned long state = servers[j].State(t);
+      if(state != serverState[j])
+      {
+        serverState[j] = state;
+        changedAt[j] = t;
+      }
+    }
+
+    uint8_t job = poller.inFlight();
+    if(JOB_NONE != job && t == answerAt)
+    {
+      bool building = answerState & 1;
+      bool changed = answerState != shown[job];
+      bool outage = (job == unreachableJob && changedAt[job] < outageEnd && t > outageStart);
+      if(changed && answerState == serverState[job] && !outage)
+      {
+        // A change already superseded on the server is not counted, since
+        // its successor will be, and neither is one held up by the outage
+        uint8_t kind = building ? 0 : 1;
+        unsigned long delay = t - changedAt[job];
+        m.changes[kind]++;
+        m.totalDelay[kind] += delay;
+        if(delay > m.maxDelay[kind])
+        {
+          m.maxDelay[kind] = delay;
+        }
+      }
+      shown[job] = answerState;
+      poller.completed(building, changed, t);
+    }
+    poller.checkTimeout(t);
+
+    job = poller.nextJob(t);
+    if(JOB_NONE != job)
+    {
+      poller.started(job, t);
+      m.requests++;
+      bool down = (job == unreachableJob && t >= outageStart && t < outageEnd);
+      if(down)
+      {
+        m.outageRequests++;
+        answerAt = 0; // Never answered; times out
+      }
+      else
+      {
+        answerAt = t + latency;
+        answerState = servers[job].State(t + latency);
+      }
+    }
+  }
+  return m;
+}
+
+static void Print(const char* name, const Measurement& m)
+{
+  printf("%-14s %8.1f %8lu %9.1f %9.1f %9.1f %9.1f\n", name,
+         m.requests / (double)(duration / minute), m.outageRequests,
+         m.totalDelay[0] / 1000.0 / m.changes[0], m.maxDelay[0] / 1000.0,
+         m.totalDelay[1] / 1000.0 / m.changes[1], m.maxDelay[1] / 1000.0);
+}
+
+static void TestAgainstFixedPolling()
+{
+  Measurement adaptive = Simulate<JobScheduler>();
+  Measurement fixed = Simulate<FixedPoller>();
+
+  printf("\n%-14s %8s %8s %9s %9s %9s %9s\n", "", "req/min", "outage",
+         "start avg", "start max", "end avg", "end max");
+  Print("adaptive", adaptive);
+  Print("fixed 10 s", fixed);
+
+  // Fewer requests overall and far fewer against a server that is down
+  CHECK(adaptive.requests < fixed.requests);
+  CHECK(adaptive.outageRequests * 5 < fixed.outageRequests);
+
+  // Build results, the change that matters most, show up sooner: within
+  // one building interval plus a round of the other jobs' requests
+  CHECK(adaptive.totalDelay[1] / adaptive.changes[1] < fixed.totalDelay[1] / fixed.changes[1]);
+  CHECK(adaptive.maxDelay[1] <= JOB_POLL_BUILDING_MS + numJobs * latency + step);
+
+  // Build starts are noticed within the longest idle interval
+  CHECK(adaptive.maxDelay[0] <= (JOB_POLL_IDLE_MS << JOB_POLL_IDLE_MAX_SHIFT) + numJobs * latency + step);
+}
+
+static void TestRoundRobin()
+{
+  JobScheduler scheduler;
+  scheduler.begin(3, 1000);
+  CHECK_EQUAL(0, scheduler.nextJob(1000));
+  scheduler.started(0, 1000);
+  CHECK_EQUAL(JOB_NONE, scheduler.nextJob(1000));   // One request at a time
+  scheduler.completed(true, true, 1100);
+  CHECK_EQUAL(1, scheduler.nextJob(1100));
+  scheduler.started(1, 1100);
+  scheduler.completed(false, false, 1200);
+  CHECK_EQUAL(2, scheduler.nextJob(1200));
+  scheduler.started(2, 1200);
+  scheduler.completed(false, false, 1300);
+  CHECK_EQUAL(JOB_NONE, scheduler.nextJob(1300));
+
+  // Job 0 is building and comes round first; the others back off
+  CHECK_EQUAL(JOB_POLL_BUILDING_MS - 200, scheduler.msUntilDue(0, 1300));
+  CHECK_EQUAL(0, scheduler.nextJob(1100 + JOB_POLL_BUILDING_MS));
+  CHECK_EQUAL((JOB_POLL_IDLE_MS << 1) - 100, scheduler.msUntilDue(1, 1300));
+}
+
+static void TestBackoff()
+{
+  JobScheduler scheduler;
+  scheduler.begin(1, 0);
+  unsigned long t = 0;
+
+  // Unchanged idle polls double up to the cap; a change resets
+  for(uint8_t i = 1; i <= JOB_POLL_IDLE_MAX_SHIFT + 1; i++)
+  {
+    uint8_t shift = i < JOB_POLL_IDLE_MAX_SHIFT ? i : JOB_POLL_IDLE_MAX_SHIFT;
+    unsigned long e = JOB_POLL_IDLE_MS << shift;
+    scheduler.started(0, t);
+    scheduler.completed(false, false, t);
+    CHECK_EQUAL(e, scheduler.msUntilDue(0, t));
+    t += e;
+  }
+  scheduler.started(0, t);
+  scheduler.completed(false, true, t);
+  CHECK_EQUAL(JOB_POLL_IDLE_MS, scheduler.msUntilDue(0, t));
+
+  // Timeouts back off separately, and recovery starts idle polling afresh
+  for(uint8_t i = 0; i <= JOB_POLL_RETRY_MAX_SHIFT + 1; i++)
+  {
+    scheduler.started(0, t);
+    t += JOB_REQUEST_TIMEOUT_MS - 1;
+    CHECK_EQUAL(JOB_NONE, scheduler.checkTimeout(t));
+    t += 1;
+    CHECK_EQUAL(0, scheduler.checkTimeout(t));
+    uint8_t shift = i < JOB_POLL_RETRY_MAX_SHIFT ? i : JOB_POLL_RETRY_MAX_SHIFT;
+    CHECK_EQUAL(JOB_POLL_RETRY_MS << shift, scheduler.msUntilDue(0, t));
+    t += JOB_POLL_RETRY_MS << shift;
+  }
+  scheduler.started(0, t);
+  scheduler.completed(false, false, t);
+  CHECK_EQUAL(JOB_POLL_IDLE_MS, scheduler.msUntilDue(0, t));
+}
+
+int main()
+{
+  TestRoundRobin();
+  TestBackoff();
+  TestAgainstFixedPolling();
+  return TestResult("JobSchedulerTest");
+}
@@ -0,0 +1,386 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file LoopSchedulerTest.cpp
+///
+/// @brief Checks LoopScheduler's ordering, wake-ups, frame budget and
+///        statistics, then simulates ten seconds of the standalone sketch
+///        resolving the Jenkins server: once with the serial loop() and the
+///        blocking dnsLookup() as before, once with the scheduled tasks and
+///        DnsResolver.  It compares the longest gap between frames.
+///
+/// The simulation models a 16 MHz AVR behind an ENC28J60:
+///
+///   render   3.8 ms every 16 ms: an animating tree of 93 pixels
+///   network  0.3 ms: packetReceive() and packetLoop() with nothing to do
+///   dns      0.4 ms to build and send a query
+///   poll     0.2 ms to check the job scheduler
+///
+/// The DNS server answers after 20 ms, or after 2.5 s when it is slow.
+////////////////////////////////////////////////////////////////////////////////
+#include "Test.h"
+#include "LoopScheduler.h"
+#include "DnsResolver.h"
+
+static const unsigned long frameUs = 16000;
+static const unsigned long renderCost = 3800;
+static const unsigned long networkCost = 300;
+static const unsigned long dnsCost = 400;
+static const unsigned long pollCost = 200;
+static const unsigned long simulatedUs = 10000000;
+static const unsigned long loopUs = 20;  ///< An empty pass of loop()
+
+////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////// Unit checks ////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+static char order[16];
+static uint8_t orderLen = 0;
+
+static void Ran(char c)
+{
+  if(orderLen < sizeof(order) - 1)
+  {
+    order[orderLen++] = c;
+    order[orderLen] = '\0';
+  }
+}
+
+static unsigned long TaskA(unsigned long) { Ran('a'); return 1000; }
+static unsigned long TaskB(unsigned long) { Ran('b'); return 1000; }
+static unsigned long TaskOnce(unsigned long) { Ran('o'); return TASK_IDLE; }
+static unsigned long TaskSlow(unsigned long)
+{
+  Ran('s');
+  hostAdvanceMicros(5000);
+  return 20000;
+}
+
+static LoopScheduler* selfWaking;
+static uint8_t selfWakingTask;
+static unsigned long TaskWakesSelf(unsigned long)
+{
+  Ran('w');
+  selfWaking->wake(selfWakingTask, 10);
+  return TASK_IDLE;
+}
+
+static void TestEarliestDeadlineFirst()
+{
+  hostSetMillis(0);
+  orderLen = 0;
+  LoopScheduler tasks;
+  uint8_t a = tasks.add(TaskA, 5000, 100);
+  uint8_t b = tasks.add(TaskB, 100, 100);
+  CHECK_EQUAL(0, a);
+  CHECK_EQUAL(1, b);
+
+  // Both due; b's deadline is closer
+  CHECK(tasks.runNext());
+  CHECK(tasks.runNext());
+  CHECK(!tasks.runNext());
+  CHECK(0 == strcmp("ba", order));
+  CHECK_EQUAL(1000, tasks.usUntilNext());
+
+  hostAdvanceMicros(1000);
+  CHECK(tasks.runNext());
+  CHECK(0 == strcmp("bab", order));
+  CHECK_EQUAL(1, tasks.getStats(a).runs);
+  CHECK_EQUAL(2, tasks.getStats(b).runs);
+}
+
+static void TestIdleAndWake()
+{
+  hostSetMillis(0);
+  orderLen = 0;
+  LoopScheduler tasks;
+  uint8_t once = tasks.add(TaskOnce, 1000, 100);
+  CHECK(tasks.runNext());
+  CHECK(!tasks.runNext());
+  CHECK_EQUAL(TASK_IDLE, tasks.usUntilNext());
+
+  tasks.wake(once, 500);
+  CHECK_EQUAL(500, tasks.usUntilNext());
+  // A later wake does not delay it
+  tasks.wake(once, 900);
+  CHECK_EQUAL(500, tasks.usUntilNext());
+  hostAdvanceMicros(500);
+  CHECK(tasks.runNext());
+  CHECK(0 == strcmp("oo", order));
+
+  // Woken from inside its own run
+  LoopScheduler selfTasks;
+  selfWaking = &selfTasks;
+  selfWakingTask = selfTasks.add(TaskWakesSelf, 1000, 100);
+  CHECK(selfTasks.runNext());
+  CHECK_EQUAL(10, selfTasks.usUntilNext());
+}
+
+static void TestFrameBudget()
+{
+  hostSetMillis(0);
+  orderLen = 0;
+  LoopScheduler tasks;
+  uint8_t frame = tasks.add(TaskA, 0, 100);
+  uint8_t slow = tasks.add(TaskSlow, 8000, 5000);
+  tasks.setFrameTask(frame);
+
+  CHECK(tasks.runNext());  // a; next frame in 1 ms
+  // The slow task would run into the frame, so it waits for it
+  CHECK(!tasks.runNext());
+  hostAdvanceMicros(1000);
+  CHECK(tasks.runNext());  // a again; next frame in 1 ms
+  CHECK(0 == strcmp("aa", order));
+
+  // Past its own deadline it goes anyway, and the miss is its own
+  for(uint8_t i = 0; i < 8; i++)
+  {
+    hostAdvanceMicros(1000);
+    tasks.runNext();
+  }
+  CHECK(strchr(order, 's') != NULL);
+  CHECK_EQUAL(1, tasks.getStats(slow).runs);
+  CHECK_EQUAL(1, tasks.getStats(slow).missed);
+  CHECK_EQUAL(5000, tasks.getStats(slow).maxUs);
+  CHECK_EQUAL(0, tasks.getStats(frame).missed);
+
+  tasks.resetStats();
+  CHECK_EQUAL(0, tasks.getStats(slow).runs);
+}
+
+static void TestCapacity()
+{
+  LoopScheduler tasks;
+  for(uint8_t i = 0; i < TASK_MAX; i++)
+  {
+    CHECK(TASK_NONE != tasks.add(TaskA, 0, 0));
+  }
+  CHECK_EQUAL(TASK_NONE, tasks.add(TaskA, 0, 0));
+  CHECK_EQUAL(TASK_MAX, tasks.getNumTasks());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////// Simulation ////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+static unsigned long answerDelayUs;
+static unsigned long answerAt;       ///< micros() the DNS answer arrives
+static bool answerPending;
+static uint8_t query[64];
+static uint8_t queryLen;
+
+static unsigned long lastFrame;
+static unsigned long worstGap;
+static unsigned long frames;
+static unsigned long resolvedAt;
+
+static DnsResolver resolver;
+static bool haveDNS;
+
+static void Frame()
+{
+  unsigned long now = micros();
+  if(frames > 0 && now - lastFrame > worstGap)
+  {
+    worstGap = now - lastFrame;
+  }
+  lastFrame = now;
+  frames++;
+  hostAdvanceMicros(renderCost);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief The answer to the last query, from the server's echo of it.
+////////////////////////////////////////////////////////////////////////////////
+static uint16_t FillAnswer(uint8_t* buf)
+{
+  static const uint8_t record[] = {
+    0xC0, 0x0C, 0, 1, 0, 1, 0, 0, 0x0E, 0x10, 0, 4, 10, 0, 0, 7
+  };
+  memcpy(buf, query, queryLen);
+  buf[2] = 0x81;
+  buf[3] = 0x80;
+  buf[7] = 1;
+  memcpy(buf + queryLen, record, sizeof(record));
+  return queryLen + sizeof(record);
+}
+
+static void NetworkWork()
+{
+  hostAdvanceMicros(networkCost);
+  if(answerPending && (long)(micros() - answerAt) >= 0)
+  {
+    answerPending = false;
+    uint8_t answer[96];
+    uint16_t len = FillAnswer(answer);
+    if(resolver.receive(answer, len) &&
+       DnsResolver::RESOLVED == resolver.getState())
+    {
+      haveDNS = true;
+      resolvedAt = micros();
+    }
+  }
+}
+
+static void SendQuery()
+{
+  queryLen = resolver.fillQuery(query, sizeof(query), "jenkins.example.com",
+                                millis());
+  // The server answers the first query; retries only repeat it
+  if(!answerPending)
+  {
+    answerAt = micros() + answerDelayUs;
+    answerPending = true;
+  }
+  hostAdvanceMicros(dnsCost);
+}
+
+static void ResetSimulation(unsigned long answerDelay)
+{
+  hostSetMillis(0);
+  answerDelayUs = answerDelay;
+  answerPending = false;
+  lastFrame = 0;
+  worstGap = 0;
+  frames = 0;
+  resolvedAt = 0;
+  haveDNS = false;
+  resolver = DnsResolver();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief The loop() before: everything in series, dnsLookup() spinning in
+///        packetLoop() until the answer comes.
+////////////////////////////////////////////////////////////////////////////////
+static void RunSerial()
+{
+  Frame();  // setup() draws the first frame
+  while(micros() < simulatedUs)
+  {
+    NetworkWork();
+    if(!haveDNS)
+    {
+      resolver.begin(millis());
+      SendQuery();
+      while(!haveDNS)
+      {
+        NetworkWork();
+      }
+    }
+    hostAdvanceMicros(pollCost);
+    if(micros() - lastFrame >= frameUs || 0 == frames)
+    {
+      Frame();
+    }
+    else
+    {
+      hostAdvanceMicros(1000);  // IdleUntilNextTick()
+    }
+  }
+}
+
+static unsigned long RenderTask(unsigned long)
+{
+  Frame();
+  return frameUs;
+}
+
+static unsigned long NetworkTask(unsigned long)
+{
+  NetworkWork();
+  return 1000;
+}
+
+static unsigned long DnsTask(unsigned long)
+{
+  if(haveDNS)
+  {
+    return TASK_IDLE;
+  }
+  switch(resolver.poll(millis()))
+  {
+    case DnsResolver::IDLE:
+    case DnsResolver::FAILED:
+      resolver.begin(millis());
+      return 0;
+    case DnsResolver::SEND:
+      SendQuery();
+      break;
+    default:
+      break;
+  }
+  return resolver.msUntilPoll(millis()) * 1000;
+}
+
+static unsigned long PollTask(unsigned long)
+{
+  hostAdvanceMicros(pollCost);
+  return 10000;
+}
+
+static LoopScheduler RunScheduled()
+{
+  LoopScheduler tasks;
+  uint8_t render = tasks.add(RenderTask, 1000, renderCost);
+  tasks.add(NetworkTask, 5000, 2000);
+  tasks.add(DnsTask, 20000, dnsCost);
+  tasks.add(PollTask, 20000, pollCost);
+  tasks.setFrameTask(render);
+  while(micros() < simulatedUs)
+  {
+    if(!tasks.runNext())
+    {
+      // A task waiting for the frame is due but cannot run; spin for it
+      unsigned long wait = tasks.usUntilNext();
+      hostAdvanceMicros(wait < loopUs ? loopUs : (wait < 1000 ? wait : 1000));
+    }
+  }
+  return tasks;
+}
+
+static void Simulate()
+{
+  static const char* const names[] = { "render", "network", "dns", "poll" };
+  static const unsigned long delays[] = { 20000, 2500000 };
+  static const char* const servers[] = { "DNS answers in 20 ms", "DNS answers in 2.5 s" };
+
+  for(uint8_t s = 0; s < 2; s++)
+  {
+    printf("\n%s, %lu s simulated\n", servers[s], simulatedUs / 1000000);
+    printf("%-12s %14s %10s %14s\n", "loop", "longest gap ms", "frames", "resolved at ms");
+
+    ResetSimulation(delays[s]);
+    RunSerial();
+    CHECK(haveDNS);
+    unsigned long serialGap = worstGap;
+    printf("%-12s %14.1f %10lu %14.1f\n", "serial", serialGap / 1000.0, frames,
+           resolvedAt / 1000.0);
+
+    ResetSimulation(delays[s]);
+    LoopScheduler tasks = RunScheduled();
+    CHECK(haveDNS);
+    printf("%-12s %14.1f %10lu %14.1f\n", "scheduled", worstGap / 1000.0, frames,
+           resolvedAt / 1000.0);
+    // The frame never waits longer than its period plus the longest task
+    CHECK(worstGap <= frameUs + 1000);
+    CHECK(worstGap < serialGap || delays[s] < frameUs * 2);
+
+    printf("\n%-12s %8s %8s %10s %10s\n", "task", "runs", "missed", "avg us", "max us");
+    for(uint8_t i = 0; i < tasks.getNumTasks(); i++)
+    {
+      const LoopScheduler::TaskStats& stats = tasks.getStats(i);
+      printf("%-12s %8lu %8lu %10lu %10lu\n", names[i], stats.runs,
+             stats.missed, stats.runs ? stats.totalUs / stats.runs : 0,
+             stats.maxUs);
+    }
+    CHECK_EQUAL(0, tasks.getStats(0).missed);
+  }
+}
+
+int main()
+{
+  TestEarliestDeadlineFirst();
+  TestIdleAndWake();
+  TestFrameBudget();
+  TestCapacity();
+  Simulate();
+  return TestResult("LoopSchedulerTest");
+}
@@ -0,0 +1,14 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file MinimalPatterns.h
+///
+/// @brief Pattern set for the minimal registry build: just the patterns the
+///        standalone tree's status display uses.  Force-included when
+///        compiling NeoPixelRing.cpp for PatternRegistryMinimalBenchmark.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef HOST_MINIMALPATTERNS_H
+#define HOST_MINIMALPATTERNS_H
+
+#define NEOPIXELRING_PATTERNS \
+  NeoPixelRing::Solid, NeoPixelRing::Pulse, NeoPixelRing::Spin
+
+#endif // HOST_MINIMALPATTERNS_H
@@ -0,0 +1,106 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file NeoPixelRingBenchmark.cpp
+///
+/// @brief Measures NeoPixelRing::update() on the host for every pattern, for
+///        the twinkle overlay, and for several ring layouts.
+///
+/// Usage: NeoPixelRingBenchmark [seconds-per-case]
+////////////////////////////////////////////////////////////////////////////////
+#include "Benchmark.h"
+#include "NeoPixelRing.h"
+
+struct Layout
+{
+  const char* name;
+  uint8_t numRings;
+  uint8_t rings[8];
+};
+
+// Stock tree first, then progressively larger cones
+static const Layout layouts[] =
+{
+  { "stock", 6, { 32, 24, 16, 12, 8, 1 } },
+  { "2x", 6, { 64, 48, 32, 24, 16, 2 } },
+  { "4x", 6, { 128, 96, 64, 48, 32, 4 } },
+};
+
+struct PatternCase
+{
+  const char* name;
+  NeoPixelRing::Pattern pattern;
+};
+
+static const PatternCase patterns[] =
+{
+  { "SOLID", NeoPixelRing::SOLID },
+  { "PULSE", NeoPixelRing::PULSE },
+  { "PROGRESS", NeoPixelRing::PROGRESS },
+  { "SPIN", NeoPixelRing::SPIN },
+  { "RAINBOW", NeoPixelRing::RAINBOW },
+};
+
+static uint16_t LayoutPixels(const Layout& layout)
+{
+  uint16_t total = 0;
+  for(uint8_t i = 0; i < layout.numRings; i++)
+  {
+    total += layout.rings[i];
+  }
+  return total;
+}
+
+static BenchResult BenchPattern(const Layout& layout,
+                                NeoPixelRing::Pattern pattern,
+                                bool flash,
+                                double seconds)
+{
+  hostSetMillis(0);
+  randomSeed(1);
+  NeoPixelRing tree(9, NEO_GRB + NEO_KHZ800, layout.numRings, layout.rings);
+  tree.begin();
+  tree.setBrightness(75);
+  tree.enableFlash(flash);
+  for(uint8_t i = 0; i < layout.numRings; i++)
+  {
+    tree.setPattern(i, pattern, 0x00FFBF00, 2000, 60);
+  }
+
+  // Advance one PERIODDIVISOR tick per frame, the finest step at which any
+  // pattern changes, so every time-based frame is actually rendered.  A
+  // static SOLID tree renders nothing after the first frame.
+  return RunBenchmark([&]() {
+    hostAdvanceMillis(PERIODDIVISOR);
+    tree.update();
+  }, seconds);
+}
+
+int main(int argc, char** argv)
+{
+  double seconds = BenchSecondsFromArgs(argc, argv);
+
+  for(const Layout& layout : layouts)
+  {
+    char title[64];
+    snprintf(title, sizeof(title), "Layout %s (%u pixels)", layout.name,
+             LayoutPixels(layout));
+    PrintBenchHeader(title);
+
+    BenchResult solid = BenchResult();
+    for(const PatternCase& pc : patterns)
+    {
+      BenchResult r = BenchPattern(layout, pc.pattern, false, seconds);
+      PrintBenchResult(pc.name, LayoutPixels(layout), r);
+      if(pc.pattern == NeoPixelRing::SOLID)
+      {
+        solid = r;
+      }
+    }
+
+    BenchResult flash = BenchPattern(layout, NeoPixelRing::SOLID, true, seconds);
+    PrintBenchResult("SOLID+flash", LayoutPixels(layout), flash);
+    printf("%-28s %7s %12.1f\n", "  flash overlay only", "",
+           flash.nsPerFrame - solid.nsPerFrame);
+  }
+
+  return 0;
+}
@@ -0,0 +1,142 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file NetworkCacheTest.cpp
+///
+/// @brief Checks NetworkCache against the EEPROM stand-in: what it loads
+///        back, what it refuses to load, and that it leaves the
+///        configuration alone and rewrites nothing that did not change.
+////////////////////////////////////////////////////////////////////////////////
+#include <EEPROM.h>
+
+#include "Test.h"
+#include "NetworkCache.h"
+#include "PatternProgram.h"
+
+static const uint8_t mac[6] = { 0x6, 0x5, 0x4, 0x3, 0x2, 0x1 };
+static const uint8_t otherMac[6] = { 0x6, 0x5, 0x4, 0x3, 0x2, 0x2 };
+static const uint8_t jenkins[4] = { 10, 0, 0, 80 };
+
+static DhcpLease TestLease()
+{
+  static const uint8_t addresses[5][4] = {
+    { 192, 168, 1, 40 }, { 192, 168, 1, 1 }, { 192, 168, 1, 2 },
+    { 255, 255, 255, 0 }, { 192, 168, 1, 3 }
+  };
+  DhcpLease lease;
+  memcpy(lease.ip, addresses[0], 4);
+  memcpy(lease.gateway, addresses[1], 4);
+  memcpy(lease.dns, addresses[2], 4);
+  memcpy(lease.mask, addresses[3], 4);
+  memcpy(lease.server, addresses[4], 4);
+  lease.seconds = 0x00015180;
+  return lease;
+}
+
+static void TestEmpty()
+{
+  EEPROM.hostErase();
+  NetworkCache cache(mac);
+  DhcpLease lease;
+  uint8_t ip[4] = { 1, 2, 3, 4 };
+  CHECK(!cache.loadLease(lease));
+  CHECK(!cache.loadServer("jenkins.example.com", ip));
+  CHECK_EQUAL(1, ip[0]);
+}
+
+static void TestRoundTrip()
+{
+  EEPROM.hostErase();
+  EEPROM.hostResetCounts();
+  NetworkCache cache(mac);
+  DhcpLease saved = TestLease();
+  cache.saveLease(saved);
+  CHECK(EEPROM.writes <= NETCACHE_SIZE);
+
+  DhcpLease loaded;
+  memset(&loaded, 0, sizeof(loaded));
+  CHECK(cache.loadLease(loaded));
+  CHECK(0 == memcmp(&saved, &loaded, sizeof(saved)));
+  uint8_t ip[4];
+  CHECK(!cache.loadServer("jenkins.example.com", ip));
+
+  // The server joins the lease, and only for the name it was looked up for
+  cache.saveServer("jenkins.example.com", jenkins);
+  CHECK(cache.loadServer("jenkins.example.com", ip));
+  CHECK(0 == memcmp(ip, jenkins, 4));
+  CHECK(!cache.loadServer("ci.example.com", ip));
+  CHECK(cache.loadLease(loaded));
+  CHECK(0 == memcmp(&saved, &loaded, sizeof(saved)));
+
+  // Every write landed in the record, clear of the configuration slots and
+  // the stored program
+  CHECK(NETCACHE_ADDRESS >= CONFIG_END);
+  CHECK(NETCACHE_END <= E2END - PROGRAM_MAX_LENGTH);
+  unsigned long inRecord = 0;
+  for(uint16_t i = NETCACHE_ADDRESS; i < NETCACHE_END; i++)
+  {
+    inRecord += EEPROM.cellWrites[i];
+  }
+  CHECK_EQUAL(EEPROM.writes, inRecord);
+}
+
+static void TestUnchanged()
+{
+  EEPROM.hostErase();
+  NetworkCache cache(mac);
+  DhcpLease lease = TestLease();
+  cache.saveLease(lease);
+  cache.saveServer("jenkins.example.com", jenkins);
+
+  // Renewals and lookups that confirm the cache write nothing
+  EEPROM.hostResetCounts();
+  for(uint8_t i = 0; i < 10; i++)
+  {
+    cache.saveLease(lease);
+    cache.saveServer("jenkins.example.com", jenkins);
+  }
+  CHECK_EQUAL(0, EEPROM.writes);
+
+  // A new address rewrites its bytes and the CRC
+  lease.ip[3] = 41;
+  cache.saveLease(lease);
+  CHECK(EEPROM.writes >= 1 && EEPROM.writes <= 3);
+}
+
+static void TestRejected()
+{
+  EEPROM.hostErase();
+  NetworkCache cache(mac);
+  cache.saveLease(TestLease());
+  cache.saveServer("jenkins.example.com", jenkins);
+
+  // Another board's lease
+  NetworkCache other(otherMac);
+  DhcpLease lease;
+  uint8_t ip[4];
+  CHECK(!other.loadLease(lease));
+  CHECK(!other.loadServer("jenkins.example.com", ip));
+
+  // Saving over it starts a record for this board, dropping the server
+  other.saveLease(TestLease());
+  CHECK(other.loadLease(lease));
+  CHECK(!other.loadServer("jenkins.example.com", ip));
+  CHECK(!cache.loadLease(lease));
+
+  // A write cut short fails the CRC
+  cache.saveLease(TestLease());
+  EEPROM.data[NETCACHE_ADDRESS + 9] ^= 0x10;
+  CHECK(!cache.loadLease(lease));
+
+  // An older record layout
+  cache.saveLease(TestLease());
+  EEPROM.data[NETCACHE_ADDRESS] = NETCACHE_VERSION + 1;
+  CHECK(!cache.loadLease(lease));
+}
+
+int main()
+{
+  TestEmpty();
+  TestRoundTrip();
+  TestUnchanged();
+  TestRejected();
+  return TestResult("NetworkCacheTest");
+}
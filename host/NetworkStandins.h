@@ -0,0 +1,229 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file NetworkStandins.h
+///
+/// @brief Simulated DHCP and DNS servers for the host tests.  Each takes the
+///        datagrams a tree sends and hands back its answers after a fixed
+///        delay, in virtual time.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef HOST_NETWORKSTANDINS_H
+#define HOST_NETWORKSTANDINS_H
+
+#include <Arduino.h>
+#include "DhcpClient.h"
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Answers waiting to be delivered, in order of sending.
+////////////////////////////////////////////////////////////////////////////////
+class DatagramQueue
+{
+  public:
+    DatagramQueue() :
+      count(0)
+    {
+    }
+
+    uint8_t* push(unsigned long due, uint16_t len)
+    {
+      if(count == QUEUE_MAX)
+      {
+        return NULL;
+      }
+      entries[count].due = due;
+      entries[count].len = len;
+      return entries[count++].data;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    /// @brief Takes the oldest answer due by now.
+    /// @return Its length, 0 if none is due.
+    ////////////////////////////////////////////////////////////////////////////
+    uint16_t pop(uint8_t* buf, unsigned long now)
+    {
+      if(0 == count || (long)(now - entries[0].due) < 0)
+      {
+        return 0;
+      }
+      uint16_t len = entries[0].len;
+      memcpy(buf, entries[0].data, len);
+      memmove(entries, entries + 1, (count - 1) * sizeof(entries[0]));
+      count--;
+      return len;
+    }
+
+    void clear()
+    {
+      count = 0;
+    }
+
+  private:
+    enum { QUEUE_MAX = 8 };
+    struct Entry
+    {
+      unsigned long due;
+      uint16_t len;
+      uint8_t data[DHCP_MESSAGE_LEN];
+    };
+    Entry entries[QUEUE_MAX];
+    uint8_t count;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A DHCP server with one address for the tree.  It offers that
+///        address, acknowledges requests for it and refuses any other.
+////////////////////////////////////////////////////////////////////////////////
+class DhcpServerStandin
+{
+  public:
+    DhcpServerStandin() :
+      seconds(86400),
+      delayMs(20),
+      up(true),
+      discovers(0),
+      requests(0),
+      lastLen(0)
+    {
+      static const uint8_t defaults[5][4] = {
+        { 192, 168, 1, 40 }, { 192, 168, 1, 1 }, { 192, 168, 1, 2 },
+        { 255, 255, 255, 0 }, { 192, 168, 1, 2 }
+      };
+      memcpy(address, defaults[0], 4);
+      memcpy(gateway, defaults[1], 4);
+      memcpy(dns, defaults[2], 4);
+      memcpy(mask, defaults[3], 4);
+      memcpy(id, defaults[4], 4);
+    }
+
+    void send(const uint8_t* msg, uint16_t len, unsigned long now)
+    {
+      memcpy(last, msg, len);
+      lastLen = len;
+      if(!up || len < 244)
+      {
+        return;
+      }
+      uint8_t type = 0;
+      uint8_t requested[4];
+      memcpy(requested, msg + 12, 4);  // ciaddr, when renewing
+      for(uint16_t pos = 240; pos + 1 < len && 255 != msg[pos]; pos += 2 + msg[pos + 1])
+      {
+        if(53 == msg[pos])
+        {
+          type = msg[pos + 2];
+        }
+        else if(50 == msg[pos])
+        {
+          memcpy(requested, msg + pos + 2, 4);
+        }
+      }
+
+      uint8_t replyType;
+      if(1 == type)
+      {
+        discovers++;
+        replyType = 2;
+      }
+      else if(3 == type)
+      {
+        requests++;
+        replyType = (0 == memcmp(requested, address, 4)) ? 5 : 6;
+      }
+      else
+      {
+        return;
+      }
+
+      uint8_t* reply = queue.push(now + delayMs, DHCP_MESSAGE_LEN);
+      if(NULL == reply)
+      {
+        return;
+      }
+      memset(reply, 0, DHCP_MESSAGE_LEN);
+      memcpy(reply, msg, 240);
+      reply[0] = 2;
+      memset(reply + 12, 0, 16);
+      uint8_t* p = reply + 240;
+      *p++ = 53; *p++ = 1; *p++ = replyType;
+      *p++ = 54; *p++ = 4; memcpy(p, id, 4); p += 4;
+      if(6 != replyType)
+      {
+        memcpy(reply + 16, address, 4);
+        *p++ = 51; *p++ = 4;
+        *p++ = seconds >> 24; *p++ = seconds >> 16; *p++ = seconds >> 8; *p++ = seconds;
+        *p++ = 1; *p++ = 4; memcpy(p, mask, 4); p += 4;
+        *p++ = 3; *p++ = 4; memcpy(p, gateway, 4); p += 4;
+        *p++ = 6; *p++ = 4; memcpy(p, dns, 4); p += 4;
+      }
+      *p = 255;
+    }
+
+    uint16_t receive(uint8_t* buf, unsigned long now)
+    {
+      return queue.pop(buf, now);
+    }
+
+    uint8_t address[4];    ///< Address leased to the tree
+    uint8_t gateway[4];
+    uint8_t dns[4];
+    uint8_t mask[4];
+    uint8_t id[4];
+    uint32_t seconds;
+    unsigned long delayMs; ///< Time to answer
+    bool up;               ///< False drops every message
+    unsigned discovers;
+    unsigned requests;
+    uint8_t last[DHCP_MESSAGE_LEN];  ///< Last message sent to the server
+    uint16_t lastLen;
+    DatagramQueue queue;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A DNS server that answers every query with one A record.
+////////////////////////////////////////////////////////////////////////////////
+class DnsServerStandin
+{
+  public:
+    DnsServerStandin() :
+      delayMs(10),
+      up(true),
+      queries(0)
+    {
+      static const uint8_t defaultAddress[4] = { 10, 0, 0, 80 };
+      memcpy(address, defaultAddress, 4);
+    }
+
+    void send(const uint8_t* query, uint16_t len, unsigned long now)
+    {
+      queries++;
+      if(!up)
+      {
+        return;
+      }
+      static const uint8_t record[] = {
+        0xC0, 0x0C, 0, 1, 0, 1, 0, 0, 1, 0, 0, 4
+      };
+      uint8_t* answer = queue.push(now + delayMs, len + sizeof(record) + 4);
+      if(NULL == answer)
+      {
+        return;
+      }
+      memcpy(answer, query, len);
+      answer[2] = 0x81;
+      answer[3] = 0x80;
+      answer[7] = 1;
+      memcpy(answer + len, record, sizeof(record));
+      memcpy(answer + len + sizeof(record), address, 4);
+    }
+
+    uint16_t receive(uint8_t* buf, unsigned long now)
+    {
+      return queue.pop(buf, now);
+    }
+
+    uint8_t address[4];    ///< Address every name resolves to
+    unsigned long delayMs; ///< Time to answer
+    bool up;               ///< False drops every query
+    unsigned queries;
+    DatagramQueue queue;
+};
+
+#endif // HOST_NETWORKSTANDINS_H
@@ -0,0 +1,190 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file PatternRegistryBenchmark.cpp
+///
+/// @brief Measures the cost of dispatching a ring to its pattern kernel and
+///        the frame time of every pattern compiled in, and checks patterns
+///        left out of NEOPIXELRING_PATTERNS draw black.
+///
+/// Built twice: PatternRegistryBenchmark against the full pattern set and
+/// PatternRegistryMinimalBenchmark against MinimalPatterns.h.  `make
+/// footprint` compares the code size of the two.
+///
+/// Usage: PatternRegistryBenchmark [seconds-per-case]
+////////////////////////////////////////////////////////////////////////////////
+#include "Benchmark.h"
+#include "NeoPixelRing.h"
+
+static const uint8_t rings[] = { 32, 24, 16, 12, 8, 1 };
+static const uint8_t numRings = sizeof(rings);
+
+static const char* const patternNames[] = {
+  "SOLID", "PULSE", "PROGRESS", "SPIN", "RAINBOW", "PROGRAM",
+  "WIPE", "FILL", "SPIRAL"
+};
+static const uint8_t numPatterns = sizeof(patternNames) / sizeof(patternNames[0]);
+
+// Trivial kernels, so the dispatch micro-benchmark times little but the
+// dispatch itself
+static volatile uint32_t sink;
+
+#define KERNEL(n) \
+  static void __attribute__((noinline)) Kernel##n(uint32_t x) { sink = x + n; }
+KERNEL(0) KERNEL(1) KERNEL(2) KERNEL(3) KERNEL(4)
+KERNEL(5) KERNEL(6) KERNEL(7) KERNEL(8)
+#undef KERNEL
+
+static void (* const kernels[])(uint32_t) = {
+  Kernel0, Kernel1, Kernel2, Kernel3, Kernel4,
+  Kernel5, Kernel6, Kernel7, Kernel8
+};
+
+static void DispatchBySwitch(uint8_t p, uint32_t x)
+{
+  switch(p)
+  {
+    case 0: Kernel0(x); break;
+    case 1: Kernel1(x); break;
+    case 2: Kernel2(x); break;
+    case 3: Kernel3(x); break;
+    case 4: Kernel4(x); break;
+    case 5: Kernel5(x); break;
+    case 6: Kernel6(x); break;
+    case 7: Kernel7(x); break;
+    case 8: Kernel8(x); break;
+  }
+}
+
+static void DispatchByTable(uint8_t p, uint32_t x)
+{
+  kernels[p](x);
+}
+
+// Pattern of each of a frame's six rings, drawn from a fixed shuffle so the
+// branch predictor cannot learn it within a frame
+static uint8_t ringPatterns[256];
+
+static BenchResult BenchDispatch(void (*dispatch)(uint8_t, uint32_t),
+                                 double seconds)
+{
+  uint8_t next = 0;
+  return RunBenchmark([&]() {
+    for(uint8_t i = 0; i < numRings; i++)
+    {
+      dispatch(ringPatterns[next++], i);
+    }
+  }, seconds);
+}
+
+static const uint8_t mixProgram[] = {
+  OP_TIME, OP_INDEX, OP_ADD, OP_WHEEL
+};
+
+static void Configure(NeoPixelRing& tree, bool mixed, uint8_t pattern)
+{
+  tree.begin();
+  tree.setBrightness(75);
+  tree.enableFlash(false);
+  tree.setProgram(mixProgram, sizeof(mixProgram));
+  for(uint8_t i = 0; i < numRings; i++)
+  {
+    // The mix gives each ring a different compiled pattern
+    uint8_t p = pattern;
+    if(mixed)
+    {
+      do
+      {
+        p = (p + 1) % numPatterns;
+      } while(!NeoPixelRing::hasPattern(p));
+      pattern = p;
+    }
+    tree.setPattern(i, (NeoPixelRing::Pattern)p, 0x00FFBF00, 2000, 60);
+  }
+}
+
+static BenchResult BenchFrame(bool mixed, uint8_t pattern, double seconds)
+{
+  hostSetMillis(0);
+  NeoPixelRing tree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+  Configure(tree, mixed, pattern);
+  return RunBenchmark([&]() {
+    hostAdvanceMillis(PERIODDIVISOR);
+    tree.update();
+  }, seconds);
+}
+
+static bool allBlack;
+
+static void CheckBlack(const Adafruit_NeoPixel& strip)
+{
+  for(uint16_t i = 0; i < strip.hostNumBytes(); i++)
+  {
+    allBlack = allBlack && 0 == strip.getPixels()[i];
+  }
+}
+
+int main(int argc, char** argv)
+{
+  double seconds = BenchSecondsFromArgs(argc, argv);
+
+  uint8_t compiled = 0;
+  for(uint8_t p = 0; p < numPatterns; p++)
+  {
+    compiled += NeoPixelRing::hasPattern(p);
+  }
+  printf("\n%u of %u patterns compiled in\n", compiled, numPatterns);
+
+  uint32_t seed = 1;
+  for(uint16_t i = 0; i < sizeof(ringPatterns); i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    ringPatterns[i] = (seed >> 16) % numPatterns;
+  }
+  PrintBenchHeader("Dispatch only, six rings of trivial kernels");
+  PrintBenchResult("switch", numRings, BenchDispatch(DispatchBySwitch, seconds));
+  PrintBenchResult("kernel table", numRings,
+                   BenchDispatch(DispatchByTable, seconds));
+
+  PrintBenchHeader("Render time, stock layout, no sparkles");
+  for(uint8_t p = 0; p < numPatterns; p++)
+  {
+    if(NeoPixelRing::hasPattern(p))
+    {
+      PrintBenchResult(patternNames[p], 93, BenchFrame(false, p, seconds));
+    }
+  }
+  PrintBenchResult("mixed", 93, BenchFrame(true, 0, seconds));
+
+  // A pattern left out is never instantiated; rings set to it must go dark
+  // rather than draw stale or uninitialized pixels
+  bool ok = true;
+  Adafruit_NeoPixel::hostSetShowHook(CheckBlack);
+  for(uint8_t p = 0; p < numPatterns; p++)
+  {
+    if(NeoPixelRing::hasPattern(p))
+    {
+      continue;
+    }
+    hostSetMillis(0);
+    NeoPixelRing tree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+    Configure(tree, false, NeoPixelRing::SOLID);
+    tree.update();
+    for(uint8_t i = 0; i < numRings; i++)
+    {
+      tree.setPattern(i, (NeoPixelRing::Pattern)p, 0x00FFBF00, 2000, 60);
+    }
+    allBlack = true;
+    for(uint8_t frame = 0; frame < 10; frame++)
+    {
+      hostAdvanceMillis(PERIODDIVISOR);
+      tree.update();
+    }
+    if(!allBlack)
+    {
+      printf("\n%s is not compiled in but drew pixels\n", patternNames[p]);
+      ok = false;
+    }
+  }
+  Adafruit_NeoPixel::hostSetShowHook(NULL);
+  printf("\npatterns left out %s\n", ok ? "draw black" : "FAILED");
+  return ok ? 0 : 1;
+}
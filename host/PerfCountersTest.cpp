@@ -0,0 +1,114 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file PerfCountersTest.cpp
+///
+/// @brief Checks the series summaries, the frame rate window and the text
+///        PerfCounters formats for GET /stats.
+////////////////////////////////////////////////////////////////////////////////
+#include "Test.h"
+#include "PerfCounters.h"
+
+#include <string.h>
+
+static void TestSeries()
+{
+  PerfSeries series;
+  uint16_t min, avg, max;
+  series.summarize(min, avg, max);
+  CHECK_EQUAL(0, min);
+  CHECK_EQUAL(0, avg);
+  CHECK_EQUAL(0, max);
+
+  series.add(30);
+  series.add(10);
+  series.add(20);
+  series.summarize(min, avg, max);
+  CHECK_EQUAL(3, series.getCount());
+  CHECK_EQUAL(10, min);
+  CHECK_EQUAL(20, avg);
+  CHECK_EQUAL(30, max);
+
+  // Old samples are replaced once the ring is full
+  for(uint8_t i = 0; i < PERF_SAMPLES; i++)
+  {
+    series.add(100 + i);
+  }
+  series.summarize(min, avg, max);
+  CHECK_EQUAL(PERF_SAMPLES, series.getCount());
+  CHECK_EQUAL(100, min);
+  CHECK_EQUAL(100 + PERF_SAMPLES - 1, max);
+
+  series.add(1000000UL);
+  series.summarize(min, avg, max);
+  CHECK_EQUAL(0xFFFF, max);
+}
+
+static void TestFps()
+{
+  PerfCounters perf;
+  CHECK_EQUAL(0, perf.getFps(0));
+
+  // 50 frames a second, 20 ms apart
+  unsigned long now = 1000;
+  for(int i = 0; i < 150; i++)
+  {
+    perf.frame(1000, 500, now);
+    now += 20;
+  }
+  CHECK_EQUAL(50, perf.getFps(now));
+
+  // Nothing shown for a while
+  CHECK_EQUAL(0, perf.getFps(now + 3000));
+  perf.frame(1000, 500, now + 3000);
+  CHECK_EQUAL(0, perf.getFps(now + 3000));
+}
+
+static void TestFormat()
+{
+  PerfCounters perf;
+  perf.frame(1200, 300, 0);
+  perf.frame(1400, 500, 20);
+  perf.packet(80);
+  perf.packet(120);
+  perf.dropped();
+  perf.pollCompleted(45);
+  perf.pollFailed();
+
+  char text[PERF_TEXT_MAX];
+  uint16_t len = perf.format(text, sizeof(text), 512, 40);
+  static const char expected[] =
+    "{\"render_us\":[1200,1300,1400],\"show_us\":[300,400,500],\"fps\":0,"
+    "\"packetloop_us\":[80,100,120],\"packets\":2,\"dropped\":1,"
+    "\"poll_ms\":[45,45,45],\"poll_failures\":1,\"free_ram\":512}";
+  CHECK_EQUAL(strlen(expected), len);
+  CHECK(0 == strcmp(expected, text));
+
+  // The longest values still fit in PERF_TEXT_MAX
+  PerfCounters full;
+  full.frame(65535, 65535, 0);
+  full.packet(65535);
+  full.pollCompleted(65535);
+  for(int i = 0; i < 10; i++)
+  {
+    full.pollFailed();
+  }
+  len = full.format(text, sizeof(text), -32768, 0);
+  CHECK(len < PERF_TEXT_MAX);
+  CHECK_EQUAL('}', text[len - 1]);
+
+  // A short buffer is cut off, never overrun
+  char small[32];
+  memset(small, 'x', sizeof(small));
+  len = perf.format(small, 20, 512, 40);
+  CHECK_EQUAL(19, len);
+  CHECK_EQUAL('\0', small[19]);
+  CHECK_EQUAL('x', small[20]);
+  CHECK(0 == strncmp(expected, small, 19));
+}
+
+int main()
+{
+  TestSeries();
+  TestFps();
+  TestFormat();
+  return TestResult("PerfCountersTest");
+}
@@ -0,0 +1,173 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file PhaseEngineBenchmark.cpp
+///
+/// @brief Compares the per-frame cost of SPIN and PROGRESS rendered with the
+///        phase accumulator against the original per-pixel division math.
+///
+/// The reference path below is the pre-accumulator CalcPulseColor() kept
+/// verbatim (three divisions and two modulos per call) and driven the same
+/// way the old SetSpin()/SetProgress() drove it.
+///
+/// Usage: PhaseEngineBenchmark [seconds-per-case]
+////////////////////////////////////////////////////////////////////////////////
+#include "Benchmark.h"
+#include "NeoPixelRing.h"
+
+static const uint8_t rings[] = { 32, 24, 16, 12, 8, 1 };
+static const uint8_t numRings = sizeof(rings);
+static const uint16_t period = 2000;
+static const uint32_t color = 0x00FFBF00;
+
+// avr-libgcc's __udivmodsi4 takes roughly 650 cycles, about 40 us at 16 MHz.
+// A host CPU has a hardware divider, so the wall-clock ratio below understates
+// the gain on the board; the division count is what the board pays for.
+static const double avrMicrosPerDivision = 40.0;
+
+class ReferenceRenderer
+{
+  public:
+    ReferenceRenderer() : strip(93, 9, NEO_GRB + NEO_KHZ800)
+    {
+      for(int i = 0; i < 256; i++)
+      {
+        GAMMA[i] = pow(i / 255.0, 2.5) * 255;
+      }
+      strip.setBrightness(75);
+    }
+
+    uint32_t divisions; ///< 32-bit divisions and modulos in the last frame
+
+    void Frame(bool spin)
+    {
+      divisions = 0;
+      now = millis();
+      uint8_t start = 0;
+      for(uint8_t r = 0; r < numRings; r++)
+      {
+        uint8_t end = start + rings[r] - 1;
+        if(spin)
+        {
+          uint8_t length = end - start + 1;
+          uint16_t offsetPerPixel = period / length;
+          for(uint8_t i = start; i <= end; i++)
+          {
+            uint16_t offset = offsetPerPixel * (i - start);
+            strip.setPixelColor(i, Gamma(CalcPulseColor(color, period, true, 0, offset)));
+          }
+        }
+        else
+        {
+          uint8_t length = end - start + 1;
+          uint16_t numProgress = length * 60 / 100 + start;
+          uint32_t minColor = strip.Color(((color >> 16) & 0xFF) / 4,
+                                          ((color >> 8) & 0xFF) / 4,
+                                          (color & 0xFF) / 4);
+          uint32_t pulseColor = CalcPulseColor(color, period, true, minColor);
+          for(uint8_t i = start; i < numProgress; i++)
+          {
+            strip.setPixelColor(i, Gamma(pulseColor));
+          }
+          for(uint8_t i = numProgress; i <= end; i++)
+          {
+            strip.setPixelColor(i, Gamma(minColor));
+          }
+        }
+        start += rings[r];
+      }
+      strip.show();
+    }
+
+  private:
+    uint32_t CalcPulseColor(uint32_t color, uint16_t period, bool smooth,
+                            uint32_t offColor = 0, uint16_t offset = 0)
+    {
+      divisions += smooth ? 5 : 4;
+      bool invert = false;
+      period /= PERIODDIVISOR;
+      offset /= PERIODDIVISOR;
+      unsigned long condensedNow = now / PERIODDIVISOR;
+      if(smooth)
+      {
+        invert = ((condensedNow + offset) % (2 * period)) !=
+                 ((condensedNow + offset) % period);
+      }
+      uint16_t curPhase = ((condensedNow + offset) % period);
+      if(invert)
+      {
+        curPhase = period - curPhase;
+      }
+      uint16_t redRange = ((color >> 16) & 0xFF) - ((offColor >> 16) & 0xFF);
+      uint32_t red = curPhase * redRange;
+      red /= period;
+      red += ((offColor >> 16) & 0xFF);
+      uint16_t greenRange = ((color >> 8) & 0xFF) - ((offColor >> 8) & 0xFF);
+      uint32_t green = curPhase * greenRange;
+      green /= period;
+      green += ((offColor >> 8) & 0xFF);
+      uint16_t blueRange = (color & 0xFF) - (offColor & 0xFF);
+      uint32_t blue = curPhase * blueRange;
+      blue /= period;
+      blue += (offColor & 0xFF);
+      return strip.Color(red, green, blue);
+    }
+
+    uint32_t Gamma(uint32_t c)
+    {
+      return ((uint32_t)GAMMA[(c >> 16) & 0xFF] << 16) |
+             ((uint32_t)GAMMA[(c >> 8) & 0xFF] << 8) |
+             GAMMA[c & 0xFF];
+    }
+
+    Adafruit_NeoPixel strip;
+    unsigned long now;
+    uint8_t GAMMA[256];
+};
+
+int main(int argc, char** argv)
+{
+  double seconds = BenchSecondsFromArgs(argc, argv);
+
+  PrintBenchHeader("Phase engine vs per-pixel division (stock layout)");
+
+  const NeoPixelRing::Pattern patterns[] = { NeoPixelRing::SPIN, NeoPixelRing::PROGRESS };
+  const char* names[] = { "SPIN", "PROGRESS" };
+
+  for(uint8_t p = 0; p < 2; p++)
+  {
+    bool spin = (patterns[p] == NeoPixelRing::SPIN);
+
+    hostSetMillis(0);
+    ReferenceRenderer reference;
+    BenchResult before = RunBenchmark([&]() {
+      hostAdvanceMillis(PERIODDIVISOR);
+      reference.Frame(spin);
+    }, seconds);
+
+    hostSetMillis(0);
+    NeoPixelRing tree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+    tree.begin();
+    tree.setBrightness(75);
+    tree.enableFlash(false);
+    for(uint8_t i = 0; i < numRings; i++)
+    {
+      tree.setPattern(i, patterns[p], color, period, 60);
+    }
+    BenchResult after = RunBenchmark([&]() {
+      hostAdvanceMillis(PERIODDIVISOR);
+      tree.update();
+    }, seconds);
+
+    char name[32];
+    snprintf(name, sizeof(name), "%s division", names[p]);
+    PrintBenchResult(name, 93, before);
+    snprintf(name, sizeof(name), "%s accumulator", names[p]);
+    PrintBenchResult(name, 93, after);
+    printf("%-28s %7s %11.2fx\n", "  host speedup", "",
+           before.nsPerFrame / after.nsPerFrame);
+    printf("  32-bit divisions per frame: %u before, 0 after "
+           "(~%.0f us per frame on a 16 MHz AVR)\n",
+           reference.divisions, reference.divisions * avrMicrosPerDivision);
+  }
+
+  return 0;
+}
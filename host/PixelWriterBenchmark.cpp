@@ -0,0 +1,209 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file PixelWriterBenchmark.cpp
+///
+/// @brief Compares writing a ring's pixels through setPixelColor(), as the
+///        patterns did before, with the wire-order writers in PixelWriter.h,
+///        then times whole frames of the stock tree for a strip in the
+///        compiled-in order, another RGB order and RGBW.
+///
+/// The first table draws 93 pixels the way SOLID/PULSE (one color for every
+/// pixel) and SPIN (a new color per pixel) do, without the color math, so
+/// only the cost of getting the colors into the buffer is left.  The last
+/// check draws every pattern on trees of each order and compares the colors
+/// the strips decode, so the run-time writer is held to the fixed one.
+///
+/// Usage: PixelWriterBenchmark [seconds-per-case]
+////////////////////////////////////////////////////////////////////////////////
+#include <vector>
+
+#include "Benchmark.h"
+#include "NeoPixelRing.h"
+
+static const uint8_t rings[] = { 32, 24, 16, 12, 8, 1 };
+static const uint8_t numRings = sizeof(rings);
+static const uint16_t numPixels = 93;
+
+static volatile uint8_t sink;
+
+// Ring sizes are only known at run time on the tree; a constant count lets
+// the compiler unroll fills in ways the patterns never see
+static volatile uint16_t spanPixels = numPixels;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Times draw() filling a strip of the given type, with a new base
+///        color each time.
+////////////////////////////////////////////////////////////////////////////////
+template<typename Draw>
+static double BenchDraw(neoPixelType type, Draw draw, double seconds)
+{
+  Adafruit_NeoPixel strip(numPixels, 9, type);
+  strip.begin();
+  uint32_t color = 0x00123456;
+  double ns = RunBenchmark([&]() {
+    draw(strip, color);
+    color += 0x00010203;
+  }, seconds).nsPerFrame;
+  sink = strip.getPixels()[numPixels];
+  return ns;
+}
+
+static void PrintWriters(const char* name, neoPixelType type, double seconds)
+{
+  RuntimePixelWriter runtime;
+  runtime.SetType(type);
+  PixelWriter<NEOPIXELRING_WIRE_ORDER> fixed;
+
+  double spanOld = BenchDraw(type, [](Adafruit_NeoPixel& strip, uint32_t c) {
+    for(uint16_t i = 0; i < numPixels; i++)
+    {
+      strip.setPixelColor(i, c);
+    }
+  }, seconds);
+  double spanRuntime = BenchDraw(type, [&](Adafruit_NeoPixel& strip, uint32_t c) {
+    runtime.Fill(strip.getPixels(), spanPixels, c);
+  }, seconds);
+  double eachOld = BenchDraw(type, [](Adafruit_NeoPixel& strip, uint32_t c) {
+    for(uint16_t i = 0; i < numPixels; i++, c += 0x00030201)
+    {
+      strip.setPixelColor(i, c);
+    }
+  }, seconds);
+  double eachRuntime = BenchDraw(type, [&](Adafruit_NeoPixel& strip, uint32_t c) {
+    uint8_t* p = strip.getPixels();
+    for(uint16_t i = 0; i < numPixels; i++, c += 0x00030201, p += runtime.Bytes())
+    {
+      runtime.Write(p, c);
+    }
+  }, seconds);
+
+  printf("%-10s %-16s %14.1f %14.1f\n", name, "setPixelColor", spanOld, eachOld);
+  printf("%-10s %-16s %14.1f %14.1f\n", "", "runtime writer", spanRuntime,
+         eachRuntime);
+  if((type & 0xFF) == (NEOPIXELRING_WIRE_ORDER & 0xFF))
+  {
+    double spanFixed = BenchDraw(type, [&](Adafruit_NeoPixel& strip, uint32_t c) {
+      fixed.Fill(strip.getPixels(), spanPixels, c);
+    }, seconds);
+    double eachFixed = BenchDraw(type, [&](Adafruit_NeoPixel& strip, uint32_t c) {
+      uint8_t* p = strip.getPixels();
+      for(uint16_t i = 0; i < numPixels; i++, c += 0x00030201, p += fixed.Bytes())
+      {
+        fixed.Write(p, c);
+      }
+    }, seconds);
+    printf("%-10s %-16s %14.1f %14.1f\n", "", "fixed writer", spanFixed,
+           eachFixed);
+  }
+}
+
+static BenchResult BenchFrame(neoPixelType type, NeoPixelRing::Pattern pattern,
+                              double seconds)
+{
+  hostSetMillis(0);
+  NeoPixelRing tree(9, type + NEO_KHZ800, numRings, rings);
+  tree.begin();
+  tree.setBrightness(75);
+  tree.enableFlash(false);
+  for(uint8_t i = 0; i < numRings; i++)
+  {
+    tree.setPattern(i, pattern, 0x0000FF00, 2000, 40);
+  }
+  return RunBenchmark([&]() {
+    hostAdvanceMillis(PERIODDIVISOR);
+    tree.update();
+  }, seconds);
+}
+
+static std::vector<uint32_t> shownColors;
+
+static void RecordColors(const Adafruit_NeoPixel& strip)
+{
+  for(uint16_t i = 0; i < strip.numPixels(); i++)
+  {
+    shownColors.push_back(strip.getPixelColor(i));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Draws a few seconds of every pattern, sparkles on, with a tree of
+///        the given type and returns the colors shown.
+////////////////////////////////////////////////////////////////////////////////
+static std::vector<uint32_t> ShownColors(neoPixelType type)
+{
+  const NeoPixelRing::Pattern patterns[] = {
+    NeoPixelRing::SOLID, NeoPixelRing::PULSE, NeoPixelRing::PROGRESS,
+    NeoPixelRing::SPIN, NeoPixelRing::RAINBOW
+  };
+  shownColors.clear();
+  Adafruit_NeoPixel::hostSetShowHook(RecordColors);
+  hostSetMillis(0);
+  randomSeed(1);
+  NeoPixelRing tree(9, type + NEO_KHZ800, numRings, rings);
+  tree.begin();
+  tree.setBrightness(200);
+  for(uint8_t i = 0; i < numRings; i++)
+  {
+    tree.setPattern(i, patterns[i % 5], 0x00FF8000 >> i, 1000 + 250 * i, 60);
+  }
+  for(uint16_t frame = 0; frame < 300; frame++)
+  {
+    hostAdvanceMillis(PERIODDIVISOR);
+    tree.update();
+  }
+  Adafruit_NeoPixel::hostSetShowHook(NULL);
+  return shownColors;
+}
+
+int main(int argc, char** argv)
+{
+  double seconds = BenchSecondsFromArgs(argc, argv);
+
+  printf("\nWriting %u pixels into the strip buffer (ns)\n", numPixels);
+  printf("%-10s %-16s %14s %14s\n", "order", "writer", "one color", "per pixel");
+  PrintWriters("NEO_GRB", NEO_GRB, seconds);
+  PrintWriters("NEO_RGB", NEO_RGB, seconds);
+  PrintWriters("NEO_GRBW", NEO_GRBW, seconds);
+
+  struct Order
+  {
+    const char* name;
+    neoPixelType type;
+  };
+  const Order orders[] = {
+    { "GRB", NEO_GRB }, { "RGB", NEO_RGB }, { "GRBW", NEO_GRBW },
+  };
+  const struct
+  {
+    const char* name;
+    NeoPixelRing::Pattern pattern;
+  } patterns[] = {
+    { "PULSE", NeoPixelRing::PULSE },
+    { "PROGRESS", NeoPixelRing::PROGRESS },
+    { "SPIN", NeoPixelRing::SPIN },
+    { "RAINBOW", NeoPixelRing::RAINBOW },
+  };
+  PrintBenchHeader("Stock tree frames by strip type");
+  for(const Order& o : orders)
+  {
+    for(const auto& p : patterns)
+    {
+      char name[32];
+      snprintf(name, sizeof(name), "%s %s", p.name, o.name);
+      PrintBenchResult(name, numPixels, BenchFrame(o.type, p.pattern, seconds));
+    }
+  }
+
+  std::vector<uint32_t> expected = ShownColors(NEOPIXELRING_WIRE_ORDER);
+  bool ok = !expected.empty();
+  for(const Order& o : orders)
+  {
+    std::vector<uint32_t> colors = ShownColors(o.type);
+    if(colors != expected)
+    {
+      printf("\n%s shows different colors\n", o.name);
+      ok = false;
+    }
+  }
+  printf("\nwire orders %s\n", ok ? "show identical colors" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file ProgramBenchmark.cpp
+///
+/// @brief Compares interpreted equivalents of SPIN and RAINBOW with the
+///        native patterns, and times the most expensive program setProgram()
+///        accepts.
+///
+/// The interpreted programs must draw exactly the same frames as the native
+/// patterns; the program exits non-zero if they differ or if the validator
+/// accepts a program it should not.
+///
+/// Usage: ProgramBenchmark [seconds-per-case]
+////////////////////////////////////////////////////////////////////////////////
+#include "Benchmark.h"
+#include "NeoPixelRing.h"
+
+static const uint8_t rings[] = { 32, 24, 16, 12, 8, 1 };
+static const uint8_t numRings = sizeof(rings);
+static const uint32_t color = 0x00FFBF00;
+
+static const uint8_t spinProgram[] = { OP_TIME, OP_SPREAD, OP_ADD, OP_TRI, OP_FADE };
+static const uint8_t rainbowProgram[] = { OP_TIME, OP_PIXEL, OP_SHL, 8, OP_ADD, OP_WHEEL };
+
+// Seven 16x16 multiplies: 1 + 7 * (1 + 3) + 1 + 1 = 31 cost units
+static const uint8_t worstProgram[] = { OP_TIME,
+                                        OP_DUP, OP_MUL, OP_DUP, OP_MUL,
+                                        OP_DUP, OP_MUL, OP_DUP, OP_MUL,
+                                        OP_DUP, OP_MUL, OP_DUP, OP_MUL,
+                                        OP_DUP, OP_MUL,
+                                        OP_TRI, OP_FADE };
+
+struct Case
+{
+  const char* name;
+  NeoPixelRing::Pattern pattern;
+  uint16_t period;
+  const uint8_t* program;
+  uint8_t programLength;
+};
+
+// RAINBOW runs a sawtooth over one period; programs see the PULSE clock,
+// which spans two periods, so the program runs at half the period
+static const Case cases[] = {
+  { "SPIN native", NeoPixelRing::SPIN, 2000, NULL, 0 },
+  { "SPIN program", NeoPixelRing::PROGRAM, 2000, spinProgram, sizeof(spinProgram) },
+  { "RAINBOW native", NeoPixelRing::RAINBOW, 4000, NULL, 0 },
+  { "RAINBOW program", NeoPixelRing::PROGRAM, 2000, rainbowProgram, sizeof(rainbowProgram) },
+  { "worst-case program", NeoPixelRing::PROGRAM, 2000, worstProgram, sizeof(worstProgram) },
+};
+static const uint8_t numCases = sizeof(cases) / sizeof(cases[0]);
+
+static void Configure(NeoPixelRing& tree, const Case& c)
+{
+  tree.begin();
+  tree.setBrightness(75);
+  tree.enableFlash(false);
+  if(c.program != NULL && !tree.setProgram(c.program, c.programLength))
+  {
+    printf("%s rejected\n", c.name);
+    exit(1);
+  }
+  for(uint8_t i = 0; i < numRings; i++)
+  {
+    tree.setPattern(i, c.pattern, color, c.period, 0);
+  }
+}
+
+static uint32_t Checksum(const Case& c)
+{
+  hostSetMillis(0);
+  Adafruit_NeoPixel::hostResetTotals();
+  NeoPixelRing tree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+  Configure(tree, c);
+  for(uint16_t frame = 0; frame < 1000; frame++)
+  {
+    hostAdvanceMillis(PERIODDIVISOR);
+    tree.update();
+  }
+  return Adafruit_NeoPixel::hostTotalShowChecksum();
+}
+
+static bool Rejects(const uint8_t* code, uint8_t length)
+{
+  NeoPixelRing tree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+  return !tree.setProgram(code, length);
+}
+
+int main(int argc, char** argv)
+{
+  double seconds = BenchSecondsFromArgs(argc, argv);
+  bool ok = true;
+
+  PrintBenchHeader("Interpreted vs native patterns (stock layout, flash off)");
+  double nativeNs = 0;
+  for(uint8_t i = 0; i < numCases; i++)
+  {
+    hostSetMillis(0);
+    NeoPixelRing tree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+    Configure(tree, cases[i]);
+    BenchResult r = RunBenchmark([&]() {
+      hostAdvanceMillis(PERIODDIVISOR);
+      tree.update();
+    }, seconds);
+    PrintBenchResult(cases[i].name, 93, r);
+    if(cases[i].program == NULL)
+    {
+      nativeNs = r.nsPerFrame;
+    }
+    else
+    {
+      printf("%-28s %7s %11.2fx of native, %.1f ns/pixel\n", "", "",
+             r.nsPerFrame / nativeNs, r.nsPerFrame / 93);
+    }
+  }
+
+  printf("\n");
+  for(uint8_t i = 0; i + 1 < 4; i += 2)
+  {
+    bool same = (Checksum(cases[i]) == Checksum(cases[i + 1]));
+    printf("%-28s %s\n", cases[i + 1].name, same ? "matches native" : "DIFFERS from native");
+    ok = ok && same;
+  }
+
+  const uint8_t underflow[] = { OP_ADD, OP_FADE };
+  const uint8_t unknown[] = { OP_TIME, 0xFF, OP_FADE };
+  const uint8_t truncated[] = { OP_PUSH16, 0x12 };
+  const uint8_t badShift[] = { OP_TIME, OP_SHL, 16, OP_FADE };
+  const uint8_t overflow[] = { OP_TIME, OP_DUP, OP_DUP, OP_DUP, OP_DUP,
+                               OP_DUP, OP_DUP, OP_DUP, OP_DUP };
+  uint8_t tooCostly[] = { OP_TIME, OP_DUP, OP_MUL, OP_DUP, OP_MUL, OP_DUP, OP_MUL,
+                          OP_DUP, OP_MUL, OP_DUP, OP_MUL, OP_DUP, OP_MUL,
+                          OP_DUP, OP_MUL, OP_DUP, OP_MUL, OP_FADE };
+  bool rejected = Rejects(underflow, sizeof(underflow)) &&
+                  Rejects(unknown, sizeof(unknown)) &&
+                  Rejects(truncated, sizeof(truncated)) &&
+                  Rejects(badShift, sizeof(badShift)) &&
+                  Rejects(overflow, sizeof(overflow)) &&
+                  Rejects(tooCostly, sizeof(tooCostly));
+  printf("%-28s %s\n", "invalid programs", rejected ? "rejected" : "ACCEPTED");
+  ok = ok && rejected;
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,400 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file ResponseSenderTest.cpp
+///
+/// @brief Checks ResponseSender's bookkeeping, then simulates serving the
+///        config page while the tree animates, sent all at once as before
+///        and paced by ResponseSender, and compares the longest gap between
+///        tree.update() calls.
+///
+/// The simulation models a 16 MHz AVR behind an ENC28J60:
+///
+///   update   3.8 ms: render, plus show() for the stock 93 pixels at 30 us
+///            each; the tree animates, so update() runs on every tick
+///   segment  1.8 ms per 846 byte segment: memcpy_P(), the SPI write at
+///            8 MHz and the wait for the previous frame to leave the wire
+///   client   0.5 ms each way; acknowledges every second segment at once
+///            and a lone segment after a 40 ms delayed ACK timer
+///   page     6.9 KB, the size of the gzipped page and its headers
+///
+/// It also compares the time to load the page as it is now with sending it
+/// uncompressed (about 20 KB once minified) and with a 304 Not Modified for
+/// a browser whose cached copy is current.
+////////////////////////////////////////////////////////////////////////////////
+#include <deque>
+#include <vector>
+
+#include "Test.h"
+#include "ResponseSender.h"
+
+static const uint16_t segmentSize = 846;
+
+static void TestSmallResponse()
+{
+  ResponseSender sender;
+  sender.begin(100, segmentSize, 1000, 0);
+  CHECK(sender.isActive());
+  CHECK(sender.sendDue(0));
+  CHECK_EQUAL(1, sender.burstSegments());
+  CHECK(sender.burstEnds());
+  uint16_t offset, size;
+  sender.segment(0, offset, size);
+  CHECK_EQUAL(0, offset);
+  CHECK_EQUAL(100, size);
+  sender.sent(0);
+  CHECK(!sender.sendDue(1));
+
+  // Data acknowledged, then the FIN
+  CHECK(sender.acknowledged(1100, 2));
+  CHECK(sender.isActive());
+  CHECK(!sender.sendDue(2));
+  CHECK(sender.acknowledged(1101, 3));
+  CHECK(!sender.isActive());
+}
+
+static void TestWindow()
+{
+  ResponseSender sender;
+  sender.begin(3000, segmentSize, 0, 0);
+  CHECK(sender.sendDue(0));
+  CHECK_EQUAL(RESPONSE_WINDOW, sender.burstSegments());
+  CHECK(!sender.burstEnds());
+  sender.sent(0);
+
+  // A partial acknowledgement waits for the rest of the burst
+  CHECK(sender.acknowledged(segmentSize, 1));
+  CHECK(!sender.sendDue(1));
+  CHECK(!sender.acknowledged(segmentSize, 1));   // Duplicate
+  CHECK(sender.acknowledged(2 * segmentSize, 2));
+  CHECK(sender.sendDue(2));
+
+  uint16_t offset, size;
+  CHECK_EQUAL(2, sender.burstSegments());
+  sender.segment(0, offset, size);
+  CHECK_EQUAL(2 * segmentSize, offset);
+  CHECK_EQUAL(segmentSize, size);
+  sender.segment(1, offset, size);
+  CHECK_EQUAL(3 * segmentSize, offset);
+  CHECK_EQUAL(3000 - 3 * segmentSize, size);
+  CHECK(sender.burstEnds());
+  sender.sent(2);
+
+  CHECK(!sender.acknowledged(3002, 3));           // Beyond what was sent
+  CHECK(sender.acknowledged(3001, 3));
+  CHECK(!sender.isActive());
+}
+
+static void TestRetry()
+{
+  // Sequence numbers wrap during the response
+  ResponseSender sender;
+  uint32_t first = 0xFFFFFF00UL;
+  sender.begin(2000, segmentSize, first, 0);
+  sender.sent(0);
+  CHECK(!sender.acknowledged(first - 1, 1));      // Before the response
+  CHECK(sender.acknowledged(first + segmentSize, 1));
+
+  // The lost segment is resent from the acknowledged byte
+  unsigned long t = 1;
+  for(uint8_t i = 0; i < RESPONSE_MAX_RETRIES; i++)
+  {
+    CHECK(!sender.sendDue(t + RESPONSE_RETRY_MS - 1));
+    t += RESPONSE_RETRY_MS;
+    CHECK(sender.sendDue(t));
+    uint16_t offset, size;
+    sender.segment(0, offset, size);
+    CHECK_EQUAL(segmentSize, offset);
+    sender.sent(t);
+  }
+  CHECK(!sender.sendDue(t + RESPONSE_RETRY_MS));
+  CHECK(!sender.isActive());
+
+  // Progress resets the retry count
+  sender.begin(2000, segmentSize, first, 0);
+  sender.sent(0);
+  CHECK(sender.sendDue(RESPONSE_RETRY_MS));
+  sender.sent(RESPONSE_RETRY_MS);
+  CHECK(sender.acknowledged(first + segmentSize, RESPONSE_RETRY_MS + 1));
+  t = RESPONSE_RETRY_MS + 1;
+  for(uint8_t i = 0; i < RESPONSE_MAX_RETRIES; i++)
+  {
+    t += RESPONSE_RETRY_MS;
+    CHECK(sender.sendDue(t));
+    sender.sent(t);
+  }
+  CHECK(sender.isActive());
+}
+
+static void TestFinRetry()
+{
+  ResponseSender sender;
+  sender.begin(100, segmentSize, 1000, 0);
+  CHECK(sender.sendDue(0));
+  CHECK_EQUAL(100, sender.finOffset());
+  sender.sent(0);
+
+  // The data is acknowledged but the FIN is lost: only the FIN is resent,
+  // still after the last byte
+  CHECK(sender.acknowledged(1100, 1));
+  CHECK(!sender.sendDue(RESPONSE_RETRY_MS));
+  CHECK(sender.sendDue(1 + RESPONSE_RETRY_MS));
+  CHECK_EQUAL(0, sender.burstSegments());
+  CHECK(sender.burstEnds());
+  CHECK_EQUAL(100, sender.finOffset());
+  sender.sent(1 + RESPONSE_RETRY_MS);
+  CHECK(sender.acknowledged(1101, 2 + RESPONSE_RETRY_MS));
+  CHECK(!sender.isActive());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////// Simulation /////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+// Times in microseconds
+static const unsigned long updateCost = 3800;
+static const unsigned long segmentCost = 1800;
+static const unsigned long oneWay = 500;
+static const unsigned long delayedAck = 40000;
+static const uint16_t pageSize = 6860;
+static const unsigned long requestAt = 100000;
+
+struct Packet
+{
+  unsigned long at;
+  uint32_t ack;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Receiving end: reassembles the page and acknowledges like a
+///        desktop TCP stack.
+////////////////////////////////////////////////////////////////////////////////
+struct Client
+{
+  uint16_t size;
+  std::vector<bool> received;
+  uint32_t next;       ///< Next in-order byte expected
+  bool finReceived;
+  uint8_t unacked;     ///< In-order segments not yet acknowledged
+  unsigned long ackTimer;
+  std::deque<Packet> toTree;
+  unsigned long lostSegment;  ///< Index of a segment to drop, or ~0
+
+  Client(uint16_t size) : size(size), received(size, false), next(0), finReceived(false),
+             unacked(0), ackTimer(0), lostSegment(~0UL) {}
+
+  void Ack(unsigned long t)
+  {
+    toTree.push_back(Packet{ t + oneWay, next + (finReceived ? 1 : 0) });
+    unacked = 0;
+    ackTimer = 0;
+  }
+
+  void Segment(unsigned long t, uint16_t offset, uint16_t size, bool fin,
+               unsigned long index)
+  {
+    if(index == lostSegment)
+    {
+      lostSegment = ~0UL;
+      return;
+    }
+    t += oneWay;
+    if(offset != next)
+    {
+      Ack(t);   // Out of order or duplicate: acknowledge at once
+      return;
+    }
+    for(uint16_t i = 0; i < size; i++)
+    {
+      received[offset + i] = true;
+    }
+    next = offset + size;
+    if(fin && next == this->size)
+    {
+      finReceived = true;
+      Ack(t);
+      return;
+    }
+    if(++unacked >= 2)
+    {
+      Ack(t);
+    }
+    else if(0 == ackTimer)
+    {
+      ackTimer = t + delayedAck;
+    }
+  }
+
+  void Tick(unsigned long t)
+  {
+    if(ackTimer && t >= ackTimer)
+    {
+      Ack(ackTimer);
+    }
+  }
+
+  bool Complete() const
+  {
+    for(bool b : received)
+    {
+      if(!b)
+      {
+        return false;
+      }
+    }
+    return finReceived;
+  }
+};
+
+struct Served
+{
+  unsigned long worstGap;   ///< Longest time between update() calls
+  unsigned long doneAt;     ///< Page fully acknowledged
+  unsigned long segments;   ///< Segments sent, including resends
+  bool complete;
+};
+
+static Served Serve(bool paced, unsigned long lostSegment,
+                    uint16_t pageSize = ::pageSize)
+{
+  Client client(pageSize);
+  client.lostSegment = lostSegment;
+  ResponseSender sender;
+  Served s = { 0, 0, 0, false };
+  unsigned long t = 0;
+  unsigned long lastUpdate = 0;
+  unsigned long sentIndex = 0;
+  bool requested = false;
+
+  while(t < 5000000)
+  {
+    client.Tick(t);
+
+    // One packet per loop, as EtherCard reads them
+    if(!requested && t >= requestAt)
+    {
+      requested = true;
+      if(paced)
+      {
+        sender.begin(pageSize, segmentSize, 0, t / 1000);
+      }
+      else
+      {
+        for(uint16_t offset = 0; offset < pageSize; offset += segmentSize)
+        {
+          uint16_t size = pageSize - offset < segmentSize ? pageSize - offset : segmentSize;
+          t += segmentCost;
+          s.segments++;
+          client.Segment(t, offset, size, offset + size == pageSize, sentIndex++);
+        }
+      }
+    }
+    else if(!client.toTree.empty() && client.toTree.front().at <= t)
+    {
+      Packet p = client.toTree.front();
+      client.toTree.pop_front();
+      if(paced)
+      {
+        sender.acknowledged(p.ack, t / 1000);
+      }
+      if(p.ack == (uint32_t)pageSize + 1 && !s.doneAt)
+      {
+        s.doneAt = t;
+      }
+    }
+
+    if(paced && sender.sendDue(t / 1000))
+    {
+      uint8_t segments = sender.burstSegments();
+      for(uint8_t i = 0; i < segments; i++)
+      {
+        uint16_t offset, size;
+        sender.segment(i, offset, size);
+        t += segmentCost;
+        s.segments++;
+        client.Segment(t, offset, size,
+                       sender.burstEnds() && i + 1 == segments,
+                       sentIndex++);
+      }
+      sender.sent(t / 1000);
+    }
+
+    // update() on every tick
+    if(requested && t - lastUpdate > s.worstGap)
+    {
+      s.worstGap = t - lastUpdate;
+    }
+    lastUpdate = t;
+    t += updateCost;
+
+    if(s.doneAt)
+    {
+      break;
+    }
+  }
+  s.complete = client.Complete();
+  return s;
+}
+
+static void Print(const char* name, const Served& s)
+{
+  printf("%-22s %10.1f %10.1f %9lu %9s\n", name, s.worstGap / 1000.0,
+         (s.doneAt - requestAt) / 1000.0, s.segments,
+         s.complete ? "yes" : "NO");
+}
+
+static void TestInterleaving()
+{
+  Served blocking = Serve(false, ~0UL);
+  Served paced = Serve(true, ~0UL);
+  Served lossy = Serve(true, 3);
+
+  printf("\n%-22s %10s %10s %9s %9s\n", "", "worst gap", "page", "segments",
+         "complete");
+  printf("%-22s %10s %10s\n", "", "ms", "ms");
+  Print("all at once", blocking);
+  Print("paced", paced);
+  Print("paced, segment 3 lost", lossy);
+
+  CHECK(blocking.complete);
+  CHECK(paced.complete);
+  CHECK(lossy.complete);
+
+  // No update() waits for more than a burst
+  CHECK(paced.worstGap <= updateCost + RESPONSE_WINDOW * segmentCost);
+  CHECK(paced.worstGap < blocking.worstGap);
+  CHECK_EQUAL(blocking.segments, paced.segments);
+
+  // A lost segment costs a retry interval, plus the delayed ACKs around it
+  CHECK(lossy.doneAt - requestAt <= paced.doneAt - requestAt + RESPONSE_RETRY_MS * 1000 + 2 * delayedAck);
+}
+
+static void TestPageSizes()
+{
+  Served uncompressed = Serve(true, ~0UL, 20000);
+  Served gzipped = Serve(true, ~0UL, pageSize);
+  Served notModified = Serve(true, ~0UL, 80);
+
+  printf("\n%-22s %10s %10s %9s\n", "", "bytes", "page", "segments");
+  printf("%-22s %10s %10s\n", "", "", "ms");
+  printf("%-22s %10u %10.1f %9lu\n", "uncompressed", 20000,
+         (uncompressed.doneAt - requestAt) / 1000.0, uncompressed.segments);
+  printf("%-22s %10u %10.1f %9lu\n", "gzip", pageSize,
+         (gzipped.doneAt - requestAt) / 1000.0, gzipped.segments);
+  printf("%-22s %10u %10.1f %9lu\n", "304 Not Modified", 80,
+         (notModified.doneAt - requestAt) / 1000.0, notModified.segments);
+
+  CHECK(uncompressed.complete && gzipped.complete && notModified.complete);
+  CHECK(gzipped.doneAt < uncompressed.doneAt);
+  CHECK(notModified.doneAt < gzipped.doneAt);
+  CHECK_EQUAL(1, notModified.segments);
+}
+
+int main()
+{
+  TestSmallResponse();
+  TestWindow();
+  TestRetry();
+  TestFinRetry();
+  TestInterleaving();
+  TestPageSizes();
+  return TestResult("ResponseSenderTest");
+}
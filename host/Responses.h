@@ -0,0 +1,82 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file Responses.h
+///
+/// @brief Recorded Jenkins `/api/json` build responses in `responses/`, with
+///        the status each one should produce.  Paths are relative to host/,
+///        where `make test` and `make bench` run the programs.
+///
+/// Every response also carries decoys the scanner must skip: `building` and
+/// `result` members of nested sub-builds, and commit messages that contain
+/// escaped quotes, braces and `"result":"FAILURE"`.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef HOST_RESPONSES_H
+#define HOST_RESPONSES_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include "BuildStatusScanner.h"
+
+struct RecordedResponse
+{
+  const char* file;
+  bool building;
+  BuildStatusScanner::Result result;
+};
+
+static const RecordedResponse recordedResponses[] = {
+  { "responses/building.http", true, BuildStatusScanner::RESULT_OTHER },
+  { "responses/success.http", false, BuildStatusScanner::RESULT_SUCCESS },
+  { "responses/unstable-pretty.http", false, BuildStatusScanner::RESULT_UNSTABLE },
+  { "responses/failure-result-first.http", false, BuildStatusScanner::RESULT_FAILURE },
+  { "responses/aborted.http", false, BuildStatusScanner::RESULT_ABORTED },
+  { "responses/not-built.http", false, BuildStatusScanner::RESULT_NOT_BUILT },
+};
+static const uint8_t numRecordedResponses =
+  sizeof(recordedResponses) / sizeof(recordedResponses[0]);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Reads a recorded response, exiting if it is missing.
+////////////////////////////////////////////////////////////////////////////////
+inline std::string LoadResponse(const char* file)
+{
+  FILE* f = fopen(file, "rb");
+  if(f == NULL)
+  {
+    printf("Cannot open %s; run from host/\n", file);
+    exit(1);
+  }
+  std::string data;
+  char chunk[512];
+  size_t n;
+  while((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+  {
+    data.append(chunk, n);
+  }
+  fclose(f);
+  return data;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Feeds a response to a scanner in segments of a fixed size, the way
+///        EtherCard hands them to the client callback.
+/// @return Number of segments passed before the scanner asked to close.
+////////////////////////////////////////////////////////////////////////////////
+inline uint16_t FeedSegments(BuildStatusScanner& scanner, const std::string& data,
+                             uint16_t segmentSize)
+{
+  uint16_t segments = 0;
+  for(size_t pos = 0; pos < data.size(); pos += segmentSize)
+  {
+    size_t len = data.size() - pos < segmentSize ? data.size() - pos : segmentSize;
+    segments++;
+    if(scanner.feed((const uint8_t*)data.data() + pos, len))
+    {
+      break;
+    }
+  }
+  return segments;
+}
+
+#endif // HOST_RESPONSES_H
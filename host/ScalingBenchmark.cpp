@@ -0,0 +1,86 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file ScalingBenchmark.cpp
+///
+/// @brief Measures render time against pixel count for installations split
+///        across several strips, from the stock tree up to several thousand
+///        pixels.
+///
+/// Each layout is built from rings of up to 240 pixels, with at most 600
+/// pixels per strip (about 18 ms of show() time per strip).
+///
+/// Usage: ScalingBenchmark [seconds-per-case]
+////////////////////////////////////////////////////////////////////////////////
+#include "Benchmark.h"
+#include "NeoPixelRing.h"
+
+static const uint16_t maxRing = 240;
+static const uint16_t maxStrip = 600;
+
+static BenchResult BenchLayout(uint16_t totalPixels, NeoPixelRing::Pattern pattern,
+                               double seconds, uint8_t& numStrips, uint8_t& numRings)
+{
+  uint8_t rings[64];
+  uint8_t pins[32];
+  uint8_t stripRings[32];
+
+  numRings = 0;
+  numStrips = 0;
+  uint16_t stripLength = maxStrip;
+  for(uint16_t remaining = totalPixels; remaining > 0; )
+  {
+    uint8_t ring = remaining < maxRing ? remaining : maxRing;
+    if(stripLength + ring > maxStrip)
+    {
+      pins[numStrips] = 2 + numStrips;
+      stripRings[numStrips] = 0;
+      numStrips++;
+      stripLength = 0;
+    }
+    rings[numRings++] = ring;
+    stripRings[numStrips - 1]++;
+    stripLength += ring;
+    remaining -= ring;
+  }
+
+  hostSetMillis(0);
+  randomSeed(1);
+  NeoPixelRing tree(NEO_GRB + NEO_KHZ800, numRings, rings,
+                    numStrips, pins, stripRings);
+  tree.begin();
+  tree.setBrightness(75);
+  for(uint8_t i = 0; i < numRings; i++)
+  {
+    tree.setPattern(i, pattern, 0x00FFBF00, 2000, 60);
+  }
+
+  return RunBenchmark([&]() {
+    hostAdvanceMillis(PERIODDIVISOR);
+    tree.update();
+  }, seconds);
+}
+
+int main(int argc, char** argv)
+{
+  double seconds = BenchSecondsFromArgs(argc, argv);
+  const uint16_t sizes[] = { 93, 250, 500, 1000, 2000, 4000 };
+
+  printf("\nRender time vs pixel count (flash overlay on)\n");
+  printf("%-10s %7s %7s %7s %12s %10s\n", "pattern", "pixels", "strips", "rings",
+         "ns/frame", "ns/pixel");
+
+  const NeoPixelRing::Pattern patterns[] = { NeoPixelRing::SOLID, NeoPixelRing::SPIN };
+  const char* names[] = { "SOLID", "SPIN" };
+  for(uint8_t p = 0; p < 2; p++)
+  {
+    for(uint16_t size : sizes)
+    {
+      uint8_t numStrips;
+      uint8_t numRings;
+      BenchResult r = BenchLayout(size, patterns[p], seconds, numStrips, numRings);
+      printf("%-10s %7u %7u %7u %12.1f %10.2f\n", names[p], size, numStrips,
+             numRings, r.nsPerFrame, r.nsPerFrame / size);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,139 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file SparkleBenchmark.cpp
+///
+/// @brief Measures the sparkle overlay from a handful to several hundred
+///        sparkles, and compares picking a new sparkling pixel against the
+///        rejection sampling the overlay used before.
+///
+/// The tree is four rings of 250 pixels showing SOLID, so the pattern itself
+/// costs next to nothing and the overlay's share is plain.  Sparkles last
+/// 400 ms, so every sparkle moves to a new pixel every 25 frames.
+///
+/// Usage: SparkleBenchmark [seconds-per-case]
+////////////////////////////////////////////////////////////////////////////////
+#include "Benchmark.h"
+#include "NeoPixelRing.h"
+
+static const uint8_t numRings = 4;
+static const uint8_t ringSize = 250;
+static const uint16_t numPixels = numRings * ringSize;
+
+static BenchResult BenchOverlay(uint8_t density, double seconds)
+{
+  const uint8_t rings[numRings] = { ringSize, ringSize, ringSize, ringSize };
+  hostSetMillis(0);
+  randomSeed(1);
+  NeoPixelRing tree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+  tree.begin();
+  tree.setBrightness(75);
+  for(uint8_t i = 0; i < numRings; i++)
+  {
+    tree.setPattern(i, NeoPixelRing::SOLID, 0x00106010);
+    tree.setSparkle(i, density, 0x00FFFFFF, 400);
+  }
+
+  // The sparkles are a small part of the frame, so take the best of a few
+  // runs to keep noise from swamping them
+  BenchResult best;
+  for(uint8_t run = 0; run < 3; run++)
+  {
+    BenchResult r = RunBenchmark([&]() {
+      hostAdvanceMillis(PERIODDIVISOR);
+      tree.update();
+    }, seconds);
+    if(0 == run || r.nsPerFrame < best.nsPerFrame)
+    {
+      best = r;
+    }
+  }
+  return best;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Replaces one of count unique pixels out of numPixels the way the
+///        old overlay did: draw a random pixel and scan every sparkle for a
+///        collision, drawing again until there is none.
+////////////////////////////////////////////////////////////////////////////////
+static void RejectionReplace(uint16_t* pixels, uint16_t count, uint16_t index)
+{
+  for(;;)
+  {
+    uint16_t candidate = random(numPixels);
+    bool repeat = false;
+    for(uint16_t i = 0; i < count; i++)
+    {
+      if(pixels[i] == candidate && i != index)
+      {
+        repeat = true;
+        break;
+      }
+    }
+    if(!repeat)
+    {
+      pixels[index] = candidate;
+      return;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Replaces one of count unique pixels the way DrawSparkles() does:
+///        swap it with a random entry past the sparkling ones.
+////////////////////////////////////////////////////////////////////////////////
+static void SwapReplace(uint16_t* pixels, uint16_t count, uint16_t index)
+{
+  uint16_t j = count + random(numPixels - count);
+  uint16_t swap = pixels[index];
+  pixels[index] = pixels[j];
+  pixels[j] = swap;
+}
+
+template<typename Replace>
+static double BenchReplace(Replace replace, uint16_t count, double seconds)
+{
+  static uint16_t pixels[numPixels];
+  for(uint16_t i = 0; i < numPixels; i++)
+  {
+    pixels[i] = i;
+  }
+  randomSeed(1);
+  uint16_t index = 0;
+  return RunBenchmark([&]() {
+    replace(pixels, count, index);
+    index = (index + 1 < count) ? index + 1 : 0;
+  }, seconds).nsPerFrame;
+}
+
+int main(int argc, char** argv)
+{
+  double seconds = BenchSecondsFromArgs(argc, argv);
+  // Per-ring densities giving 1, 8, 32, 64, 128, 192 and 249 sparkles a ring
+  const uint8_t densities[] = { 2, 9, 33, 66, 132, 197, 255 };
+
+  // With the overlay on every ring is redrawn and transferred each frame
+  // whether or not it sparkles; that part is measured with no sparkles
+  double baseline = BenchOverlay(0, seconds).nsPerFrame;
+  printf("\nSparkle overlay, %u pixels in %u rings (no sparkles: %.1f ns/frame)\n",
+         numPixels, numRings, baseline);
+  printf("%-10s %12s %14s %14s\n", "sparkles", "ns/frame", "sparkle ns", "ns/sparkle");
+  for(uint8_t density : densities)
+  {
+    uint16_t sparkles = numRings * (((uint16_t)ringSize * density) >> 8);
+    BenchResult r = BenchOverlay(density, seconds);
+    double sparkleNs = r.nsPerFrame - baseline;
+    printf("%-10u %12.1f %14.1f %14.2f\n", sparkles, r.nsPerFrame, sparkleNs,
+           sparkleNs / sparkles);
+  }
+
+  printf("\nPicking a new unique pixel out of %u\n", numPixels);
+  printf("%-10s %18s %18s\n", "sparkles", "rejection ns", "swap ns");
+  const uint16_t counts[] = { 1, 32, 128, 256, 512, 768, 900, 990 };
+  for(uint16_t count : counts)
+  {
+    double rejection = BenchReplace(RejectionReplace, count, seconds);
+    double swap = BenchReplace(SwapReplace, count, seconds);
+    printf("%-10u %18.1f %18.1f\n", count, rejection, swap);
+  }
+
+  return 0;
+}
@@ -0,0 +1,127 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file SpatialMapBenchmark.cpp
+///
+/// @brief Times the patterns drawn from the spatial map against SPIN on the
+///        stock tree, with the map built in RAM by NeoPixelRing and built into
+///        flash for StaticNeoPixelRing, and checks both draw the same frames.
+///
+/// Sparkles are off, so a frame is the pattern and the gamma and brightness
+/// pass.  The last check also runs a program reading the map opcodes.
+///
+/// Usage: SpatialMapBenchmark [seconds-per-case]
+////////////////////////////////////////////////////////////////////////////////
+#include "Benchmark.h"
+#include "NeoPixelRing.h"
+
+static const uint8_t rings[] = { 32, 24, 16, 12, 8, 1 };
+static const uint8_t numRings = sizeof(rings);
+typedef StaticNeoPixelRing<32, 24, 16, 12, 8, 1> StockTree;
+typedef StaticSpatialMap<93, 32, 24, 16, 12, 8, 1> StockMap;
+
+// Rainbow by height, brightness by radius
+static const uint8_t mapProgram[] = {
+  OP_HEIGHT, OP_TIME, OP_ADD, OP_WHEEL,
+  OP_RADIUS, OP_NOT, OP_ANGLE, OP_MAX, OP_FADE
+};
+
+template<typename Tree>
+static void Configure(Tree& tree, NeoPixelRing::Pattern pattern, bool flash)
+{
+  tree.begin();
+  tree.setBrightness(75);
+  tree.enableFlash(flash);
+  tree.setProgram(mapProgram, sizeof(mapProgram));
+  for(uint8_t i = 0; i < numRings; i++)
+  {
+    tree.setPattern(i, pattern, 0x00FFBF00, 2000, 60);
+  }
+}
+
+template<typename Tree>
+static BenchResult Render(Tree& tree, NeoPixelRing::Pattern pattern,
+                          double seconds)
+{
+  Configure(tree, pattern, false);
+  return RunBenchmark([&]() {
+    hostAdvanceMillis(PERIODDIVISOR);
+    tree.update();
+  }, seconds);
+}
+
+int main(int argc, char** argv)
+{
+  double seconds = BenchSecondsFromArgs(argc, argv);
+
+  printf("\nSpatial map, stock layout: %u pixels, %zu bytes per pixel\n", 93,
+         sizeof(SpatialPoint));
+  printf("  NeoPixelRing        %zu bytes of RAM, built when first needed\n",
+         93 * sizeof(SpatialPoint));
+  printf("  StaticNeoPixelRing  %zu bytes of flash, no RAM\n",
+         sizeof(StockMap::points));
+
+  const struct
+  {
+    const char* name;
+    NeoPixelRing::Pattern pattern;
+  } patterns[] = {
+    { "SPIN", NeoPixelRing::SPIN },
+    { "WIPE", NeoPixelRing::WIPE },
+    { "FILL", NeoPixelRing::FILL },
+    { "SPIRAL", NeoPixelRing::SPIRAL },
+    { "map program", NeoPixelRing::PROGRAM },
+  };
+  PrintBenchHeader("Render time, stock layout, no sparkles");
+  for(const auto& p : patterns)
+  {
+    char name[32];
+
+    hostSetMillis(0);
+    NeoPixelRing dynamicTree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+    snprintf(name, sizeof(name), "%s RAM map", p.name);
+    PrintBenchResult(name, 93, Render(dynamicTree, p.pattern, seconds));
+
+    hostSetMillis(0);
+    StockTree staticTree(9, NEO_GRB + NEO_KHZ800);
+    snprintf(name, sizeof(name), "%s flash map", p.name);
+    PrintBenchResult(name, 93, Render(staticTree, p.pattern, seconds));
+  }
+
+  // The RAM and flash maps come from the same formula, so both trees must
+  // draw exactly the same frames, sparkles included
+  bool ok = true;
+  for(const auto& p : patterns)
+  {
+    uint32_t checksums[2];
+    for(uint8_t variant = 0; variant < 2; variant++)
+    {
+      hostSetMillis(0);
+      randomSeed(1);
+      Adafruit_NeoPixel::hostResetTotals();
+      NeoPixelRing dynamicTree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+      StockTree staticTree(9, NEO_GRB + NEO_KHZ800);
+      NeoPixelRing& tree = variant ? (NeoPixelRing&)staticTree : dynamicTree;
+      Configure(tree, p.pattern, true);
+      for(uint16_t frame = 0; frame < 1000; frame++)
+      {
+        hostAdvanceMillis(PERIODDIVISOR);
+        if(variant)
+        {
+          staticTree.update();
+        }
+        else
+        {
+          dynamicTree.update();
+        }
+        tree.setParam(frame % numRings, frame / 10 % 101);
+      }
+      checksums[variant] = Adafruit_NeoPixel::hostTotalShowChecksum();
+    }
+    if(checksums[0] != checksums[1])
+    {
+      printf("\n%s differs between the RAM and flash maps\n", p.name);
+      ok = false;
+    }
+  }
+  printf("\nspatial maps %s\n", ok ? "draw identical frames" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,46 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file StartupBenchmark.cpp
+///
+/// @brief Measures the boot-time cost of NeoPixelRing: constructing the tree
+///        and drawing the first frame.  The sketch constructs its tree during
+///        static initialization, so this runs before setup().
+///
+/// Usage: StartupBenchmark [seconds-per-case]
+////////////////////////////////////////////////////////////////////////////////
+#include <new>
+
+#include "Benchmark.h"
+#include "NeoPixelRing.h"
+
+static const uint8_t rings[] = { 32, 24, 16, 12, 8, 1 };
+static const uint8_t numRings = sizeof(rings);
+
+int main(int argc, char** argv)
+{
+  double seconds = BenchSecondsFromArgs(argc, argv);
+
+  // Constructed in place so only the constructor is timed, not the heap
+  alignas(NeoPixelRing) static uint8_t storage[sizeof(NeoPixelRing)];
+
+  printf("\nStartup, stock layout (sizeof(NeoPixelRing) = %zu)\n", sizeof(NeoPixelRing));
+  printf("%-28s %12s\n", "case", "ns");
+
+  BenchResult construct = RunBenchmark([&]() {
+    NeoPixelRing* tree = new(storage) NeoPixelRing(9, NEO_GRB + NEO_KHZ800,
+                                                   numRings, rings);
+    tree->~NeoPixelRing();
+  }, seconds);
+  printf("%-28s %12.1f\n", "construct", construct.nsPerFrame);
+
+  BenchResult firstFrame = RunBenchmark([&]() {
+    NeoPixelRing* tree = new(storage) NeoPixelRing(9, NEO_GRB + NEO_KHZ800,
+                                                   numRings, rings);
+    tree->begin();
+    tree->setBrightness(75);
+    tree->update();
+    tree->~NeoPixelRing();
+  }, seconds);
+  printf("%-28s %12.1f\n", "construct + first frame", firstFrame.nsPerFrame);
+
+  return 0;
+}
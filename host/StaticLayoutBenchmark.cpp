@@ -0,0 +1,170 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file StaticLayoutBenchmark.cpp
+///
+/// @brief Compares the heap-allocated NeoPixelRing with StaticNeoPixelRing on
+///        the stock layout: memory footprint, render time, and identical
+///        output.
+///
+/// Heap use is counted by replacing the global operator new, which is how
+/// NeoPixelRing allocates.  The strip's pixel buffer is allocated by the
+/// NeoPixel library in both variants and is reported separately.  Host
+/// object sizes include 8-byte pointers and alignment padding, so the board
+/// footprint is smaller; the allocation count is the same on both.
+///
+/// Usage: StaticLayoutBenchmark [seconds-per-case]
+////////////////////////////////////////////////////////////////////////////////
+#include <new>
+
+#include "Benchmark.h"
+#include "NeoPixelRing.h"
+
+static const uint8_t rings[] = { 32, 24, 16, 12, 8, 1 };
+static const uint8_t numRings = sizeof(rings);
+typedef StaticNeoPixelRing<32, 24, 16, 12, 8, 1> StockTree;
+
+// avr-libc malloc keeps a 2-byte size header in front of every block
+static const uint32_t avrMallocHeader = 2;
+
+static uint32_t heapBlocks = 0;
+static uint32_t heapBytes = 0;
+
+void* operator new(size_t size)
+{
+  heapBlocks++;
+  heapBytes += size;
+  void* p = malloc(size ? size : 1);
+  if(p == NULL)
+  {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+  free(p);
+}
+
+template<typename Tree>
+static void Configure(Tree& tree, NeoPixelRing::Pattern pattern, bool flash)
+{
+  tree.begin();
+  tree.setBrightness(75);
+  tree.enableFlash(flash);
+  for(uint8_t i = 0; i < numRings; i++)
+  {
+    tree.setPattern(i, pattern, 0x00FFBF00, 2000, 60);
+  }
+}
+
+template<typename Tree>
+static BenchResult Render(Tree& tree, NeoPixelRing::Pattern pattern, bool flash,
+                          double seconds)
+{
+  Configure(tree, pattern, flash);
+  return RunBenchmark([&]() {
+    hostAdvanceMillis(PERIODDIVISOR);
+    tree.update();
+  }, seconds);
+}
+
+int main(int argc, char** argv)
+{
+  double seconds = BenchSecondsFromArgs(argc, argv);
+
+  printf("\nMemory footprint, stock layout (host sizes)\n");
+  printf("%-28s %10s %12s %12s\n", "case", "object", "heap blocks", "heap bytes");
+  heapBlocks = heapBytes = 0;
+  {
+    NeoPixelRing tree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+    printf("%-28s %10zu %12u %12u\n", "NeoPixelRing", sizeof(tree),
+           heapBlocks, heapBytes + heapBlocks * avrMallocHeader);
+  }
+  heapBlocks = heapBytes = 0;
+  {
+    StockTree tree(9, NEO_GRB + NEO_KHZ800);
+    printf("%-28s %10zu %12u %12u\n", "StaticNeoPixelRing", sizeof(tree),
+           heapBlocks, heapBytes + heapBlocks * avrMallocHeader);
+  }
+  printf("  heap bytes include %u bytes of malloc header per block; both add\n"
+         "  one %u-byte pixel buffer allocated by the NeoPixel library\n",
+         avrMallocHeader, 93 * 3);
+
+  PrintBenchHeader("Render time, stock layout");
+  const NeoPixelRing::Pattern patterns[] = { NeoPixelRing::SOLID, NeoPixelRing::SPIN,
+                                             NeoPixelRing::RAINBOW };
+  const char* names[] = { "SOLID", "SPIN", "RAINBOW" };
+  for(uint8_t p = 0; p < 3; p++)
+  {
+    for(uint8_t flash = 0; flash < 2; flash++)
+    {
+      char name[32];
+
+      hostSetMillis(0);
+      randomSeed(1);
+      NeoPixelRing dynamicTree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+      BenchResult before = Render(dynamicTree, patterns[p], flash, seconds);
+      snprintf(name, sizeof(name), "%s%s heap", names[p], flash ? "+flash" : "");
+      PrintBenchResult(name, 93, before);
+
+      hostSetMillis(0);
+      randomSeed(1);
+      StockTree staticTree(9, NEO_GRB + NEO_KHZ800);
+      BenchResult after = Render(staticTree, patterns[p], flash, seconds);
+      snprintf(name, sizeof(name), "%s%s static", names[p], flash ? "+flash" : "");
+      PrintBenchResult(name, 93, after);
+    }
+  }
+
+  // Both variants must draw exactly the same frames, sparkles included.
+  // Each instance picks its own sparkling pixels, so the tree that is not
+  // drawn does not disturb the one that is.
+  uint32_t checksums[2];
+  for(uint8_t variant = 0; variant < 2; variant++)
+  {
+    hostSetMillis(0);
+    randomSeed(1);
+    Adafruit_NeoPixel::hostResetTotals();
+    NeoPixelRing dynamicTree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+    StockTree staticTree(9, NEO_GRB + NEO_KHZ800);
+    NeoPixelRing& tree = variant ? (NeoPixelRing&)staticTree : dynamicTree;
+    Configure(tree, NeoPixelRing::SPIN, true);
+    for(uint16_t frame = 0; frame < 2000; frame++)
+    {
+      hostAdvanceMillis(PERIODDIVISOR);
+      if(variant)
+      {
+        staticTree.update();
+      }
+      else
+      {
+        dynamicTree.update();
+      }
+      tree.setPattern(frame % numRings, (NeoPixelRing::Pattern)(frame / 300 % 5),
+                      0x00FF00FF, 1000 + frame, 40);
+    }
+    checksums[variant] = Adafruit_NeoPixel::hostTotalShowChecksum();
+  }
+  printf("\noutput %s\n", checksums[0] == checksums[1] ? "identical" : "DIFFERS");
+  return checksums[0] == checksums[1] ? 0 : 1;
+}
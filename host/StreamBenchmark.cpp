@@ -0,0 +1,219 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file StreamBenchmark.cpp
+///
+/// @brief Measures sustained frame rate for streamed pixel frames and works
+///        out the packet-to-photon latency budget on the device.
+///
+/// The host numbers time PixelStream::receive() over whole frames, including
+/// gamma correction and the stand-in show().  The latency budget is a model
+/// of an ATmega328 at 16 MHz behind an ENC28J60:
+///
+///   wire     10 Mbit/s; header, preamble, FCS and gap included
+///   SPI      buffer read at 8 MHz, 1 us per byte
+///   decode   about 100 cycles per pixel for the gamma lookups, scaling and
+///            setPixelColor()
+///   poll     up to one 1024 us timer tick, since the loop idles between
+///            ticks and the ENC28J60 interrupt line is not used
+///   show     30 us per pixel plus the 50 us latch, interrupts off
+///
+/// show() blocks the CPU but not the wire, so a frame's datagrams arrive in
+/// the ENC28J60 receive buffer while the previous frame is being shown.
+///
+/// The program also checks that frames are shown exactly once, only when
+/// every segment of the newest frame has arrived, and that the patterns
+/// come back after the timeout; it exits non-zero if not.
+///
+/// Usage: StreamBenchmark [seconds-per-case]
+////////////////////////////////////////////////////////////////////////////////
+#include <vector>
+
+#include "Benchmark.h"
+#include "PixelStream.h"
+
+static const uint8_t stockRings[] = { 32, 24, 16, 12, 8, 1 };
+static const uint8_t largeRings[] = { 240, 240, 120 };
+
+// Largest segment that fits the UDP build's 500 byte Ethernet::buffer after
+// the 42 bytes of Ethernet, IP and UDP headers
+static const uint16_t maxSegmentPixels = (500 - 42 - STREAM_HEADER_SIZE) / 3;
+
+static std::vector<uint8_t> Segment(uint16_t frameId, uint8_t segment,
+                                    uint8_t segmentCount, uint16_t firstPixel,
+                                    uint16_t count, uint8_t seed)
+{
+  std::vector<uint8_t> d;
+  d.push_back(STREAM_MAGIC);
+  d.push_back(frameId >> 8);
+  d.push_back(frameId & 0xFF);
+  d.push_back(segment);
+  d.push_back(segmentCount);
+  d.push_back(firstPixel >> 8);
+  d.push_back(firstPixel & 0xFF);
+  for(uint16_t i = 0; i < count * 3; i++)
+  {
+    d.push_back(seed + firstPixel * 3 + i);
+  }
+  return d;
+}
+
+static std::vector<std::vector<uint8_t> > Frame(uint16_t frameId,
+                                                uint16_t pixels, uint8_t seed)
+{
+  std::vector<std::vector<uint8_t> > segments;
+  uint8_t segmentCount = (pixels + maxSegmentPixels - 1) / maxSegmentPixels;
+  for(uint8_t s = 0; s < segmentCount; s++)
+  {
+    uint16_t first = s * maxSegmentPixels;
+    uint16_t count = pixels - first < maxSegmentPixels ? pixels - first : maxSegmentPixels;
+    segments.push_back(Segment(frameId, s, segmentCount, first, count, seed));
+  }
+  return segments;
+}
+
+static void BenchThroughput(const char* name, const uint8_t* rings,
+                            uint8_t numRings, double seconds)
+{
+  hostSetMillis(0);
+  NeoPixelRing tree(9, NEO_GRB + NEO_KHZ800, numRings, rings);
+  tree.begin();
+  tree.setBrightness(75);
+  PixelStream stream;
+  uint16_t pixels = tree.getNumPixels();
+
+  // Pre-build a few frames so the loop only times decoding
+  std::vector<std::vector<std::vector<uint8_t> > > frames;
+  for(uint8_t f = 0; f < 4; f++)
+  {
+    frames.push_back(Frame(0, pixels, f * 17));
+  }
+  uint16_t frameId = 0;
+  BenchResult r = RunBenchmark([&]() {
+    std::vector<std::vector<uint8_t> >& frame = frames[frameId & 3];
+    frameId++;
+    for(std::vector<uint8_t>& segment : frame)
+    {
+      segment[1] = frameId >> 8;
+      segment[2] = frameId & 0xFF;
+      stream.receive(tree, segment.data(), segment.size(), millis());
+    }
+  }, seconds);
+  PrintBenchResult(name, pixels, r);
+}
+
+static void PrintBudget(uint16_t pixels)
+{
+  uint8_t segments = (pixels + maxSegmentPixels - 1) / maxSegmentPixels;
+  uint16_t lastPixels = pixels - (segments - 1) * maxSegmentPixels;
+  const double ethernetOverhead = 42 + 8 + 4 + 12; // Headers, preamble, FCS, gap
+  double frameWire = 0;
+  double frameSpi = 0;
+  for(uint8_t s = 0; s < segments; s++)
+  {
+    uint16_t count = (s + 1 < segments) ? maxSegmentPixels : lastPixels;
+    frameWire += (STREAM_HEADER_SIZE + count * 3 + ethernetOverhead) * 0.8;
+    frameSpi += STREAM_HEADER_SIZE + count * 3 + 42;
+  }
+  double lastWire = (STREAM_HEADER_SIZE + lastPixels * 3 + ethernetOverhead) * 0.8;
+  double lastSpi = STREAM_HEADER_SIZE + lastPixels * 3 + 42;
+  double decodePerPixel = 100 / 16.0;
+  double lastDecode = lastPixels * decodePerPixel;
+  double poll = 1024;
+  double show = pixels * 30.0 + 50;
+
+  double latency = lastWire + poll + lastSpi + lastDecode + show;
+  double cpuPerFrame = frameSpi + pixels * decodePerPixel + show;
+  double perFrame = cpuPerFrame > frameWire ? cpuPerFrame : frameWire;
+  printf("%7u %5u %8.0f %8.0f %8.0f %8.0f %8.0f %9.0f %8.1f\n",
+         pixels, segments, lastWire, poll, lastSpi, lastDecode, show,
+         latency, 1e6 / perFrame);
+}
+
+static bool CheckFraming()
+{
+  bool ok = true;
+  hostSetMillis(0);
+  NeoPixelRing tree(9, NEO_GRB + NEO_KHZ800, sizeof(largeRings), largeRings);
+  tree.begin();
+  tree.enableFlash(false);
+  for(uint8_t i = 0; i < sizeof(largeRings); i++)
+  {
+    tree.setPattern(i, NeoPixelRing::SOLID, 0x00FF0000, 2000, 0);
+  }
+  tree.update();
+  PixelStream stream;
+  Adafruit_NeoPixel::hostResetTotals();
+
+  // Segments out of order: shown once, on the last one
+  std::vector<std::vector<uint8_t> > frame = Frame(10, 600, 0);
+  ok = ok && frame.size() == 4;
+  ok = ok && PixelStream::BUFFERED == stream.receive(tree, frame[3].data(), frame[3].size(), millis());
+  ok = ok && stream.isActive() && tree.isStreaming();
+  ok = ok && PixelStream::BUFFERED == stream.receive(tree, frame[0].data(), frame[0].size(), millis());
+  ok = ok && PixelStream::IGNORED == stream.receive(tree, frame[0].data(), frame[0].size(), millis());
+  ok = ok && PixelStream::BUFFERED == stream.receive(tree, frame[1].data(), frame[1].size(), millis());
+  ok = ok && 0 == Adafruit_NeoPixel::hostTotalShowCount();
+  ok = ok && PixelStream::SHOWN == stream.receive(tree, frame[2].data(), frame[2].size(), millis());
+  ok = ok && 1 == Adafruit_NeoPixel::hostTotalShowCount();
+
+  // Late duplicates and older frames are dropped; patterns stay suspended
+  ok = ok && PixelStream::IGNORED == stream.receive(tree, frame[2].data(), frame[2].size(), millis());
+  std::vector<std::vector<uint8_t> > old = Frame(9, 600, 0);
+  ok = ok && PixelStream::IGNORED == stream.receive(tree, old[0].data(), old[0].size(), millis());
+  hostAdvanceMillis(500);
+  ok = ok && !tree.update();
+  ok = ok && 1 == Adafruit_NeoPixel::hostTotalShowCount();
+
+  // A newer frame abandons an incomplete one
+  std::vector<std::vector<uint8_t> > partial = Frame(11, 600, 5);
+  std::vector<std::vector<uint8_t> > next = Frame(12, 600, 9);
+  stream.receive(tree, partial[0].data(), partial[0].size(), millis());
+  for(std::vector<uint8_t>& segment : next)
+  {
+    stream.receive(tree, segment.data(), segment.size(), millis());
+  }
+  for(uint8_t s = 1; s < partial.size(); s++)
+  {
+    ok = ok && PixelStream::IGNORED == stream.receive(tree, partial[s].data(), partial[s].size(), millis());
+  }
+  ok = ok && 2 == Adafruit_NeoPixel::hostTotalShowCount();
+
+  // Malformed segments
+  std::vector<uint8_t> bad = frame[0];
+  bad.pop_back();
+  ok = ok && PixelStream::IGNORED == stream.receive(tree, bad.data(), bad.size(), millis());
+  bad = frame[0];
+  bad[3] = bad[4];
+  ok = ok && PixelStream::IGNORED == stream.receive(tree, bad.data(), bad.size(), millis());
+
+  // Patterns take over again after the timeout
+  hostAdvanceMillis(STREAM_TIMEOUT_MS - 1);
+  ok = ok && !stream.checkTimeout(tree, millis());
+  hostAdvanceMillis(1);
+  ok = ok && stream.checkTimeout(tree, millis());
+  ok = ok && !stream.isActive() && !tree.isStreaming();
+  ok = ok && tree.update();
+  ok = ok && 3 == Adafruit_NeoPixel::hostTotalShowCount();
+  return ok;
+}
+
+int main(int argc, char** argv)
+{
+  double seconds = BenchSecondsFromArgs(argc, argv);
+
+  PrintBenchHeader("Streamed frames decoded and shown on the host");
+  BenchThroughput("stock tree, 1 segment", stockRings, sizeof(stockRings), seconds);
+  BenchThroughput("600 pixels, 4 segments", largeRings, sizeof(largeRings), seconds);
+
+  printf("\nPacket-to-photon budget on the device, us (last segment to latch)\n");
+  printf("%7s %5s %8s %8s %8s %8s %8s %9s %8s\n", "pixels", "segs", "wire",
+         "poll", "spi", "decode", "show", "latency", "max fps");
+  const uint16_t sizes[] = { 93, 150, 300, 600 };
+  for(uint16_t size : sizes)
+  {
+    PrintBudget(size);
+  }
+
+  bool ok = CheckFraming();
+  printf("\n%-28s %s\n", "frame assembly", ok ? "correct" : "WRONG");
+  return ok ? 0 : 1;
+}
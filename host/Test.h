@@ -0,0 +1,51 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file Test.h
+///
+/// @brief Minimal assertion helpers shared by the host tests.  A failed
+///        CHECK prints its location and the test keeps going; TestResult()
+///        turns the tally into the process exit code.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+
+static unsigned testChecks = 0;
+static unsigned testFailures = 0;
+
+#define CHECK(cond) \
+  do \
+  { \
+    testChecks++; \
+    if(!(cond)) \
+    { \
+      testFailures++; \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    } \
+  } while(0)
+
+#define CHECK_EQUAL(expected, actual) \
+  do \
+  { \
+    testChecks++; \
+    long long e_ = (long long)(expected); \
+    long long a_ = (long long)(actual); \
+    if(e_ != a_) \
+    { \
+      testFailures++; \
+      printf("%s:%d: CHECK_EQUAL(%s, %s) failed: %lld != %lld\n", \
+             __FILE__, __LINE__, #expected, #actual, e_, a_); \
+    } \
+  } while(0)
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Prints the tally.
+/// @return Exit code for main(): 0 if every check passed.
+////////////////////////////////////////////////////////////////////////////////
+inline int TestResult(const char* name)
+{
+  printf("%s: %u checks, %u failures\n", name, testChecks, testFailures);
+  return testFailures ? 1 : 0;
+}
+
+#endif // HOST_TEST_H
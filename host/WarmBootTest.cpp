@@ -0,0 +1,257 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file WarmBootTest.cpp
+///
+/// @brief Measures the time from reset to the first successful Jenkins poll
+///        of a standalone tree, against simulated DHCP and DNS servers, for
+///        the previous boot and for the boot with NetworkCache.
+///
+/// The tree is modelled as the sketch's tasks, stepped a millisecond at a
+/// time from reset:
+///
+///   before  setup() blocks until DHCP is bound, and the first DNS query
+///           waits out DNS_RETRY_INTERVAL_MS from reset
+///   cold    DHCP in the background, the first query as soon as there is an
+///           address, the lease and server address cached
+///   warm    the cached lease and server used at once, both confirmed in
+///           the background
+///
+/// Nothing goes out before the Ethernet link is up.  A poll succeeds if the
+/// tree's address is the one the DHCP server leases it and the server
+/// address is the one DNS gives; otherwise it times out and is retried as
+/// JobScheduler would.
+////////////////////////////////////////////////////////////////////////////////
+#include <EEPROM.h>
+
+#include "Test.h"
+#include "NetworkStandins.h"
+#include "NetworkCache.h"
+#include "DnsResolver.h"
+#include "JobScheduler.h"
+
+#define OLD_DNS_RETRY_INTERVAL_MS 5000  // DNS_RETRY_INTERVAL_MS in the sketch
+#define SIMULATION_LIMIT_MS 120000UL
+
+static const uint8_t mac[6] = { 0x6, 0x5, 0x4, 0x3, 0x2, 0x1 };
+static const char* domain = "jenkins.example.com";
+
+enum Boot
+{
+  BEFORE,
+  COLD,
+  WARM
+};
+
+static const char* const bootNames[] = { "before", "cold", "warm" };
+
+struct Network
+{
+  const char* name;
+  unsigned long linkMs;  ///< Ethernet link up after reset
+  unsigned long dhcpMs;  ///< DHCP server answer time
+  unsigned long dnsMs;   ///< DNS server answer time
+  unsigned long httpMs;  ///< Jenkins request round trip
+};
+
+static const Network networks[] = {
+  { "typical", 1500, 30, 20, 150 },
+  { "slow", 1500, 2500, 800, 600 },
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Boots a tree.
+/// @return Milliseconds from reset to the first successful poll, or
+///         SIMULATION_LIMIT_MS if there was none.
+////////////////////////////////////////////////////////////////////////////////
+static unsigned long BootToFirstPoll(Boot boot, const Network& net,
+                                     DhcpServerStandin& dhcpServer,
+                                     DnsServerStandin& dnsServer)
+{
+  static uint8_t buf[DHCP_MESSAGE_LEN];
+  dhcpServer.delayMs = net.dhcpMs;
+  dhcpServer.queue.clear();
+  dnsServer.delayMs = net.dnsMs;
+  dnsServer.queue.clear();
+
+  NetworkCache cache(mac);
+  DhcpClient dhcp;
+  DnsResolver resolver;
+  bool haveDNS = false;
+  bool dnsConfirmed = false;
+  unsigned long lastLookup = 0;
+  uint8_t hisip[4];
+  bool polling = false;
+  bool pollOk = false;
+  unsigned long pollDoneAt = 0;
+  unsigned long nextPollAt = 0;
+
+  DhcpLease lease;
+  if(WARM == boot && cache.loadLease(lease))
+  {
+    dhcp.reboot(mac, lease, 0);
+  }
+  else
+  {
+    dhcp.begin(mac, 0);
+  }
+  haveDNS = (WARM == boot && cache.loadServer(domain, hisip));
+
+  for(unsigned long now = 0; now < SIMULATION_LIMIT_MS; now++)
+  {
+    bool linkUp = now >= net.linkMs;
+
+    // Answers
+    uint16_t len = dhcpServer.receive(buf, now);
+    if(len > 0 && dhcp.receive(buf, len, now) &&
+       DhcpClient::BOUND == dhcp.getState() && BEFORE != boot)
+    {
+      cache.saveLease(dhcp.getLease());
+    }
+    len = dnsServer.receive(buf, now);
+    if(len > 0 && resolver.receive(buf, len) &&
+       DnsResolver::RESOLVED == resolver.getState())
+    {
+      memcpy(hisip, resolver.getAddress(), 4);
+      haveDNS = true;
+      dnsConfirmed = true;
+      if(BEFORE != boot)
+      {
+        cache.saveServer(domain, hisip);
+      }
+    }
+
+    // DHCP
+    if(linkUp && DhcpClient::SEND == dhcp.poll(now))
+    {
+      len = dhcp.fillMessage(buf, sizeof(buf), now);
+      dhcpServer.send(buf, len, now);
+    }
+    if(BEFORE == boot && DhcpClient::BOUND != dhcp.getState())
+    {
+      // Still in ether.dhcpSetup()
+      continue;
+    }
+    bool haveAddress = dhcp.hasLease();
+
+    // DNS
+    if(linkUp && haveAddress && !dnsConfirmed)
+    {
+      DnsResolver::State state = resolver.poll(now);
+      if(DnsResolver::IDLE == state || DnsResolver::FAILED == state)
+      {
+        bool gated = (BEFORE == boot || DnsResolver::FAILED == state);
+        if(!gated || now - lastLookup > OLD_DNS_RETRY_INTERVAL_MS)
+        {
+          lastLookup = now;
+          resolver.begin(now);
+          state = DnsResolver::SEND;
+        }
+      }
+      if(DnsResolver::SEND == state)
+      {
+        len = resolver.fillQuery(buf, sizeof(buf), domain, now);
+        dnsServer.send(buf, len, now);
+      }
+    }
+
+    // Jenkins
+    if(polling && now >= pollDoneAt)
+    {
+      polling = false;
+      if(pollOk)
+      {
+        return now;
+      }
+      nextPollAt = now + JOB_POLL_RETRY_MS;
+    }
+    if(linkUp && haveAddress && haveDNS && !polling && now >= nextPollAt)
+    {
+      polling = true;
+      pollOk = 0 == memcmp(dhcp.getLease().ip, dhcpServer.address, 4) &&
+               0 == memcmp(hisip, dnsServer.address, 4);
+      pollDoneAt = now + (pollOk ? net.httpMs : JOB_REQUEST_TIMEOUT_MS);
+    }
+  }
+  return SIMULATION_LIMIT_MS;
+}
+
+static void PrintResult(const char* network, const char* boot,
+                        unsigned long ms)
+{
+  printf("%-28s %-8s %10lu\n", network, boot, ms);
+}
+
+static void TestBootTimes()
+{
+  printf("\nReset to first successful poll\n");
+  printf("%-28s %-8s %10s\n", "network", "boot", "ms");
+  for(const Network& net : networks)
+  {
+    unsigned long ms[3];
+    DhcpServerStandin dhcpServer;
+    DnsServerStandin dnsServer;
+    EEPROM.hostErase();
+    for(uint8_t boot = BEFORE; boot <= WARM; boot++)
+    {
+      EEPROM.hostResetCounts();
+      ms[boot] = BootToFirstPoll((Boot)boot, net, dhcpServer, dnsServer);
+      PrintResult(net.name, bootNames[boot], ms[boot]);
+      if(WARM == boot)
+      {
+        // Confirming an unchanged lease and server writes nothing
+        CHECK_EQUAL(0, EEPROM.writes);
+      }
+    }
+    // A slow DHCP server outlasts the old DNS wait, so a cold boot can only
+    // match the old one there
+    CHECK(ms[COLD] <= ms[BEFORE]);
+    CHECK(ms[WARM] < ms[COLD]);
+    CHECK(ms[BEFORE] > OLD_DNS_RETRY_INTERVAL_MS);
+    CHECK_EQUAL(net.linkMs + net.httpMs, ms[WARM]);
+  }
+}
+
+static void TestStaleCache()
+{
+  const Network& net = networks[0];
+  DhcpServerStandin dhcpServer;
+  DnsServerStandin dnsServer;
+  EEPROM.hostErase();
+  BootToFirstPoll(COLD, net, dhcpServer, dnsServer);
+
+  // No DHCP server: the cached lease carries on
+  dhcpServer.up = false;
+  unsigned long ms = BootToFirstPoll(WARM, net, dhcpServer, dnsServer);
+  PrintResult("typical, DHCP server down", bootNames[WARM], ms);
+  CHECK_EQUAL(net.linkMs + net.httpMs, ms);
+  dhcpServer.up = true;
+
+  // Moved to another network: the first poll fails, and the refused lease
+  // and the new server address are replaced and cached before the retry
+  static const uint8_t newAddress[4] = { 10, 1, 1, 7 };
+  static const uint8_t newServer[4] = { 10, 1, 2, 80 };
+  memcpy(dhcpServer.address, newAddress, 4);
+  memcpy(dnsServer.address, newServer, 4);
+  ms = BootToFirstPoll(WARM, net, dhcpServer, dnsServer);
+  PrintResult("typical, moved network", bootNames[WARM], ms);
+  CHECK_EQUAL(net.linkMs + JOB_REQUEST_TIMEOUT_MS + JOB_POLL_RETRY_MS +
+              net.httpMs, ms);
+  DhcpLease lease;
+  uint8_t ip[4];
+  NetworkCache cache(mac);
+  CHECK(cache.loadLease(lease));
+  CHECK(0 == memcmp(lease.ip, newAddress, 4));
+  CHECK(cache.loadServer(domain, ip));
+  CHECK(0 == memcmp(ip, newServer, 4));
+
+  // And the next boot is a warm one again
+  ms = BootToFirstPoll(WARM, net, dhcpServer, dnsServer);
+  CHECK_EQUAL(net.linkMs + net.httpMs, ms);
+}
+
+int main()
+{
+  TestBootTimes();
+  TestStaleCache();
+  printf("\n");
+  return TestResult("WarmBootTest");
+}
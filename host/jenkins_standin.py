@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+################################################################################
+### @file jenkins_standin.py
+###
+### @brief Stand-in Jenkins server for trying a standalone tree's polling
+###        without a CI server.
+###
+### Serves five jobs that build on a fixed schedule, the same scenario
+### JobSchedulerTest simulates: builds start every 12 to 45 minutes and run
+### for 3 to 9 minutes, and job4 stops answering between minutes 60 and 90.
+### --speed compresses the schedule for shorter runs.
+###
+### Every request is logged.  On exit (Ctrl-C or --duration) the server
+### prints each job's request rate and how long each build state change took
+### to be served to the tree, i.e. the time-to-reflect as seen from here.
+###
+### Usage:
+###   ./jenkins_standin.py [--port 8080] [--speed 10] [--duration SECONDS]
+###
+### Then open the tree's config page, connect to http://<this host>:8080 and
+### select the jobs.
+################################################################################
+
+import argparse
+import json
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, HTTPServer
+from socketserver import ThreadingMixIn
+
+MINUTE = 60.0
+
+# name: (period, offset, length) in minutes, as in JobSchedulerTest.cpp
+JOBS = {
+  "job0": (12, 2, 3),
+  "job1": (20, 7, 5),
+  "job2": (30, 11, 9),
+  "job3": (45, 25, 6),
+  "job4": (15, 4, 4),
+}
+UNREACHABLE_JOB = "job4"
+OUTAGE = (60, 90)
+
+RESULTS = ["SUCCESS", "FAILURE", "SUCCESS", "UNSTABLE", "SUCCESS", "ABORTED"]
+
+
+class Scenario(object):
+  def __init__(self, speed):
+    self.speed = speed
+    self.start = time.time()
+    self.lock = threading.Lock()
+    self.requests = dict((name, 0) for name in JOBS)
+    self.served = dict((name, 0) for name in JOBS)  # Last state served
+    self.delays = {"start": [], "end": []}
+
+  def minutes(self):
+    """Scenario time in minutes."""
+    return (time.time() - self.start) * self.speed / MINUTE
+
+  def state(self, name, t):
+    """0 before the first build, then twice the builds started, less one
+    while the latest is running."""
+    period, offset, length = JOBS[name]
+    if t < offset:
+      return 0, offset
+    builds = int((t - offset) // period) + 1
+    started = offset + (builds - 1) * period
+    if t - started < length:
+      return builds * 2 - 1, started
+    return builds * 2, started + length
+
+  def reachable(self, name, t):
+    return name != UNREACHABLE_JOB or not (OUTAGE[0] <= t < OUTAGE[1])
+
+  def build(self, name):
+    """Records the request and returns the build JSON, or None if the job
+    is down."""
+    t = self.minutes()
+    with self.lock:
+      self.requests[name] += 1
+      if not self.reachable(name, t):
+        return None
+      state, changedAt = self.state(name, t)
+      if state != self.served[name]:
+        kind = "start" if state & 1 else "end"
+        self.delays[kind].append((t - changedAt) * MINUTE / self.speed)
+        self.served[name] = state
+    building = bool(state & 1)
+    number = (state + 1) // 2
+    result = None
+    if state and not building:
+      result = RESULTS[(number + len(name)) % len(RESULTS)]
+    return {
+      "_class": "hudson.model.FreeStyleBuild",
+      "building": building,
+      "number": number,
+      "result": result,
+    }
+
+  def report(self):
+    elapsed = time.time() - self.start
+    print("\n%-8s %8s %10s" % ("job", "requests", "req/min"))
+    total = 0
+    for name in sorted(JOBS):
+      total += self.requests[name]
+      print("%-8s %8d %10.2f" % (name, self.requests[name],
+                                 self.requests[name] * 60.0 / elapsed))
+    print("%-8s %8d %10.2f" % ("all", total, total * 60.0 / elapsed))
+    for kind in ("start", "end"):
+      d = self.delays[kind]
+      if d:
+        print("build %-5s shown after %.1f s on average, %.1f s at most (%d changes)"
+              % (kind, sum(d) / len(d), max(d), len(d)))
+
+
+class Handler(BaseHTTPRequestHandler):
+  protocol_version = "HTTP/1.0"
+
+  def log_message(self, fmt, *args):
+    print("%7.2f min  %s" % (self.server.scenario.minutes(), fmt % args))
+
+  def send_json(self, data):
+    body = json.dumps(data).encode()
+    self.send_response(200)
+    self.send_header("Content-Type", "application/json;charset=utf-8")
+    self.send_header("Content-Length", str(len(body)))
+    self.end_headers()
+    self.wfile.write(body)
+
+  def do_GET(self):
+    path = self.path.split("?")[0].rstrip("/")
+    parts = path.strip("/").split("/")
+    host = self.headers.get("Host", "localhost")
+    if path == "/api/json":
+      # Job list for the config page
+      self.send_json({"jobs": [{"name": n, "url": "http://%s/job/%s/" % (host, n)}
+                               for n in sorted(JOBS)]})
+    elif (len(parts) == 5 and parts[0] == "job" and parts[1] in JOBS and
+          parts[2:] == ["lastBuild", "api", "json"]):
+      build = self.server.scenario.build(parts[1])
+      if build is None:
+        # Down: hold the connection without answering until the tree gives up
+        time.sleep(10)
+        return
+      self.send_json(build)
+    else:
+      self.send_error(404)
+
+
+class Server(ThreadingMixIn, HTTPServer):
+  daemon_threads = True
+
+
+def main():
+  parser = argparse.ArgumentParser(description="Stand-in Jenkins server")
+  parser.add_argument("--port", type=int, default=8080)
+  parser.add_argument("--speed", type=float, default=1.0,
+                      help="scenario minutes per real minute")
+  parser.add_argument("--duration", type=float, default=0,
+                      help="stop after this many real seconds")
+  args = parser.parse_args()
+
+  server = Server(("", args.port), Handler)
+  server.scenario = Scenario(args.speed)
+  if args.duration > 0:
+    threading.Timer(args.duration, server.shutdown).start()
+  try:
+    server.serve_forever()
+  except KeyboardInterrupt:
+    pass
+  server.scenario.report()
+
+
+if __name__ == "__main__":
+  main()